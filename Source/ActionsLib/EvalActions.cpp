@@ -17,6 +17,7 @@
 #include "Config.h"
 #include "SimpleEvaluator.h"
 #include "SimpleOutputWriter.h"
+#include "BeamSearchDecoder.h"
 #include "Criterion.h"
 #include "BestGpu.h"
 #include "ScriptableObjects.h"
@@ -256,9 +257,22 @@ void DoWriteOutput(const ConfigParameters& config)
     else if (config.Exists("outputPath"))
     {
         wstring outputPath = config(L"outputPath");
-        WriteFormattingOptions formattingOptions(config);
-        bool nodeUnitTest = config(L"nodeUnitTest", "false");
-        writer.WriteOutput(testDataReader, mbSize[0], outputPath, outputNodeNamesVector, formattingOptions, epochSize, nodeUnitTest);
+        wstring outputFormat = config(L"outputFormat", L"text");
+        if (outputFormat == L"binary")
+        {
+            wstring outputPrecision = config(L"outputPrecision", L"float");
+            if (outputPrecision != L"float" && outputPrecision != L"half")
+                InvalidArgument("write command: 'outputPrecision' must be 'float' or 'half'.");
+            writer.WriteBinaryOutput(testDataReader, mbSize[0], outputPath, outputNodeNamesVector, outputPrecision == L"half", epochSize);
+        }
+        else if (outputFormat == L"text")
+        {
+            WriteFormattingOptions formattingOptions(config);
+            bool nodeUnitTest = config(L"nodeUnitTest", "false");
+            writer.WriteOutput(testDataReader, mbSize[0], outputPath, outputNodeNamesVector, formattingOptions, epochSize, nodeUnitTest);
+        }
+        else
+            InvalidArgument("write command: 'outputFormat' must be 'text' or 'binary'.");
     }
     else
         InvalidArgument("write command: You must specify either 'writer'or 'outputPath'");
@@ -266,3 +280,52 @@ void DoWriteOutput(const ConfigParameters& config)
 
 template void DoWriteOutput<float>(const ConfigParameters& config);
 template void DoWriteOutput<double>(const ConfigParameters& config);
+
+// ===========================================================================
+// DoBeamSearchDecode() - implements CNTK "beamSearch" command
+// ===========================================================================
+
+template <typename ElemType>
+void DoBeamSearchDecode(const ConfigParameters& config)
+{
+    ConfigParameters readerConfig(config(L"reader"));
+    readerConfig.Insert("randomize", "None"); // output is written in input order
+
+    DataReader testDataReader(readerConfig);
+
+    ConfigArray minibatchSize = config(L"minibatchSize", "2048");
+    intargvector mbSize = minibatchSize;
+
+    size_t epochSize = config(L"epochSize", "0");
+    if (epochSize == 0)
+    {
+        epochSize = requestDataSize;
+    }
+
+    vector<wstring> outputNodeNamesVector;
+
+    let net = GetModelFromConfig<ConfigParameters, ElemType>(config, L"outputNodeNames", outputNodeNamesVector);
+    if (outputNodeNamesVector.size() != 1)
+        InvalidArgument("beamSearch command: Exactly one output node (the decoder's scores of the next token) must be given in 'outputNodeNames'.");
+
+    wstring decoderInputNodeName = config(L"decoderInputNodeName");
+    size_t beamWidth = config(L"beamWidth", "5");
+    size_t maxLength = config(L"maxLength", "100");
+    size_t startSymbol = config(L"startSymbolIndex");
+    size_t endSymbol = config(L"endSymbolIndex");
+    bool normalizeScores = config(L"normalizeScores", "true");
+    double lengthPenalty = config(L"lengthPenalty", "0");
+    int traceLevel = config(L"traceLevel", "0");
+
+    wstring outputPath = config(L"outputPath");
+    vector<string> labelMapping;
+    wstring labelMappingFile = config(L"labelMappingFile", L"");
+    if (!labelMappingFile.empty())
+        File::LoadLabelFile(labelMappingFile, labelMapping);
+
+    BeamSearchDecoder<ElemType> decoder(net, outputNodeNamesVector[0], decoderInputNodeName, beamWidth, maxLength, startSymbol, endSymbol, normalizeScores, lengthPenalty, traceLevel);
+    decoder.Decode(testDataReader, mbSize[0], outputPath, labelMapping, epochSize);
+}
+
+template void DoBeamSearchDecode<float>(const ConfigParameters& config);
+template void DoBeamSearchDecode<double>(const ConfigParameters& config);
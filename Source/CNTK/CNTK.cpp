@@ -309,6 +309,10 @@ void DoCommands(const ConfigParameters& config, const shared_ptr<MPIWrapper>& mp
                 {
                     DoWriteOutput<ElemType>(commandParams);
                 }
+                else if (thisAction == "beamSearch")
+                {
+                    DoBeamSearchDecode<ElemType>(commandParams);
+                }
                 else if (thisAction == "devtest")
                 {
                     TestCn<ElemType>(config); // for "devtest" action pass the root config instead
@@ -620,6 +620,22 @@ void MELScript<ElemType>::CallFunction(const std::string& p_name, const ConfigPa
             fprintf(stderr, "Revise node %ls using parameter file %s\n", pNodes->NodeName().c_str(), paramPath.c_str());
         }
     }
+    else if (EqualInsensitive(name, "OptimizeForInference"))
+    {
+        size_t numFixedParams = 0, numOptionalParams = 1;
+        if (params.size() > numFixedParams + numOptionalParams || params.size() < numFixedParams)
+            RuntimeError("Invalid number of parameters. Valid parameters: OptimizeForInference([modelName]).");
+
+        NetNdl<ElemType>* netNdl = m_netNdlDefault;
+        if (params.size() > 0)
+            netNdl = &m_mapNameToNetNdl[params[0]];
+        if (netNdl == nullptr || netNdl->cn == NULL)
+            RuntimeError("OptimizeForInference can only be called after a network has been setup, no active model.");
+
+        // validate and finish the second pass through NDL if any in-line NDL was defined
+        ProcessNDLScript(netNdl, ndlPassAll, true);
+        netNdl->cn->template OptimizeForInference<ElemType>();
+    }
     else
     {
         RuntimeError("Unknown Editor function %s", name.c_str());
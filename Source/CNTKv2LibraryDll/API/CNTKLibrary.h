@@ -407,6 +407,7 @@ namespace CNTK
         friend class PackedValue;
         friend class MPICommunicatorImpl;
         friend class BlockMomentumDistributedLearner;
+        friend class CompressedDataParallelDistributedLearner;
         friend class Internal::VariableResolver;
 
         template <typename T, typename ...CtorArgTypes>
@@ -3991,6 +3992,17 @@ namespace CNTK
 
     CNTK_API DistributedLearnerPtr CreateQuantizedDataParallelDistributedLearner(QuantizedDistributedCommunicatorPtr communicator, LearnerPtr learner, size_t distributeAfterSamples, bool useAsyncBufferedParameterUpdate = false);
 
+    ///
+    /// Creates a data parallel distributed learner that exchanges compressed gradients. Each worker keeps the part of its gradients
+    /// that was not transmitted as a residual, which is added to its next gradients (error feedback).
+    /// 'gradientCompression' is one of
+    ///     L"1bit": column-wise quantization to 'numQuantizationBits' bits per value (1-bit SGD),
+    ///     L"topK": only the 'topKFraction' values of largest magnitude of each gradient stripe are sent,
+    ///     L"8bit": column-wise 8-bit quantization with stochastic rounding.
+    /// Unlike CreateQuantizedDataParallelDistributedLearner, this is available in all builds, and aggregates on the CPU.
+    ///
+    CNTK_API DistributedLearnerPtr CreateCompressedDataParallelDistributedLearner(DistributedCommunicatorPtr communicator, LearnerPtr learner, size_t distributeAfterSamples, const std::wstring& gradientCompression, size_t numQuantizationBits = 1, double topKFraction = 0.01);
+
     CNTK_API DistributedLearnerPtr CreateBlockMomentumDistributedLearner(
         DistributedCommunicatorPtr communicator,
         LearnerPtr learner,
@@ -4375,10 +4387,13 @@ namespace CNTK
 
     ///
     /// Compute the per dimension means and variances for each of the specified streams using data from the specified minibatchSource.
+    /// If statisticsCacheFile is specified, the statistics are saved to this file and reused by later calls
+    /// as long as the data files of the minibatch source do not change.
     ///
     CNTK_API void ComputeInputPerDimMeansAndInvStdDevs(const MinibatchSourcePtr& minibatchSource,
         std::unordered_map<StreamInformation, std::pair<NDArrayViewPtr, NDArrayViewPtr>>& computedMeanAndVariances,
-        const DeviceDescriptor& device = DeviceDescriptor::CPUDevice());
+        const DeviceDescriptor& device = DeviceDescriptor::CPUDevice(),
+        const std::wstring& statisticsCacheFile = L"");
 
     ///
     /// Set the process-wide setting for maximum number of CPU threads to be used by any individual compute operation
@@ -4495,6 +4510,15 @@ namespace CNTK
     ///
     CNTK_API DistributedCommunicatorPtr MPICommunicator();
 
+    ///
+    /// MPI-based communicator that aggregates in two levels: the workers on a host sum their values through
+    /// shared memory, one worker per host aggregates the host sums across hosts, and the result is shared
+    /// within each host. ranksPerHost > 0 groups consecutive workers into pseudo-hosts of that size instead
+    /// of grouping them by physical host (for testing). Values larger than the shared segment of a host
+    /// (maxSegmentSizeInBytes) are aggregated in several chunks.
+    ///
+    CNTK_API DistributedCommunicatorPtr HierarchicalMPICommunicator(size_t ranksPerHost = 0, size_t maxSegmentSizeInBytes = 64 * 1024 * 1024);
+
     ///
     /// Distributed communicator that allows quantized aggregations.
     ///
@@ -4514,6 +4538,14 @@ namespace CNTK
             std::function<void(size_t currentIndex, const DeviceDescriptor&)> action;
         };
 
+        struct CrossValidationResult
+        {
+            size_t index;
+            double averageError;
+            size_t numberOfSamples;
+            size_t numberOfMinibatches;
+        };
+
     public:
         /// 
         /// Constructor of the training session:
@@ -4531,6 +4563,10 @@ namespace CNTK
         /// maxNumberOfTrainingSamples : max number of samples after which the training should be stopped
         /// progressFrequency : an approximate number of global samples processed accross the workers
         ///    after which the summary of metrics is reported using the progress_printer
+        /// crossValidationThreads : if not zero, cross validation runs in the background on a snapshot of the parameters
+        ///    using the given number of CPU threads, while the training continues. The result is reported
+        ///    with OnCrossValidationEnd after the minibatch during which it became available.
+        ///    Only supported when training on the CPU, otherwise cross validation is synchronous.
         ///
         CNTK_API TrainingSession(
             const MinibatchSourcePtr& trainingSource,
@@ -4545,19 +4581,26 @@ namespace CNTK
             bool restoreFromCheckpointIfExists = true,
             bool keepExistingCheckpoints = false,
             size_t maxNumberOfTrainingSamples = std::numeric_limits<size_t>::max(),
-            size_t progressFrequency = std::numeric_limits<size_t>::max());
+            size_t progressFrequency = std::numeric_limits<size_t>::max(),
+            size_t crossValidationThreads = 0);
 
         ///
         /// Runs the session.
         ///
         CNTK_API void Train(const DeviceDescriptor& computeDevice);
 
+        ///
+        /// Waits for the cross validation running in the background (if any) and reports its result.
+        /// Can be used by callbacks that need the latest cross validation error, i.e. for learning rate control.
+        ///
+        CNTK_API void WaitForCrossValidation();
+
         ///
         /// Restores a session from a checkpoint.
         ///
         CNTK_API void RestoreFromCheckpoint(const std::wstring& checkpointFileName);
 
-        CNTK_API virtual ~TrainingSession() {}
+        CNTK_API virtual ~TrainingSession();
 
     public:
         ///
@@ -4626,6 +4669,10 @@ namespace CNTK
         void SaveFinalCheckpoint();
 
         void CrossValidate(size_t currentIndex, const DeviceDescriptor& computeDevice);
+        void StartBackgroundCrossValidation(size_t currentIndex, const DeviceDescriptor& computeDevice);
+        void ReportFinishedCrossValidation();
+        CrossValidationResult EvaluateCrossValidationSource(size_t currentIndex, const DeviceDescriptor& computeDevice,
+            const std::function<double(const std::unordered_map<Variable, ValuePtr>&, size_t&)>& test);
         void ReportProgress(size_t currentIndex);
 
         // Checkpointing
@@ -4647,6 +4694,10 @@ namespace CNTK
         MinibatchSourcePtr m_crossValidationSource;
         const MinibatchSizeSchedule m_crossValidationSchedule;
 
+        // Background cross validation, at most one is in flight.
+        const size_t m_crossValidationThreads;
+        std::future<CrossValidationResult> m_pendingCrossValidation;
+
         std::vector<PeriodicAction> m_actions;
     };
 
@@ -4666,7 +4717,8 @@ namespace CNTK
         bool restoreFromCheckpointIfExists = true,
         bool keepExistingCheckpoints = false,
         size_t maxNumberOfTrainingSamples = std::numeric_limits<size_t>::max(),
-        size_t progressFrequency = std::numeric_limits<size_t>::max());
+        size_t progressFrequency = std::numeric_limits<size_t>::max(),
+        size_t crossValidationThreads = 0);
 }
 
 
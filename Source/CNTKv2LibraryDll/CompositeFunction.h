@@ -45,10 +45,6 @@ namespace CNTK
 
         friend void Internal::SaveAsLegacyModel(const FunctionPtr& rootFunction, const std::wstring& modelFile);
 
-        friend void ComputeInputPerDimMeansAndInvStdDevs(const MinibatchSourcePtr& minibatchSource,
-                                                         std::unordered_map<StreamInformation, std::pair<NDArrayViewPtr, NDArrayViewPtr>>& computedMeanAndInvStdDevs,
-                                                         const DeviceDescriptor& device /*= DeviceDescriptor::CPUDevice()*/);
-
         static std::atomic<unsigned int> s_nextAutoGeneratedDynamicAxis;
 
         static const std::wstring CompositeFunctionOpName;
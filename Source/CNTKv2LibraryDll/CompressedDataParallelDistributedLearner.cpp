@@ -0,0 +1,97 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "CompressedDataParallelDistributedLearner.h"
+#include "Learner.h"
+#include "PerformanceProfiler.h"
+
+namespace CNTK
+{
+    using namespace Microsoft::MSR::CNTK;
+
+    DistributedLearnerPtr CreateCompressedDataParallelDistributedLearner(DistributedCommunicatorPtr communicator, LearnerPtr learner, size_t distributeAfterSamples, const std::wstring& gradientCompression, size_t numQuantizationBits, double topKFraction)
+    {
+        GradientCompressionOptions options;
+        options.m_type = ParseGradientCompressionType(gradientCompression);
+        if (options.m_type == GradientCompressionType::None)
+            InvalidArgument("CreateCompressedDataParallelDistributedLearner: A gradient compression must be specified; use CreateDataParallelDistributedLearner() for uncompressed aggregation.");
+        options.m_numQuantizationBits = numQuantizationBits;
+        options.m_topKFraction = topKFraction;
+        return MakeSharedObject<CompressedDataParallelDistributedLearner>(communicator, learner, distributeAfterSamples, options);
+    }
+
+    CompressedDataParallelDistributedLearner::CompressedDataParallelDistributedLearner(DistributedCommunicatorPtr communicator, LearnerPtr learner, size_t distributedAfterSamples, const GradientCompressionOptions& options)
+        : DistributedLearnerBase(communicator, learner, distributedAfterSamples), m_options(options)
+    {
+        // the compressed exchange is implemented directly on MPI, over all workers
+        m_mpi = MPIWrapper::GetInstance();
+        if (!m_mpi || m_communicator->Workers().size() != m_mpi->NumNodesInUse())
+            InvalidArgument("CompressedDataParallelDistributedLearner: The communicator must comprise all MPI workers.");
+    }
+
+    template <typename ElementType>
+    void CompressedDataParallelDistributedLearner::AllReduce(std::unique_ptr<CompressedAllReducer<ElementType>>& allReducer, DataType dataType)
+    {
+        // (the matrices are views of the gradient arrays and must be kept alive while aggregating)
+        std::vector<std::shared_ptr<Matrix<ElementType>>> matrices;
+        std::vector<Matrix<ElementType>*> gradients;
+        for (const auto& i : m_gradientBuffer)
+        {
+            if (i.second->GetDataType() != dataType)
+                continue;
+            matrices.push_back(i.second->GetWritableMatrix<ElementType>());
+            gradients.push_back(matrices.back().get());
+        }
+
+        if (gradients.empty())
+            return;
+        if (!allReducer)
+            allReducer.reset(new CompressedAllReducer<ElementType>(m_mpi, m_options));
+        allReducer->AllReduce(gradients);
+    }
+
+    bool CompressedDataParallelDistributedLearner::Update(std::unordered_map<Parameter, NDArrayViewPtr>& gradientValues, MinibatchInfo& info)
+    {
+        if (m_sampleCount >= m_distributeAfterSamples)
+        {
+            auto profGradientAgg = Microsoft::MSR::CNTK::ScopeProfile(Microsoft::MSR::CNTK::profilerEvtMainGradient);
+
+            if (info.IsEmpty())
+                PrepaireZeroGradients(gradientValues, info);
+            ConvertToOrdered(gradientValues, m_gradientBuffer);
+
+            AllReduce(m_floatAllReducer, DataType::Float);
+            AllReduce(m_doubleAllReducer, DataType::Double);
+
+            // the criteria and the sample count are aggregated without compression
+            auto value = MakeSharedObject<NDArrayView>(static_cast<double>(info.numberOfSamples), NDShape{ 1 }, DeviceDescriptor::CPUDevice());
+            std::vector<NDArrayViewPtr> valuesToAggregate = { info.evalCriterionValue, info.trainingLossValue, value };
+            m_communicator->AggregateInPlace(valuesToAggregate, m_communicator->Workers());
+            info.numberOfSamples = static_cast<size_t>(*valuesToAggregate.back()->WritableDataBuffer<double>());
+        }
+
+        auto profWeights = Microsoft::MSR::CNTK::ScopeProfile(Microsoft::MSR::CNTK::profilerEvtMainWeights);
+
+        m_sampleCount += info.numberOfSamples;
+        m_gradientBuffer.clear();
+
+        if (info.IsEmpty())
+            return false;
+
+        return m_learner->Update(gradientValues, info.numberOfSamples, info.atEndOfSweep);
+    }
+
+    void CompressedDataParallelDistributedLearner::RestoreFromCheckpoint(const Dictionary& checkpoint)
+    {
+        DistributedLearnerBase::RestoreFromCheckpoint(checkpoint);
+
+        // the residuals belong to the gradients of the abandoned state
+        if (m_floatAllReducer)
+            m_floatAllReducer->ResetResiduals();
+        if (m_doubleAllReducer)
+            m_doubleAllReducer->ResetResiduals();
+    }
+}
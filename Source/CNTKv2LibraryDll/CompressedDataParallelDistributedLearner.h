@@ -0,0 +1,38 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma  once
+
+#include "CNTKLibrary.h"
+#include "DistributedLearnerBase.h"
+#include "GradientCompression.h"
+
+namespace CNTK
+{
+    ///
+    /// Data parallel distributed learner that aggregates compressed gradients with error feedback (see GradientCompression.h).
+    ///
+    class CompressedDataParallelDistributedLearner : public DistributedLearnerBase
+    {
+    public:
+        CompressedDataParallelDistributedLearner(DistributedCommunicatorPtr communicator, LearnerPtr learner, size_t distributedAfterSamples, const Microsoft::MSR::CNTK::GradientCompressionOptions& options);
+
+        // Optional override that gets called per minibatch after finishing gradient computation but before updating model parameters
+        bool Update(std::unordered_map<Parameter, NDArrayViewPtr>& gradientValues, MinibatchInfo& trainingSampleCount) override;
+
+        void RestoreFromCheckpoint(const Dictionary& checkpoint) override;
+
+    private:
+        template <typename ElementType>
+        void AllReduce(std::unique_ptr<Microsoft::MSR::CNTK::CompressedAllReducer<ElementType>>& allReducer, DataType dataType);
+
+        Microsoft::MSR::CNTK::MPIWrapperPtr m_mpi;
+        Microsoft::MSR::CNTK::GradientCompressionOptions m_options;
+
+        // one per element type; the error-feedback residuals are kept per gradient, in the order of m_gradientBuffer
+        std::unique_ptr<Microsoft::MSR::CNTK::CompressedAllReducer<float>> m_floatAllReducer;
+        std::unique_ptr<Microsoft::MSR::CNTK::CompressedAllReducer<double>> m_doubleAllReducer;
+    };
+}
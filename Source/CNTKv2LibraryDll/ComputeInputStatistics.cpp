@@ -6,113 +6,314 @@
 #include "stdafx.h"
 #include "CNTKLibrary.h"
 #include "Utils.h"
-#include "CompositeFunction.h"
+#include "MinibatchSource.h"
+#include "fileutil.h"
+#include "SidecarCache.h"
+#include <set>
 #include <tuple>
-#include "ComputationNetworkBuilder.h"
 
 using namespace Microsoft::MSR::CNTK;
 
 namespace CNTK
 {
-    void ComputeInputPerDimMeansAndInvStdDevs(const MinibatchSourcePtr& minibatchSource,
-                                              std::unordered_map<StreamInformation, std::pair<NDArrayViewPtr, NDArrayViewPtr>>& computedMeanAndInvStdDevs,
-                                              const DeviceDescriptor& device /*= DeviceDescriptor::CPUDevice()*/)
+    namespace
     {
-        typedef std::shared_ptr<ComputationNode<float>> ComputationNodePtr;
-        const auto& minibatchSourceStreams = minibatchSource->StreamInfos();
+        // Per dimension count, mean and sum of squared deviations from the mean (Welford).
+        // Partial accumulators are merged with the pairwise update of Chan et al., which is exact up to rounding,
+        // so the data can be split in any way without changing the statistics beyond floating point noise.
+        struct WelfordAccumulator
+        {
+            size_t m_count;
+            std::vector<double> m_mean;
+            std::vector<double> m_m2;
 
-        auto computationNetwork = std::make_shared<ComputationNetwork>(AsCNTKImplDeviceId(device));
-        ComputationNetworkBuilder<float> builder(*computationNetwork);
+            explicit WelfordAccumulator(size_t dimension = 0)
+                : m_count(0), m_mean(dimension, 0), m_m2(dimension, 0)
+            {}
 
-        std::vector<ComputationNodeBasePtr> allInputNodes;
-        std::unordered_map<StreamInformation, ComputationNodeBasePtr> streamToInputNodeMap;
-        std::unordered_map<StreamInformation, Variable> streamToDummyInputVariableMap;
-        std::unordered_map<StreamInformation, ComputationNodeBasePtr> streamToMeanNodeMap;
-        std::unordered_map<StreamInformation, ComputationNodeBasePtr> streamToInvStdDevNodeMap;
+            void Add(const float* sample)
+            {
+                m_count++;
+                const double scale = 1.0 / m_count;
+                for (size_t i = 0; i < m_mean.size(); ++i)
+                {
+                    double delta = sample[i] - m_mean[i];
+                    m_mean[i] += delta * scale;
+                    m_m2[i] += delta * (sample[i] - m_mean[i]);
+                }
+            }
 
-        size_t totalSizePerSample = 0;
-        for (auto& currentStreamKV : computedMeanAndInvStdDevs)
-        {
-            auto currentStreamInfo = currentStreamKV.first;
-            if (minibatchSourceStreams.find(currentStreamInfo) == minibatchSourceStreams.end())
-                InvalidArgument("ComputeMeanAndVariance: Stream for which mean and variance is to be computed is not supported by the specified minibatchSource");
+            void Merge(const WelfordAccumulator& other)
+            {
+                if (other.m_count == 0)
+                    return;
+                if (m_count == 0)
+                {
+                    *this = other;
+                    return;
+                }
 
-            if (currentStreamInfo.m_elementType != DataType::Float)
-                LogicError("Input data of type other than DataType::Float is currently unsupported by the CNTK built-in composite MinibatchSource!");
+                const double count = (double)m_count + other.m_count;
+                const double otherWeight = other.m_count / count;
+                const double crossWeight = (double)m_count * other.m_count / count;
+                for (size_t i = 0; i < m_mean.size(); ++i)
+                {
+                    double delta = other.m_mean[i] - m_mean[i];
+                    m_mean[i] += delta * otherWeight;
+                    m_m2[i] += other.m_m2[i] + delta * delta * crossWeight;
+                }
+                m_count += other.m_count;
+            }
+        };
 
-            auto inputVariableShape = currentStreamInfo.m_sampleLayout;
-            auto inputTensorShape = AsTensorShape(inputVariableShape);
-            totalSizePerSample += (inputVariableShape.TotalSize() * sizeof(float));
+        // Samples of a minibatch are accumulated in blocks of this many columns, so that the result does not depend on the number of threads.
+        const size_t s_statisticsBlockSize = 1024;
 
-            ComputationNodePtr inputNode;
-            Variable inputVariable;
-            if (currentStreamInfo.m_storageFormat != StorageFormat::Dense)
+        // Adds all valid samples of a minibatch value to the accumulator.
+        void AccumulateStatistics(const ValuePtr& value, size_t sampleSize, WelfordAccumulator& accumulator)
+        {
+            // The data is requested on the CPU; sparse data is densified here.
+            NDArrayViewPtr data = value->Data();
+            if (data->IsSparse() || data->Device() != DeviceDescriptor::CPUDevice())
             {
-                inputNode = builder.CreateSparseInputNode(currentStreamInfo.m_name, inputTensorShape);
-                inputVariable = InputVariable(inputVariableShape, /*isSparse*/  true, DataType::Float, currentStreamInfo.m_name);
+                auto dense = MakeSharedObject<NDArrayView>(DataType::Float, StorageFormat::Dense, data->Shape(), DeviceDescriptor::CPUDevice());
+                dense->CopyFrom(*data);
+                data = dense;
             }
-            else
+
+            const float* samples = data->DataBuffer<float>();
+            const size_t numColumns = data->Shape().TotalSize() / sampleSize;
+
+            NDMaskPtr mask = value->Mask();
+            const MaskKind* maskData = nullptr;
+            if (mask)
             {
-                inputNode = builder.CreateInputNode(currentStreamInfo.m_name, inputTensorShape);
-                inputVariable = InputVariable(inputVariableShape, DataType::Float, currentStreamInfo.m_name);
+                if (mask->Device() != DeviceDescriptor::CPUDevice())
+                    mask = mask->DeepClone(DeviceDescriptor::CPUDevice());
+                maskData = mask->DataBuffer();
             }
 
-            allInputNodes.push_back(inputNode);
-            streamToInputNodeMap[currentStreamInfo] = inputNode;
-            streamToDummyInputVariableMap[currentStreamInfo] = inputVariable;
-            streamToMeanNodeMap[currentStreamInfo] = builder.Mean(inputNode);
-            streamToInvStdDevNodeMap[currentStreamInfo] = builder.InvStdDev(inputNode);
+            const size_t numBlocks = (numColumns + s_statisticsBlockSize - 1) / s_statisticsBlockSize;
+            std::vector<WelfordAccumulator> blocks(numBlocks, WelfordAccumulator(sampleSize));
+#pragma omp parallel for schedule(dynamic)
+            for (long long block = 0; block < (long long)numBlocks; ++block)
+            {
+                size_t begin = block * s_statisticsBlockSize;
+                size_t end = std::min(begin + s_statisticsBlockSize, numColumns);
+                for (size_t column = begin; column < end; ++column)
+                {
+                    if (maskData && maskData[column] == MaskKind::Invalid)
+                        continue;
+                    blocks[block].Add(samples + column * sampleSize);
+                }
+            }
+
+            for (const auto& block : blocks)
+                accumulator.Merge(block);
         }
 
-        computationNetwork->CompileNetwork();
-        computationNetwork->AllocateAllMatrices(computationNetwork->RootNodes(), {}, nullptr);
+        // Collects existing files named in the minibatch source configuration (ctf files, scp files, map files, etc.).
+        void CollectConfigurationFiles(const DictionaryValue& value, std::set<std::wstring>& files)
+        {
+            switch (value.ValueType())
+            {
+            case DictionaryValue::Type::String:
+            {
+                const auto& path = value.Value<std::wstring>();
+                if (!path.empty() && fexists(path))
+                    files.insert(path);
+                break;
+            }
+            case DictionaryValue::Type::Vector:
+                for (const auto& element : value.Value<std::vector<DictionaryValue>>())
+                    CollectConfigurationFiles(element, files);
+                break;
+            case DictionaryValue::Type::Dictionary:
+                for (const auto& entry : value.Value<Dictionary>())
+                    CollectConfigurationFiles(entry.second, files);
+                break;
+            default:
+                break;
+            }
+        }
 
-        ScopedNetworkOperationMode modeGuard(computationNetwork, NetworkOperationMode::preComputing);
+        // Statistics sidecar file: header, then per stream the name, dimension, number of samples, means and variances.
+        const char* s_statisticsCacheMagic = "CNTKISTA";
+        const uint32_t s_statisticsCacheVersion = 2;
 
-        // initialize
-        auto preComputeNodes = computationNetwork->GetNodesRequiringPreComputation();
-        for (auto & preComputeNode : preComputeNodes)
-            dynamic_pointer_cast<IPreComputeNode>(preComputeNode)->MarkComputed(false /*begin accumulating*/);
+        struct StatisticsCacheHeader
+        {
+            SidecarCacheHeader m_file;
+            uint64_t m_numberOfStreams;
+        };
 
-        std::unordered_map<MBLayoutPtr, Variable> layoutsPopulated;
-        const size_t maxMinibatchDataSize = (1 << 27); // 128 MB
-        const size_t minibatchSize = maxMinibatchDataSize / totalSizePerSample;
-        for (;;)
+        // Fingerprint of the streams and the names and sizes of the data files.
+        uint64_t StatisticsFingerprint(const std::vector<StreamInformation>& streams, const std::vector<std::wstring>& files)
         {
-            auto minibatchData = minibatchSource->GetNextMinibatch(minibatchSize, device);
-            if (minibatchData.empty())
-                break;
+            SidecarFingerprint fingerprint;
+            fingerprint.AddValue(s_statisticsCacheVersion);
+            for (const auto& stream : streams)
+            {
+                fingerprint.AddString(stream.m_name);
+                fingerprint.AddValue((uint64_t)stream.m_storageFormat);
+                fingerprint.AddValue(stream.m_sampleLayout.TotalSize());
+            }
+            for (const auto& file : files)
+                fingerprint.AddFile(file);
+            return fingerprint.Value();
+        }
+
+        bool TryLoadStatistics(const std::wstring& cacheFile, uint64_t fingerprint, const std::vector<std::wstring>& files,
+                               const std::vector<StreamInformation>& streams, std::vector<WelfordAccumulator>& accumulators)
+        {
+            SidecarCacheReader reader(cacheFile, files);
+            if (!reader.IsOpen())
+                return false;
 
-            for (auto& currentStreamKV : computedMeanAndInvStdDevs)
-                CompositeFunction::PopulateComputationNodeValue<float>({ streamToDummyInputVariableMap[currentStreamKV.first], minibatchData[currentStreamKV.first].data }, streamToInputNodeMap[currentStreamKV.first], layoutsPopulated);
+            StatisticsCacheHeader header;
+            bool valid = reader.ReadValue(header) &&
+                         header.m_file.Matches(SidecarCacheHeader(s_statisticsCacheMagic, s_statisticsCacheVersion, sizeof(double), fingerprint)) &&
+                         header.m_numberOfStreams == streams.size();
+            for (size_t i = 0; valid && i < streams.size(); ++i)
+            {
+                uint64_t nameLength, dimension, count;
+                valid = reader.ReadValue(nameLength) && nameLength < 4096;
+                std::string name(valid ? (size_t)nameLength : 0, '\0');
+                valid = valid && reader.Read(&name[0], name.size()) && name == msra::strfun::utf8(streams[i].m_name) &&
+                        reader.ReadValue(dimension) && dimension == streams[i].m_sampleLayout.TotalSize() &&
+                        reader.ReadValue(count);
+                if (!valid)
+                    break;
 
-            ComputationNetwork::BumpEvalTimeStamp(allInputNodes);
+                WelfordAccumulator& accumulator = accumulators[i];
+                accumulator = WelfordAccumulator((size_t)dimension);
+                accumulator.m_count = (size_t)count;
+                valid = reader.ReadVector(accumulator.m_mean, dimension) &&
+                        reader.ReadVector(accumulator.m_m2, dimension);
+            }
+            valid = valid && reader.AtEnd();
+            return reader.Close(valid, "ComputeInputPerDimMeansAndInvStdDevs");
+        }
+
+        void SaveStatistics(const std::wstring& cacheFile, uint64_t fingerprint,
+                            const std::vector<StreamInformation>& streams, const std::vector<WelfordAccumulator>& accumulators)
+        {
+            StatisticsCacheHeader header;
+            header.m_file = SidecarCacheHeader(s_statisticsCacheMagic, s_statisticsCacheVersion, sizeof(double), fingerprint);
+            header.m_numberOfStreams = streams.size();
 
-            computationNetwork->ForwardProp(preComputeNodes);
+            TryWriteSidecarCache(cacheFile, "ComputeInputPerDimMeansAndInvStdDevs", [&]()
+            {
+                SidecarCacheWriter writer(cacheFile);
+                writer.WriteValue(header);
+                for (size_t i = 0; i < streams.size(); ++i)
+                {
+                    std::string name = msra::strfun::utf8(streams[i].m_name);
+                    writer.WriteValue((uint64_t)name.size());
+                    writer.Write(name.data(), name.size());
+                    writer.WriteValue((uint64_t)accumulators[i].m_mean.size());
+                    writer.WriteValue((uint64_t)accumulators[i].m_count);
+                    writer.WriteVector(accumulators[i].m_mean);
+                    writer.WriteVector(accumulators[i].m_m2);
+                }
+                writer.Commit();
+            });
         }
 
-        // finalize
-        for (auto & preComputeNode : preComputeNodes)
-            dynamic_pointer_cast<IPreComputeNode>(preComputeNode)->MarkComputed(true /*done accumulating*/);
+        // Copies the result into the caller provided view or into a new one on the requested device.
+        void SetStatistic(NDArrayViewPtr& result, const NDShape& shape, const std::vector<float>& values, const DeviceDescriptor& device)
+        {
+            auto cpuView = MakeSharedObject<NDArrayView>(shape, values.data(), values.size(), DeviceDescriptor::CPUDevice());
+            if (!result)
+                result = MakeSharedObject<NDArrayView>(DataType::Float, shape, device);
+            result->CopyFrom(*cpuView);
+        }
+    }
 
-        // Copy out the results
+    // The statistics are computed on the CPU directly from the minibatch data: the samples of each minibatch are
+    // accumulated in parallel into per-block Welford accumulators, which are merged in order.
+    // The results match the Mean() and InvStdDev() nodes: the variance is the population variance, floored at 1e-10.
+    void ComputeInputPerDimMeansAndInvStdDevs(const MinibatchSourcePtr& minibatchSource,
+                                              std::unordered_map<StreamInformation, std::pair<NDArrayViewPtr, NDArrayViewPtr>>& computedMeanAndInvStdDevs,
+                                              const DeviceDescriptor& device /*= DeviceDescriptor::CPUDevice()*/,
+                                              const std::wstring& statisticsCacheFile /*= L""*/)
+    {
+        const auto& minibatchSourceStreams = minibatchSource->StreamInfos();
+
+        std::vector<StreamInformation> streams;
+        size_t totalSizePerSample = 0;
         for (auto& currentStreamKV : computedMeanAndInvStdDevs)
         {
-            ValuePtr mean, invStdDev;
-            if (computedMeanAndInvStdDevs[currentStreamKV.first].first != nullptr)
-                mean = MakeSharedObject<Value>(computedMeanAndInvStdDevs[currentStreamKV.first].first);
+            auto currentStreamInfo = currentStreamKV.first;
+            if (minibatchSourceStreams.find(currentStreamInfo) == minibatchSourceStreams.end())
+                InvalidArgument("ComputeMeanAndVariance: Stream for which mean and variance is to be computed is not supported by the specified minibatchSource");
 
-            if (computedMeanAndInvStdDevs[currentStreamKV.first].second != nullptr)
-                invStdDev = MakeSharedObject<Value>(computedMeanAndInvStdDevs[currentStreamKV.first].second);
+            if (currentStreamInfo.m_elementType != DataType::Float)
+                LogicError("Input data of type other than DataType::Float is currently unsupported by the CNTK built-in composite MinibatchSource!");
+
+            totalSizePerSample += (currentStreamInfo.m_sampleLayout.TotalSize() * sizeof(float));
+            streams.push_back(currentStreamInfo);
+        }
+
+        // Streams are processed in a fixed order, so that the cache file does not depend on the hashing of the map.
+        std::sort(streams.begin(), streams.end(), [](const StreamInformation& a, const StreamInformation& b) { return a.m_name < b.m_name; });
+
+        std::vector<WelfordAccumulator> accumulators;
+        for (const auto& stream : streams)
+            accumulators.push_back(WelfordAccumulator(stream.m_sampleLayout.TotalSize()));
 
-            CompositeFunction::GetNodeOutputOrGradient(streamToDummyInputVariableMap[currentStreamKV.first], mean, streamToMeanNodeMap[currentStreamKV.first], false /*getGradient*/);
-            CompositeFunction::GetNodeOutputOrGradient(streamToDummyInputVariableMap[currentStreamKV.first], invStdDev, streamToInvStdDevNodeMap[currentStreamKV.first], false /*getGradient*/);
+        // The statistics are reused while the data files of the minibatch source do not change.
+        std::vector<std::wstring> files;
+        uint64_t fingerprint = 0;
+        bool cached = false;
+        if (!statisticsCacheFile.empty())
+        {
+            std::set<std::wstring> configurationFiles;
+            auto compositeSource = std::dynamic_pointer_cast<CompositeMinibatchSource>(minibatchSource);
+            if (compositeSource)
+                CollectConfigurationFiles(DictionaryValue(compositeSource->Configuration()), configurationFiles);
+            files.assign(configurationFiles.begin(), configurationFiles.end());
+            fingerprint = StatisticsFingerprint(streams, files);
+            cached = TryLoadStatistics(statisticsCacheFile, fingerprint, files, streams, accumulators);
+        }
+
+        if (!cached)
+        {
+            const size_t maxMinibatchDataSize = (1 << 27); // 128 MB
+            const size_t minibatchSize = maxMinibatchDataSize / totalSizePerSample;
+            for (;;)
+            {
+                auto minibatchData = minibatchSource->GetNextMinibatch(minibatchSize, DeviceDescriptor::CPUDevice());
+                if (minibatchData.empty())
+                    break;
 
-            if (computedMeanAndInvStdDevs[currentStreamKV.first].first == nullptr)
-                computedMeanAndInvStdDevs[currentStreamKV.first].first = mean->Data();
+                for (size_t i = 0; i < streams.size(); ++i)
+                    AccumulateStatistics(minibatchData[streams[i]].data, streams[i].m_sampleLayout.TotalSize(), accumulators[i]);
+            }
+
+            if (!statisticsCacheFile.empty())
+                SaveStatistics(statisticsCacheFile, fingerprint, streams, accumulators);
+        }
+
+        // Copy out the results
+        for (size_t i = 0; i < streams.size(); ++i)
+        {
+            const auto& accumulator = accumulators[i];
+            if (accumulator.m_count == 0)
+                LogicError("ComputeMeanAndVariance: No data accumulated for stream '%ls'.", streams[i].m_name.c_str());
+
+            const double sqrtFloor = 1e-10f;
+            std::vector<float> mean(accumulator.m_mean.size()), invStdDev(accumulator.m_mean.size());
+            for (size_t j = 0; j < mean.size(); ++j)
+            {
+                mean[j] = (float)accumulator.m_mean[j];
+                double variance = std::max(accumulator.m_m2[j] / accumulator.m_count, sqrtFloor);
+                invStdDev[j] = (float)(1 / sqrt(variance));
+            }
 
-            if (computedMeanAndInvStdDevs[currentStreamKV.first].second == nullptr)
-                computedMeanAndInvStdDevs[currentStreamKV.first].second = invStdDev->Data();
+            auto& result = computedMeanAndInvStdDevs[streams[i]];
+            SetStatistic(result.first, streams[i].m_sampleLayout, mean, device);
+            SetStatistic(result.second, streams[i].m_sampleLayout, invStdDev, device);
         }
     }
 }
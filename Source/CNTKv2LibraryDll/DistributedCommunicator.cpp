@@ -12,6 +12,7 @@
 #include "CUDAPageLockedMemAllocator.h"
 #include "MatrixQuantizerImpl.h"
 #include "GPUDataTransferer.h"
+#include "HierarchicalAllReducer.h"
 #include <numeric>
 
 using namespace Microsoft::MSR::CNTK;
@@ -33,6 +34,11 @@ namespace CNTK
         return std::make_shared<MPICommunicatorImpl>();
     }
 
+    DistributedCommunicatorPtr HierarchicalMPICommunicator(size_t ranksPerHost, size_t maxSegmentSizeInBytes)
+    {
+        return std::make_shared<MPICommunicatorImpl>(true, ranksPerHost, maxSegmentSizeInBytes);
+    }
+
     void DistributedCommunicator::Finalize()
     {
         MPIWrapper::DeleteInstance();
@@ -65,6 +71,11 @@ namespace CNTK
     }
 
     MPICommunicatorImpl::MPICommunicatorImpl()
+        : MPICommunicatorImpl(false, 0, 0)
+    {
+    }
+
+    MPICommunicatorImpl::MPICommunicatorImpl(bool useHierarchicalAggregation, size_t ranksPerHost, size_t maxSegmentSizeInBytes)
     {
         m_mpi = MPIWrapper::GetInstance();
         if (m_mpi == nullptr)
@@ -81,6 +92,9 @@ namespace CNTK
                 // TOOD: Nodes have to exchange their names.
                 m_workers.insert({ i,  L"" });
         }
+
+        if (useHierarchicalAggregation)
+            m_hierarchicalAllReducer = std::make_shared<HierarchicalAllReducer>(m_mpi, ranksPerHost, maxSegmentSizeInBytes);
     }
 
     void MPICommunicatorImpl::Initialize(const std::vector<NDArrayViewPtr>& values)
@@ -314,6 +328,12 @@ namespace CNTK
             }
         }
 
+        if (m_hierarchicalAllReducer)
+        {
+            AggregateHierarchicalImpl(inputValues, outputValues);
+            return;
+        }
+
         std::vector<MPI_Request> allReduceRequests(numValues);
         for (auto i = 0; i < numValues; ++i)
         {
@@ -390,6 +410,57 @@ namespace CNTK
         }
     }
 
+    void MPICommunicatorImpl::AggregateHierarchicalImpl(
+        const std::vector<NDArrayViewPtr>& inputValues,
+        const std::vector<NDArrayViewPtr>& outputValues)
+    {
+        // the values are aggregated in place in their CPU buffers, all float values and then all double values
+        std::vector<std::pair<float*, size_t>> floatBuffers;
+        std::vector<std::pair<double*, size_t>> doubleBuffers;
+        auto numValues = inputValues.size();
+        for (auto i = 0; i < numValues; ++i)
+        {
+            auto inputValue = inputValues[i];
+            auto& outputValue = outputValues[i];
+            auto numElements = inputValue->Shape().TotalSize();
+
+            void* data;
+            if (inputValue->Device() != DeviceDescriptor::CPUDevice())
+            {
+                m_gpuDataTransferers[i]->WaitForCopyGPUToCPUAsync();
+                data = m_intermediateCPUBuffers[i].data.get();
+            }
+            else
+            {
+                data = GetDataBuffer(outputValue);
+                if (inputValue != outputValue)
+                    memcpy(data, GetDataBuffer(inputValue), GetBufferSize(inputValue));
+            }
+
+            if (inputValue->GetDataType() == DataType::Float)
+                floatBuffers.push_back(std::make_pair(static_cast<float*>(data), numElements));
+            else if (inputValue->GetDataType() == DataType::Double)
+                doubleBuffers.push_back(std::make_pair(static_cast<double*>(data), numElements));
+            else
+                LogicError("Unknown DataType");
+        }
+
+        m_hierarchicalAllReducer->AllReduce(floatBuffers);
+        m_hierarchicalAllReducer->AllReduce(doubleBuffers);
+
+        for (auto i = 0; i < numValues; ++i)
+        {
+            if (inputValues[i]->Device() != DeviceDescriptor::CPUDevice())
+                m_gpuDataTransferers[i]->CopyCPUToGPUAsync(m_intermediateCPUBuffers[i].data.get(), GetBufferSize(outputValues[i]), GetDataBuffer(outputValues[i]));
+        }
+
+        for (auto i = 0; i < numValues; ++i)
+        {
+            if (inputValues[i]->Device() != DeviceDescriptor::CPUDevice())
+                m_gpuDataTransferers[i]->WaitForCopyCPUToGPUAsync();
+        }
+    }
+
     void  MPICommunicatorImpl::Barrier()
     {
         m_mpi->WaitAll();
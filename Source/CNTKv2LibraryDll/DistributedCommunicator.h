@@ -13,6 +13,8 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 
     class MPIWrapper;
     typedef std::shared_ptr<MPIWrapper> MPIWrapperPtr;
+
+    class HierarchicalAllReducer;
 }}}
 
 namespace CNTK
@@ -22,6 +24,9 @@ namespace CNTK
     public:
         MPICommunicatorImpl();
 
+        // Aggregates through shared memory within each (pseudo-)host first, see HierarchicalAllReducer.
+        MPICommunicatorImpl(bool useHierarchicalAggregation, size_t ranksPerHost, size_t maxSegmentSizeInBytes);
+
         virtual const std::unordered_set<DistributedWorkerDescriptor>& Workers() const override;
 
         virtual const DistributedWorkerDescriptor& CurrentWorker() const override;
@@ -67,6 +72,10 @@ namespace CNTK
             const std::vector<NDArrayViewPtr>& outputValues,
             const std::unordered_set<DistributedWorkerDescriptor>& sendToWorkers);
 
+        void AggregateHierarchicalImpl(
+            const std::vector<NDArrayViewPtr>& inputValues,
+            const std::vector<NDArrayViewPtr>& outputValues);
+
         struct Buffer
         {
             std::shared_ptr<void> data = nullptr;
@@ -82,6 +91,8 @@ namespace CNTK
         // TODO: these two are always parallel, merge them together?
         std::vector<std::shared_ptr<Microsoft::MSR::CNTK::GPUDataTransferer>> m_gpuDataTransferers;
 
+        std::shared_ptr<Microsoft::MSR::CNTK::HierarchicalAllReducer> m_hierarchicalAllReducer;
+
     protected:
         DeviceDescriptor GetNonCPUDevice(const std::vector<NDArrayViewPtr>& values)
         {
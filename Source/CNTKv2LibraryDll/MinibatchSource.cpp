@@ -88,6 +88,8 @@ namespace CNTK
           m_workerRank(0),
           m_restorePosition(0)
     {
+        m_configuration = configuration;
+
         // The CNTK reader implementation requires for each deserializer both the module and deserializer type be specified
         // This is redundant and the V2 API users will just specify type from which the module is automatically inferred
         // TODO: This should be done in the same manner for CNTK exe as well.
@@ -95,46 +95,6 @@ namespace CNTK
         m_distributed = m_parameterLearners->IsDistributed();
     }
 
-    static double GetScalarValue(const ValuePtr& value)
-    {
-        if (value->Mask())
-            LogicError("Scalar Value object cannot have an associated mask");
-
-        auto scalarData = value->Data();
-        if (scalarData->Shape().TotalSize() != 1)
-            LogicError("Scalar Value object's has a size > 1");
-
-        double scalar = std::numeric_limits<double>::quiet_NaN();
-        NDArrayViewPtr cpuData;
-        if (scalarData->Device() == DeviceDescriptor::CPUDevice())
-            cpuData = scalarData;
-        else
-        {
-            cpuData = std::make_shared<NDArrayView>(scalarData->GetDataType(), scalarData->Shape(), CNTK::DeviceDescriptor::CPUDevice());
-            cpuData->CopyFrom(*scalarData);
-        }
-
-        if (scalarData->GetDataType() == DataType::Float)
-            scalar = *(cpuData->DataBuffer<float>());
-        else if (scalarData->GetDataType() == DataType::Double)
-            scalar = *(cpuData->DataBuffer<double>());
-        else
-            LogicError("Unsupported DataType of training loss value");
-
-        return scalar;
-    }
-
-    static size_t GetSampleCount(const Variable& var, const ValuePtr& value)
-    {
-        auto valueDataShape = value->Shape();
-        size_t numMaskedSamples = value->MaskedCount();
-        size_t numSamplesInDataArrayView = valueDataShape.SubShape(var.Shape().Rank()).TotalSize();
-        if (numMaskedSamples > numSamplesInDataArrayView)
-            LogicError("Number of masked values cannot exceed the number of samples that the Value object's Data NDArrayView can hold");
-
-        return (numSamplesInDataArrayView - numMaskedSamples);
-    }
-
     static std::unordered_map<Variable, ValuePtr> GetInputs(const std::unordered_map<Variable, MinibatchData>& arguments)
     {
         std::unordered_map<Variable, ValuePtr> inputs(arguments.size());
@@ -7,8 +7,12 @@
 #include <boost/algorithm/string/predicate.hpp>
 
 #include "CNTKLibrary.h"
+#include "Utils.h"
 #include "fileutil.h"
 #include "PerformanceProfiler.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace CNTK
 {
@@ -35,7 +39,8 @@ namespace CNTK
         bool restoreFromCheckpointIfExists,
         bool saveAllCheckpoints,
         size_t maxNumberOfSamples,
-        size_t progressFrequency)
+        size_t progressFrequency,
+        size_t crossValidationThreads)
     {
         return MakeSharedObject<TrainingSession>(trainingSource,
             trainer,
@@ -49,7 +54,8 @@ namespace CNTK
             restoreFromCheckpointIfExists,
             saveAllCheckpoints,
             maxNumberOfSamples,
-            progressFrequency);
+            progressFrequency,
+            crossValidationThreads);
     }
 
     TrainingSession::TrainingSession(
@@ -65,7 +71,8 @@ namespace CNTK
         bool restoreFromCheckpointIfExists,
         bool saveAllCheckpoints,
         size_t maxNumberOfSamples,
-        size_t progressFrequencyInSamples) :
+        size_t progressFrequencyInSamples,
+        size_t crossValidationThreads) :
         m_trainingSource(trainingSource),
         m_trainer(trainer),
         m_modelInputToMinibatchSourceStream(modelInputToMinibatchSourceStream),
@@ -78,7 +85,8 @@ namespace CNTK
         m_restoreFromCheckpointIfExists(restoreFromCheckpointIfExists),
         m_saveAllCheckpoints(saveAllCheckpoints),
         m_crossValidationSource(crossValidationSource),
-        m_crossValidationSchedule(crossValidationSchedule)
+        m_crossValidationSchedule(crossValidationSchedule),
+        m_crossValidationThreads(crossValidationThreads)
     {
         if (!trainingSource)
             InvalidArgument("Training minibatch source is not allowed to be null.");
@@ -102,6 +110,8 @@ namespace CNTK
                 InvalidArgument("Cross validation minibatch source is not allowed to be empty.");
             crossValidationFrequencyInSamples = 0;
         }
+        else if (m_crossValidationThreads != 0 && !trainer->EvaluationFunction())
+            InvalidArgument("Background cross validation requires the trainer to have an evaluation function.");
 
         // Let's calculate the warm up period the distributed learners may need.
         // We will take the maximum warm up period required.
@@ -138,6 +148,13 @@ namespace CNTK
                 [this](size_t currentIndex, const DeviceDescriptor&) { ReportProgress(currentIndex); } });
     }
 
+    TrainingSession::~TrainingSession()
+    {
+        // The background cross validation uses the sources of this session, so it has to finish first.
+        if (m_pendingCrossValidation.valid())
+            m_pendingCrossValidation.wait();
+    }
+
     void TrainingSession::Train(const DeviceDescriptor& computeDevice)
     {
         std::unordered_map<Variable, ValuePtr> minibatch;
@@ -164,6 +181,7 @@ namespace CNTK
             OnMinibatchStart();
             shouldTrain = m_trainer->TrainMinibatch(minibatch, computeDevice);
             OnMinibatchEnd();
+            ReportFinishedCrossValidation();
 
             auto profMisc = Microsoft::MSR::CNTK::ScopeProfile(Microsoft::MSR::CNTK::profilerEvtMainPost);
 
@@ -192,6 +210,8 @@ namespace CNTK
             }
         }
 
+        WaitForCrossValidation();
+
         // In case of incremental - save final checkpoint.
         // This is required only when we keep all existing checkpoints, otherwise 
         // The checkpoint was already saved with the proper name.
@@ -201,6 +221,24 @@ namespace CNTK
 
     // TODO: Possibly expose a limiting counter on the number of samples for validation.
     void TrainingSession::CrossValidate(size_t currentIndex, const DeviceDescriptor& computeDevice)
+    {
+        if (m_crossValidationThreads != 0 && computeDevice.Type() == DeviceKind::CPU)
+        {
+            StartBackgroundCrossValidation(currentIndex, computeDevice);
+            return;
+        }
+
+        auto result = EvaluateCrossValidationSource(currentIndex, computeDevice,
+            [this, &computeDevice](const std::unordered_map<Variable, ValuePtr>& minibatch, size_t& sampleCount)
+            {
+                return m_trainer->TestMinibatch(minibatch, computeDevice, sampleCount);
+            });
+
+        OnCrossValidationEnd(result.index, result.averageError, result.numberOfSamples, result.numberOfMinibatches);
+    }
+
+    TrainingSession::CrossValidationResult TrainingSession::EvaluateCrossValidationSource(size_t currentIndex, const DeviceDescriptor& computeDevice,
+        const std::function<double(const std::unordered_map<Variable, ValuePtr>&, size_t&)>& test)
     {
         std::unordered_map<Variable, ValuePtr> minibatch;
         double accumulatedError = 0;
@@ -212,14 +250,84 @@ namespace CNTK
         size_t sampleCount = 0;
         while(GetCrossValidationMinibatch(minibatch, m_crossValidationSchedule[sampleCount], computeDevice), !minibatch.empty())
         {
-            error = m_trainer->TestMinibatch(minibatch, computeDevice, sampleCount);
+            error = test(minibatch, sampleCount);
             accumulatedError += error;
             totalNumberOfSamples += sampleCount;
             numberOfMinibatches++;
         }
         m_crossValidationSource->RestoreFromCheckpoint(checkpoint);
 
-        OnCrossValidationEnd(currentIndex, accumulatedError / totalNumberOfSamples, totalNumberOfSamples, numberOfMinibatches);
+        return { currentIndex, accumulatedError / totalNumberOfSamples, totalNumberOfSamples, numberOfMinibatches };
+    }
+
+    // Starts cross validation on a snapshot of the current parameters, the training continues while it runs.
+    // Only the cross validation source and the snapshot are used by the background task, the result is reported
+    // on the training thread by ReportFinishedCrossValidation or WaitForCrossValidation.
+    void TrainingSession::StartBackgroundCrossValidation(size_t currentIndex, const DeviceDescriptor& computeDevice)
+    {
+        // At most one cross validation is in flight.
+        WaitForCrossValidation();
+
+        // Cloning copies the values of all parameters and constants; the inputs are kept,
+        // so that minibatches of the cross validation source can be fed as they are.
+        auto evaluationFunction = m_trainer->EvaluationFunction();
+        std::unordered_map<Variable, Variable> inputs;
+        for (const auto& argument : evaluationFunction->Arguments())
+            inputs.insert({ argument, argument });
+        auto snapshot = evaluationFunction->Clone(ParameterCloningMethod::Clone, inputs);
+
+        // Same aggregation as done by the trainer for TestMinibatch.
+        FunctionPtr aggregatedEvaluation;
+        Variable sampleCountVar;
+        if (!snapshot->Output().DynamicAxes().empty())
+        {
+            aggregatedEvaluation = ReduceSum(snapshot);
+            sampleCountVar = snapshot->Output();
+        }
+        else
+        {
+            aggregatedEvaluation = snapshot;
+            sampleCountVar = snapshot->RootFunction()->Inputs()[0];
+        }
+        auto evaluation = Combine({ aggregatedEvaluation->Output(), sampleCountVar });
+        Variable aggregatedEvaluationVar = aggregatedEvaluation->Output();
+
+        size_t numberOfThreads = m_crossValidationThreads;
+        m_pendingCrossValidation = std::async(std::launch::async,
+            [this, currentIndex, computeDevice, evaluation, aggregatedEvaluationVar, sampleCountVar, numberOfThreads]()
+            {
+#ifdef _OPENMP
+                // Only affects parallel regions started from this thread.
+                omp_set_num_threads((int)numberOfThreads);
+#else
+                UNUSED(numberOfThreads);
+#endif
+                return EvaluateCrossValidationSource(currentIndex, computeDevice,
+                    [&](const std::unordered_map<Variable, ValuePtr>& minibatch, size_t& sampleCount)
+                    {
+                        std::unordered_map<Variable, ValuePtr> outputs = { { aggregatedEvaluationVar, nullptr }, { sampleCountVar, nullptr } };
+                        evaluation->Forward(minibatch, outputs, computeDevice);
+                        sampleCount = GetSampleCount(sampleCountVar, outputs[sampleCountVar]);
+                        return GetScalarValue(outputs[aggregatedEvaluationVar]);
+                    });
+            });
+    }
+
+    // Reports the background cross validation if it has finished, does not block.
+    void TrainingSession::ReportFinishedCrossValidation()
+    {
+        if (m_pendingCrossValidation.valid() &&
+            m_pendingCrossValidation.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            WaitForCrossValidation();
+    }
+
+    void TrainingSession::WaitForCrossValidation()
+    {
+        if (!m_pendingCrossValidation.valid())
+            return;
+
+        auto result = m_pendingCrossValidation.get();
+        OnCrossValidationEnd(result.index, result.averageError, result.numberOfSamples, result.numberOfMinibatches);
     }
 
     inline void TrainingSession::ReportProgress(size_t currentIndex)
@@ -375,6 +375,46 @@ namespace CNTK
         return MakeSharedObject<NDArrayView>(sourceShape, castValue, sourceSize, DeviceDescriptor::CPUDevice(), readOnly);
     }
 
+    inline double GetScalarValue(const ValuePtr& value)
+    {
+        if (value->Mask())
+            LogicError("Scalar Value object cannot have an associated mask");
+
+        auto scalarData = value->Data();
+        if (scalarData->Shape().TotalSize() != 1)
+            LogicError("Scalar Value object's has a size > 1");
+
+        double scalar = std::numeric_limits<double>::quiet_NaN();
+        NDArrayViewPtr cpuData;
+        if (scalarData->Device() == DeviceDescriptor::CPUDevice())
+            cpuData = scalarData;
+        else
+        {
+            cpuData = std::make_shared<NDArrayView>(scalarData->GetDataType(), scalarData->Shape(), DeviceDescriptor::CPUDevice());
+            cpuData->CopyFrom(*scalarData);
+        }
+
+        if (scalarData->GetDataType() == DataType::Float)
+            scalar = *(cpuData->DataBuffer<float>());
+        else if (scalarData->GetDataType() == DataType::Double)
+            scalar = *(cpuData->DataBuffer<double>());
+        else
+            LogicError("Unsupported DataType of training loss value");
+
+        return scalar;
+    }
+
+    inline size_t GetSampleCount(const Variable& var, const ValuePtr& value)
+    {
+        auto valueDataShape = value->Shape();
+        size_t numMaskedSamples = value->MaskedCount();
+        size_t numSamplesInDataArrayView = valueDataShape.SubShape(var.Shape().Rank()).TotalSize();
+        if (numMaskedSamples > numSamplesInDataArrayView)
+            LogicError("Number of masked values cannot exceed the number of samples that the Value object's Data NDArrayView can hold");
+
+        return (numSamplesInDataArrayView - numMaskedSamples);
+    }
+
     template <typename T>
     inline std::string Typename(const T* = nullptr)
     {
@@ -26,6 +26,7 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <cstdint>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -362,4 +363,98 @@ void EVAL_API GetEvalExtended(IEvaluateModelExtended<ElemType>** peval);
 extern "C" EVAL_API void GetEvalExtendedF(IEvaluateModelExtended<float>** peval);
 extern "C" EVAL_API void GetEvalExtendedD(IEvaluateModelExtended<double>** peval);
 
+//
+// GetEvalConcurrent - get an evaluator of the extended interface whose ForwardPass() can be called
+// concurrently from multiple threads. It keeps 'numWorkers' (from the Init() or network description config,
+// default 1) private copies of the network state, all sharing one read-only copy of the model parameters.
+// resetRNN=false is only supported with a single worker.
+//
+template <typename ElemType>
+void EVAL_API GetEvalConcurrent(IEvaluateModelExtended<ElemType>** peval);
+extern "C" EVAL_API void GetEvalConcurrentF(IEvaluateModelExtended<float>** peval);
+extern "C" EVAL_API void GetEvalConcurrentD(IEvaluateModelExtended<double>** peval);
+
+//
+// GetEvalBatching - get an evaluator of the extended interface that merges the requests of concurrent
+// ForwardPass() callers into one minibatch. Each caller's inputs are treated as one sequence; a batch is
+// evaluated once it holds 'maxBatchSize' sequences (default 64) or 'maxBatchSamples' samples (default: no limit),
+// or once its first request has waited 'maxWaitTimeMs' milliseconds (default 2).
+// Only dense inputs are supported, and resetRNN must be true.
+//
+template <typename ElemType>
+void EVAL_API GetEvalBatching(IEvaluateModelExtended<ElemType>** peval);
+extern "C" EVAL_API void GetEvalBatchingF(IEvaluateModelExtended<float>** peval);
+extern "C" EVAL_API void GetEvalBatchingD(IEvaluateModelExtended<double>** peval);
+
+// Counters of a batching evaluator (one obtained from GetEvalBatching), e.g. to check how well requests are merged.
+struct EvalBatchingCounters
+{
+    size_t m_numRequests;      // ForwardPass() calls evaluated so far
+    size_t m_numForwardPasses; // minibatches evaluated so far
+    size_t m_largestBatch;     // largest number of requests evaluated in one minibatch
+};
+
+template <typename ElemType>
+void EVAL_API GetEvalBatchingCounters(IEvaluateModelExtended<ElemType>* eval, EvalBatchingCounters* counters);
+extern "C" EVAL_API void GetEvalBatchingCountersF(IEvaluateModelExtended<float>* eval, EvalBatchingCounters* counters);
+extern "C" EVAL_API void GetEvalBatchingCountersD(IEvaluateModelExtended<double>* eval, EvalBatchingCounters* counters);
+
+// ------------------------------------------------------------------------
+// Streaming interface
+// ------------------------------------------------------------------------
+
+//
+// Evaluates many concurrent streams (e.g. live audio) with one model instance. Each stream is identified by a
+// session id; every ForwardPass() call evaluates the next chunk of several sessions in one minibatch, and the
+// recurrent state (the past values of the network's PastValue nodes) of each session is saved after the chunk
+// and restored before the session's next chunk. A session starts with its first chunk.
+//
+template <typename ElemType>
+class IEvaluateModelStreaming : public IEvaluateModelBase<ElemType>
+{
+public:
+    //
+    // Same as IEvaluateModelExtended::GetOutputSchema().
+    //
+    virtual VariableSchema GetOutputSchema() const = 0;
+
+    //
+    // Same as IEvaluateModelExtended::StartForwardEvaluation(). Fails if the network has recurrent state that
+    // cannot be carried across chunks (FutureValue nodes, OptimizedRNNStack).
+    //
+    virtual void StartForwardEvaluation(const std::vector<std::wstring>& outputs) = 0;
+
+    //
+    // Same as IEvaluateModelExtended::GetInputSchema().
+    //
+    virtual VariableSchema GetInputSchema() const = 0;
+
+    //
+    // ForwardPass - Evaluate the next chunk of each of the given sessions in a single forward pass.
+    // sessionIds - the sessions to evaluate; each id may appear at most once per call
+    // inputs - one vector of (dense) input buffers per session, as given by GetInputSchema(); all inputs
+    //          of a session must have the same number of frames
+    // outputs - one vector of output buffers per session; resized to fit the output schema
+    //
+    virtual void ForwardPass(const std::vector<uint64_t>& sessionIds, const std::vector<Values<ElemType>>& inputs, std::vector<Values<ElemType>>& outputs) = 0;
+
+    //
+    // EndSession - release the recurrent state of a session. Its id may be reused for a new stream afterwards.
+    //
+    virtual void EndSession(uint64_t sessionId) = 0;
+
+    //
+    // GetNumSessions - number of sessions whose state is currently kept.
+    //
+    virtual size_t GetNumSessions() const = 0;
+};
+
+//
+// GetEvalStreaming - get an evaluator of the streaming interface.
+//
+template <typename ElemType>
+void EVAL_API GetEvalStreaming(IEvaluateModelStreaming<ElemType>** peval);
+extern "C" EVAL_API void GetEvalStreamingF(IEvaluateModelStreaming<float>** peval);
+extern "C" EVAL_API void GetEvalStreamingD(IEvaluateModelStreaming<double>** peval);
+
 } } }
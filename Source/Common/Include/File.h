@@ -110,6 +110,7 @@ public:
     void Flush();
 
     bool CanSeek() const { return m_seekable; }
+    const std::wstring& GetFileName() const { return m_filename; }
     size_t Size();
     uint64_t GetPosition();
     void SetPosition(uint64_t pos);
@@ -0,0 +1,76 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Float16.h -- conversion between float and IEEE 754 binary16, for compact storage of values on the host
+//
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// float to binary16, rounded to nearest even
+inline uint16_t FloatToHalf(float value)
+{
+    uint32_t x;
+    memcpy(&x, &value, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t exponent = (x >> 23) & 0xff;
+    uint32_t mantissa = x & 0x7fffff;
+    if (exponent == 0xff) // Inf or NaN
+        return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+
+    int e = (int)exponent - 127 + 15;
+    if (e >= 0x1f) // overflow
+        return (uint16_t)(sign | 0x7c00);
+    if (e <= 0) // subnormal or zero
+    {
+        if (e < -10)
+            return (uint16_t)sign;
+        mantissa |= 0x800000;
+        uint32_t shift = (uint32_t)(14 - e);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1)))
+            half++;
+        return (uint16_t)(sign | half);
+    }
+    uint32_t half = ((uint32_t)e << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++; // a carry into the exponent is correct, up to Inf
+    return (uint16_t)(sign | half);
+}
+
+// binary16 to float (exact)
+inline float HalfToFloat(uint16_t value)
+{
+    uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+    uint32_t x;
+    if (exponent == 0x1f) // Inf or NaN
+        x = sign | 0x7f800000 | (mantissa << 13);
+    else if (exponent != 0)
+        x = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    else if (mantissa == 0) // zero
+        x = sign;
+    else // subnormal: normalize
+    {
+        int e = -14;
+        while (!(mantissa & 0x400))
+        {
+            mantissa <<= 1;
+            e--;
+        }
+        x = sign | ((uint32_t)(e + 127) << 23) | ((mantissa & 0x3ff) << 13);
+    }
+    float result;
+    memcpy(&result, &x, sizeof(result));
+    return result;
+}
+
+}}}
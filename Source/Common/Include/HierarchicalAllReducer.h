@@ -0,0 +1,279 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// HierarchicalAllReducer.h -- two-level allreduce: through shared memory among the ranks of a host, through MPI among hosts
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "MPIWrapper.h"
+#include "TimerUtility.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// HierarchicalAllReducer -- sums buffers over all workers in three phases:
+//  (1) the ranks of a host copy their data into a shared-memory segment, and each rank sums
+//      its share of the elements over all ranks of the host (parallel reduce-scatter);
+//  (2) one leader rank per host runs the MPI allreduce of the host sums with the other hosts;
+//  (3) all ranks of the host copy the result out of the shared segment (local broadcast).
+// Hosts are the groups of ranks that can share memory. For testing, ranksPerHost > 0 further
+// splits them into pseudo-hosts of (at most) that many consecutive ranks.
+// Every worker must call AllReduce() with buffers of the same sizes, in the same order.
+// -----------------------------------------------------------------------
+
+class HierarchicalAllReducer
+{
+public:
+    // accumulated time spent in each phase of the last AllReduce() call
+    struct PhaseTimes
+    {
+        double m_copyIn = 0;         // copying into the shared segment
+        double m_localReduce = 0;    // summing over the ranks of the host
+        double m_interHost = 0;      // allreduce among the host leaders (includes waiting for the leader)
+        double m_localBroadcast = 0; // copying the result out of the shared segment
+    };
+
+    static const size_t DefaultMaxSegmentSizeInBytes = 64 * 1024 * 1024;
+
+    // maxSegmentSizeInBytes bounds the shared segment of a host; larger buffers are reduced in several chunks
+    HierarchicalAllReducer(const MPIWrapperPtr& mpi, size_t ranksPerHost = 0, size_t maxSegmentSizeInBytes = DefaultMaxSegmentSizeInBytes)
+        : m_mpi(mpi), m_localComm(MPI_COMM_NULL), m_leaderComm(MPI_COMM_NULL), m_window(MPI_WIN_NULL), m_slotSizeInBytes(0),
+          m_maxSegmentSizeInBytes(maxSegmentSizeInBytes)
+    {
+        if (m_maxSegmentSizeInBytes < sizeof(double))
+            InvalidArgument("HierarchicalAllReducer: The shared segment size must hold at least one value.");
+
+        MPI_Comm parentComm = m_mpi->Communicator();
+        int worldRank;
+        MPI_Comm_rank(parentComm, &worldRank) || MpiFail("HierarchicalAllReducer: MPI_Comm_rank");
+
+        // the ranks that can share memory with us, split into pseudo-hosts if requested
+        MPI_Comm sharedComm;
+        MPI_Comm_split_type(parentComm, MPI_COMM_TYPE_SHARED, worldRank, MPI_INFO_NULL, &sharedComm) || MpiFail("HierarchicalAllReducer: MPI_Comm_split_type");
+        if (ranksPerHost > 0)
+        {
+            MPI_Comm_split(sharedComm, (int) (worldRank / ranksPerHost), worldRank, &m_localComm) || MpiFail("HierarchicalAllReducer: MPI_Comm_split");
+            MPI_Comm_free(&sharedComm) || MpiFail("HierarchicalAllReducer: MPI_Comm_free");
+        }
+        else
+            m_localComm = sharedComm;
+
+        int localRank, localSize;
+        MPI_Comm_rank(m_localComm, &localRank) || MpiFail("HierarchicalAllReducer: MPI_Comm_rank");
+        MPI_Comm_size(m_localComm, &localSize) || MpiFail("HierarchicalAllReducer: MPI_Comm_size");
+        m_localRank = localRank;
+        m_localSize = localSize;
+
+        // the leaders (local rank 0) of all hosts
+        MPI_Comm_split(parentComm, IsLeader() ? 0 : MPI_UNDEFINED, worldRank, &m_leaderComm) || MpiFail("HierarchicalAllReducer: MPI_Comm_split");
+        int numHosts = 0;
+        if (IsLeader())
+            MPI_Comm_size(m_leaderComm, &numHosts) || MpiFail("HierarchicalAllReducer: MPI_Comm_size");
+        MPI_Bcast(&numHosts, 1, MPI_INT, 0, m_localComm) || MpiFail("HierarchicalAllReducer: MPI_Bcast");
+        m_numHosts = numHosts;
+
+        // hosts may have different numbers of ranks, but the chunks reduced by the leaders must agree
+        int maxLocalSize = localSize;
+        MPI_Allreduce(MPI_IN_PLACE, &maxLocalSize, 1, MPI_INT, MPI_MAX, parentComm) || MpiFail("HierarchicalAllReducer: MPI_Allreduce");
+        m_maxLocalSize = maxLocalSize;
+    }
+
+    ~HierarchicalAllReducer()
+    {
+        // see ~MPIWrapper(): don't communicate while an exception is in flight
+        if (std::uncaught_exception())
+            return;
+
+        FreeSegment();
+        if (m_leaderComm != MPI_COMM_NULL)
+            MPI_Comm_free(&m_leaderComm);
+        if (m_localComm != MPI_COMM_NULL)
+            MPI_Comm_free(&m_localComm);
+    }
+
+    size_t NumHosts() const { return m_numHosts; }
+    size_t NumLocalRanks() const { return m_localSize; }
+    size_t LocalRank() const { return m_localRank; }
+    bool IsLeader() const { return m_localRank == 0; }
+
+    const PhaseTimes& LastPhaseTimes() const { return m_phaseTimes; }
+
+    // Replaces each buffer (pointer, number of elements) by its sum over all workers.
+    template <class ElemType>
+    void AllReduce(const std::vector<std::pair<ElemType*, size_t>>& buffers)
+    {
+        m_phaseTimes = PhaseTimes();
+
+        size_t totalNumElements = 0;
+        for (const auto& buffer : buffers)
+            totalNumElements += buffer.second;
+        if (totalNumElements == 0)
+            return;
+
+        // the buffers are processed as one concatenated array, in chunks that fit into a slot of the segment
+        size_t chunkSize = std::min(totalNumElements, m_maxSegmentSizeInBytes / m_maxLocalSize / sizeof(ElemType));
+        if (chunkSize == 0)
+            chunkSize = 1;
+        EnsureSegment(chunkSize * sizeof(ElemType));
+
+        Timer timer;
+        for (size_t chunkBegin = 0; chunkBegin < totalNumElements; chunkBegin += chunkSize)
+        {
+            size_t chunkEnd = std::min(chunkBegin + chunkSize, totalNumElements);
+            size_t numElements = chunkEnd - chunkBegin;
+
+            // phase 1: copy our values into our slot, and sum our share of the chunk over the slots of all local ranks into slot 0
+            timer.Start();
+            CopyChunk(buffers, chunkBegin, chunkEnd, Slot<ElemType>(m_localRank), /*toBuffers=*/false);
+            LocalBarrier();
+            timer.Stop();
+            m_phaseTimes.m_copyIn += timer.ElapsedSeconds();
+
+            timer.Start();
+            size_t shareBegin = numElements * m_localRank / m_localSize;
+            size_t shareEnd = numElements * (m_localRank + 1) / m_localSize;
+            ElemType* sum = Slot<ElemType>(0);
+            for (size_t r = 1; r < m_localSize; r++)
+            {
+                const ElemType* values = Slot<ElemType>(r);
+                for (size_t j = shareBegin; j < shareEnd; j++)
+                    sum[j] += values[j];
+            }
+            LocalBarrier();
+            timer.Stop();
+            m_phaseTimes.m_localReduce += timer.ElapsedSeconds();
+
+            // phase 2: the leader reduces the host sums across hosts
+            timer.Start();
+            if (IsLeader() && m_numHosts > 1)
+            {
+                MPI_Allreduce(MPI_IN_PLACE, sum, (int) numElements, MPIWrapper::GetDataType(sum), MPI_SUM, m_leaderComm) || MpiFail("HierarchicalAllReducer: MPI_Allreduce");
+            }
+            if (m_numHosts > 1)
+                LocalBarrier();
+            timer.Stop();
+            m_phaseTimes.m_interHost += timer.ElapsedSeconds();
+
+            // phase 3: every rank picks up the result; slot 0 must not be overwritten before all ranks are done
+            timer.Start();
+            CopyChunk(buffers, chunkBegin, chunkEnd, sum, /*toBuffers=*/true);
+            LocalBarrier();
+            timer.Stop();
+            m_phaseTimes.m_localBroadcast += timer.ElapsedSeconds();
+        }
+    }
+
+    void PrintPhaseTimes(FILE* f) const
+    {
+        fprintf(f, "Hierarchical aggregation phase times (%d ranks on %d hosts): copy-in %.6g, local reduce %.6g, inter-host allreduce %.6g, local broadcast %.6g\n",
+                (int) m_mpi->NumNodesInUse(), (int) m_numHosts, m_phaseTimes.m_copyIn, m_phaseTimes.m_localReduce, m_phaseTimes.m_interHost, m_phaseTimes.m_localBroadcast);
+    }
+
+private:
+    template <class ElemType>
+    ElemType* Slot(size_t localRank) const
+    {
+        return reinterpret_cast<ElemType*>(m_slots[localRank]);
+    }
+
+    // copies elements [chunkBegin, chunkEnd) of the concatenated buffers to or from 'chunk'
+    template <class ElemType>
+    static void CopyChunk(const std::vector<std::pair<ElemType*, size_t>>& buffers, size_t chunkBegin, size_t chunkEnd, ElemType* chunk, bool toBuffers)
+    {
+        size_t bufferBegin = 0;
+        for (const auto& buffer : buffers)
+        {
+            size_t bufferEnd = bufferBegin + buffer.second;
+            size_t begin = std::max(bufferBegin, chunkBegin);
+            size_t end = std::min(bufferEnd, chunkEnd);
+            if (begin < end)
+            {
+                ElemType* bufferData = buffer.first + (begin - bufferBegin);
+                ElemType* chunkData = chunk + (begin - chunkBegin);
+                if (toBuffers)
+                    memcpy(bufferData, chunkData, (end - begin) * sizeof(ElemType));
+                else
+                    memcpy(chunkData, bufferData, (end - begin) * sizeof(ElemType));
+            }
+            if (bufferEnd >= chunkEnd)
+                break;
+            bufferBegin = bufferEnd;
+        }
+    }
+
+    // Makes the stores of all local ranks to the segment visible to each other, following the MPI-3 shared memory model.
+    void LocalBarrier()
+    {
+        MPI_Win_sync(m_window) || MpiFail("HierarchicalAllReducer: MPI_Win_sync");
+        MPI_Barrier(m_localComm) || MpiFail("HierarchicalAllReducer: MPI_Barrier");
+        MPI_Win_sync(m_window) || MpiFail("HierarchicalAllReducer: MPI_Win_sync");
+    }
+
+    // (re-)allocates the shared segment such that each local rank has a slot of at least 'slotSizeInBytes'; collective over the host
+    void EnsureSegment(size_t slotSizeInBytes)
+    {
+        if (m_window != MPI_WIN_NULL && m_slotSizeInBytes >= slotSizeInBytes)
+            return;
+
+        FreeSegment();
+
+        // each slot is allocated close to the rank that writes it
+        MPI_Info info;
+        MPI_Info_create(&info) || MpiFail("HierarchicalAllReducer: MPI_Info_create");
+        MPI_Info_set(info, const_cast<char*>("alloc_shared_noncontig"), const_cast<char*>("true")) || MpiFail("HierarchicalAllReducer: MPI_Info_set");
+        void* base = nullptr;
+        MPI_Win_allocate_shared((MPI_Aint) slotSizeInBytes, 1, info, m_localComm, &base, &m_window) || MpiFail("HierarchicalAllReducer: MPI_Win_allocate_shared");
+        MPI_Info_free(&info) || MpiFail("HierarchicalAllReducer: MPI_Info_free");
+
+        m_slots.resize(m_localSize);
+        for (size_t r = 0; r < m_localSize; r++)
+        {
+            MPI_Aint size;
+            int dispUnit;
+            void* slot;
+            MPI_Win_shared_query(m_window, (int) r, &size, &dispUnit, &slot) || MpiFail("HierarchicalAllReducer: MPI_Win_shared_query");
+            m_slots[r] = static_cast<char*>(slot);
+        }
+        m_slotSizeInBytes = slotSizeInBytes;
+
+        // a passive-target epoch lasting for the lifetime of the segment, as required by MPI_Win_sync()
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, m_window) || MpiFail("HierarchicalAllReducer: MPI_Win_lock_all");
+    }
+
+    void FreeSegment()
+    {
+        if (m_window == MPI_WIN_NULL)
+            return;
+
+        MPI_Win_unlock_all(m_window) || MpiFail("HierarchicalAllReducer: MPI_Win_unlock_all");
+        MPI_Win_free(&m_window) || MpiFail("HierarchicalAllReducer: MPI_Win_free");
+        m_slots.clear();
+        m_slotSizeInBytes = 0;
+    }
+
+private:
+    MPIWrapperPtr m_mpi;
+
+    MPI_Comm m_localComm;  // the ranks of our (pseudo-)host
+    MPI_Comm m_leaderComm; // the leaders of all hosts; MPI_COMM_NULL on non-leaders
+    size_t m_localRank;
+    size_t m_localSize;
+    size_t m_maxLocalSize; // over all hosts
+    size_t m_numHosts;
+
+    // the shared segment, one slot per local rank
+    MPI_Win m_window;
+    std::vector<char*> m_slots;
+    size_t m_slotSizeInBytes;
+    size_t m_maxSegmentSizeInBytes;
+
+    PhaseTimes m_phaseTimes;
+};
+
+}}}
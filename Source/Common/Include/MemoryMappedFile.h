@@ -0,0 +1,45 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <string>
+#include <stdint.h>
+#include "Basics.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Read-only memory mapping of a whole file.
+// Pages are loaded on demand by the operating system and are shared between processes mapping the same file,
+// so this is used for large read-only sidecar files that several workers on a machine need.
+class MemoryMappedFile
+{
+public:
+    explicit MemoryMappedFile(const std::wstring& fileName);
+    ~MemoryMappedFile();
+
+    const char* Data() const { return m_data; }
+    uint64_t Size() const { return m_size; }
+    const std::wstring& FileName() const { return m_fileName; }
+
+    // Asks the operating system to start reading the given byte range into memory in the background.
+    // This is only a hint, it neither blocks nor fails.
+    void Prefetch(uint64_t offset, uint64_t size) const;
+
+private:
+    DISABLE_COPY_AND_MOVE(MemoryMappedFile);
+
+    std::wstring m_fileName;
+    const char* m_data;
+    uint64_t m_size;
+#ifdef _WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#else
+    int m_file;
+#endif
+};
+
+}}}
@@ -8,6 +8,8 @@
 #pragma once
 
 #include <vector>
+#include <map>
+#include <algorithm>
 #include <memory> // for shared_ptr
 #include <mutex>
 #include "Basics.h"
@@ -198,10 +200,13 @@ public:
     //  - width: maximum width of structure; set to maximum over sequence lengths
     //  - inputSequences: vector of input SequenceInfo records (only seqId and GetNumTimeSteps() are used)
     //  - placement, rowAllocations: temp buffers (passed in to be able to optimize memory allocations)
+    //  - bestFitDecreasing: place sequences longest first, each into the row with the least space left that still fits it.
+    //    This leaves fewer gaps than the default first-fit in input order, but changes the placement of sequences.
     template<typename SequenceInfoVector>
     void InitAsPackedSequences(const SequenceInfoVector& inputSequences,
         /*temp buffer*/std::vector<std::pair<size_t, size_t>>& placement,
-        /*temp buffer*/std::vector<size_t> rowAllocations)
+        /*temp buffer*/std::vector<size_t> rowAllocations,
+        bool bestFitDecreasing = false)
     {
         placement.resize(inputSequences.size()); // [sequence index] result goes here (entries are invalid for gaps)
         // determine width of MBLayout
@@ -215,24 +220,60 @@ public:
         }
         // allocate
         rowAllocations.clear();             // [row] we build rows one by one
-        for (size_t i = 0; i < inputSequences.size(); i++)
+        if (!bestFitDecreasing)
         {
-            if (inputSequences[i].seqId == GAP_SEQUENCE_ID)
-                continue;
-            let len = inputSequences[i].GetNumTimeSteps();
-            // first see if we find a row that has enough space
-            // TODO: Should we use a proper priority_queue?
-            size_t s;
-            for (s = 0; s < rowAllocations.size(); s++)
-                if (rowAllocations[s] + len <= width)
-                    break; // yep, it fits
-            // we did not find a s that fit then create a new one
-            if (s == rowAllocations.size())
-                rowAllocations.push_back(0);
-            // sequence goes to (s, rowAllocations[s])
-            placement[i] = make_pair(s, rowAllocations[s]);
-            // and allocate it
-            rowAllocations[s] += len;
+            for (size_t i = 0; i < inputSequences.size(); i++)
+            {
+                if (inputSequences[i].seqId == GAP_SEQUENCE_ID)
+                    continue;
+                let len = inputSequences[i].GetNumTimeSteps();
+                // first see if we find a row that has enough space
+                size_t s;
+                for (s = 0; s < rowAllocations.size(); s++)
+                    if (rowAllocations[s] + len <= width)
+                        break; // yep, it fits
+                // we did not find a s that fit then create a new one
+                if (s == rowAllocations.size())
+                    rowAllocations.push_back(0);
+                // sequence goes to (s, rowAllocations[s])
+                placement[i] = make_pair(s, rowAllocations[s]);
+                // and allocate it
+                rowAllocations[s] += len;
+            }
+        }
+        else
+        {
+            // visit sequences longest first; equal lengths keep their input order, so the result is deterministic
+            std::vector<size_t> order;
+            order.reserve(inputSequences.size());
+            for (size_t i = 0; i < inputSequences.size(); i++)
+                if (inputSequences[i].seqId != GAP_SEQUENCE_ID)
+                    order.push_back(i);
+            std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+            {
+                return inputSequences[a].GetNumTimeSteps() > inputSequences[b].GetNumTimeSteps();
+            });
+            // rows keyed by their remaining space; the first row with at least len left is the best fit
+            std::multimap<size_t, size_t> rowsBySpaceLeft;
+            for (let i : order)
+            {
+                let len = inputSequences[i].GetNumTimeSteps();
+                size_t s;
+                auto bestFit = rowsBySpaceLeft.lower_bound(len);
+                if (bestFit == rowsBySpaceLeft.end())
+                {
+                    s = rowAllocations.size();
+                    rowAllocations.push_back(0);
+                }
+                else
+                {
+                    s = bestFit->second;
+                    rowsBySpaceLeft.erase(bestFit);
+                }
+                placement[i] = make_pair(s, rowAllocations[s]);
+                rowAllocations[s] += len;
+                rowsBySpaceLeft.insert(make_pair(width - rowAllocations[s], s));
+            }
         }
         // create MBLayout
         Init(rowAllocations.size(), width);
@@ -311,6 +352,16 @@ public:
     // This is used by MeanNode and InvStdDevNode, and by statistics reporting.
     size_t GetActualNumSamples() const;
 
+    // fraction of the columns of the underlying MB matrix that hold actual frames rather than gaps (1 if there are no columns)
+    double GetPaddingEfficiency() const
+    {
+        size_t numCols = GetNumCols();
+        return numCols == 0 ? 1.0 : (double)(numCols - m_numGapFrames) / numCols;
+    }
+
+    // number of gap frames in this layout
+    size_t GetNumGapFrames() const { return m_numGapFrames; }
+
     const Matrix<char>& GetColumnsValidityMask(DEVICEID_TYPE deviceId) const;
 
     // compare whether two layouts are the same
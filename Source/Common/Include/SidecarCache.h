@@ -0,0 +1,258 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Helpers for binary sidecar cache files, i.e. files next to the input data that keep the result of an
+// expensive pass over it (parsed labels, bundling decisions, input statistics, ...) for later runs.
+//
+// A cache file starts with a SidecarCacheHeader, followed by a header and data specific to the owner.
+// It is used only while it is at least as new as all its inputs and its header matches the expected one,
+// which includes a fingerprint of the inputs and options the result depends on.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+#include "Basics.h"
+#include "fileutil.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// FNV-1a fingerprint of the inputs of a cache file.
+class SidecarFingerprint
+{
+public:
+    SidecarFingerprint()
+        : m_hash(14695981039346656037ull)
+    {}
+
+    void Add(const void* data, size_t size)
+    {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; ++i)
+        {
+            m_hash ^= bytes[i];
+            m_hash *= 1099511628211ull;
+        }
+    }
+
+    void AddValue(uint64_t value)
+    {
+        Add(&value, sizeof(value));
+    }
+
+    void AddString(const std::wstring& value)
+    {
+        std::string s = msra::strfun::utf8(value);
+        AddValue(s.size());
+        Add(s.data(), s.size());
+    }
+
+    // Adds the name and the size of a file; changes of the content are caught by the time stamp check.
+    void AddFile(const std::wstring& path)
+    {
+        AddString(path);
+        AddValue((uint64_t)filesize64(path.c_str()));
+    }
+
+    uint64_t Value() const
+    {
+        return m_hash;
+    }
+
+private:
+    uint64_t m_hash;
+};
+
+// Common header of all cache files.
+struct SidecarCacheHeader
+{
+    char m_magic[8];
+    uint32_t m_version;
+    uint32_t m_elementSize; // size of the elements of the payload (e.g. a character or a class id)
+    uint64_t m_fingerprint; // 0 if the file is not tied to inputs
+
+    SidecarCacheHeader()
+    {
+        memset(this, 0, sizeof(*this));
+    }
+
+    SidecarCacheHeader(const char* magic, uint32_t version, uint32_t elementSize, uint64_t fingerprint)
+        : m_version(version), m_elementSize(elementSize), m_fingerprint(fingerprint)
+    {
+        memcpy(m_magic, magic, sizeof(m_magic));
+    }
+
+    bool HasMagic(const SidecarCacheHeader& expected) const
+    {
+        return memcmp(m_magic, expected.m_magic, sizeof(m_magic)) == 0 && m_version == expected.m_version;
+    }
+
+    bool Matches(const SidecarCacheHeader& expected) const
+    {
+        return HasMagic(expected) && m_elementSize == expected.m_elementSize && m_fingerprint == expected.m_fingerprint;
+    }
+};
+
+// Reads a cache file. The file is only opened if it exists and is at least as new as all inputs.
+// Opening and reads report failure instead of throwing, so that a missing, damaged or foreign file
+// (e.g. one that another process has just replaced) is simply ignored and recomputed.
+class SidecarCacheReader
+{
+public:
+    SidecarCacheReader(const std::wstring& path, const std::vector<std::wstring>& inputs)
+        : m_path(path), m_file(nullptr)
+    {
+        if (!fexists(path))
+            return;
+        for (const auto& input : inputs)
+        {
+            if (!msra::files::fuptodate(path, input))
+                return;
+        }
+        m_file = _wfopen(path.c_str(), L"rb");
+    }
+
+    ~SidecarCacheReader()
+    {
+        if (m_file)
+            fclose(m_file);
+    }
+
+    bool IsOpen() const
+    {
+        return m_file != nullptr;
+    }
+
+    bool Read(void* data, size_t size)
+    {
+        return size == 0 || fread(data, 1, size, m_file) == size;
+    }
+
+    template <class T>
+    bool ReadValue(T& value)
+    {
+        return Read(&value, sizeof(value));
+    }
+
+    template <class T>
+    bool ReadVector(std::vector<T>& values, uint64_t size)
+    {
+        values.resize((size_t)size);
+        return Read(values.data(), values.size() * sizeof(T));
+    }
+
+    // Reads the common header and checks it against the expected one.
+    bool ReadHeader(const SidecarCacheHeader& expected)
+    {
+        SidecarCacheHeader header;
+        return ReadValue(header) && header.Matches(expected);
+    }
+
+    bool AtEnd()
+    {
+        return fgetc(m_file) == EOF;
+    }
+
+    // Closes the file; if its content was rejected, tells the user that it is going to be recomputed.
+    bool Close(bool valid, const char* owner)
+    {
+        fclose(m_file);
+        m_file = nullptr;
+        if (!valid)
+            fprintf(stderr, "WARNING: %s: ignoring cache file '%ls', it does not match the input.\n", owner, m_path.c_str());
+        return valid;
+    }
+
+private:
+    DISABLE_COPY_AND_MOVE(SidecarCacheReader);
+
+    std::wstring m_path;
+    FILE* m_file;
+};
+
+// Writes a cache file under a temporary name and renames it on Commit(), so that concurrent readers
+// (or writers in other processes) never see a partial file. Errors throw; the temporary file is removed
+// either way. Optional caches are written through TryWriteSidecarCache().
+class SidecarCacheWriter
+{
+public:
+    explicit SidecarCacheWriter(const std::wstring& path)
+        : m_path(path), m_tempPath(path + L".tmp" + std::to_wstring((unsigned long long)GetCurrentProcessId()))
+    {
+        m_file = fopenOrDie(m_tempPath, L"wb");
+    }
+
+    // Removes the temporary file if the writer is abandoned, e.g. by an exception.
+    ~SidecarCacheWriter()
+    {
+        if (m_file)
+        {
+            fclose(m_file);
+            _wunlink(m_tempPath.c_str());
+        }
+    }
+
+    void Write(const void* data, size_t size)
+    {
+        if (size > 0)
+            fwriteOrDie(data, 1, size, m_file);
+    }
+
+    template <class T>
+    void WriteValue(const T& value)
+    {
+        Write(&value, sizeof(value));
+    }
+
+    template <class T>
+    void WriteVector(const std::vector<T>& values)
+    {
+        Write(values.data(), values.size() * sizeof(T));
+    }
+
+    void Commit()
+    {
+        FILE* f = m_file;
+        m_file = nullptr;
+        try
+        {
+            fcloseOrDie(f);
+            renameOrDie(m_tempPath, m_path);
+        }
+        catch (...)
+        {
+            _wunlink(m_tempPath.c_str());
+            throw;
+        }
+    }
+
+private:
+    DISABLE_COPY_AND_MOVE(SidecarCacheWriter);
+
+    std::wstring m_path;
+    std::wstring m_tempPath;
+    FILE* m_file;
+};
+
+// Runs a function that writes a cache file with a SidecarCacheWriter. A cache only saves time, so a failure
+// (full disk, read-only directory, ...) is reported as a warning and the caller continues without it.
+template <class F>
+bool TryWriteSidecarCache(const std::wstring& path, const char* owner, F&& write)
+{
+    try
+    {
+        write();
+        return true;
+    }
+    catch (const std::exception& e)
+    {
+        fprintf(stderr, "WARNING: %s: could not write cache file '%ls', continuing without it: %s\n", owner, path.c_str(), e.what());
+        return false;
+    }
+}
+
+}}}
@@ -17,8 +17,10 @@
 #include "latticestorage.h"
 #include "simple_checked_arrays.h"
 #include "fileutil.h"
+#include "MemoryMappedFile.h"
 #include <vector>
 #include <string>
+#include <memory>
 #include <unordered_map>
 #include <algorithm> // for find()
 #include "simplesenonehmm.h"
@@ -94,6 +96,35 @@ class lattice
     std::vector<nodeinfo> nodes;
     std::vector<edgeinfowithscores> edges;
     std::vector<aligninfo> align;
+    // flat per-edge frame ranges, built once when the lattice is read (see buildedgespans())
+    // The CPU forward-backward iterates these instead of dereferencing nodes[] for each edge. 'edgeorder'
+    // lists the edges by decreasing duration, so that long edges are picked up first by parallel workers.
+    struct edgespan
+    {
+        unsigned int ts; // first frame of edge
+        unsigned int te; // end frame of edge (exclusive)
+    };
+    std::vector<edgespan> edgespans;
+    std::vector<unsigned int> edgeorder;
+    void computeedgespans(std::vector<edgespan>& spans, std::vector<unsigned int>& order) const
+    {
+        spans.resize(edges.size());
+        order.resize(edges.size());
+        foreach_index (j, edges)
+        {
+            spans[j].ts = nodes[edges[j].S].t;
+            spans[j].te = nodes[edges[j].E].t;
+            order[j] = (unsigned int) j;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](unsigned int j1, unsigned int j2)
+                         {
+                             return spans[j1].te - spans[j1].ts > spans[j2].te - spans[j2].ts;
+                         });
+    }
+    void buildedgespans()
+    {
+        computeedgespans(edgespans, edgeorder);
+    }
     // V2 lattices  --for a while, we will store both in RAM, until all code is updated
     static int fsgn(float f)
     {
@@ -573,11 +604,16 @@ private:
             }
             alignoffsets[L.edges.size()] = (unsigned int) alignbufsize; // (TODO: remove if not actually needed)
         }
-        // edgealignments[j][t] is the senone at frame offset t in edge j
-        array_ref<unsigned short> operator[](size_t j)
+        // allocate the storage for all edges  --operator[] does this lazily, which is not safe when edges are processed in parallel
+        void allocate()
         {
             if (allalignments.size() == 0)
                 allalignments.resize(alignoffsets.back());
+        }
+        // edgealignments[j][t] is the senone at frame offset t in edge j
+        array_ref<unsigned short> operator[](size_t j)
+        {
+            allocate();
             size_t offset = alignoffsets[j];
             size_t numframes = alignoffsets[j + 1] - alignoffsets[j];
             if (numframes == 0)
@@ -957,6 +993,85 @@ public:
         freadOrDie(v, sz, f);
     }
 
+    // check whether the unit ids of a V2 lattice need to be mapped to the user's symbol map
+    template <class IDMAP>
+    bool needsunitmapping(const IDMAP& idmap, size_t spunit) const
+    {
+#if 1                                                                                     // post-bugfix for incorrect inference of spunit
+        if (info.impliedspunitid != SIZE_MAX && info.impliedspunitid >= idmap.size()) // we have buggy lattices like that--what do they mean??
+        {
+            fprintf(stderr, "fread: detected buggy spunit id %d which is out of range (%d entries in map)\n", (int) info.impliedspunitid, (int) idmap.size());
+            RuntimeError("fread: out of bounds spunitid");
+        }
+#endif
+        // This is critical--we have a buggy lattice set that requires no mapping where mapping would fail
+        foreach_index (k, idmap)
+        {
+            if (idmap[k] != (size_t) k
+#if 1
+                && (k != (int) idmap.size() - 1 || idmap[k] != spunit) // that HACK that we add one more /sp/ entry at the end...
+#endif
+                )
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // map the unit ids of a V2 lattice read into edges2[] and uniquededgedatatokens[], and convert it to edges[] and align[]
+    template <class IDMAP>
+    void mapandrebuildedges(const IDMAP& idmap, size_t spunit)
+    {
+        const bool needsmapping = needsunitmapping(idmap, spunit);
+        // map align ids to user's symmap  --the lattice gets updated in place here
+        if (needsmapping)
+        {
+            if (info.impliedspunitid != SIZE_MAX)
+                info.impliedspunitid = idmap[info.impliedspunitid];
+
+            // deal with broken (zero-token) edges
+            std::vector<bool> isendworkaround;
+            if (info.impliedspunitid != spunit)
+            {
+                fprintf(stderr, "fread: lattice with broken spunit, using workaround to handle potentially broken zero-token edges\n");
+                inferends(isendworkaround);
+            }
+
+            size_t uniquealignments = 1;
+            const size_t skipscoretokens = info.hasacscores ? 2 : 1;
+            for (size_t k = skipscoretokens; k < uniquededgedatatokens.size(); k++)
+            {
+                if (!isendworkaround.empty() && isendworkaround[k]) // secondary criterion to detect ends in broken lattices
+                {
+                    k--; // don't advance, since nothing to advance over
+                }
+                else
+                {
+                    // this is a regular token: update it in-place
+                    auto& ai = uniquededgedatatokens[k];
+                    if (ai.unit >= idmap.size())
+                        RuntimeError("fread: broken-file heuristics failed");
+                    ai.updateunit(idmap); // updates itself
+                    if (!ai.last)
+                        continue;
+                }
+                // if last then skip over the lm and ac scores
+                k += skipscoretokens;
+                uniquealignments++;
+            }
+            fprintf(stderr, "fread: mapped %d unique alignments\n", (int) uniquealignments);
+        }
+        if (info.impliedspunitid != spunit)
+        {
+            // fprintf (stderr, "fread: inconsistent spunit id in file %d vs. expected %d; due to erroneous heuristic\n", info.impliedspunitid, spunit);    // [v-hansu] comment out becaues it takes up most of the log
+            // it's actually OK, we can live with this, since we only decompress and then move on without any assumptions
+            // RuntimeError("fread: mismatching /sp/ units");
+        }
+        // reconstruct old lattice format from this   --TODO: remove once we change to new data representation
+        rebuildedges(info.impliedspunitid != spunit /*to be able to read somewhat broken V2 lattice archives*/);
+    }
+
     // read from a stream
     // This can be used on an existing structure and will replace its content. May be useful to avoid memory allocations (resize() will not shrink memory).
     // For efficiency, we will not check the inner consistency of the file here, but rather when we further process it.
@@ -990,77 +1105,211 @@ public:
             freadvector(f, "EDGS", edges2, info.numedges); // uniqued edges
             freadvector(f, "ALNS", uniquededgedatatokens); // uniqued alignments
             fcheckTag(f, "END ");
-// check if we need to map
-#if 1                                                                                     // post-bugfix for incorrect inference of spunit
-            if (info.impliedspunitid != SIZE_MAX && info.impliedspunitid >= idmap.size()) // we have buggy lattices like that--what do they mean??
+            mapandrebuildedges(idmap, spunit);
+        }
+        else
+            RuntimeError("fread: unsupported lattice format version");
+        buildedgespans();
+    }
+
+private:
+    // bounds-checked cursor over a lattice in memory; counterpart of freadtag() and freadvector()
+    // Arrays are returned as raw pointers into the buffer since they are not necessarily aligned; use getelement() to access them.
+    class memoryreader
+    {
+        const char* p;
+        const char* end;
+
+    public:
+        memoryreader(const char* data, size_t size)
+            : p(data), end(data + size)
+        {
+        }
+        const char* get(size_t bytes)
+        {
+            if ((size_t)(end - p) < bytes)
+                RuntimeError("read: malformed lattice, data is truncated");
+            const char* q = p;
+            p += bytes;
+            return q;
+        }
+        void checktag(const char* tag)
+        {
+            if (memcmp(get(4), tag, 4) != 0)
+                RuntimeError("read: malformed lattice, expected tag '%s'", tag);
+        }
+        size_t gettag(const char* tag)
+        {
+            checktag(tag);
+            int n;
+            memcpy(&n, get(sizeof(n)), sizeof(n));
+            return (unsigned int) n;
+        }
+        template <class T>
+        const char* getarray(const char* tag, size_t& n, size_t expectedsize = SIZE_MAX)
+        {
+            n = gettag(tag);
+            if (expectedsize != SIZE_MAX && n != expectedsize)
+                RuntimeError("read: malformed lattice, number of vector elements differs from head, for tag %s", tag);
+            if (n > (size_t)(end - p) / sizeof(T))
+                RuntimeError("read: malformed lattice, data is truncated");
+            return get(n * sizeof(T));
+        }
+        template <class T>
+        void getvector(const char* tag, std::vector<T>& v, size_t expectedsize = SIZE_MAX)
+        {
+            size_t n;
+            const char* data = getarray<T>(tag, n, expectedsize);
+            v.resize(n);
+            if (n > 0)
+                memcpy(v.data(), data, n * sizeof(T));
+        }
+    };
+
+    template <class T>
+    static T getelement(const char* array, size_t i)
+    {
+        T v;
+        memcpy(&v, array + i * sizeof(T), sizeof(T));
+        return v;
+    }
+
+    // convert a V2 lattice to edges[] and align[] directly from its uniqued edges and alignments in memory
+    // Same as rebuildedges() for lattices with a consistent /sp/ unit, but unit ids are mapped while expanding, and align[]
+    // is sized exactly in a first pass, so that no intermediate arrays are needed.
+    template <class IDMAP>
+    void decodeedges(const char* uniqueedges, size_t numedges, const char* tokens, size_t numtokens, const IDMAP& idmap, bool needsmapping)
+    {
+        const size_t skipscoretokens = info.hasacscores ? 2 : 1;
+        // pass 1: validate and count the alignment tokens
+        size_t numalign = 0;
+        for (size_t j = 0; j < numedges; j++)
+        {
+            const auto e2 = getelement<edgeinfo>(uniqueedges, j);
+            const size_t firstalign = e2.firstalign;
+            if (firstalign < skipscoretokens || firstalign > numtokens)
+                RuntimeError("read: mal-formed lattice, edge %d points outside the alignment records", (int) j);
+            if (firstalign == numtokens && j != numedges - 1)
+                RuntimeError("read: !NULL edges forbidden except for the last edge");
+            for (size_t k = firstalign; k < numtokens; k++)
             {
-                fprintf(stderr, "fread: detected buggy spunit id %d which is out of range (%d entries in map)\n", (int) info.impliedspunitid, (int) idmap.size());
-                RuntimeError("fread: out of bounds spunitid");
+                numalign++;
+                if (getelement<aligninfo>(tokens, k).last)
+                    break;
+                if (k == numtokens - 1)
+                    RuntimeError("read: mal-formed uniquededgedatatokens[] array: missing 'last' flag in last entry");
             }
-#endif
-            // This is critical--we have a buggy lattice set that requires no mapping where mapping would fail
-            bool needsmapping = false;
-            foreach_index (k, idmap)
+            if (e2.implysp)
+                numalign++;
+        }
+        // pass 2: expand
+        edges.resize(numedges);
+        align.resize(numalign);
+        size_t n = 0;
+        for (size_t j = 0; j < numedges; j++)
+        {
+            const auto e2 = getelement<edgeinfo>(uniqueedges, j);
+            const size_t firstalign = e2.firstalign;
+            if (e2.S >= nodes.size() || e2.E >= nodes.size())
+                RuntimeError("read: mal-formed lattice, edge %d refers to a non-existent node", (int) j);
+            auto& e = edges[j];
+            e.S = e2.S;
+            e.E = e2.E;
+            e.unused = 0;
+            e.implysp = 0;
+            e.a = info.hasacscores ? getelement<float>(tokens, firstalign - 2) : -1e30f /*LOGZERO*/; // cannot reconstruct; not available
+            e.l = getelement<float>(tokens, firstalign - 1);
+            e.firstalign = n;
+            const size_t edgedur = nodes[e2.E].t - nodes[e2.S].t; // for checking and back-filling the implied /sp/
+            size_t aligndur = 0;
+            for (size_t k = firstalign; k < numtokens; k++)
             {
-                if (idmap[k] != (size_t) k
-#if 1
-                    && (k != (int) idmap.size() - 1 || idmap[k] != spunit) // that HACK that we add one more /sp/ entry at the end...
-#endif
-                    )
+                aligninfo ai = getelement<aligninfo>(tokens, k);
+                if (ai.unused != 0)
+                    RuntimeError("read: mal-formed uniquededgedatatokens[] array: 'unused' field must be 0");
+                const bool islast = ai.last != 0;
+                ai.last = 0; // old format does not support this
+                if (needsmapping)
                 {
-                    needsmapping = true;
-                    break;
+                    if (ai.unit >= idmap.size())
+                        RuntimeError("read: unit id out of range of the symbol map");
+                    ai.updateunit(idmap);
                 }
+                align[n++] = ai;
+                aligndur += ai.frames;
+                if (aligndur > edgedur)
+                    RuntimeError("read: mal-formed uniquededgedatatokens[] array: aligment longer than edge");
+                if (islast)
+                    break;
             }
-            // map align ids to user's symmap  --the lattice gets updated in place here
-            if (needsmapping)
+            if (e2.implysp)
             {
-                if (info.impliedspunitid != SIZE_MAX)
-                    info.impliedspunitid = idmap[info.impliedspunitid];
-
-                // deal with broken (zero-token) edges
-                std::vector<bool> isendworkaround;
-                if (info.impliedspunitid != spunit)
-                {
-                    fprintf(stderr, "fread: lattice with broken spunit, using workaround to handle potentially broken zero-token edges\n");
-                    inferends(isendworkaround);
-                }
+                if (info.impliedspunitid == SIZE_MAX)
+                    RuntimeError("read: edge requests implied /sp/ but none specified in lattice header");
+                align[n++] = aligninfo(info.impliedspunitid, edgedur - aligndur /*frames: remaining frames are /sp/ */);
+            }
+        }
+        // the V2 data is not kept (as in rebuildedges())
+        edges2.clear();
+        uniquededgedatatokens.clear();
+    }
 
-                size_t uniquealignments = 1;
-                const size_t skipscoretokens = info.hasacscores ? 2 : 1;
-                for (size_t k = skipscoretokens; k < uniquededgedatatokens.size(); k++)
-                {
-                    if (!isendworkaround.empty() && isendworkaround[k]) // secondary criterion to detect ends in broken lattices
-                    {
-                        k--; // don't advance, since nothing to advance over
-                    }
-                    else
-                    {
-                        // this is a regular token: update it in-place
-                        auto& ai = uniquededgedatatokens[k];
-                        if (ai.unit >= idmap.size())
-                            RuntimeError("fread: broken-file heuristics failed");
-                        ai.updateunit(idmap); // updates itself
-                        if (!ai.last)
-                            continue;
-                    }
-                    // if last then skip over the lm and ac scores
-                    k += skipscoretokens;
-                    uniquealignments++;
-                }
-                fprintf(stderr, "fread: mapped %d unique alignments\n", (int) uniquealignments);
+public:
+    // read from memory, e.g. from a memory-mapped archive
+    // Same as fread(), but data is copied or decoded straight from the buffer into the lattice's arrays. V2 lattices are expanded
+    // without going through edges2[] and uniquededgedatatokens[]; only lattices with an inconsistent /sp/ unit, which need
+    // the workarounds in mapandrebuildedges(), take that path.
+    template <class IDMAP>
+    void read(const char* data, size_t size, const IDMAP& idmap, size_t spunit)
+    {
+        memoryreader reader(data, size);
+        size_t version = reader.gettag("LAT ");
+        if (version == 1)
+        {
+            memcpy(&info, reader.get(sizeof(info)), sizeof(info));
+            reader.getvector("NODE", nodes, info.numnodes);
+            if (nodes.empty() || nodes.back().t != info.numframes)
+                RuntimeError("read: mismatch between info.numframes and last node's time");
+            reader.getvector("EDGE", edges, info.numedges);
+            reader.getvector("ALIG", align);
+            reader.checktag("END ");
+            // map align ids to user's symmap
+            foreach_index (k, align)
+                align[k].updateunit(idmap); // updates itself
+        }
+        else if (version == 2)
+        {
+            memcpy(&info, reader.get(sizeof(info)), sizeof(info));
+            reader.getvector("NODS", nodes, info.numnodes);
+            if (nodes.empty() || nodes.back().t != info.numframes)
+                RuntimeError("read: mismatch between info.numframes and last node's time");
+            size_t numedges, numtokens;
+            const char* uniqueedges = reader.getarray<edgeinfo>("EDGS", numedges, info.numedges);
+            const char* tokens = reader.getarray<aligninfo>("ALNS", numtokens);
+            reader.checktag("END ");
+            const bool needsmapping = needsunitmapping(idmap, spunit);
+            size_t impliedspunitid = info.impliedspunitid;
+            if (needsmapping && impliedspunitid != SIZE_MAX)
+                impliedspunitid = idmap[impliedspunitid];
+            if (impliedspunitid == spunit)
+            {
+                info.impliedspunitid = impliedspunitid;
+                decodeedges(uniqueedges, numedges, tokens, numtokens, idmap, needsmapping);
             }
-            if (info.impliedspunitid != spunit)
+            else // somewhat broken V2 lattice archive
             {
-                // fprintf (stderr, "fread: inconsistent spunit id in file %d vs. expected %d; due to erroneous heuristic\n", info.impliedspunitid, spunit);    // [v-hansu] comment out becaues it takes up most of the log
-                // it's actually OK, we can live with this, since we only decompress and then move on without any assumptions
-                // RuntimeError("fread: mismatching /sp/ units");
+                edges2.resize(numedges);
+                uniquededgedatatokens.resize(numtokens);
+                if (numedges > 0)
+                    memcpy(edges2.data(), uniqueedges, numedges * sizeof(edgeinfo));
+                if (numtokens > 0)
+                    memcpy(uniquededgedatatokens.data(), tokens, numtokens * sizeof(aligninfo));
+                mapandrebuildedges(idmap, spunit);
             }
-            // reconstruct old lattice format from this   --TODO: remove once we change to new data representation
-            rebuildedges(info.impliedspunitid != spunit /*to be able to read somewhat broken V2 lattice archives*/);
         }
         else
-            RuntimeError("fread: unsupported lattice format version");
+            RuntimeError("read: unsupported lattice format version");
+        buildedgespans();
     }
 
     // parallel versions (defined in parallelforwardbackward.cpp)
@@ -1210,9 +1459,49 @@ class archive
     };
     static_assert(sizeof(latticeref) == 8, "unexpected byte size of struct latticeref");
 
-    mutable size_t currentarchiveindex;               // which archive is open
-    mutable auto_file_ptr f;                          // cached archive file handle of currentarchiveindex
-    std::unordered_map<std::wstring, latticeref> toc; // [key] -> (file, offset)  --table of content (.toc file)
+    // table of content (.toc file), as a compact index: entries sorted by key, with the UTF-8 keys packed into one buffer
+    // This needs a fraction of the memory of a hash map of wstrings when there are millions of utterances.
+    struct tocentry
+    {
+        uint64_t keyoffset : 40; // start of key in tockeys[]
+        uint64_t keylength : 24;
+        latticeref ref;
+    };
+    static_assert(sizeof(tocentry) == 16, "unexpected byte size of struct tocentry");
+    std::vector<tocentry> toc;
+    std::vector<char> tockeys;
+    std::vector<std::vector<uint64_t>> latticeoffsets; // [archiveindex] sorted offsets of all lattices, to determine the byte range of a lattice
+
+    int comparekey(const tocentry& entry, const std::string& key) const
+    {
+        const size_t len = std::min((size_t) entry.keylength, key.size());
+        int diff = memcmp(tockeys.data() + entry.keyoffset, key.data(), len);
+        if (diff != 0)
+            return diff;
+        return entry.keylength < key.size() ? -1 : (entry.keylength > key.size() ? 1 : 0);
+    }
+    const tocentry* findtoc(const std::wstring& key) const
+    {
+        const std::string utf8key = msra::strfun::utf8(key);
+        auto iter = std::lower_bound(toc.begin(), toc.end(), utf8key, [this](const tocentry& entry, const std::string& k)
+                                     {
+                                         return comparekey(entry, k) < 0;
+                                     });
+        if (iter == toc.end() || comparekey(*iter, utf8key) != 0)
+            return nullptr;
+        return &*iter;
+    }
+
+    // archive files are memory-mapped on first use; lattices are decoded straight from the mapping
+    mutable std::vector<std::shared_ptr<Microsoft::MSR::CNTK::MemoryMappedFile>> mappedarchives; // [archiveindex]
+    const Microsoft::MSR::CNTK::MemoryMappedFile& getmappedarchive(size_t archiveindex) const
+    {
+        auto& mapped = mappedarchives[archiveindex];
+        if (!mapped)
+            mapped = std::make_shared<Microsoft::MSR::CNTK::MemoryMappedFile>(archivepaths[archiveindex]);
+        return *mapped;
+    }
+
 public:
     // construct = open the archive
     // archive() : currentarchiveindex (SIZE_MAX) {}
@@ -1228,7 +1517,7 @@ public:
 
     // construct from a list of TOC files
     archive(const std::vector<std::wstring>& tocpaths, const std::unordered_map<std::string, size_t>& modelsymmap, const std::wstring prefixPath = L"")
-        : currentarchiveindex(SIZE_MAX), modelsymmap(modelsymmap), prefixPathInToc(prefixPath), verbosity(0)
+        : modelsymmap(modelsymmap), prefixPathInToc(prefixPath), verbosity(0)
     {
         if (tocpaths.empty()) // nothing to read--keep silent
             return;
@@ -1254,6 +1543,8 @@ public:
         auto toclines = msra::files::fgetfilelines(tocpath, textbuffer, 3);
 
         // parse it one by one
+        const size_t firstnewentry = toc.size();
+        const size_t firstnewkey = tockeys.size();
         size_t archiveindex = SIZE_MAX; // its index
         foreach_index (i, toclines)
         {
@@ -1261,7 +1552,7 @@ public:
             const char* p = strchr(line, '=');
             if (p == NULL)
                 RuntimeError("open: invalid TOC line (no = sign): %s", line);
-            const std::wstring key = msra::strfun::utf16(std::string(line, p - line));
+            const size_t keylength = p - line;
             p++;
             const char* q = strchr(p, '[');
             if (q == NULL)
@@ -1287,18 +1578,69 @@ public:
             if (sscanf(q, "[%" PRIu64 "]%c", &offset, &c) != 1)
 #endif
                 RuntimeError("open: invalid TOC line (bad [] expression): %s", line);
-            if (!toc.insert(make_pair(key, latticeref(offset, archiveindex))).second)
-                RuntimeError("open: TOC entry leads to duplicate key: %s", line);
+            tocentry entry = {0, 0, latticeref(offset, archiveindex)};
+            entry.keyoffset = tockeys.size();
+            entry.keylength = keylength;
+            if (entry.keyoffset != tockeys.size() || entry.keylength != keylength || entry.ref.offset != offset || entry.ref.archiveindex != archiveindex)
+                RuntimeError("open: TOC too large for the lattice index: %s", line);
+            tockeys.insert(tockeys.end(), line, line + keylength);
+            toc.push_back(entry);
         }
 
+        // sort the new entries into the index
+        auto keyorder = [this](const tocentry& e1, const tocentry& e2)
+        {
+            const size_t len = std::min((size_t) e1.keylength, (size_t) e2.keylength);
+            int diff = memcmp(tockeys.data() + e1.keyoffset, tockeys.data() + e2.keyoffset, len);
+            return diff != 0 ? diff < 0 : e1.keylength < e2.keylength;
+        };
+        std::sort(toc.begin() + firstnewentry, toc.end(), keyorder);
+        std::inplace_merge(toc.begin(), toc.begin() + firstnewentry, toc.end(), keyorder);
+        for (size_t i = 1; i < toc.size(); i++)
+        {
+            if (!keyorder(toc[i - 1], toc[i]))
+                RuntimeError("open: TOC entry leads to duplicate key: %s", std::string(tockeys.data() + toc[i].keyoffset, toc[i].keylength).c_str());
+        }
+
+        latticeoffsets.resize(archivepaths.size());
+        for (size_t i = 0; i < toc.size(); i++)
+        {
+            if (toc[i].keyoffset >= firstnewkey)
+                latticeoffsets[toc[i].ref.archiveindex].push_back(toc[i].ref.offset);
+        }
+        for (auto& offsets : latticeoffsets)
+            std::sort(offsets.begin(), offsets.end());
+
         // initialize symmaps  --alloc the array, but actually read the symmap on demand
         symmaps.resize(archivepaths.size());
+        mappedarchives.resize(archivepaths.size());
     }
 
     // check if a lattice for a given key is available  --do this during initial check ideally
     bool haslattice(const std::wstring& key) const
     {
-        return toc.find(key) != toc.end();
+        return findtoc(key) != nullptr;
+    }
+
+    // start reading the lattice for a given key into memory in the background, so that getlattice() does not wait for the disk
+    // This is only a hint, it fails silently (a later getlattice() will report the error).
+    void prefetchlattice(const std::wstring& key) const
+    {
+        const tocentry* entry = findtoc(key);
+        if (entry == nullptr)
+            return;
+        const size_t archiveindex = entry->ref.archiveindex;
+        const uint64_t offset = entry->ref.offset;
+        try
+        {
+            const auto& mapped = getmappedarchive(archiveindex);
+            const auto& offsets = latticeoffsets[archiveindex];
+            auto next = std::upper_bound(offsets.begin(), offsets.end(), offset);
+            mapped.Prefetch(offset, (next != offsets.end() ? *next : mapped.Size()) - offset);
+        }
+        catch (const std::exception&)
+        {
+        }
     }
 
 #if 0 // TODO: change design to keep the #frames in the TOC, so we can check for mismatches before entering the training iteration
@@ -1321,12 +1663,12 @@ public:
     void getlattice(const std::wstring& key, lattice& L,
                     size_t expectedframes = SIZE_MAX /*if unknown*/) const
     {
-        auto iter = toc.find(key);
-        if (iter == toc.end())
+        const tocentry* entry = findtoc(key);
+        if (entry == nullptr)
             LogicError("getlattice: requested lattice for non-existent key; haslattice() should have been used to check availability");
         // get the archive that the lattice lives in and its byte offset
-        const size_t archiveindex = iter->second.archiveindex;
-        const auto offset = iter->second.offset;
+        const size_t archiveindex = entry->ref.archiveindex;
+        const uint64_t offset = entry->ref.offset;
         // get id map (used below); this may lazily load a .symlist file. We do it here rather than later w.r.t. an outer retry loop.
         auto& idmap = getcachedidmap(archiveindex, modelsymmap); // at first time, this will load the .symlist file and create a mapping to the user SYMMAP
         const size_t spunit = idmap.back();                      // ugh--getcachedidmap() just appends it to the end
@@ -1335,18 +1677,13 @@ public:
         if (spunit2 != spunit)
             LogicError("getlattice: huh? same lookup of /sp/ gives different result?");
 #endif
-        // open archive file in case it is not the current one
-        if (archiveindex != currentarchiveindex)
-        {
-            f = fopenOrDie(archivepaths[archiveindex], L"rbS"); // or throw (will close old 'f' iff succeeded)
-            currentarchiveindex = archiveindex;
-        }
         try // (for read operation)
         {
-            // seek to start
-            fsetpos(f, offset);
-            // get it
-            L.fread(f, idmap, spunit);
+            // map the archive file unless already mapped, and decode the lattice from there
+            const auto& mapped = getmappedarchive(archiveindex);
+            if (offset >= mapped.Size())
+                RuntimeError("getlattice: lattice offset %llu beyond end of archive '%ls'", (unsigned long long) offset, archivepaths[archiveindex].c_str());
+            L.read(mapped.Data() + offset, (size_t)(mapped.Size() - offset), idmap, spunit);
             L.setverbosity(verbosity);
 #ifdef HACK_IN_SILENCE // hack to simulate DEL in the lattice
             const size_t silunit = getid(modelsymmap, "sil");
@@ -1354,10 +1691,9 @@ public:
             L.hackinsilencesubstitutionedges(silunit, spunit, addsp);
 #endif
         }
-        catch (...) // to retry a read error due to a disconnected file handle, we need to reopen the file
+        catch (...) // to retry a read error due to a disconnected file handle, we need to remap the file
         {
-            currentarchiveindex = SIZE_MAX;
-            f = NULL; // this closes the file handle
+            mappedarchives[archiveindex].reset();
             throw;
         }
         // check if number of frames is as expected
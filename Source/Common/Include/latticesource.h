@@ -69,6 +69,12 @@ public:
         L = LP;
     }
 
+    // hint that the lattices for a key will be needed soon (see archive::prefetchlattice())
+    void prefetchlattices(const std::wstring& key) const
+    {
+        denlattices.prefetchlattice(key);
+    }
+
     void setverbosity(int veb)
     {
         verbosity = veb;
@@ -0,0 +1,104 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "MemoryMappedFile.h"
+#include <algorithm>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+MemoryMappedFile::MemoryMappedFile(const std::wstring& fileName) :
+    m_fileName(fileName), m_data(nullptr), m_size(0)
+{
+#ifdef _WIN32
+    m_mapping = NULL;
+    m_file = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_file == INVALID_HANDLE_VALUE)
+        RuntimeError("MemoryMappedFile: Unable to open file %ls, error %x", fileName.c_str(), GetLastError());
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_file, &fileSize))
+    {
+        CloseHandle(m_file);
+        RuntimeError("MemoryMappedFile: Unable to determine size of file %ls, error %x", fileName.c_str(), GetLastError());
+    }
+    m_size = (uint64_t)fileSize.QuadPart;
+    if (m_size == 0)
+        return;
+    m_mapping = CreateFileMappingW(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_mapping)
+        m_data = (const char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m_data)
+    {
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        CloseHandle(m_file);
+        RuntimeError("MemoryMappedFile: Could not memory map file %ls, error %x", fileName.c_str(), GetLastError());
+    }
+#else
+    m_file = open(msra::strfun::utf8(fileName).c_str(), O_RDONLY);
+    if (m_file == -1)
+        RuntimeError("MemoryMappedFile: Unable to open file %ls", fileName.c_str());
+    struct stat sb;
+    if (fstat(m_file, &sb) == -1)
+    {
+        close(m_file);
+        RuntimeError("MemoryMappedFile: Unable to determine size of file %ls", fileName.c_str());
+    }
+    m_size = (uint64_t)sb.st_size;
+    if (m_size == 0)
+        return;
+    void* data = mmap(nullptr, (size_t)m_size, PROT_READ, MAP_SHARED, m_file, 0);
+    if (data == MAP_FAILED)
+    {
+        close(m_file);
+        RuntimeError("MemoryMappedFile: Could not memory map file %ls", fileName.c_str());
+    }
+    m_data = (const char*)data;
+#endif
+}
+
+void MemoryMappedFile::Prefetch(uint64_t offset, uint64_t size) const
+{
+    if (!m_data || offset >= m_size)
+        return;
+    size = std::min(size, m_size - offset);
+#ifdef _WIN32
+#if _WIN32_WINNT >= 0x0602 // PrefetchVirtualMemory() requires Windows 8
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = (PVOID)(m_data + offset);
+    range.NumberOfBytes = (SIZE_T)size;
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+#else
+    // madvise() requires a page-aligned address
+    const uint64_t pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+    const uint64_t begin = offset / pageSize * pageSize;
+    madvise((void*)(m_data + begin), (size_t)(offset + size - begin), MADV_WILLNEED);
+#endif
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+#ifdef _WIN32
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    CloseHandle(m_file);
+#else
+    if (m_data)
+        munmap((void*)m_data, (size_t)m_size);
+    close(m_file);
+#endif
+}
+
+}}}
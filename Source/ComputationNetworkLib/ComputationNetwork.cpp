@@ -21,11 +21,13 @@
 #include "SpecialPurposeNodes.h"
 #include "DeprecatedNodes.h" // (for SaveToDbnFile(), which is also deprecated)
 #include "MPIWrapper.h" // TODO: does not belong here
+#include "ParameterPayload.h"
 #include <string>
 #include <vector>
 #include <stack>
 #include <list>
 #include <set>
+#include <thread>
 
 using namespace std;
 
@@ -115,6 +117,8 @@ void ComputationNetwork::SaveToFileImpl(const wstring& fileName, const FileOptio
     fstream << (size_t) CURRENT_CNTK_MODEL_VERSION;
     fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EVersion");
 
+    SavePayload(fstream);
+
     fstream << (size_t) m_nameToNodeMap.size();
 
     // put all node info first
@@ -196,6 +200,44 @@ void ComputationNetwork::SaveToFileImpl(const wstring& fileName, const FileOptio
     fstream.Flush();
 }
 
+// write the values of large parameters into the aligned payload region (see ParameterPayload.h)
+void ComputationNetwork::SavePayload(File& fstream) const
+{
+    vector<pair<IPayloadNode*, uint64_t>> values; // (node, offset in payload region)
+    uint64_t payloadSize = 0;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        auto payloadNode = dynamic_cast<IPayloadNode*>(iter.second.get());
+        if (!payloadNode || !ParameterPayload::IsStoredInPayload(payloadNode->GetPayloadBytes(), fstream))
+            continue;
+        payloadSize = ParameterPayload::AlignUp(payloadSize);
+        values.push_back(make_pair(payloadNode, payloadSize));
+        payloadSize += payloadNode->GetPayloadBytes();
+    }
+    if (values.empty())
+        return;
+
+    fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BPayload");
+    fstream << values.size();
+    for (const auto& value : values)
+        fstream << dynamic_cast<ComputationNodeBase*>(value.first)->NodeName() << value.second << (uint64_t)value.first->GetPayloadBytes();
+    fstream << payloadSize;
+    fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EPayload");
+
+    // values are padded with zeroes to their aligned offsets
+    auto writePadding = [&fstream](uint64_t toPos)
+    {
+        for (uint64_t pos = fstream.GetPosition(); pos < toPos; pos++)
+            fstream << (char)0;
+    };
+    let payloadBegin = ParameterPayload::AlignUp(fstream.GetPosition());
+    for (const auto& value : values)
+    {
+        writePadding(payloadBegin + value.second);
+        value.first->WritePayload(fstream);
+    }
+    writePadding(payloadBegin + payloadSize);
+}
 
 size_t ComputationNetwork::GetModelVersion(File& fstream) 
 {
@@ -220,6 +262,33 @@ size_t ComputationNetwork::GetModelVersion(File& fstream)
 template <class ElemType> // ElemType is the default for models prior to CNTK_MODEL_VERSION_7; after that, it is serialized, and ElemType is ignored
 void ComputationNetwork::ReadPersistableParameters(size_t modelVersion, File& fstream, bool create)
 {
+    // large parameter values are stored in an aligned payload region ahead of the node list
+    // It is mapped into memory and paged in on a background thread while the node list is parsed.
+    map<wstring, pair<uint64_t, uint64_t>> payloadValues; // [node name] -> (offset in payload region, number of bytes)
+    shared_ptr<ParameterPayload> payload;
+    if (modelVersion >= CNTK_MODEL_VERSION_20 && fstream.TryGetMarker(FileMarker::fileMarkerBeginSection, L"BPayload"))
+    {
+        size_t numValues;
+        fstream >> numValues;
+        for (size_t i = 0; i < numValues; i++)
+        {
+            wstring nodeName;
+            uint64_t offset, numBytes;
+            fstream >> nodeName >> offset >> numBytes;
+            payloadValues[nodeName] = make_pair(offset, numBytes);
+        }
+        uint64_t payloadSize;
+        fstream >> payloadSize;
+        fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EPayload");
+        if (!fstream.CanSeek())
+            RuntimeError("Read: Model files with a parameter payload region must be seekable.");
+
+        let payloadBegin = ParameterPayload::AlignUp(fstream.GetPosition());
+        payload = make_shared<ParameterPayload>(fstream.GetFileName(), payloadBegin, payloadBegin + payloadSize);
+        payload->StartPrefetch();
+        fstream.SetPosition(payloadBegin + payloadSize);
+    }
+
     size_t numNodes;
     fstream >> numNodes;
 
@@ -265,6 +334,59 @@ void ComputationNetwork::ReadPersistableParameters(size_t modelVersion, File& fs
     }
 
     fstream.GetMarker(FileMarker::fileMarkerEndSection, L"ENodeList");
+
+    if (modelVersion >= CNTK_MODEL_VERSION_20)
+        LoadPayload(payload, payloadValues, /*useInPlace=*/create && m_deviceId == CPUDEVICE);
+}
+
+// hand the payload values to the nodes that expect them
+// CPU values are used in place if allowed; otherwise they are copied, in parallel if the target is the CPU.
+void ComputationNetwork::LoadPayload(const shared_ptr<ParameterPayload>& payload, const map<wstring, pair<uint64_t, uint64_t>>& payloadValues, bool useInPlace)
+{
+    vector<pair<IPayloadNode*, pair<uint64_t, uint64_t>>> pending;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        auto payloadNode = dynamic_cast<IPayloadNode*>(iter.second.get());
+        if (!payloadNode || !payloadNode->IsPayloadPending())
+            continue;
+        auto value = payloadValues.find(iter.first);
+        if (value == payloadValues.end())
+            RuntimeError("Read: The value of %ls is missing from the payload region of the model file.", iter.second->NodeDescription().c_str());
+        pending.push_back(make_pair(payloadNode, value->second));
+    }
+
+    size_t numThreads = (useInPlace || m_deviceId != CPUDEVICE) ? 1 : min(pending.size(), (size_t)max(thread::hardware_concurrency(), 1u));
+    if (numThreads <= 1)
+    {
+        for (const auto& value : pending)
+            value.first->LoadPayload(payload, value.second.first, value.second.second, useInPlace);
+        return;
+    }
+
+    vector<thread> threads;
+    vector<exception_ptr> errors(numThreads);
+    for (size_t t = 0; t < numThreads; t++)
+    {
+        threads.push_back(thread([&, t]()
+        {
+            try
+            {
+                for (size_t i = t; i < pending.size(); i += numThreads)
+                    pending[i].first->LoadPayload(payload, pending[i].second.first, pending[i].second.second, /*useInPlace=*/false);
+            }
+            catch (...)
+            {
+                errors[t] = current_exception();
+            }
+        }));
+    }
+    for (auto& worker : threads)
+        worker.join();
+    for (const auto& error : errors)
+    {
+        if (error)
+            rethrow_exception(error);
+    }
 }
 
 // deserialize the model
@@ -462,6 +584,7 @@ bool ComputationNetwork::IsTypicalCriterionNode(ComputationNodeBasePtr nodePtr)
         nodePtr->OperationName() == OperationNameOf(SequenceWithSoftmaxNode) ||
         nodePtr->OperationName() == OperationNameOf(CrossEntropyNode) ||
         nodePtr->OperationName() == OperationNameOf(ClassBasedCrossEntropyWithSoftmaxNode) ||
+        nodePtr->OperationName() == OperationNameOf(SampledCrossEntropyWithSoftmaxNode) ||
         nodePtr->OperationName() == OperationNameOf(ClassificationErrorNode) ||
         nodePtr->OperationName() == OperationNameOf(EditDistanceErrorNode) ||
 #ifdef COMING_SOON
@@ -1157,6 +1280,282 @@ void ComputationNetwork::PerformSVDecomposition(const map<wstring, float>& SVDCo
     CompileNetwork();
 }
 
+// -----------------------------------------------------------------------
+// OptimizeForInference() -- rewrite a trained network for deployment
+// -----------------------------------------------------------------------
+
+// The result computes the same outputs in inference mode with fewer nodes and less work:
+//  - Reshape nodes that do not change the shape are bypassed.
+//  - Subgraphs that depend on nothing but constants are precomputed into a single constant each.
+//    Only parameters that training does not update (Constant(), or learningRateMultiplier=0) count as constants,
+//    so that the network can still be trained after this rewrite.
+//  - BatchNormalization applied to the output of a Times or Convolution (optionally plus a bias) is folded
+//    into the weights of that node, i.e. BN(W*x + b) is replaced by W'*x + b'.
+// The network is compiled again afterwards, so it can be saved or evaluated right away.
+template <class ElemType>
+size_t ComputationNetwork::OptimizeForInference()
+{
+    if (!IsCompiled())
+        CompileNetwork(); // we need validated dimensions
+
+    size_t numNodesBefore = GetTotalNumberOfNodes();
+    fprintf(stderr, "\nOptimizeForInference: Optimizing network with %d nodes for inference.\n", (int) numNodesBefore);
+
+    size_t numReshapesRemoved = RemoveNoOpReshapes<ElemType>();
+    CompileNetwork();
+    size_t numConstantsFolded = FoldConstantSubgraphs<ElemType>();
+    CompileNetwork();
+    size_t numBatchNormalizationsFolded = FoldBatchNormalization<ElemType>();
+    CompileNetwork();
+
+    size_t numNodesAfter = GetTotalNumberOfNodes();
+    size_t numNodesEliminated = numNodesBefore > numNodesAfter ? numNodesBefore - numNodesAfter : 0;
+    fprintf(stderr, "OptimizeForInference: %d no-op reshapes removed, %d constant subgraphs folded, %d batch normalizations folded.\n",
+            (int) numReshapesRemoved, (int) numConstantsFolded, (int) numBatchNormalizationsFolded);
+    fprintf(stderr, "OptimizeForInference: %d nodes eliminated, %d nodes left.\n\n", (int) numNodesEliminated, (int) numNodesAfter);
+    return numNodesEliminated;
+}
+
+// bypass all Reshape nodes whose output has the same sample layout and MBLayout as their input
+// Returns the number of nodes removed.
+template <class ElemType>
+size_t ComputationNetwork::RemoveNoOpReshapes()
+{
+    size_t numRemoved = 0;
+    for (const auto& node : GetAllNodes())
+    {
+        if (!dynamic_pointer_cast<ReshapeNode<ElemType>>(node) || !NodeNameExists(node->NodeName()) || IsInAnyNodeGroup(node))
+            continue;
+
+        auto input = node->Input(0);
+        if (node->GetSampleLayout() != input->GetSampleLayout() || node->GetMBLayout() != input->GetMBLayout())
+            continue;
+
+        ChangeNodeInputs(node, input);
+        if (DeleteNodeIfOrphaned(node) > 0)
+            numRemoved++;
+    }
+    return numRemoved;
+}
+
+template <class ElemType>
+static vector<ElemType> CopyToVector(const Matrix<ElemType>& m)
+{
+    vector<ElemType> v(m.GetNumElements());
+    ElemType* data = v.data();
+    size_t size = v.size();
+    m.CopyToArray(data, size); // (v has the right size, hence data is not reallocated)
+    return v;
+}
+
+// replace all maximal subgraphs without dynamic axis that only depend on constant LearnableParameters (those that
+// are not updated by training) by a constant LearnableParameter that holds their precomputed value
+// Nodes that draw random numbers or are precomputed from data are never folded.
+// Returns the number of subgraphs folded.
+template <class ElemType>
+size_t ComputationNetwork::FoldConstantSubgraphs()
+{
+    // determine the nodes whose value is a constant
+    map<ComputationNodeBasePtr, bool> isConstant;
+    function<bool(const ComputationNodeBasePtr&)> determineIsConstant = [&](const ComputationNodeBasePtr& node) -> bool
+    {
+        auto iter = isConstant.find(node);
+        if (iter != isConstant.end())
+            return iter->second;
+        isConstant[node] = false; // (while we recurse; this cuts loops)
+
+        bool result;
+        if (dynamic_cast<LearnableParameter<ElemType>*>(node.get()))
+            result = !node->IsParameterUpdateRequired();
+        else if (node->GetNumInputs() == 0 || node->HasMBLayout() ||
+                 dynamic_cast<IRngUser*>(node.get()) || dynamic_cast<IPreComputeNode*>(node.get()))
+            result = false;
+        else
+        {
+            result = true;
+            for (const auto& input : node->GetInputs())
+                result &= determineIsConstant(input);
+        }
+        isConstant[node] = result;
+        return result;
+    };
+
+    // the subgraphs to fold are rooted in constant nodes that are used by non-constant ones, or are network outputs
+    auto parents = CreateParentsMap();
+    vector<ComputationNodeBasePtr> roots;
+    for (const auto& node : GetAllNodes())
+    {
+        if (!determineIsConstant(node) || dynamic_cast<LearnableParameter<ElemType>*>(node.get()))
+            continue;
+        bool isRoot = IsInAnyNodeGroup(node);
+        for (const auto& parent : parents[node])
+            isRoot |= !determineIsConstant(parent);
+        if (isRoot)
+            roots.push_back(node);
+    }
+    if (roots.empty())
+        return 0;
+
+    // compute the values of these subgraphs, as if we were inferring
+    auto prevOperationMode = Environment().SetOperationMode(NetworkOperationMode::inferring);
+    set<ComputationNodeBasePtr> evaluated;
+    function<void(const ComputationNodeBasePtr&)> evaluate = [&](const ComputationNodeBasePtr& node)
+    {
+        if (!evaluated.insert(node).second || dynamic_cast<LearnableParameter<ElemType>*>(node.get()))
+            return;
+        for (const auto& input : node->GetInputs())
+            evaluate(input);
+        node->RequestMatricesBeforeForwardProp(m_matrixPool); // (not released: values of inner nodes must survive until all roots are computed)
+        node->BeginForwardProp();
+        node->ForwardProp(FrameRange(nullptr));
+        node->EndForwardProp();
+    };
+    for (const auto& root : roots)
+        evaluate(root);
+    Environment().SetOperationMode(prevOperationMode);
+
+    // and replace them by parameters of the same name
+    for (const auto& root : roots)
+    {
+        auto node = dynamic_pointer_cast<ComputationNode<ElemType>>(root);
+        auto value = CopyToVector(node->Value());
+
+        auto parameter = New<LearnableParameter<ElemType>>(m_deviceId, node->NodeName(), node->GetSampleLayout());
+        InitLearnableParameters(parameter, L"fixedValue", 0); // follow the protocol; otherwise deferred initialization will overwrite the value in validation
+        parameter->Value().SetValue(parameter->Value().GetNumRows(), parameter->Value().GetNumCols(), parameter->Value().GetDeviceId(), value.data());
+        ComputationNodeBasePtr(parameter)->SetLearningRateMultiplier(0);
+        SubstituteNode(node, parameter);
+    }
+    return roots.size();
+}
+
+// fold BatchNormalization into a preceding Times or Convolution node with a parameter as its weight matrix:
+//   BN(W*x [+ b]) = scale .* (W*x [+ b] - mean) ./ sqrt(var + epsilon) + bias = W'*x + b'
+// where W' is W with each output channel c scaled by s[c] = scale[c] / sqrt(var[c] + epsilon), and b' = s .* ([b] - mean) + bias.
+// W is updated in place, the BN node is replaced by a Plus node of the same name that adds b'.
+// This is only done if W, W*x, and W*x + b are not used anywhere else. For Convolution, only spatial BN on CHW data is folded.
+// Returns the number of BN nodes folded.
+template <class ElemType>
+size_t ComputationNetwork::FoldBatchNormalization()
+{
+    auto isOnlyUsedBy = [&](const ComputationNodeBasePtr& node, const ComputationNodeBasePtr& user)
+    {
+        auto users = GetParentNodes(node->NodeName());
+        return users.size() == 1 && users[0] == user && !IsInAnyNodeGroup(node);
+    };
+
+    size_t numFolded = 0;
+    for (const auto& node : GetAllNodes())
+    {
+        auto bnNode = dynamic_pointer_cast<BatchNormalizationNode<ElemType>>(node);
+        if (!bnNode || !NodeNameExists(node->NodeName()))
+            continue;
+        const ComputationNodeBasePtr& bn = node;
+
+        // the BN parameters must be known
+        size_t numChannels = bn->Input(1)->GetSampleLayout().GetNumElements();
+        bool hasParameters = true;
+        for (size_t i = 1; i < 5; i++) // scale, bias, run_mean, run_var
+            hasParameters &= dynamic_cast<LearnableParameter<ElemType>*>(bn->Input(i).get()) != nullptr &&
+                             bn->Input(i)->GetSampleLayout().GetNumElements() == numChannels;
+        wstring foldedBiasName = bn->NodeName() + L"_foldedBias";
+        if (!hasParameters || numChannels == 0 || NodeNameExists(foldedBiasName))
+            continue;
+
+        // match W*x [+ b]
+        ComputationNodeBasePtr producer = bn->Input(0);
+        shared_ptr<ComputationNode<ElemType>> producerBias;
+        if (producer->OperationName() == OperationNameOf(PlusNode) && isOnlyUsedBy(producer, bn))
+        {
+            for (size_t i = 0; i < 2; i++)
+            {
+                if (dynamic_cast<LearnableParameter<ElemType>*>(producer->Input(i).get()) &&
+                    producer->Input(i)->GetSampleLayout().GetNumElements() == numChannels)
+                {
+                    producerBias = dynamic_pointer_cast<ComputationNode<ElemType>>(producer->Input(i));
+                    producer = producer->Input(1 - i);
+                    break;
+                }
+            }
+            if (!producerBias)
+                continue;
+            if (!isOnlyUsedBy(producer, bn->Input(0)))
+                continue;
+        }
+        else if (!isOnlyUsedBy(producer, bn))
+            continue;
+
+        auto weights = dynamic_pointer_cast<LearnableParameter<ElemType>>(producer->Input(0));
+        if (!weights || !isOnlyUsedBy(weights, producer))
+            continue;
+        size_t numWeights = producer->Input(0)->GetSampleLayout().GetNumElements();
+        if (numWeights == 0 || numWeights % numChannels != 0)
+            continue;
+
+        // determine how weights map to output channels, and the shape of the bias
+        const auto& outputLayout = producer->GetSampleLayout();
+        function<size_t(size_t)> channelOf;
+        TensorShape biasShape;
+        if (dynamic_pointer_cast<TimesNode<ElemType>>(producer))
+        {
+            // W is [outputDims x inputDims] in column-major order, and BN normalizes each output element
+            if (outputLayout.GetNumElements() != numChannels)
+                continue;
+            channelOf = [numChannels](size_t i) { return i % numChannels; };
+            biasShape = outputLayout;
+        }
+        else if (auto conv = dynamic_pointer_cast<ConvolutionNode<ElemType>>(producer))
+        {
+            // W holds one kernel per output map, one after another
+            const auto& sharing = conv->Sharing();
+            bool isShared = all_of(sharing.begin(), sharing.end(), [](bool b) { return b; });
+            if (conv->Transpose() || !isShared || conv->ImageLayout() != ImageLayoutKind::CHW ||
+                !bnNode->Spatial() || outputLayout.GetRank() == 0 || outputLayout.GetDims().back() != numChannels)
+                continue;
+            size_t kernelSize = numWeights / numChannels;
+            channelOf = [kernelSize](size_t i) { return i / kernelSize; };
+            SmallVector<size_t> dims(outputLayout.GetRank(), 1);
+            dims.back() = numChannels;
+            biasShape = TensorShape(dims);
+        }
+        else
+            continue;
+
+        // compute the scaled weights and the new bias
+        auto scale    = CopyToVector(dynamic_pointer_cast<ComputationNode<ElemType>>(bn->Input(1))->Value());
+        auto bias     = CopyToVector(dynamic_pointer_cast<ComputationNode<ElemType>>(bn->Input(2))->Value());
+        auto mean     = CopyToVector(dynamic_pointer_cast<ComputationNode<ElemType>>(bn->Input(3))->Value());
+        auto variance = CopyToVector(dynamic_pointer_cast<ComputationNode<ElemType>>(bn->Input(4))->Value());
+        vector<ElemType> oldBias = producerBias ? CopyToVector(producerBias->Value()) : vector<ElemType>(numChannels, 0);
+
+        vector<double> channelScale(numChannels);
+        vector<ElemType> newBias(numChannels);
+        for (size_t c = 0; c < numChannels; c++)
+        {
+            channelScale[c] = scale[c] / sqrt((double) variance[c] + bnNode->Epsilon());
+            newBias[c] = (ElemType) (channelScale[c] * ((double) oldBias[c] - mean[c]) + bias[c]);
+        }
+
+        Matrix<ElemType>& weightMatrix = weights->Value();
+        auto w = CopyToVector(weightMatrix);
+        for (size_t i = 0; i < w.size(); i++)
+            w[i] = (ElemType) (w[i] * channelScale[channelOf(i)]);
+        weightMatrix.SetValue(weightMatrix.GetNumRows(), weightMatrix.GetNumCols(), weightMatrix.GetDeviceId(), w.data());
+
+        auto newBiasNode = AddNodeToNetWithElemType(New<LearnableParameter<ElemType>>(m_deviceId, foldedBiasName, biasShape));
+        InitLearnableParameters(newBiasNode, L"fixedValue", 0);
+        newBiasNode->Value().SetValue(newBiasNode->Value().GetNumRows(), newBiasNode->Value().GetNumCols(), newBiasNode->Value().GetDeviceId(), newBias.data());
+        ComputationNodeBasePtr(newBiasNode)->SetLearningRateMultiplier(bn->Input(2)->GetLearningRateMultiplier());
+
+        // replace BN(...) by W'*x + b'
+        auto plus = New<PlusNode<ElemType>>(m_deviceId, bn->NodeName());
+        plus->AttachInputs({ producer, newBiasNode });
+        SubstituteNode(bn, plus);
+        numFolded++;
+    }
+    return numFolded;
+}
+
 // Helper class to form a logical DBN layer while exporting the network (used by SaveToDbnFile)
 class DbnLayer
 {
@@ -1524,6 +1923,7 @@ template void ComputationNetwork::InitLearnableParametersWithBilinearFill<float>
 template void ComputationNetwork::Read<float>(const wstring& fileName);
 template void ComputationNetwork::ReadPersistableParameters<float>(size_t modelVersion, File& fstream, bool create);
 template void ComputationNetwork::PerformSVDecomposition<float>(const map<wstring, float>& SVDConfig, size_t alignedsize);
+template size_t ComputationNetwork::OptimizeForInference<float>();
 template /*static*/ void ComputationNetwork::SetDropoutRate<float>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double dropoutRate, double& prevDropoutRate);
 template /*static*/ void ComputationNetwork::SetIRngUserSeed<float>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, size_t randSeedBase);
 template /*static*/ void ComputationNetwork::SetBatchNormalizationTimeConstants<float>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double normalizationTimeConstant, double& prevNormalizationTimeConstant, double blendTimeConstant, double& prevBlendTimeConstant);
@@ -1535,6 +1935,7 @@ template void ComputationNetwork::InitLearnableParametersWithBilinearFill<double
 template void ComputationNetwork::Read<double>(const wstring& fileName);
 template void ComputationNetwork::ReadPersistableParameters<double>(size_t modelVersion, File& fstream, bool create);
 template void ComputationNetwork::PerformSVDecomposition<double>(const map<wstring, float>& SVDConfig, size_t alignedsize);
+template size_t ComputationNetwork::OptimizeForInference<double>();
 template /*static*/ void ComputationNetwork::SetDropoutRate<double>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double dropoutRate, double& prevDropoutRate);
 template /*static*/ void ComputationNetwork::SetIRngUserSeed<double>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, size_t randSeedBase);
 template /*static*/ void ComputationNetwork::SetBatchNormalizationTimeConstants<double>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double normalizationTimeConstant, double& prevNormalizationTimeConstant, double blendTimeConstant, double& prevBlendTimeConstant);
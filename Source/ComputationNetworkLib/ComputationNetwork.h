@@ -29,6 +29,7 @@
 #include <chrono>
 #include <unordered_map>
 #include <set>
+#include <functional>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -125,6 +126,8 @@ private:
     void SaveToFileImpl(const std::wstring& fileName, const FileOptions fileFormat) const;
     
     static size_t GetModelVersion(File& fstream);
+    void SavePayload(File& fstream) const;
+    void LoadPayload(const std::shared_ptr<ParameterPayload>& payload, const std::map<std::wstring, std::pair<uint64_t, uint64_t>>& payloadValues, bool useInPlace);
 
 public:
 
@@ -138,6 +141,11 @@ public:
     // main entry point for backprop
     void Backprop(const ComputationNodeBasePtr rootNode);
 
+    // same, but calls 'nodeBackpropDone' after each top-level node has been backpropagated, in reverse evaluation order.
+    // A leaf (e.g. a LearnableParameter) is visited after all of its consumers, i.e. its gradient is final at that point.
+    // This allows to start exchanging gradients while the rest of the network is still being backpropagated.
+    void Backprop(const ComputationNodeBasePtr rootNode, const std::function<void(const ComputationNodeBasePtr&)>& nodeBackpropDone);
+
     template <class NODESET> // version that takes multiple nodes
     void ForwardProp(const NODESET& nodes)
     {
@@ -397,6 +405,7 @@ public:
     ComputationNodeBasePtr CopyNode(const ComputationNetwork& fromNet, const std::wstring fromName, std::wstring toName, const CopyNodeFlags flags);
     void CopySubTree(const ComputationNetwork& fromNet, const std::wstring fromName, std::wstring toNamePrefix, const CopyNodeFlags flags);
     void CopyInputs(const std::wstring fromName, std::wstring toName);
+    ComputationNetworkPtr CloneWithSharedParameters() const;
     void RenameNode(const std::wstring& nodeNameOrig, const std::wstring& nodeNameNew);
     void RenameNode(ComputationNodeBasePtr node, const std::wstring& newNodeName);
     void DeleteNode(const std::wstring& nodeName);
@@ -407,6 +416,9 @@ public:
     void AddFeatureNode(ComputationNodeBasePtr featureNode);
     //ComputationNodeBasePtr RemoveFeatureNode(ComputationNodeBasePtr featureNode);
     void SetLearnableNodesBelowLearningRateMultiplier(const float learningRateMultiplier, const ComputationNodeBasePtr& rootNode = nullptr);
+    void SubstituteNode(const ComputationNodeBasePtr& oldNode, const ComputationNodeBasePtr& newNode);
+    size_t DeleteNodeIfOrphaned(const ComputationNodeBasePtr& node);
+    bool IsInAnyNodeGroup(const ComputationNodeBasePtr& node);
 
     // -----------------------------------------------------------------------
     // node access
@@ -770,9 +782,22 @@ public:
     template <class ElemType>
     void PerformSVDecomposition(const map<wstring, float>& SVDConfig, size_t AlignedSize);
 
+    // rewrite a trained network into a leaner one for deployment; returns the number of nodes eliminated
+    template <class ElemType>
+    size_t OptimizeForInference();
+
     template <class ElemType>
     void SaveToDbnFile(ComputationNetworkPtr net, const std::wstring& fileName) const;
 
+private:
+    template <class ElemType>
+    size_t RemoveNoOpReshapes();
+    template <class ElemType>
+    size_t FoldBatchNormalization();
+    template <class ElemType>
+    size_t FoldConstantSubgraphs();
+public:
+
     // -----------------------------------------------------------------------
     // construction
     // -----------------------------------------------------------------------
@@ -1124,6 +1149,9 @@ protected:
         // There is currently no other constructor for inner nested PAR-traversed sub-networks, but there will be.
         PARTraversalFlowControlNode(const std::vector<shared_ptr<SEQTraversalFlowControlNode>>& recurrentInfo, const std::list<ComputationNodeBasePtr>& allNodes);
         // Base::m_nestedNodes contains all top-level nodes, in evaluation order
+
+        // if set, called by Backprop() after each top-level node
+        std::function<void(const ComputationNodeBasePtr&)> m_nodeBackpropDone;
     };
 
 public:
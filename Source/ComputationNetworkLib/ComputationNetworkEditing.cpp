@@ -103,6 +103,56 @@ void ComputationNetwork::CopyInputs(const std::wstring fromName, std::wstring to
     CopyNode(*this, fromName, toName, CopyNodeFlags::copyNodeInputLinks);
 }
 
+// CloneWithSharedParameters - create a structurally identical network whose LearnableParameter nodes
+// reference the value matrices of this network instead of owning a copy.
+// All other node state (activations, MBLayouts, matrix pool) is private to the clone, so that several
+// clones can be evaluated concurrently on different threads as long as nobody writes to the parameters.
+ComputationNetworkPtr ComputationNetwork::CloneWithSharedParameters() const
+{
+    VerifyIsCompiled("CloneWithSharedParameters");
+
+    auto net = make_shared<ComputationNetwork>(GetDeviceId());
+    net->SetTraceLevel(TraceLevel());
+    net->SetRandomSeedOffset(GetRandomSeedOffset());
+
+    // duplicate all nodes; parameters get their value by reference, everything else by copy
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        const auto& node = iter.second;
+        auto flags = CopyNodeFlags::copyNodeValue;
+        if (node->OperationName() == OperationNameOf(LearnableParameter))
+            flags = CopyNodeFlags(flags | CopyNodeFlags::copyNodeValueShared);
+        net->AddNodeToNet(node->Duplicate(node->NodeName(), flags));
+    }
+
+    // rewire the inputs to the cloned nodes
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        const auto& node = iter.second;
+        if (node->GetNumInputs() == 0)
+            continue;
+        vector<ComputationNodeBasePtr> inputs;
+        for (const auto& input : node->GetInputs())
+            inputs.push_back(net->GetNodeFromName(input->NodeName()));
+        net->GetNodeFromName(node->NodeName())->AttachInputs(inputs);
+    }
+
+    // restore the node groups in their original order
+    auto cloneNodeGroup = [&](const wchar_t* groupTag, const vector<ComputationNodeBasePtr>& nodes)
+    {
+        for (const auto& node : nodes)
+            net->AddToNodeGroup(groupTag, net->GetNodeFromName(node->NodeName()));
+    };
+    cloneNodeGroup(L"feature",    FeatureNodes());
+    cloneNodeGroup(L"label",      LabelNodes());
+    cloneNodeGroup(L"criterion",  FinalCriterionNodes());
+    cloneNodeGroup(L"evaluation", EvaluationNodes());
+    cloneNodeGroup(L"output",     OutputNodes());
+
+    net->CompileNetwork();
+    return net;
+}
+
 // RenameNode - Rename a node to another name
 // nodeNameOrig - original node name
 // nodeNameNew - new node name
@@ -339,6 +389,64 @@ ComputationNodeBasePtr ComputationNetwork::RemoveFeatureNode(ComputationNodeBase
 }
 #endif
 
+// replaces oldNode by newNode, which may be of a different type and have different inputs
+// All consumers and node groups that referred to oldNode refer to newNode afterwards. newNode must not be part of
+// the network yet and usually carries oldNode's name. Former inputs of oldNode that are no longer used are deleted.
+void ComputationNetwork::SubstituteNode(const ComputationNodeBasePtr& oldNode, const ComputationNodeBasePtr& newNode)
+{
+    InvalidateCompiledNetwork();
+
+    ChangeNodeInputs(oldNode, newNode);
+    for (auto groupIter : GetAllNodeGroups())
+    {
+        auto& group = *groupIter;
+        for (auto& node : group)
+            if (node == oldNode)
+                node = newNode;
+    }
+
+    auto oldInputs = oldNode->GetInputs();
+    oldNode->DetachInputs();
+    RemoveNodeFromNet(oldNode);
+    AddNodeToNet(newNode);
+
+    for (const auto& input : oldInputs)
+        DeleteNodeIfOrphaned(input);
+}
+
+// deletes a node that is no longer consumed by any other node nor referenced by a node group, and then
+// recursively those of its inputs that became orphans by that
+// Returns the number of nodes deleted.
+size_t ComputationNetwork::DeleteNodeIfOrphaned(const ComputationNodeBasePtr& node)
+{
+    auto iter = m_nameToNodeMap.find(node->NodeName());
+    if (iter == m_nameToNodeMap.end() || iter->second != node) // already gone (e.g. a node that was used twice)
+        return 0;
+    if (!GetParentNodes(node->NodeName()).empty() || IsInAnyNodeGroup(node))
+        return 0;
+
+    InvalidateCompiledNetwork();
+
+    auto inputs = node->GetInputs();
+    node->DetachInputs();
+    RemoveNodeFromNet(node);
+
+    size_t numDeleted = 1;
+    for (const auto& input : inputs)
+        numDeleted += DeleteNodeIfOrphaned(input);
+    return numDeleted;
+}
+
+bool ComputationNetwork::IsInAnyNodeGroup(const ComputationNodeBasePtr& node)
+{
+    for (auto groupIter : GetAllNodeGroups())
+    {
+        if (std::find(groupIter->begin(), groupIter->end(), node) != groupIter->end())
+            return true;
+    }
+    return false;
+}
+
 // sets m_learningRateMultiplier in all LearnableParameters feeding into the passed rootNode
 // Called from MEL
 void ComputationNetwork::SetLearnableNodesBelowLearningRateMultiplier(const float learningRateMultiplier, const ComputationNodeBasePtr& rootNode)
@@ -80,6 +80,25 @@ void ComputationNetwork::Backprop(const ComputationNodeBasePtr rootNode) // trai
     GetNestedNetwork(rootNode)->Backprop(FrameRange(nullptr), true, true);
 }
 
+void ComputationNetwork::Backprop(const ComputationNodeBasePtr rootNode, const std::function<void(const ComputationNodeBasePtr&)>& nodeBackpropDone)
+{
+    auto network = dynamic_pointer_cast<PARTraversalFlowControlNode>(GetNestedNetwork(rootNode));
+    if (!network)
+        LogicError("Backprop: Nested network of %ls %ls operation is not a PAR traversal.", rootNode->NodeName().c_str(), rootNode->OperationName().c_str());
+
+    network->m_nodeBackpropDone = nodeBackpropDone;
+    try
+    {
+        Backprop(rootNode);
+    }
+    catch (...)
+    {
+        network->m_nodeBackpropDone = nullptr;
+        throw;
+    }
+    network->m_nodeBackpropDone = nullptr;
+}
+
 void ComputationNetwork::FormNestedNetwork(const ComputationNodeBasePtr& rootNode)
 {
     if (m_nestedNetworks.find(rootNode) != m_nestedNetworks.end())
@@ -169,6 +188,9 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
         // Extreme Tracing, part 2/4
         if (node->HasEnvironmentPtr() && node->Environment().ShouldDumpNode() && node->NeedsGradient())
             DumpNode<float>(node, /*dumpGradient=*/true) || DumpNode<double>(node, true);
+
+        if (m_nodeBackpropDone)
+            m_nodeBackpropDone(node);
     }
 }
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) /*override*/
@@ -49,7 +49,8 @@
 #define CNTK_MODEL_VERSION_17 17 // use 8 bytes for rng seeds on both platforms
 #define CNTK_MODEL_VERSION_18 18 // reserving 18 for dilated convolution, write out one more TensorShape 
 #define CNTK_MODEL_VERSION_19 19 // batch norm: add an input parameter to store running mean sample count.
-#define CURRENT_CNTK_MODEL_VERSION CNTK_MODEL_VERSION_19
+#define CNTK_MODEL_VERSION_20 20 // large parameter values in an aligned payload region (ParameterPayload.h)
+#define CURRENT_CNTK_MODEL_VERSION CNTK_MODEL_VERSION_20
 
 
 // helper mode for debugging
@@ -64,7 +65,8 @@ enum CopyNodeFlags // flags to be passed to the CopyTo() function
     copyNodeValue          = 1, // copy everything except for the input links
     copyNodeInputLinks     = 2, // copy over input links
     copyNodeAll            = 3, // copy everything
-    copyNodeAcrossNetworks = 4  // allow a cross network child copy
+    copyNodeAcrossNetworks = 4, // allow a cross network child copy
+    copyNodeValueShared    = 8  // with copyNodeValue: let the copy reference the same value matrix instead of cloning it
 };
 
 #pragma region base computation class
@@ -1210,7 +1212,9 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = DownCast(nodeP);
-            if (m_value)
+            if (m_value && (flags & CopyNodeFlags::copyNodeValueShared))
+                node->m_value = m_value;
+            else if (m_value)
             {
                 node->CreateValueMatrixIfNull();
                 node->m_value->SetValue(*m_value);
@@ -2239,6 +2243,25 @@ struct IRecurrentNode { virtual int GetRecurrenceSteppingDirection() const = 0;
 
 struct IFreezable { virtual void FreezeParameters() { } };
 
+// =======================================================================
+// IPayloadNode -- nodes whose value may be stored in the parameter payload region of a model file
+// The node itself serializes only whether its value is in the payload; ComputationNetwork writes and
+// resolves the payload values (see ParameterPayload.h).
+// =======================================================================
+
+class ParameterPayload;
+
+struct IPayloadNode
+{
+    // size of the value in bytes if it can be stored in the payload, otherwise 0
+    virtual size_t GetPayloadBytes() const = 0;
+    virtual void WritePayload(FILE* f) const = 0;
+    // after Load(): whether the value still has to be taken from the payload
+    virtual bool IsPayloadPending() const = 0;
+    // take the value from the payload; with 'useInPlace', the value matrix references the (CPU) mapping directly
+    virtual void LoadPayload(const std::shared_ptr<ParameterPayload>& payload, uint64_t offset, uint64_t numBytes, bool useInPlace) = 0;
+};
+
 // =======================================================================
 // PreComputedNodeBase -- interface implemented by ComputationNodes that precompute
 // TODO: We can use this interface in more places.
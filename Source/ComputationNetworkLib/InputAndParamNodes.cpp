@@ -8,6 +8,7 @@
 #include "File.h"        // for LoadMatrixFromTextFile()
 #include "TensorShape.h" // for SmallVector<>
 #include "Globals.h"     // for ShouldForceConstantRandomSeed()
+#include "ParameterPayload.h"
 
 #include <string>
 
@@ -418,7 +419,13 @@ void LearnableParameter<ElemType>::Save(File& fstream) const /*override*/
     Base::Save(fstream);
     fstream << m_learningRateMultiplier;
     m_sampleLayout.Save(fstream);
-    fstream << Value();
+    // large values are written by ComputationNetwork into the payload region; only their dimensions go here
+    bool valueInPayload = ParameterPayload::IsStoredInPayload(GetPayloadBytes(), fstream);
+    fstream << valueInPayload;
+    if (valueInPayload)
+        fstream << Value().GetNumRows() << Value().GetNumCols();
+    else
+        fstream << Value();
 }
 
 template <class ElemType>
@@ -451,11 +458,70 @@ void LearnableParameter<ElemType>::Load(File& fstream, size_t modelVersion) /*ov
         }
     }
 
+    m_initString.clear(); // deferred initialization not possible after loading
+
+    bool valueInPayload = false;
+    if (modelVersion >= CNTK_MODEL_VERSION_20)
+        fstream >> valueInPayload;
+    if (valueInPayload) // ComputationNetwork calls LoadPayload() once the node list has been read
+    {
+        fstream >> m_payloadNumRows >> m_payloadNumCols;
+        CreateMatrixIfNull(m_value);
+        SetDims(sampleLayout, false);
+        m_isPayloadPending = true;
+        return;
+    }
+
     LoadValue(fstream);
     SetDims(sampleLayout, false); // note: call this after LoadValue() since LoadValue() overwrites m_sampleLayout
     VerifyDataSize(Value());      // sanity check
+}
 
-    m_initString.clear(); // deferred initialization not possible after loading
+template <class ElemType>
+/*virtual*/ size_t LearnableParameter<ElemType>::GetPayloadBytes() const /*override*/
+{
+    if (!m_value || Value().GetMatrixType() != MatrixType::DENSE)
+        return 0;
+    return Value().GetNumElements() * sizeof(ElemType);
+}
+
+template <class ElemType>
+/*virtual*/ void LearnableParameter<ElemType>::WritePayload(FILE* f) const /*override*/
+{
+    const auto& value = Value();
+    if (value.GetDeviceId() < 0)
+        fwriteOrDie(value.Data(), sizeof(ElemType), value.GetNumElements(), f);
+    else
+    {
+        vector<ElemType> buffer(value.GetNumElements());
+        ElemType* data = buffer.data();
+        size_t size = buffer.size();
+        value.CopyToArray(data, size);
+        fwriteOrDie(buffer.data(), sizeof(ElemType), buffer.size(), f);
+    }
+}
+
+template <class ElemType>
+/*virtual*/ void LearnableParameter<ElemType>::LoadPayload(const shared_ptr<ParameterPayload>& payload, uint64_t offset, uint64_t numBytes, bool useInPlace) /*override*/
+{
+    if (!m_isPayloadPending)
+        LogicError("%ls: LoadPayload() called for a value that is not stored in the payload region.", NodeDescription().c_str());
+    if (numBytes != m_payloadNumRows * m_payloadNumCols * sizeof(ElemType))
+        RuntimeError("%ls: Payload value has %d bytes, expected [%d x %d] elements of %d bytes.", NodeDescription().c_str(),
+                     (int)numBytes, (int)m_payloadNumRows, (int)m_payloadNumCols, (int)sizeof(ElemType));
+
+    ElemType* data = (ElemType*)payload->Data(offset, numBytes);
+    if (useInPlace)
+    {
+        if (m_deviceId != CPUDEVICE)
+            LogicError("%ls: Payload values can only be used in place on the CPU.", NodeDescription().c_str());
+        Value().SetValue(m_payloadNumRows, m_payloadNumCols, CPUDEVICE, data, matrixFlagDontOwnBuffer);
+        m_payload = payload;
+    }
+    else // (if the value referenced an earlier mapping in place, it still does, so m_payload is kept)
+        Value().SetValue(m_payloadNumRows, m_payloadNumCols, m_deviceId, data, matrixFlagNormal);
+    m_isPayloadPending = false;
+    VerifyDataSize(Value());
 }
 
 template <class ElemType>
@@ -472,6 +538,7 @@ template <class ElemType>
         node->m_initOutputRank = m_initOutputRank;
         node->m_initOnCPUOnly  = m_initOnCPUOnly;
         node->m_initValue      = m_initValue;
+        node->m_payload        = m_payload; // the copy's value may reference the same mapping
     }
 }
 
@@ -33,7 +33,7 @@ static const wchar_t* BilinearInitializerTypeName =         L"bilinear";
 // -----------------------------------------------------------------------
 
 template <class ElemType>
-class LearnableParameter : public ComputationNode<ElemType>, public NumInputs<0>, public IFreezable, public TransformerNode
+class LearnableParameter : public ComputationNode<ElemType>, public NumInputs<0>, public IFreezable, public TransformerNode, public IPayloadNode
 {
     typedef ComputationNode<ElemType> Base; UsingComputationNodeMembersBoilerplate;
     static const std::wstring TypeName() { return L"LearnableParameter"; }
@@ -50,6 +50,7 @@ public:
         m_initString = L"fromValue"; // default init is with 0; typically overwritten
         m_initValue = 0;
         m_regMultiplier = 1.0f; // enable reg in update by default
+        m_isPayloadPending = false;
     }
     LearnableParameter(DEVICEID_TYPE deviceId, const wstring& name, const TensorShape& shape) :
         LearnableParameter(deviceId, name)
@@ -127,6 +128,12 @@ public:
 
     virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override;
 
+    // values of large parameters live in the payload region of the model file (see ParameterPayload.h)
+    virtual size_t GetPayloadBytes() const override;
+    virtual void WritePayload(FILE* f) const override;
+    virtual bool IsPayloadPending() const override { return m_isPayloadPending; }
+    virtual void LoadPayload(const std::shared_ptr<ParameterPayload>& payload, uint64_t offset, uint64_t numBytes, bool useInPlace) override;
+
     // computation functions don't do anything for parameter nodes
     virtual void UpdateFunctionMBSize() override;
     virtual void /*ComputationNode::*/ ForwardProp(const FrameRange&) override;
@@ -176,6 +183,11 @@ private:
 
     // flags related to gradient update
     float m_regMultiplier; // The multiplier to adjust the L1Reg and L2Reg for Learnable node
+
+    // value stored in the payload region of the model file
+    bool m_isPayloadPending;                  // Load() has read the dimensions below, but not yet the value
+    size_t m_payloadNumRows, m_payloadNumCols;
+    std::shared_ptr<ParameterPayload> m_payload; // keeps the mapping alive while the value references it in place
 };
 
 // -----------------------------------------------------------------------
@@ -0,0 +1,107 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// ParameterPayload.cpp -- memory mapping of the parameter payload region of model files
+//
+
+#define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
+
+#include "Basics.h"
+#include "ParameterPayload.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+ParameterPayload::ParameterPayload(const wstring& fileName, uint64_t begin, uint64_t end) :
+    m_fileName(fileName), m_begin(begin), m_end(end), m_data(nullptr)
+{
+    if (begin % Alignment != 0 || end < begin)
+        LogicError("ParameterPayload: Invalid payload region [%llu, %llu).", (unsigned long long)begin, (unsigned long long)end);
+#ifdef _WIN32
+    m_file = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_file == INVALID_HANDLE_VALUE)
+        RuntimeError("ParameterPayload: Unable to open file %ls, error %x", fileName.c_str(), GetLastError());
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_file, &fileSize) || (uint64_t)fileSize.QuadPart < end)
+    {
+        CloseHandle(m_file);
+        RuntimeError("ParameterPayload: File %ls is truncated, expected at least %llu bytes.", fileName.c_str(), (unsigned long long)end);
+    }
+    m_mapping = CreateFileMappingW(m_file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if (m_mapping)
+        m_data = (char*)MapViewOfFile(m_mapping, FILE_MAP_COPY, 0, 0, (SIZE_T)end);
+    if (!m_data)
+    {
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        CloseHandle(m_file);
+        RuntimeError("ParameterPayload: Could not memory map file %ls, error %x", fileName.c_str(), GetLastError());
+    }
+#else
+    m_file = open(msra::strfun::utf8(fileName).c_str(), O_RDONLY);
+    if (m_file == -1)
+        RuntimeError("ParameterPayload: Unable to open file %ls", fileName.c_str());
+    struct stat sb;
+    if (fstat(m_file, &sb) == -1 || (uint64_t)sb.st_size < end)
+    {
+        close(m_file);
+        RuntimeError("ParameterPayload: File %ls is truncated, expected at least %llu bytes.", fileName.c_str(), (unsigned long long)end);
+    }
+    void* data = end > 0 ? mmap(nullptr, (size_t)end, PROT_READ | PROT_WRITE, MAP_PRIVATE, m_file, 0) : nullptr;
+    if (data == MAP_FAILED)
+    {
+        close(m_file);
+        RuntimeError("ParameterPayload: Could not memory map file %ls", fileName.c_str());
+    }
+    m_data = (char*)data;
+#endif
+}
+
+ParameterPayload::~ParameterPayload()
+{
+    if (m_prefetchThread.joinable())
+        m_prefetchThread.join();
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mapping);
+    CloseHandle(m_file);
+#else
+    if (m_data)
+        munmap(m_data, (size_t)m_end);
+    close(m_file);
+#endif
+}
+
+char* ParameterPayload::Data(uint64_t offset, uint64_t numBytes) const
+{
+    if (m_begin + offset + numBytes > m_end)
+        RuntimeError("ParameterPayload: Value at offset %llu (%llu bytes) lies outside of the payload region of %ls.",
+                     (unsigned long long)offset, (unsigned long long)numBytes, m_fileName.c_str());
+    return m_data + m_begin + offset;
+}
+
+void ParameterPayload::StartPrefetch()
+{
+    if (m_prefetchThread.joinable() || m_end == m_begin)
+        return;
+#ifndef _WIN32
+    madvise(m_data + m_begin, (size_t)(m_end - m_begin), MADV_WILLNEED);
+#endif
+    // touching every page makes sure they are resident even where the advice above is not followed
+    m_prefetchThread = thread([this]()
+    {
+        volatile char sink = 0;
+        for (uint64_t pos = m_begin; pos < m_end; pos += Alignment)
+            sink += m_data[pos];
+    });
+}
+
+}}}
@@ -0,0 +1,71 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// ParameterPayload.h -- aligned region for large parameter values in model files
+//
+// Starting with CNTK_MODEL_VERSION_20, the values of large parameters are not serialized inline with their
+// node, but into a separate region that follows the version header of the model file. Each value starts at a
+// page-aligned offset, so that the loader can memory-map the region and use CPU values in place. The mapping is
+// copy-on-write, so all processes that load the same model share its pages until one of them modifies a value.
+// For other devices, the values are copied from the mapping after the node list has been parsed, while a
+// background thread pages the region in concurrently with parsing.
+//
+// File layout:
+//   BPayload <numEntries> { <nodeName> <offset> <numBytes> }* <payloadSize> EPayload
+//   <zero padding up to the next multiple of Alignment = payload begin>
+//   <values, each at payload begin + offset>
+//   <node list etc., starting at payload begin + payloadSize>
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "File.h"
+#include <string>
+#include <thread>
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+class ParameterPayload
+{
+public:
+    static const size_t Alignment = 4096;      // values start at multiples of this (file offsets)
+    static const size_t MinBytes = 64 * 1024;  // smaller values are serialized inline with their node
+
+    static uint64_t AlignUp(uint64_t pos) { return (pos + Alignment - 1) / Alignment * Alignment; }
+
+    // whether a value of the given size is stored in the payload region (0 = cannot be stored there)
+    static bool IsStoredInPayload(size_t numBytes, File& fstream) { return numBytes >= MinBytes && !fstream.IsTextBased(); }
+
+    // map the model file; the payload region is [begin, end) in file offsets
+    ParameterPayload(const std::wstring& fileName, uint64_t begin, uint64_t end);
+    ~ParameterPayload();
+
+    // pointer to a value inside the mapping (offset relative to the payload begin)
+    // The mapping is writable copy-on-write, so that values may be used in place by nodes that update them.
+    char* Data(uint64_t offset, uint64_t numBytes) const;
+
+    // page in the whole region on a background thread
+    void StartPrefetch();
+
+private:
+    std::wstring m_fileName;
+    uint64_t m_begin;
+    uint64_t m_end;
+    char* m_data;      // mapping of the file from offset 0 to m_end
+    std::thread m_prefetchThread;
+#ifdef _WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#else
+    int m_file;
+#endif
+
+    DISABLE_COPY_AND_MOVE(ParameterPayload);
+};
+
+}}}
@@ -494,6 +494,106 @@ template<class ElemType, int direction>
         LogicError("Unrecognized direction in DelayedValueNodeBase");
 }
 
+// set up m_delayedValue and m_delayedActivationMBLayout as if the previous minibatch had consisted of the given
+// histories, one per parallel sequence, so that sequences of the next minibatch that start before it (tBegin < 0)
+// continue from them
+template<class ElemType, int direction>
+void DelayedValueNodeBase<ElemType, direction>::ImportStreamHistories(const std::vector<const std::vector<ElemType>*>& histories)
+{
+    if (direction != -1)
+        LogicError("%ls %ls operation: Stream histories can only be carried across minibatches for past values.", NodeName().c_str(), OperationName().c_str());
+
+    let D = GetSampleLayout().GetNumElements();
+    let S = histories.size();
+    let T = (size_t)m_timeStep;
+    vector<ElemType> buffer(D * S * T, 0);
+    if (!m_delayedActivationMBLayout)
+        m_delayedActivationMBLayout = make_shared<MBLayout>();
+    m_delayedActivationMBLayout->Init(S, T);
+    for (size_t s = 0; s < S; s++)
+    {
+        if (!histories[s] || histories[s]->empty())
+        {
+            m_delayedActivationMBLayout->AddGap(s, 0, T);
+            continue;
+        }
+        if (histories[s]->size() != D * T)
+            LogicError("%ls %ls operation: Stream history has %d elements, expected %d.", NodeName().c_str(), OperationName().c_str(), (int)histories[s]->size(), (int)(D * T));
+        for (size_t t = 0; t < T; t++)
+            copy(histories[s]->begin() + t * D, histories[s]->begin() + (t + 1) * D, buffer.begin() + (t * S + s) * D);
+        m_delayedActivationMBLayout->AddSequence(s, s, 0, T + 1); // continues into the next minibatch
+    }
+    m_delayedValue->SetValue(D, S * T, m_deviceId, buffer.data(), matrixFlagNormal);
+}
+
+// after a minibatch: shift the input frames of parallel sequence s up to time endTimes[s] into histories[s]
+template<class ElemType, int direction>
+void DelayedValueNodeBase<ElemType, direction>::ExportStreamHistories(const std::vector<size_t>& endTimes, const std::vector<std::vector<ElemType>*>& histories) const
+{
+    if (!m_delayedActivationMBLayout)
+        LogicError("%ls %ls operation: No minibatch to export stream histories from.", NodeName().c_str(), OperationName().c_str());
+
+    let D = GetSampleLayout().GetNumElements();
+    let S = m_delayedActivationMBLayout->GetNumParallelSequences();
+    let T = (size_t)m_timeStep;
+    if (endTimes.size() != S || histories.size() != S)
+        LogicError("%ls %ls operation: Expected stream histories for %d parallel sequences.", NodeName().c_str(), OperationName().c_str(), (int)S);
+
+    vector<ElemType> value(m_delayedValue->GetNumElements());
+    ElemType* data = value.data();
+    size_t size = value.size();
+    m_delayedValue->CopyToArray(data, size);
+
+    for (size_t s = 0; s < S; s++)
+    {
+        auto& history = *histories[s];
+        history.resize(D * T, 0);
+        let numNew = min(endTimes[s], T); // frames of this minibatch that go into the history
+        copy(history.begin() + numNew * D, history.end(), history.begin());
+        for (size_t j = 0; j < numNew; j++)
+        {
+            let t = endTimes[s] - numNew + j;
+            copy(value.begin() + (t * S + s) * D, value.begin() + (t * S + s + 1) * D, history.begin() + (T - numNew + j) * D);
+        }
+    }
+}
+
+// after a minibatch: replace the delayed values of each parallel sequence s by those of sourceSequences[s]
+// The MBLayout is kept, so all parallel sequences must be in the same position of their stream (as is the case for beam hypotheses).
+// The columns are gathered on the device, so this does not copy the state to the CPU.
+template<class ElemType, int direction>
+void DelayedValueNodeBase<ElemType, direction>::ReorderStreamHistories(const std::vector<size_t>& sourceSequences)
+{
+    if (!m_delayedActivationMBLayout)
+        LogicError("%ls %ls operation: No minibatch to reorder stream histories of.", NodeName().c_str(), OperationName().c_str());
+
+    let S = m_delayedActivationMBLayout->GetNumParallelSequences();
+    let T = m_delayedActivationMBLayout->GetNumTimeSteps();
+    if (sourceSequences.size() != S)
+        LogicError("%ls %ls operation: Expected source indices for %d parallel sequences.", NodeName().c_str(), OperationName().c_str(), (int)S);
+
+    vector<ElemType> columnMap(T * S);
+    for (size_t t = 0; t < T; t++)
+    {
+        for (size_t s = 0; s < S; s++)
+        {
+            if (sourceSequences[s] >= S)
+                LogicError("%ls %ls operation: Source parallel sequence index %d out of range.", NodeName().c_str(), OperationName().c_str(), (int)sourceSequences[s]);
+            columnMap[t * S + s] = (ElemType)(t * S + sourceSequences[s]);
+        }
+    }
+    Matrix<ElemType> idx(1, T * S, columnMap.data(), m_deviceId);
+    auto reordered = make_shared<Matrix<ElemType>>(m_delayedValue->GetNumRows(), T * S, m_deviceId);
+    reordered->DoGatherColumnsOf(0, idx, *m_delayedValue, 1);
+    m_delayedValue = reordered;
+}
+
+// instantiate the base classes as well, since their non-virtual members are not instantiated with the derived classes
+template class DelayedValueNodeBase<float, -1>;
+template class DelayedValueNodeBase<double, -1>;
+template class DelayedValueNodeBase<float, +1>;
+template class DelayedValueNodeBase<double, +1>;
+
 // instantiate the classes that derive from the above
 template class PastValueNode<float>;
 template class PastValueNode<double>;
@@ -74,6 +74,14 @@ public:
     virtual NodeStatePtr /*IStatefulNode::*/ ExportState() override;
     virtual void /*IStatefulNode::*/ ImportState(const NodeStatePtr& pImportedState) override;
     int TimeStep() const { return m_timeStep; }
+
+    // streaming: carry the delay history of individual parallel sequences from one minibatch into another
+    // A history holds the last TimeStep() input frames of a stream, oldest first. Empty histories denote parallel
+    // sequences that do not continue a stream.
+    void ImportStreamHistories(const std::vector<const std::vector<ElemType>*>& histories);
+    void ExportStreamHistories(const std::vector<size_t>& endTimes, const std::vector<std::vector<ElemType>*>& histories) const;
+    // beam search: after a minibatch, let parallel sequence s continue from the history of parallel sequence sourceSequences[s]
+    void ReorderStreamHistories(const std::vector<size_t>& sourceSequences);
     ElemType InitialActivationValue() const { return m_initialStateValue; }
 
 protected:
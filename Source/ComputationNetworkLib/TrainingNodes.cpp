@@ -5,6 +5,8 @@
 
 #include "TrainingNodes.h"
 #include <boost/random/uniform_real_distribution.hpp>
+#include <algorithm>
+#include <limits>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -150,12 +152,12 @@ void RandomSampleNode<ElemType>::ForwardPropNonLooping()
     valueMatrix.Reset();
 
     // Get vector with indices of randomly sampled classes
-    const std::vector<size_t> samples = GetWeightedSamples();
+    m_samples = GetWeightedSamples();
 
     // Set columns of (sparse) result matrix as indicator vectors
     for (size_t i = 0; i < Base::m_sizeOfSampledSet; i++)
     {
-        int sample = samples[i];
+        int sample = m_samples[i];
         valueMatrix.SetValue(sample, i, 1);
     }
 }
@@ -264,6 +266,283 @@ void RandomSampleInclusionFrequencyNode<ElemType>::Validate(bool isFinalValidati
 template class RandomSampleInclusionFrequencyNode<float>;
 template class RandomSampleInclusionFrequencyNode<double>;
 
+template<class ElemType>
+void SampledCrossEntropyWithSoftmaxNode<ElemType>::Validate(bool isFinalValidationPass)
+{
+    Base::Validate(isFinalValidationPass);
+    m_pMBLayout = nullptr; // this node does not hold mini-batch data
+
+    let numClasses = Input(0)->GetSampleLayout().GetNumElements();
+    let hiddenDim = Input(1)->GetSampleLayout().GetNumElements();
+    Input(2)->ValidateInferInputDimsFrom(TensorShape(hiddenDim, numClasses));
+    Input(3)->ValidateInferInputDimsFrom(TensorShape(numClasses));
+
+    if (isFinalValidationPass)
+    {
+        if (!Input(0)->HasMBLayout() || !Input(1)->HasMBLayout())
+            InvalidArgument("%ls: The labels and the hidden activations must have a dynamic axis.", NodeDescription().c_str());
+        if (Input(2)->HasMBLayout() || Input(3)->HasMBLayout() || Input(5)->HasMBLayout())
+            InvalidArgument("%ls: The weights, the bias and the inclusion frequencies must not have a dynamic axis.", NodeDescription().c_str());
+        if (Input(2)->GetAsMatrixNumRows() != hiddenDim || Input(2)->GetAsMatrixNumCols() != numClasses)
+            InvalidArgument("%ls: The weights must have the shape [%d x %d] (hidden dimension x number of classes).", NodeDescription().c_str(), (int)hiddenDim, (int)numClasses);
+        if (Input(3)->GetSampleLayout().GetNumElements() != numClasses || Input(5)->GetSampleLayout().GetNumElements() != numClasses)
+            InvalidArgument("%ls: The bias and the inclusion frequencies must have one value per class (%d).", NodeDescription().c_str(), (int)numClasses);
+        if (!dynamic_pointer_cast<RandomSampleNode<ElemType>>(Input(4)))
+            InvalidArgument("%ls: The samples must be the output of a RandomSample node.", NodeDescription().c_str());
+        if (Input(4)->GetAsMatrixNumRows() != numClasses)
+            InvalidArgument("%ls: The samples are drawn from %d classes, but the labels have %d classes.", NodeDescription().c_str(), (int)Input(4)->GetAsMatrixNumRows(), (int)numClasses);
+        // class ids are passed to the gather operations as ElemType
+        if (numClasses > ((size_t)1 << std::numeric_limits<ElemType>::digits))
+            InvalidArgument("%ls: %d classes are too many to be indexed with this precision.", NodeDescription().c_str(), (int)numClasses);
+    }
+
+    SetDims(TensorShape(1), false);
+}
+
+template<class ElemType>
+void SampledCrossEntropyWithSoftmaxNode<ElemType>::RequestMatricesBeforeForwardProp(MatrixPool& matrixPool)
+{
+    Base::RequestMatricesBeforeForwardProp(matrixPool);
+    for (auto matrixPtr : { &m_classIds, &m_labelIndex, &m_sampleIndex, &m_labelWeights, &m_sampleWeights, &m_labelBias, &m_sampleBias,
+                            &m_labelLogits, &m_logSoftmax, &m_labelGradient, &m_sampleGradient, &m_temp })
+        CreateMatrixIfNull(*matrixPtr);
+    for (auto matrixPtr : { &m_labelIndicator, &m_sampleIndicator, &m_accidentalHits })
+    {
+        if (!*matrixPtr)
+            *matrixPtr = std::make_shared<Matrix<ElemType>>(0, 0, m_deviceId, SPARSE, matrixFormatSparseCSC);
+    }
+}
+
+template<class ElemType>
+void SampledCrossEntropyWithSoftmaxNode<ElemType>::AllocateGradientMatricesForInputs(MatrixPool& matrixPool)
+{
+    // The gradient of the weights only has columns for the sampled classes and the labels, so it is allocated as a sparse block-column
+    // matrix directly instead of from the pool (like the gradient of the left operand of TimesNode for a sparse right operand).
+    if (Input(2)->NeedsGradient())
+        InputRef(2).GradientPtrRef() = std::make_shared<Matrix<ElemType>>(0, 0, m_deviceId, SPARSE, matrixFormatSparseBlockCol);
+
+    Base::AllocateGradientMatricesForInputs(matrixPool);
+}
+
+template<class ElemType>
+/*static*/ void SampledCrossEntropyWithSoftmaxNode<ElemType>::GatherColumns(Matrix<ElemType>& result, const Matrix<ElemType>& index, const Matrix<ElemType>& a)
+{
+    result.Resize(a.GetNumRows(), index.GetNumCols());
+    result.SetValue(0); // DoGatherColumnsOf() leaves the columns of negative indices untouched
+    result.DoGatherColumnsOf(1, index, a, 1);
+}
+
+template<class ElemType>
+void SampledCrossEntropyWithSoftmaxNode<ElemType>::UpdateClassIndices(const FrameRange& fr)
+{
+    let numClasses = InputRef(0).GetSampleLayout().GetNumElements();
+    if (m_classIds->GetNumCols() != numClasses)
+    {
+        m_labelIds.resize(numClasses);
+        for (size_t i = 0; i < numClasses; i++)
+            m_labelIds[i] = (ElemType)i;
+        m_classIds->SetValue(1, numClasses, m_deviceId, m_labelIds.data());
+    }
+
+    // The class id of each label is found as [0, 1, 2, ...] * labels, which works for dense and sparse labels on any device.
+    // Only this row of T values is copied to the CPU.
+    m_labelIndex->AssignProductOf(*m_classIds, false, InputRef(0).ValueFor(fr), false);
+    let numCols = m_labelIndex->GetNumCols();
+    m_labelIds.resize(numCols);
+    ElemType* labelIds = m_labelIds.data();
+    size_t labelIdsSize = m_labelIds.size();
+    m_labelIndex->CopyToArray(labelIds, labelIdsSize);
+
+    let& pMBLayout = InputRef(0).GetMBLayout();
+    if (pMBLayout->HasGaps())
+    {
+        let numSequences = pMBLayout->GetNumParallelSequences();
+        let numTimeSteps = pMBLayout->GetNumTimeSteps();
+        for (const auto& seq : pMBLayout->GetAllSequences())
+        {
+            if (seq.seqId != GAP_SEQUENCE_ID)
+                continue;
+            for (size_t t = (size_t)std::max(seq.tBegin, (ptrdiff_t)0); t < std::min(seq.tEnd, numTimeSteps); t++)
+                m_labelIds[t * numSequences + seq.s] = -1;
+        }
+    }
+
+    // labels as sparse one-hot matrix, gaps are empty columns
+    m_indicatorColumns.resize(numCols + 1);
+    m_indicatorRows.clear();
+    for (size_t j = 0; j < numCols; j++)
+    {
+        m_indicatorColumns[j] = (CPUSPARSE_INDEX_TYPE)m_indicatorRows.size();
+        if (m_labelIds[j] < 0)
+            continue;
+        let classId = (size_t)(m_labelIds[j] + (ElemType)0.5);
+        if (classId >= numClasses)
+            RuntimeError("%ls: The label of frame %d is not a one-hot vector.", NodeDescription().c_str(), (int)j);
+        m_labelIds[j] = (ElemType)classId;
+        m_indicatorRows.push_back((CPUSPARSE_INDEX_TYPE)classId);
+    }
+    m_indicatorColumns[numCols] = (CPUSPARSE_INDEX_TYPE)m_indicatorRows.size();
+    if (m_ones.size() < m_indicatorRows.size())
+        m_ones.resize(m_indicatorRows.size(), 1);
+    m_labelIndex->SetValue(1, numCols, m_deviceId, m_labelIds.data());
+    m_labelIndicator->SetMatrixFromCSCFormat(m_indicatorColumns.data(), m_indicatorRows.data(), m_ones.data(), m_indicatorRows.size(), numClasses, numCols);
+
+    // the samples, shared by all frames
+    let& samples = Input(4)->template As<RandomSampleNode<ElemType>>()->GetSamples();
+    let numSamples = samples.size();
+    m_sampleIds.resize(numSamples);
+    m_sortedSamples.resize(numSamples);
+    m_indicatorColumns.resize(numSamples + 1);
+    m_indicatorRows.resize(numSamples);
+    for (size_t k = 0; k < numSamples; k++)
+    {
+        m_sampleIds[k] = (ElemType)samples[k];
+        m_sortedSamples[k] = std::make_pair(samples[k], k);
+        m_indicatorColumns[k] = (CPUSPARSE_INDEX_TYPE)k;
+        m_indicatorRows[k] = (CPUSPARSE_INDEX_TYPE)samples[k];
+    }
+    m_indicatorColumns[numSamples] = (CPUSPARSE_INDEX_TYPE)numSamples;
+    if (m_ones.size() < numSamples)
+        m_ones.resize(numSamples, 1);
+    m_sampleIndex->SetValue(1, numSamples, m_deviceId, m_sampleIds.data());
+    m_sampleIndicator->SetMatrixFromCSCFormat(m_indicatorColumns.data(), m_indicatorRows.data(), m_ones.data(), numSamples, numClasses, numSamples);
+
+    // accidental hits: a 1 in row 1 + k of column j if sample k is the label of frame j
+    std::sort(m_sortedSamples.begin(), m_sortedSamples.end());
+    m_indicatorColumns.resize(numCols + 1);
+    m_indicatorRows.clear();
+    for (size_t j = 0; j < numCols; j++)
+    {
+        m_indicatorColumns[j] = (CPUSPARSE_INDEX_TYPE)m_indicatorRows.size();
+        if (m_labelIds[j] < 0)
+            continue;
+        let classId = (size_t)m_labelIds[j];
+        for (auto iter = std::lower_bound(m_sortedSamples.begin(), m_sortedSamples.end(), std::make_pair(classId, (size_t)0)); iter != m_sortedSamples.end() && iter->first == classId; ++iter)
+            m_indicatorRows.push_back((CPUSPARSE_INDEX_TYPE)(1 + iter->second));
+    }
+    m_indicatorColumns[numCols] = (CPUSPARSE_INDEX_TYPE)m_indicatorRows.size();
+    m_hasAccidentalHits = !m_indicatorRows.empty();
+    if (m_hasAccidentalHits)
+    {
+        if (m_ones.size() < m_indicatorRows.size())
+            m_ones.resize(m_indicatorRows.size(), 1);
+        m_accidentalHits->SetMatrixFromCSCFormat(m_indicatorColumns.data(), m_indicatorRows.data(), m_ones.data(), m_indicatorRows.size(), 1 + numSamples, numCols);
+    }
+}
+
+template<class ElemType>
+void SampledCrossEntropyWithSoftmaxNode<ElemType>::ForwardPropNonLooping()
+{
+    FrameRange fr(InputRef(0).GetMBLayout());
+    UpdateClassIndices(fr);
+
+    let hidden = InputRef(1).ValueFor(fr);
+    let& weights = InputRef(2).ValueAsMatrix();
+    let numClasses = weights.GetNumCols();
+    let numSamples = m_sampleIndex->GetNumCols();
+    let numCols = m_labelIndex->GetNumCols();
+    if (hidden.GetNumCols() != numCols)
+        InvalidArgument("%ls: The labels have %d frames but the hidden activations have %d.", NodeDescription().c_str(), (int)numCols, (int)hidden.GetNumCols());
+
+    GatherColumns(*m_sampleWeights, *m_sampleIndex, weights);
+    GatherColumns(*m_labelWeights, *m_labelIndex, weights);
+
+    // bias - log(inclusionFrequency); the [numClasses x 1] vectors are gathered as [1 x numClasses] rows
+    let bias = InputRef(3).ValueAsMatrix().Reshaped(1, numClasses);
+    let inclusionFrequency = InputRef(5).ValueAsMatrix().Reshaped(1, numClasses);
+    for (let& biasAndIndex : { std::make_pair(m_sampleBias, m_sampleIndex), std::make_pair(m_labelBias, m_labelIndex) })
+    {
+        GatherColumns(*m_temp, *biasAndIndex.second, inclusionFrequency);
+        m_temp->InplaceTruncateBottom(std::numeric_limits<ElemType>::min()); // gaps, and labels that are never sampled
+        m_temp->InplaceLog();
+        GatherColumns(*biasAndIndex.first, *biasAndIndex.second, bias);
+        *biasAndIndex.first -= *m_temp;
+    }
+
+    // logits: row 0 is the label of the frame, rows 1..numSamples are the samples
+    m_logSoftmax->Resize(1 + numSamples, numCols);
+    m_temp->AssignProductOf(*m_sampleWeights, true, hidden, false);
+    Matrix<ElemType>::ScaleAndAdd(1, m_sampleBias->Reshaped(numSamples, 1), *m_temp);
+    m_logSoftmax->AssignToRowSliceValuesOf(*m_temp, 1, numSamples);
+    m_temp->AssignElementProductOf(*m_labelWeights, hidden);
+    Matrix<ElemType>::VectorSum(*m_temp, *m_labelLogits, /*isColWise=*/true);
+    *m_labelLogits += *m_labelBias;
+    m_logSoftmax->AssignToRowSliceValuesOf(*m_labelLogits, 0, 1);
+
+    // remove the samples that are the label of a frame from the softmax of that frame
+    if (m_hasAccidentalHits)
+        Matrix<ElemType>::ScaleAndAdd((ElemType)-1e30, *m_accidentalHits, *m_logSoftmax);
+
+    m_logSoftmax->InplaceLogSoftmax(/*isColWise=*/true);
+    MaskMissingColumnsToZero(*m_logSoftmax, InputRef(0).GetMBLayout(), fr);
+    m_labelLogits->AssignRowSliceValuesOf(*m_logSoftmax, 0, 1);
+    Value().VerifySize(1, 1);
+    Value().AssignSumOfElements(*m_labelLogits);
+    Value() *= -1;
+    m_needRecomputeGradientToLogits = true;
+#if NANCHECK
+    Value().HasNan("SampledCrossEntropyWithSoftmax");
+#endif
+}
+
+template<class ElemType>
+void SampledCrossEntropyWithSoftmaxNode<ElemType>::ComputeGradientToLogits(const FrameRange& fr)
+{
+    // gradient of -log softmax_0(z) is softmax(z) - [1, 0, 0, ...]; m_logSoftmax is not needed afterwards
+    let numSamples = m_logSoftmax->GetNumRows() - 1;
+    m_logSoftmax->InplaceExp();
+    m_labelGradient->AssignRowSliceValuesOf(*m_logSoftmax, 0, 1);
+    *m_labelGradient -= 1;
+    m_sampleGradient->AssignRowSliceValuesOf(*m_logSoftmax, 1, numSamples);
+    MaskMissingColumnsToZero(*m_labelGradient, InputRef(0).GetMBLayout(), fr);
+    MaskMissingColumnsToZero(*m_sampleGradient, InputRef(0).GetMBLayout(), fr);
+
+    let criterionGradient = Gradient().Get00Element();
+    *m_labelGradient *= criterionGradient;
+    *m_sampleGradient *= criterionGradient;
+    m_needRecomputeGradientToLogits = false;
+}
+
+template<class ElemType>
+void SampledCrossEntropyWithSoftmaxNode<ElemType>::BackpropToNonLooping(size_t inputIndex)
+{
+    if (inputIndex == 0 || inputIndex > 3)
+        InvalidArgument("%ls: No gradient can be computed for the labels, the samples or the inclusion frequencies.", NodeDescription().c_str());
+
+    FrameRange fr(InputRef(0).GetMBLayout());
+    if (m_needRecomputeGradientToLogits)
+        ComputeGradientToLogits(fr);
+
+    if (inputIndex == 1) // hidden activations
+    {
+        auto gradient = InputRef(1).GradientFor(fr);
+        Matrix<ElemType>::MultiplyAndAdd(*m_sampleWeights, false, *m_sampleGradient, false, gradient);
+        m_temp->SetValue(*m_labelWeights);
+        m_temp->RowElementMultiplyWith(*m_labelGradient);
+        gradient += *m_temp;
+    }
+    else if (inputIndex == 2) // weights: only the columns of the samples and the labels are touched
+    {
+        auto& gradient = InputRef(2).GradientAsMatrix();
+        let hidden = InputRef(1).MaskedValueFor(fr);
+        m_temp->AssignProductOf(hidden, false, *m_sampleGradient, true);
+        Matrix<ElemType>::MultiplyAndAdd(*m_temp, false, *m_sampleIndicator, true, gradient);
+        m_temp->SetValue(hidden);
+        m_temp->RowElementMultiplyWith(*m_labelGradient);
+        Matrix<ElemType>::MultiplyAndAdd(*m_temp, false, *m_labelIndicator, true, gradient);
+    }
+    else // bias
+    {
+        auto& gradient = InputRef(3).GradientAsMatrix();
+        Matrix<ElemType>::VectorSum(*m_sampleGradient, *m_temp, /*isColWise=*/false);
+        Matrix<ElemType>::MultiplyAndAdd(*m_sampleIndicator, false, *m_temp, false, gradient);
+        Matrix<ElemType>::MultiplyAndAdd(*m_labelIndicator, false, m_labelGradient->Reshaped(m_labelGradient->GetNumCols(), 1), false, gradient);
+    }
+}
+
+template class SampledCrossEntropyWithSoftmaxNode<float>;
+template class SampledCrossEntropyWithSoftmaxNode<double>;
+
 template<class ElemType>
 void DropoutNode<ElemType>::Save(File& fstream) const
 {
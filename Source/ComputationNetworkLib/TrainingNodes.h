@@ -1319,6 +1319,12 @@ public:
     const std::vector<size_t> GetWeightedSamples();
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override;
     virtual bool IsOutOfDateWrtInputs() const override;
+
+    // The class ids of the samples drawn by the last ForwardProp(), in the order of the columns of the value.
+    const std::vector<size_t>& GetSamples() const { return m_samples; }
+
+private:
+    std::vector<size_t> m_samples;
 };
 
 // ------------------------------------------------------------------------------------------------------------------------------------------------
@@ -1360,6 +1366,83 @@ private:
     double EstimateNumberOfTries();
 };
 
+// ------------------------------------------------------------------------------------------------------------------------------------------------
+// SampledCrossEntropyWithSoftmaxNode(labels, hidden, weights, bias, samples, inclusionFrequency):
+// Training criterion that approximates CrossEntropyWithSoftmax(labels, TransposeTimes(weights, hidden) + bias) for very large numbers of classes
+// (sampled softmax). For each frame the softmax is taken only over its label and a set of classes that is sampled once per minibatch and shared by
+// all frames. The logits are corrected by the log of the expected number of occurrences of each class in the sampled set (logQ correction), and
+// sampled classes that happen to be the label of a frame are removed from the softmax of that frame. The value is the sum over all frames.
+//
+// Only the columns of 'weights' that belong to the sampled classes and the labels are read, and the gradient of 'weights' is a sparse
+// block-column matrix that contains only these columns, so the cost per frame grows with the number of samples, not with the number of classes.
+// For evaluation use the full softmax, e.g. CrossEntropyWithSoftmax(labels, TransposeTimes(weights, hidden) + bias).
+//
+// Parameters:
+// * Input(0): labels [numClasses x *], one-hot, dense or sparse.
+// * Input(1): hidden activations [hiddenDim x *].
+// * Input(2): output weights [hiddenDim x numClasses], one column per class.
+// * Input(3): output bias [numClasses].
+// * Input(4): the sampled classes, a RandomSampleNode over numClasses classes.
+// * Input(5): expected number of occurrences of each class in the sampled set [numClasses], normally a RandomSampleInclusionFrequencyNode
+//             with the same sampling weights and parameters as Input(4).
+// --------------------------------------------------------------------------------------------------------------------------------------------------
+template <class ElemType>
+class SampledCrossEntropyWithSoftmaxNode : public ComputationNodeNonLooping<ElemType>, public NumInputs<6>
+{
+    typedef ComputationNodeNonLooping<ElemType> Base; UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"SampledCrossEntropyWithSoftmax"; }
+
+public:
+    DeclareConstructorFromConfigWithNumInputs(SampledCrossEntropyWithSoftmaxNode);
+    SampledCrossEntropyWithSoftmaxNode(DEVICEID_TYPE deviceId, const wstring& name)
+        : Base(deviceId, name), m_hasAccidentalHits(false), m_needRecomputeGradientToLogits(false)
+    {
+    }
+
+    virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override;
+    virtual void /*ComputationNodeNonLooping::*/ BackpropToNonLooping(size_t inputIndex) override;
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override;
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+    virtual void AllocateGradientMatricesForInputs(MatrixPool& matrixPool) override;
+    virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override;
+
+protected:
+    // Determines the class ids of the labels and the samples and the accidental hits, and uploads them as index and indicator matrices.
+    void UpdateClassIndices(const FrameRange& fr);
+    void ComputeGradientToLogits(const FrameRange& fr);
+
+    // result[:, j] = a[:, index[j]], or 0 where index[j] is negative
+    static void GatherColumns(Matrix<ElemType>& result, const Matrix<ElemType>& index, const Matrix<ElemType>& a);
+
+    // These are not taken from the matrix pool: the indicator matrices are sparse and the others are small,
+    // [numSamples x T] or [hiddenDim x T] instead of [numClasses x T].
+    shared_ptr<Matrix<ElemType>> m_classIds;          // [1 x numClasses] 0, 1, 2, ..., maps one-hot labels to their class id
+    shared_ptr<Matrix<ElemType>> m_labelIndex;        // [1 x T] class id of the label of each frame, -1 for gaps
+    shared_ptr<Matrix<ElemType>> m_sampleIndex;       // [1 x numSamples] class id of each sample
+    shared_ptr<Matrix<ElemType>> m_labelIndicator;    // [numClasses x T] sparse one-hot labels, without gaps
+    shared_ptr<Matrix<ElemType>> m_sampleIndicator;   // [numClasses x numSamples] sparse one-hot samples
+    shared_ptr<Matrix<ElemType>> m_accidentalHits;    // [(1 + numSamples) x T] sparse, 1 where a sample is the label of the frame
+    shared_ptr<Matrix<ElemType>> m_labelWeights;      // [hiddenDim x T] weights of the label of each frame
+    shared_ptr<Matrix<ElemType>> m_sampleWeights;     // [hiddenDim x numSamples] weights of the samples
+    shared_ptr<Matrix<ElemType>> m_labelBias;         // [1 x T] bias - log(inclusionFrequency) of the label of each frame
+    shared_ptr<Matrix<ElemType>> m_sampleBias;        // [1 x numSamples] bias - log(inclusionFrequency) of each sample
+    shared_ptr<Matrix<ElemType>> m_labelLogits;       // [1 x T] logit of the label of each frame, then its log softmax
+    shared_ptr<Matrix<ElemType>> m_logSoftmax;        // [(1 + numSamples) x T] row 0 is the label, then the samples; the softmax after ComputeGradientToLogits()
+    shared_ptr<Matrix<ElemType>> m_labelGradient;     // [1 x T] gradient of the label logits
+    shared_ptr<Matrix<ElemType>> m_sampleGradient;    // [numSamples x T] gradient of the sample logits
+    shared_ptr<Matrix<ElemType>> m_temp;
+    bool m_hasAccidentalHits;
+    bool m_needRecomputeGradientToLogits;
+
+    // host-side buffers for UpdateClassIndices()
+    std::vector<ElemType> m_labelIds;
+    std::vector<ElemType> m_sampleIds;
+    std::vector<ElemType> m_ones;
+    std::vector<CPUSPARSE_INDEX_TYPE> m_indicatorColumns;
+    std::vector<CPUSPARSE_INDEX_TYPE> m_indicatorRows;
+    std::vector<std::pair<size_t, size_t>> m_sortedSamples; // (class id, sample index)
+};
+
 // -----------------------------------------------------------------------
 // ClassBasedCrossEntropyWithSoftmaxNode (labeldata(.,t), inputdata(.,t), embeddingMatrix, clsProbBeforeSoftmaxData(.,t))
 //  - Input(0) [4 x T] label in dense matrix in
@@ -409,6 +409,137 @@ void CNTKEvalExtended<ElemType>::ForwardPassT(const std::vector<ValueBuffer<Elem
     }
 }
 
+// matrix columns of the frames of a sequence that lie within the minibatch, in time order
+static vector<size_t> GetColumnsInMinibatch(const MBLayout& layout, const MBLayout::SequenceInfo& seq)
+{
+    vector<size_t> columns;
+    size_t tBegin = (size_t)max(seq.tBegin, (ptrdiff_t)0);
+    size_t tEnd = min(seq.tEnd, layout.GetNumTimeSteps());
+    for (size_t t = tBegin; t < tEnd; t++)
+        columns.push_back(t * layout.GetNumParallelSequences() + seq.s);
+    return columns;
+}
+
+template<typename ElemType>
+void CNTKEvalExtended<ElemType>::ForwardPassSequences(const std::vector<EvalSequence<ElemType>*>& sequences, bool packSequences)
+{
+    if (!m_started)
+        RuntimeError("ForwardPassSequences() called before StartForwardEvaluation()");
+    if (sequences.empty())
+        return;
+
+    vector<MBLayout::SequenceInfo> sequenceInfos(sequences.size());
+    vector<pair<size_t, size_t>> placement;
+    vector<size_t> rowAllocations;
+    vector<ElemType> packed;
+    // inputs may share an MBLayout; each layout is set up once, by the first input that uses it, and all
+    // other inputs on it must have sequences of the same lengths
+    map<const MBLayout*, pair<size_t, vector<size_t>>> initializedLayouts; // layout -> (first input, sequence lengths)
+    vector<size_t> sequenceLengths(sequences.size());
+    for (size_t i = 0; i < m_inputNodes.size(); ++i)
+    {
+        auto& inputNode = m_inputNodes[i];
+        auto matrix = dynamic_pointer_cast<Matrix<ElemType>>(inputNode->ValuePtr());
+        if (matrix->GetMatrixType() != MatrixType::DENSE)
+            RuntimeError("Input %ls: Only dense inputs can be evaluated in batches.", inputNode->GetName().c_str());
+        size_t numRows = inputNode->GetSampleLayout().GetNumElements();
+
+        for (size_t k = 0; k < sequences.size(); ++k)
+        {
+            if (sequences[k]->m_inputs.size() != m_inputNodes.size())
+                RuntimeError("Expected %d inputs, but got %d.", (int)m_inputNodes.size(), (int)sequences[k]->m_inputs.size());
+            const auto& input = sequences[k]->m_inputs[i];
+            if (input.first == nullptr)
+                RuntimeError("Input %ls: Buffer is not allocated.", inputNode->GetName().c_str());
+            if (input.second == 0 || input.second % numRows != 0)
+                RuntimeError("Input %ls: Expected input data to be a non-zero multiple of %" PRIu64 ", but it is %" PRIu64 ".",
+                             inputNode->GetName().c_str(), numRows, input.second);
+            if (packSequences && sequences[k]->m_numPastFrames > 0)
+                LogicError("ForwardPassSequences: Sequences that continue a stream cannot be packed.");
+            sequenceInfos[k] = { k, 0, 0, input.second / numRows };
+            sequenceLengths[k] = sequenceInfos[k].tEnd;
+        }
+
+        // place all sequences into parallel rows of this input's layout; gaps are zero
+        auto pMBLayout = inputNode->GetMBLayout();
+        auto initialized = initializedLayouts.find(pMBLayout.get());
+        if (initialized != initializedLayouts.end())
+        {
+            if (initialized->second.second != sequenceLengths)
+                RuntimeError("Inputs %ls and %ls share a dynamic axis, but their sequences have different lengths.",
+                             m_inputNodes[initialized->second.first]->GetName().c_str(), inputNode->GetName().c_str());
+        }
+        else if (packSequences)
+            pMBLayout->InitAsPackedSequences(sequenceInfos, placement, rowAllocations);
+        else
+        {
+            size_t numTimeSteps = 0;
+            for (const auto& seq : sequenceInfos)
+                numTimeSteps = max(numTimeSteps, seq.tEnd);
+            pMBLayout->Init(sequences.size(), numTimeSteps);
+            for (size_t k = 0; k < sequences.size(); ++k)
+            {
+                pMBLayout->AddSequence(k, k, -(ptrdiff_t)sequences[k]->m_numPastFrames, sequenceInfos[k].tEnd);
+                pMBLayout->AddGap(k, sequenceInfos[k].tEnd, numTimeSteps);
+            }
+        }
+        if (initialized == initializedLayouts.end())
+            initializedLayouts[pMBLayout.get()] = make_pair(i, sequenceLengths);
+        packed.assign(numRows * pMBLayout->GetNumCols(), 0);
+        for (const auto& seq : pMBLayout->GetAllSequences())
+        {
+            if (seq.seqId == GAP_SEQUENCE_ID)
+                continue;
+            const ElemType* data = sequences[seq.seqId]->m_inputs[i].first;
+            size_t t = 0;
+            for (auto col : GetColumnsInMinibatch(*pMBLayout, seq))
+                memcpy(&packed[col * numRows], data + numRows * t++, sizeof(ElemType) * numRows);
+        }
+        matrix->SetValue(numRows, pMBLayout->GetNumCols(), matrix->GetDeviceId(), packed.data(), matrixFlagNormal);
+    }
+
+    ComputationNetwork::BumpEvalTimeStamp(m_inputNodes);
+    this->m_net->ForwardProp(m_outputNodes);
+
+    for (auto& sequence : sequences)
+        sequence->m_outputs.resize(m_outputNodes.size());
+
+    for (size_t i = 0; i < m_outputNodes.size(); ++i)
+    {
+        auto node = m_outputNodes[i];
+        shared_ptr<Matrix<ElemType>> outputMatrix = dynamic_pointer_cast<Matrix<ElemType>>(node->ValuePtr());
+        size_t numRows = node->GetSampleLayout().GetNumElements();
+        size_t numElements = outputMatrix->GetNumElements();
+        packed.resize(numElements);
+        ElemType* data = packed.data();
+        outputMatrix->CopyToArray(data, numElements);
+
+        auto pMBLayout = node->GetMBLayout();
+        if (!pMBLayout) // output does not depend on the inputs' sequence axis: every sequence gets all of it
+        {
+            for (auto& sequence : sequences)
+                sequence->m_outputs[i] = packed;
+            continue;
+        }
+
+        vector<bool> found(sequences.size(), false);
+        for (const auto& seq : pMBLayout->GetAllSequences())
+        {
+            if (seq.seqId == GAP_SEQUENCE_ID)
+                continue;
+            if (seq.seqId >= sequences.size())
+                RuntimeError("Output %ls: Unexpected sequence id %" PRIu64 ".", node->GetName().c_str(), seq.seqId);
+            auto& output = sequences[seq.seqId]->m_outputs[i];
+            output.clear();
+            for (auto col : GetColumnsInMinibatch(*pMBLayout, seq))
+                output.insert(output.end(), packed.begin() + col * numRows, packed.begin() + (col + 1) * numRows);
+            found[seq.seqId] = true;
+        }
+        if (std::find(found.begin(), found.end(), false) != found.end())
+            RuntimeError("Output %ls: Not every input sequence has a corresponding output sequence.", node->GetName().c_str());
+    }
+}
+
 template<typename ElemType>
 void CNTKEvalExtended<ElemType>::ForwardPass(const Values<ElemType>& inputs, Values<ElemType>& outputs)
 {
@@ -459,4 +590,170 @@ extern "C" EVAL_API void GetEvalExtendedD(IEvaluateModelExtended<double>** peval
 
 template class CNTKEvalExtended<double>;
 template class CNTKEvalExtended<float>;
+
+// ----------------------------------------------------------------------------
+// Concurrent extended interface
+// ----------------------------------------------------------------------------
+
+template <typename ElemType>
+void CNTKEvalConcurrent<ElemType>::Init(const std::string& config)
+{
+    CNTKEvalBase<ElemType>::Init(config);
+    m_numWorkers = this->m_config(L"numWorkers", m_numWorkers);
+}
+
+// CreateNetwork - load the network once and create 'numWorkers' evaluators on top of it.
+// Worker 0 uses the loaded network, all others a clone that references its parameter values.
+template <typename ElemType>
+void CNTKEvalConcurrent<ElemType>::CreateNetwork(const std::string& networkDescription)
+{
+    if (!m_workers.empty())
+        RuntimeError("CreateNetwork: The network of a concurrent evaluator can only be created once.");
+
+    ConfigParameters config;
+    config.Parse(networkDescription);
+    m_numWorkers = config(L"numWorkers", m_numWorkers);
+    if (m_numWorkers == 0)
+        InvalidArgument("CreateNetwork: numWorkers must be at least 1.");
+
+    CNTKEvalBase<ElemType>::CreateNetwork(networkDescription);
+
+    for (size_t i = 0; i < m_numWorkers; i++)
+    {
+        auto worker = new CNTKEvalExtended<ElemType>();
+        worker->SetNetwork(i == 0 ? this->m_net : this->m_net->CloneWithSharedParameters());
+        m_workers.push_back(worker);
+    }
+    m_freeWorkers = m_workers;
+}
+
+// StartForwardEvaluation - prepare all workers. Must not be called while a ForwardPass() is in progress.
+template <typename ElemType>
+void CNTKEvalConcurrent<ElemType>::StartForwardEvaluation(const std::vector<wstring>& outputNodeNames)
+{
+    if (m_workers.empty())
+        RuntimeError("StartForwardEvaluation() called before CreateNetwork()");
+
+    std::lock_guard<std::mutex> lock(m_workersMutex);
+    if (m_freeWorkers.size() != m_workers.size())
+        LogicError("StartForwardEvaluation() called while a ForwardPass() is in progress.");
+
+    for (auto worker : m_workers)
+        worker->StartForwardEvaluation(outputNodeNames);
+}
+
+template <typename ElemType>
+VariableSchema CNTKEvalConcurrent<ElemType>::GetOutputSchema() const
+{
+    if (m_workers.empty())
+        RuntimeError("GetOutputSchema() called before CreateNetwork()");
+    return m_workers[0]->GetOutputSchema();
+}
+
+template <typename ElemType>
+VariableSchema CNTKEvalConcurrent<ElemType>::GetInputSchema() const
+{
+    if (m_workers.empty())
+        RuntimeError("GetInputSchema() called before CreateNetwork()");
+    return m_workers[0]->GetInputSchema();
+}
+
+// borrow a worker, waiting until one becomes free
+template <typename ElemType>
+CNTKEvalExtended<ElemType>* CNTKEvalConcurrent<ElemType>::AcquireWorker()
+{
+    std::unique_lock<std::mutex> lock(m_workersMutex);
+    m_workerReleased.wait(lock, [this] { return !m_freeWorkers.empty(); });
+    auto worker = m_freeWorkers.back();
+    m_freeWorkers.pop_back();
+    return worker;
+}
+
+template <typename ElemType>
+void CNTKEvalConcurrent<ElemType>::ReleaseWorker(CNTKEvalExtended<ElemType>* worker)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_workersMutex);
+        m_freeWorkers.push_back(worker);
+    }
+    m_workerReleased.notify_one();
+}
+
+template <typename ElemType>
+template <template <typename> class ValueContainer>
+void CNTKEvalConcurrent<ElemType>::ForwardPassT(const std::vector<ValueBuffer<ElemType, ValueContainer>>& inputs, std::vector<ValueBuffer<ElemType, ValueContainer>>& outputs, bool resetRNN)
+{
+    if (m_workers.empty())
+        RuntimeError("ForwardPass() called before CreateNetwork()");
+
+    // Consecutive calls may be served by different workers, so recurrent state cannot be carried over.
+    if (!resetRNN && m_numWorkers > 1)
+        InvalidArgument("ForwardPass: Carrying over RNN state between calls (resetRNN=false) is not supported with more than one worker.");
+
+    auto worker = AcquireWorker();
+    try
+    {
+        worker->ForwardPass(inputs, outputs, resetRNN);
+    }
+    catch (...)
+    {
+        ReleaseWorker(worker);
+        throw;
+    }
+    ReleaseWorker(worker);
+}
+
+template <typename ElemType>
+void CNTKEvalConcurrent<ElemType>::ForwardPass(const Values<ElemType>& inputs, Values<ElemType>& outputs)
+{
+    ForwardPassT(inputs, outputs, true);
+}
+
+template <typename ElemType>
+void CNTKEvalConcurrent<ElemType>::ForwardPass(const Values<ElemType>& inputs, Values<ElemType>& outputs, bool resetRNN)
+{
+    ForwardPassT(inputs, outputs, resetRNN);
+}
+
+template <typename ElemType>
+void CNTKEvalConcurrent<ElemType>::ForwardPass(const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& outputs)
+{
+    ForwardPassT(inputs, outputs, true);
+}
+
+template <typename ElemType>
+void CNTKEvalConcurrent<ElemType>::ForwardPass(const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& outputs, bool resetRNN)
+{
+    ForwardPassT(inputs, outputs, resetRNN);
+}
+
+template <typename ElemType>
+void CNTKEvalConcurrent<ElemType>::Destroy()
+{
+    // Each worker releases its network (and with it its references to the shared parameters).
+    for (auto worker : m_workers)
+        worker->Destroy();
+    m_workers.clear();
+    m_freeWorkers.clear();
+    CNTKEvalBase<ElemType>::Destroy();
+    delete this;
+}
+
+template <typename ElemType>
+void EVAL_API GetEvalConcurrent(IEvaluateModelExtended<ElemType>** peval)
+{
+    *peval = new CNTKEvalConcurrent<ElemType>();
+}
+
+extern "C" EVAL_API void GetEvalConcurrentF(IEvaluateModelExtended<float>** peval)
+{
+    GetEvalConcurrent(peval);
+}
+extern "C" EVAL_API void GetEvalConcurrentD(IEvaluateModelExtended<double>** peval)
+{
+    GetEvalConcurrent(peval);
+}
+
+template class CNTKEvalConcurrent<double>;
+template class CNTKEvalConcurrent<float>;
 } } }
@@ -13,6 +13,8 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <mutex>
+#include <condition_variable>
 
 #include "Eval.h"
 #include "EvalReader.h"
@@ -86,6 +88,17 @@ public:
 // ------------------------------------------------------------------------
 // Extended interface
 // ------------------------------------------------------------------------
+
+// One sequence of a batched forward pass: the dense input samples for every input,
+// and the output samples for every output that the forward pass produces for it.
+template <typename ElemType>
+struct EvalSequence
+{
+    std::vector<std::pair<const ElemType*, size_t>> m_inputs; // (data, number of elements), one per input
+    std::vector<std::vector<ElemType>> m_outputs;             // one per output
+    size_t m_numPastFrames = 0;                               // > 0 if this continues a stream of which that many frames were evaluated before
+};
+
 template <typename ElemType>
 class CNTKEvalExtended : public CNTKEvalBase<ElemType>, public IEvaluateModelExtended<ElemType>
 {
@@ -119,6 +132,23 @@ public:
         CNTKEvalBase<ElemType>::Init(config);
     }
 
+    // use an already constructed network, e.g. a clone that shares its parameters with another evaluator
+    void SetNetwork(ComputationNetworkPtr net)
+    {
+        this->m_net = net;
+    }
+
+    ComputationNetworkPtr GetNetwork() const
+    {
+        return this->m_net;
+    }
+
+    // evaluate several independent dense sequences in a single forward pass; they are packed into one
+    // minibatch through the MBLayout, and each sequence receives its own share of the outputs
+    // With packSequences=false, sequence k is placed alone into parallel sequence k starting at time 0, which
+    // is required for sequences that continue a stream (m_numPastFrames > 0).
+    void ForwardPassSequences(const std::vector<EvalSequence<ElemType>*>& sequences, bool packSequences = true);
+
 private:
     static VariableLayout ToVariableLayout(const ComputationNodeBasePtr n);
     std::vector<ComputationNodeBasePtr> m_outputNodes;
@@ -132,4 +162,52 @@ private:
                       std::vector < ValueBuffer<ElemType, ValueContainer> >& outputs, bool resetRNN);
 
 };
+
+// ------------------------------------------------------------------------
+// Concurrent extended interface
+// Holds a pool of CNTKEvalExtended workers, each with its own clone of the network
+// (activations, MBLayouts, matrix pool), while all clones reference one read-only copy
+// of the LearnableParameter values. ForwardPass() may be called from many threads; each
+// call borrows a free worker and blocks if all of them are busy.
+// ------------------------------------------------------------------------
+template <typename ElemType>
+class CNTKEvalConcurrent : public CNTKEvalBase<ElemType>, public IEvaluateModelExtended<ElemType>
+{
+public:
+    CNTKEvalConcurrent() : CNTKEvalBase<ElemType>(), m_numWorkers(1) {}
+
+    virtual VariableSchema GetOutputSchema() const override;
+
+    virtual void StartForwardEvaluation(const std::vector<wstring>& outputs) override;
+
+    virtual VariableSchema GetInputSchema() const override;
+
+    virtual void ForwardPass(const Values<ElemType>& inputs, Values<ElemType>& output) override;
+
+    virtual void ForwardPass(const Values<ElemType>& inputs, Values<ElemType>& output, bool resetRNN) override;
+
+    virtual void ForwardPass(const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& output) override;
+
+    virtual void ForwardPass(const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& output, bool resetRNN) override;
+
+    virtual void Destroy() override;
+
+    virtual void CreateNetwork(const std::string& networkDescription) override;
+
+    virtual void Init(const std::string& config) override;
+
+private:
+    CNTKEvalExtended<ElemType>* AcquireWorker();
+    void ReleaseWorker(CNTKEvalExtended<ElemType>* worker);
+
+    template<template<typename> class ValueContainer>
+    void ForwardPassT(const std::vector < ValueBuffer<ElemType, ValueContainer> >& inputs,
+                      std::vector < ValueBuffer<ElemType, ValueContainer> >& outputs, bool resetRNN);
+
+    size_t m_numWorkers;
+    std::vector<CNTKEvalExtended<ElemType>*> m_workers;     // all workers; m_workers[0] evaluates m_net itself
+    std::vector<CNTKEvalExtended<ElemType>*> m_freeWorkers; // workers not currently inside a ForwardPass()
+    std::mutex m_workersMutex;
+    std::condition_variable m_workerReleased;
+};
 } } }
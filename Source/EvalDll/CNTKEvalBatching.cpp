@@ -0,0 +1,354 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CNTKEvalBatching.cpp : dynamic request batching for the extended evaluation interface
+//
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+
+#include <stdio.h>
+#include <math.h>
+#define EVAL_EXPORTS // creating the exports here
+#include "Eval.h"
+#include "CNTKEvalBatching.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// ----------------------------------------------------------------------------
+// statistics
+// ----------------------------------------------------------------------------
+
+/*static*/ double LatencyHistogram::BucketUpperBound(size_t bucket)
+{
+    return pow(2.0, (bucket + 1) / 4.0);
+}
+
+void LatencyHistogram::Add(double microseconds)
+{
+    size_t bucket = 0;
+    if (microseconds > 1)
+        bucket = min((size_t)(4 * log2(microseconds)), NumBuckets - 1);
+    m_counts[bucket]++;
+    m_total++;
+}
+
+double LatencyHistogram::Percentile(double percentile) const
+{
+    if (m_total == 0)
+        return 0;
+    double threshold = percentile / 100 * m_total;
+    size_t cumulative = 0;
+    for (size_t bucket = 0; bucket < NumBuckets; bucket++)
+    {
+        cumulative += m_counts[bucket];
+        if (cumulative > 0 && cumulative >= threshold)
+            return BucketUpperBound(bucket);
+    }
+    return BucketUpperBound(NumBuckets - 1);
+}
+
+void EvalBatchingStatistics::Print(FILE* f) const
+{
+    fprintf(f, "Batching evaluator: %" PRIu64 " requests with %" PRIu64 " samples in %" PRIu64 " forward passes (%.2f sequences per pass).\n",
+            m_numRequests, m_numSamples, m_numBatches, m_numBatches ? (double)m_numRequests / m_numBatches : 0.0);
+    fprintf(f, "Latency percentiles (microseconds): p50 <= %.0f, p90 <= %.0f, p99 <= %.0f, p99.9 <= %.0f\n",
+            m_latency.Percentile(50), m_latency.Percentile(90), m_latency.Percentile(99), m_latency.Percentile(99.9));
+    fprintf(f, "Batch size histogram (sequences: passes):\n");
+    for (size_t size = 0; size < m_batchSizeHistogram.size(); size++)
+    {
+        if (m_batchSizeHistogram[size] > 0)
+            fprintf(f, "\t%5" PRIu64 ": %" PRIu64 "\n", size, m_batchSizeHistogram[size]);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// batching evaluator
+// ----------------------------------------------------------------------------
+
+template <typename ElemType>
+CNTKEvalBatching<ElemType>::CNTKEvalBatching() :
+    m_worker(new CNTKEvalExtended<ElemType>()),
+    m_maxBatchSize(64),
+    m_maxBatchSamples(0),
+    m_maxWaitTime(2000),
+    m_traceLevel(0),
+    m_stopping(false)
+{
+}
+
+// configuration (from Init() or the network description):
+//  - maxBatchSize: maximum number of requests (sequences) evaluated in one forward pass (default 64)
+//  - maxBatchSamples: maximum number of samples over all sequences of a forward pass (default 0: no limit)
+//  - maxWaitTimeMs: how long the oldest request may wait for more requests to arrive (default 2)
+template <typename ElemType>
+void CNTKEvalBatching<ElemType>::ReadConfig(const ConfigParameters& config)
+{
+    m_maxBatchSize = config(L"maxBatchSize", m_maxBatchSize);
+    m_maxBatchSamples = config(L"maxBatchSamples", m_maxBatchSamples);
+    double maxWaitTimeMs = config(L"maxWaitTimeMs", m_maxWaitTime.count() / 1000.0);
+    m_maxWaitTime = std::chrono::microseconds((long long)(maxWaitTimeMs * 1000));
+    m_traceLevel = config(L"traceLevel", m_traceLevel);
+    if (m_maxBatchSize == 0)
+        InvalidArgument("maxBatchSize must be at least 1.");
+}
+
+template <typename ElemType>
+void CNTKEvalBatching<ElemType>::Init(const std::string& config)
+{
+    ConfigParameters configParameters;
+    configParameters.Parse(config);
+    ReadConfig(configParameters);
+    m_worker->Init(config);
+}
+
+template <typename ElemType>
+void CNTKEvalBatching<ElemType>::CreateNetwork(const std::string& networkDescription)
+{
+    ConfigParameters config;
+    config.Parse(networkDescription);
+    ReadConfig(config);
+    m_worker->CreateNetwork(networkDescription);
+}
+
+template <typename ElemType>
+void CNTKEvalBatching<ElemType>::StartForwardEvaluation(const std::vector<wstring>& outputs)
+{
+    StopDispatcher();
+    m_worker->StartForwardEvaluation(outputs);
+    for (const auto& layout : m_worker->GetInputSchema())
+    {
+        if (layout.m_storageType == VariableLayout::Sparse)
+            RuntimeError("Input %ls: Sparse inputs are not supported by the batching evaluator.", layout.m_name.c_str());
+    }
+    m_stopping = false;
+    m_dispatcher = std::thread([this] { DispatcherLoop(); });
+}
+
+template <typename ElemType>
+void CNTKEvalBatching<ElemType>::StopDispatcher()
+{
+    if (!m_dispatcher.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_requestArrived.notify_one();
+    m_dispatcher.join();
+}
+
+// The dispatcher thread waits for the first request, then for more until the batch is full or the first
+// request has waited for m_maxWaitTime, and evaluates all of them in a single forward pass.
+template <typename ElemType>
+void CNTKEvalBatching<ElemType>::DispatcherLoop()
+{
+    auto isBatchFull = [this]()
+    {
+        if (m_queue.size() >= m_maxBatchSize)
+            return true;
+        if (m_maxBatchSamples == 0)
+            return false;
+        size_t numSamples = 0;
+        for (auto request : m_queue)
+            numSamples += request->m_numSamples;
+        return numSamples >= m_maxBatchSamples;
+    };
+
+    std::vector<Request*> batch;
+    std::vector<EvalSequence<ElemType>*> sequences;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_requestArrived.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+        if (m_queue.empty()) // stopping, and nothing left to do
+            break;
+
+        auto deadline = m_queue.front()->m_arrivalTime + m_maxWaitTime;
+        m_requestArrived.wait_until(lock, deadline, [&] { return m_stopping || isBatchFull(); });
+
+        // take the oldest requests that fit into the batch
+        batch.clear();
+        sequences.clear();
+        size_t numSamples = 0;
+        while (!m_queue.empty() && batch.size() < m_maxBatchSize)
+        {
+            auto request = m_queue.front();
+            if (!batch.empty() && m_maxBatchSamples > 0 && numSamples + request->m_numSamples > m_maxBatchSamples)
+                break;
+            numSamples += request->m_numSamples;
+            batch.push_back(request);
+            sequences.push_back(&request->m_sequence);
+            m_queue.pop_front();
+        }
+        lock.unlock();
+
+        std::exception_ptr error;
+        try
+        {
+            m_worker->ForwardPassSequences(sequences);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        lock.lock();
+        auto now = Clock::now();
+        for (auto request : batch)
+        {
+            request->m_error = error;
+            request->m_done = true;
+            m_statistics.m_latency.Add((double)std::chrono::duration_cast<std::chrono::microseconds>(now - request->m_arrivalTime).count());
+        }
+        if (m_statistics.m_batchSizeHistogram.size() <= batch.size())
+            m_statistics.m_batchSizeHistogram.resize(batch.size() + 1, 0);
+        m_statistics.m_batchSizeHistogram[batch.size()]++;
+        m_statistics.m_numRequests += batch.size();
+        m_statistics.m_numSamples += numSamples;
+        m_statistics.m_numBatches++;
+        m_requestDone.notify_all();
+    }
+}
+
+template <typename ElemType>
+template <template <typename> class ValueContainer>
+void CNTKEvalBatching<ElemType>::ForwardPassT(const std::vector<ValueBuffer<ElemType, ValueContainer>>& inputs, std::vector<ValueBuffer<ElemType, ValueContainer>>& outputs, bool resetRNN)
+{
+    if (!m_dispatcher.joinable())
+        RuntimeError("ForwardPass() called before StartForwardEvaluation()");
+
+    // Requests are batched with those of other callers, each as a sequence of its own.
+    if (!resetRNN)
+        InvalidArgument("ForwardPass: Carrying over RNN state between calls (resetRNN=false) is not supported by the batching evaluator.");
+
+    // validate here, so that a malformed request fails on its own rather than failing the whole batch
+    auto inputSchema = m_worker->GetInputSchema();
+    if (inputs.size() != inputSchema.size())
+        RuntimeError("Expected %d inputs, but got %d.", (int)inputSchema.size(), (int)inputs.size());
+    auto outputSchema = m_worker->GetOutputSchema();
+    if (outputs.size() != outputSchema.size())
+        RuntimeError("Expected %d outputs, but got %d.", (int)outputSchema.size(), (int)outputs.size());
+
+    Request request;
+    request.m_numSamples = 0;
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        const auto& buffer = inputs[i].m_buffer;
+        size_t numRows = inputSchema[i].m_numElements;
+        if (buffer.data() == nullptr)
+            RuntimeError("Input %ls: Buffer is not allocated.", inputSchema[i].m_name.c_str());
+        if (buffer.size() == 0 || buffer.size() % numRows != 0)
+            RuntimeError("Input %ls: Expected input data to be a non-zero multiple of %" PRIu64 ", but it is %" PRIu64 ".",
+                         inputSchema[i].m_name.c_str(), numRows, (size_t)buffer.size());
+        request.m_sequence.m_inputs.push_back(std::make_pair(buffer.data(), (size_t)buffer.size()));
+        request.m_numSamples = max(request.m_numSamples, buffer.size() / numRows);
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        request.m_arrivalTime = Clock::now();
+        m_queue.push_back(&request);
+        m_requestArrived.notify_one();
+        m_requestDone.wait(lock, [&request] { return request.m_done; });
+    }
+
+    if (request.m_error)
+        std::rethrow_exception(request.m_error);
+
+    for (size_t i = 0; i < outputs.size(); i++)
+    {
+        const auto& result = request.m_sequence.m_outputs[i];
+        ValueContainer<ElemType>& vec = outputs[i].m_buffer;
+        if (vec.capacity() < result.size())
+        {
+            // Bad luck - we can't reallocate memory of an external object at this point.
+            RuntimeError("Not enough space in output buffer for output '%ls'.", outputSchema[i].m_name.c_str());
+        }
+        vec.resize(result.size());
+        ElemType* data = const_cast<ElemType*>(vec.data());
+        std::copy(result.begin(), result.end(), data);
+    }
+}
+
+template <typename ElemType>
+void CNTKEvalBatching<ElemType>::ForwardPass(const Values<ElemType>& inputs, Values<ElemType>& outputs)
+{
+    ForwardPassT(inputs, outputs, true);
+}
+
+template <typename ElemType>
+void CNTKEvalBatching<ElemType>::ForwardPass(const Values<ElemType>& inputs, Values<ElemType>& outputs, bool resetRNN)
+{
+    ForwardPassT(inputs, outputs, resetRNN);
+}
+
+template <typename ElemType>
+void CNTKEvalBatching<ElemType>::ForwardPass(const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& outputs)
+{
+    ForwardPassT(inputs, outputs, true);
+}
+
+template <typename ElemType>
+void CNTKEvalBatching<ElemType>::ForwardPass(const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& outputs, bool resetRNN)
+{
+    ForwardPassT(inputs, outputs, resetRNN);
+}
+
+template <typename ElemType>
+EvalBatchingStatistics CNTKEvalBatching<ElemType>::GetStatistics()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_statistics;
+}
+
+template <typename ElemType>
+void CNTKEvalBatching<ElemType>::Destroy()
+{
+    StopDispatcher();
+    if (m_traceLevel > 0)
+        m_statistics.Print(stderr);
+    m_worker->Destroy();
+    delete this;
+}
+
+template <typename ElemType>
+void EVAL_API GetEvalBatching(IEvaluateModelExtended<ElemType>** peval)
+{
+    *peval = new CNTKEvalBatching<ElemType>();
+}
+
+extern "C" EVAL_API void GetEvalBatchingF(IEvaluateModelExtended<float>** peval)
+{
+    GetEvalBatching(peval);
+}
+extern "C" EVAL_API void GetEvalBatchingD(IEvaluateModelExtended<double>** peval)
+{
+    GetEvalBatching(peval);
+}
+
+template <typename ElemType>
+void EVAL_API GetEvalBatchingCounters(IEvaluateModelExtended<ElemType>* eval, EvalBatchingCounters* counters)
+{
+    auto batching = dynamic_cast<CNTKEvalBatching<ElemType>*>(eval);
+    if (batching == nullptr)
+        InvalidArgument("GetEvalBatchingCounters: The evaluator was not created by GetEvalBatching().");
+    EvalBatchingStatistics statistics = batching->GetStatistics();
+    counters->m_numRequests = statistics.m_numRequests;
+    counters->m_numForwardPasses = statistics.m_numBatches;
+    counters->m_largestBatch = statistics.m_batchSizeHistogram.empty() ? 0 : statistics.m_batchSizeHistogram.size() - 1;
+}
+
+extern "C" EVAL_API void GetEvalBatchingCountersF(IEvaluateModelExtended<float>* eval, EvalBatchingCounters* counters)
+{
+    GetEvalBatchingCounters(eval, counters);
+}
+extern "C" EVAL_API void GetEvalBatchingCountersD(IEvaluateModelExtended<double>* eval, EvalBatchingCounters* counters)
+{
+    GetEvalBatchingCounters(eval, counters);
+}
+
+template class CNTKEvalBatching<double>;
+template class CNTKEvalBatching<float>;
+}}}
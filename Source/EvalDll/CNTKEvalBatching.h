@@ -0,0 +1,131 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CNTKEvalBatching.h - dynamic request batching on top of the extended evaluation interface
+//
+// Online callers typically submit a single sample or a short sequence per ForwardPass() call, which
+// makes every GEMM in the network run at batch size 1. CNTKEvalBatching collects the requests of
+// concurrent callers into one minibatch (up to maxBatchSize sequences / maxBatchSamples samples, or
+// whatever arrived within maxWaitTimeMs of the first request), packs their sequences through the
+// MBLayout, runs a single forward pass, and scatters the outputs back to the callers.
+//
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CNTKEval.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// ------------------------------------------------------------------------
+// Statistics of the batching evaluator
+// ------------------------------------------------------------------------
+
+// Histogram of request latencies with logarithmically spaced buckets (4 per octave, starting at 1 microsecond).
+class LatencyHistogram
+{
+public:
+    LatencyHistogram() : m_counts(NumBuckets, 0), m_total(0) {}
+
+    void Add(double microseconds);
+
+    // returns the upper bound (in microseconds) of the bucket that contains the given percentile (0..100)
+    double Percentile(double percentile) const;
+
+    size_t Count() const { return m_total; }
+
+private:
+    static const size_t NumBuckets = 128; // covers up to 2^32 microseconds
+    static double BucketUpperBound(size_t bucket);
+
+    std::vector<size_t> m_counts;
+    size_t m_total;
+};
+
+struct EvalBatchingStatistics
+{
+    LatencyHistogram m_latency;                // time from entering ForwardPass() until its outputs are ready
+    std::vector<size_t> m_batchSizeHistogram;  // [number of sequences] -> number of forward passes of that size
+    size_t m_numRequests = 0;
+    size_t m_numBatches = 0;
+    size_t m_numSamples = 0;
+
+    void Print(FILE* f) const;
+};
+
+// ------------------------------------------------------------------------
+// Batching extended interface
+// ------------------------------------------------------------------------
+template <typename ElemType>
+class CNTKEvalBatching : public IEvaluateModelExtended<ElemType>
+{
+public:
+    CNTKEvalBatching();
+
+    virtual void Init(const std::string& config) override;
+
+    virtual void CreateNetwork(const std::string& networkDescription) override;
+
+    virtual VariableSchema GetOutputSchema() const override { return m_worker->GetOutputSchema(); }
+
+    virtual void StartForwardEvaluation(const std::vector<wstring>& outputs) override;
+
+    virtual VariableSchema GetInputSchema() const override { return m_worker->GetInputSchema(); }
+
+    virtual void ForwardPass(const Values<ElemType>& inputs, Values<ElemType>& output) override;
+
+    virtual void ForwardPass(const Values<ElemType>& inputs, Values<ElemType>& output, bool resetRNN) override;
+
+    virtual void ForwardPass(const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& output) override;
+
+    virtual void ForwardPass(const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& output, bool resetRNN) override;
+
+    virtual void Destroy() override;
+
+    // snapshot of the statistics collected so far
+    EvalBatchingStatistics GetStatistics();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // a caller's request, waiting for the dispatcher thread to evaluate it as part of a batch
+    struct Request
+    {
+        EvalSequence<ElemType> m_sequence;
+        size_t m_numSamples;
+        Clock::time_point m_arrivalTime;
+        bool m_done = false;
+        std::exception_ptr m_error;
+    };
+
+    void ReadConfig(const ConfigParameters& config);
+    void DispatcherLoop();
+    void StopDispatcher();
+
+    template <template <typename> class ValueContainer>
+    void ForwardPassT(const std::vector<ValueBuffer<ElemType, ValueContainer>>& inputs,
+                      std::vector<ValueBuffer<ElemType, ValueContainer>>& outputs, bool resetRNN);
+
+    CNTKEvalExtended<ElemType>* m_worker;
+    size_t m_maxBatchSize;    // maximum number of sequences in one forward pass
+    size_t m_maxBatchSamples; // maximum number of samples (over all sequences) in one forward pass; 0 = no limit
+    std::chrono::microseconds m_maxWaitTime;
+    int m_traceLevel;
+
+    std::thread m_dispatcher;
+    std::mutex m_mutex;                       // protects all members below
+    std::condition_variable m_requestArrived;
+    std::condition_variable m_requestDone;
+    std::deque<Request*> m_queue;
+    bool m_stopping;
+    EvalBatchingStatistics m_statistics;
+};
+
+}}}
@@ -0,0 +1,167 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CNTKEvalStreaming.cpp : evaluation of many concurrent streams with per-session recurrent state
+//
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+
+#include <stdio.h>
+#define EVAL_EXPORTS // creating the exports here
+#include "Eval.h"
+#include "CNTKEvalStreaming.h"
+#include "RNNNodes.h"
+#include <set>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <typename ElemType>
+void CNTKEvalStreaming<ElemType>::StartForwardEvaluation(const std::vector<wstring>& outputs)
+{
+    m_worker->StartForwardEvaluation(outputs);
+    m_sessions.clear();
+    m_delayNodes.clear();
+
+    // collect the delay nodes whose state must be kept per session
+    auto net = m_worker->GetNetwork();
+    std::set<ComputationNodeBasePtr> visited;
+    for (const auto& outputName : outputs)
+    {
+        for (const auto& node : net->GetEvalOrder(net->GetNodeFromName(outputName)))
+        {
+            if (!visited.insert(node).second)
+                continue;
+            if (node->OperationName() == OperationNameOf(FutureValueNode))
+                RuntimeError("%ls %ls operation: Streaming evaluation does not support future values.", node->NodeName().c_str(), node->OperationName().c_str());
+            if (node->OperationName() == OperationNameOf(OptimizedRNNStackNode))
+                RuntimeError("%ls %ls operation: Streaming evaluation cannot carry the state of an optimized RNN stack across chunks.", node->NodeName().c_str(), node->OperationName().c_str());
+            auto delayNode = dynamic_pointer_cast<PastValueNode<ElemType>>(node);
+            if (delayNode)
+                m_delayNodes.push_back(delayNode);
+        }
+    }
+}
+
+template <typename ElemType>
+void CNTKEvalStreaming<ElemType>::ForwardPass(const std::vector<uint64_t>& sessionIds, const std::vector<Values<ElemType>>& inputs, std::vector<Values<ElemType>>& outputs)
+{
+    if (inputs.size() != sessionIds.size())
+        InvalidArgument("Expected inputs for %d sessions, but got %d.", (int)sessionIds.size(), (int)inputs.size());
+    if (sessionIds.empty())
+        return;
+
+    // validate the whole call before any session is created; all inputs of a session advance its stream
+    // by the same number of frames
+    const auto& inputSchema = m_worker->GetInputSchema();
+    std::set<uint64_t> uniqueSessionIds;
+    std::vector<size_t> numFrames(sessionIds.size());
+    for (size_t k = 0; k < sessionIds.size(); ++k)
+    {
+        if (!uniqueSessionIds.insert(sessionIds[k]).second)
+            InvalidArgument("Session %" PRIu64 " appears more than once in one ForwardPass() call.", sessionIds[k]);
+        if (inputs[k].size() != inputSchema.size())
+            InvalidArgument("Session %" PRIu64 ": Expected %d inputs, but got %d.", sessionIds[k], (int)inputSchema.size(), (int)inputs[k].size());
+        for (size_t i = 0; i < inputSchema.size(); ++i)
+        {
+            size_t numRows = inputSchema[i].m_numElements;
+            size_t size = inputs[k][i].m_buffer.size();
+            if (size == 0 || size % numRows != 0)
+                InvalidArgument("Session %" PRIu64 ", input %ls: Expected input data to be a non-zero multiple of %d, but it is %d.",
+                                sessionIds[k], inputSchema[i].m_name.c_str(), (int)numRows, (int)size);
+            if (i == 0)
+                numFrames[k] = size / numRows;
+            else if (size / numRows != numFrames[k])
+                InvalidArgument("Session %" PRIu64 ": Input %ls has %d frames, but input %ls has %d; all inputs of a session must have the same number of frames.",
+                                sessionIds[k], inputSchema[i].m_name.c_str(), (int)(size / numRows), inputSchema[0].m_name.c_str(), (int)numFrames[k]);
+        }
+    }
+
+    std::vector<EvalSequence<ElemType>> sequences(sessionIds.size());
+    std::vector<Session*> sessions(sessionIds.size());
+    bool anyContinued = false;
+    for (size_t k = 0; k < sessionIds.size(); ++k)
+    {
+        sessions[k] = &m_sessions[sessionIds[k]];
+        for (const auto& input : inputs[k])
+            sequences[k].m_inputs.push_back(std::make_pair(input.m_buffer.data(), input.m_buffer.size()));
+        sequences[k].m_numPastFrames = sessions[k]->m_numFrames;
+        anyContinued |= sessions[k]->m_numFrames > 0;
+    }
+
+    // restore the histories of the continued sessions (only needed if any session continues)
+    std::vector<const std::vector<ElemType>*> importedHistories(sessionIds.size());
+    for (size_t i = 0; i < m_delayNodes.size() && anyContinued; ++i)
+    {
+        for (size_t k = 0; k < sessions.size(); ++k)
+            importedHistories[k] = sessions[k]->m_histories.empty() ? nullptr : &sessions[k]->m_histories[i];
+        m_delayNodes[i]->ImportStreamHistories(importedHistories);
+    }
+
+    std::vector<EvalSequence<ElemType>*> sequencePtrs;
+    for (auto& sequence : sequences)
+        sequencePtrs.push_back(&sequence);
+    try
+    {
+        m_worker->ForwardPassSequences(sequencePtrs, /*packSequences=*/false);
+    }
+    catch (...)
+    {
+        // new sessions whose first chunk failed are not kept
+        for (size_t k = 0; k < sessions.size(); ++k)
+        {
+            if (sessions[k]->m_numFrames == 0)
+                m_sessions.erase(sessionIds[k]);
+        }
+        throw;
+    }
+
+    // save the updated histories
+    std::vector<std::vector<ElemType>*> exportedHistories(sessionIds.size());
+    for (size_t k = 0; k < sessions.size(); ++k)
+    {
+        sessions[k]->m_histories.resize(m_delayNodes.size());
+        sessions[k]->m_numFrames += numFrames[k];
+    }
+    for (size_t i = 0; i < m_delayNodes.size(); ++i)
+    {
+        for (size_t k = 0; k < sessions.size(); ++k)
+            exportedHistories[k] = &sessions[k]->m_histories[i];
+        m_delayNodes[i]->ExportStreamHistories(numFrames, exportedHistories);
+    }
+
+    outputs.resize(sessionIds.size());
+    for (size_t k = 0; k < sessionIds.size(); ++k)
+    {
+        outputs[k].resize(sequences[k].m_outputs.size());
+        for (size_t i = 0; i < sequences[k].m_outputs.size(); ++i)
+            outputs[k][i].m_buffer = std::move(sequences[k].m_outputs[i]);
+    }
+}
+
+template <typename ElemType>
+void CNTKEvalStreaming<ElemType>::Destroy()
+{
+    m_worker->Destroy();
+    delete this;
+}
+
+template <typename ElemType>
+void EVAL_API GetEvalStreaming(IEvaluateModelStreaming<ElemType>** peval)
+{
+    *peval = new CNTKEvalStreaming<ElemType>();
+}
+
+extern "C" EVAL_API void GetEvalStreamingF(IEvaluateModelStreaming<float>** peval)
+{
+    GetEvalStreaming(peval);
+}
+extern "C" EVAL_API void GetEvalStreamingD(IEvaluateModelStreaming<double>** peval)
+{
+    GetEvalStreaming(peval);
+}
+
+template class CNTKEvalStreaming<double>;
+template class CNTKEvalStreaming<float>;
+}}}
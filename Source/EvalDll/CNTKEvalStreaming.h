@@ -0,0 +1,59 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CNTKEvalStreaming.h - evaluation of many concurrent streams with per-session recurrent state
+//
+// Each ForwardPass() places the chunk of every given session into its own parallel sequence of one
+// minibatch. Sessions that continue a stream start at a negative time in the MBLayout, and the PastValue
+// nodes are primed with the saved history of each session (the last 'timeStep' input frames), exactly as
+// truncated BPTT carries state from one minibatch into the next. After the forward pass, the histories are
+// updated from the chunk and kept per session id.
+//
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "CNTKEval.h"
+#include "RecurrentNodes.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <typename ElemType>
+class CNTKEvalStreaming : public IEvaluateModelStreaming<ElemType>
+{
+public:
+    CNTKEvalStreaming() : m_worker(new CNTKEvalExtended<ElemType>()) {}
+
+    virtual void Init(const std::string& config) override { m_worker->Init(config); }
+
+    virtual void CreateNetwork(const std::string& networkDescription) override { m_worker->CreateNetwork(networkDescription); }
+
+    virtual VariableSchema GetOutputSchema() const override { return m_worker->GetOutputSchema(); }
+
+    virtual void StartForwardEvaluation(const std::vector<wstring>& outputs) override;
+
+    virtual VariableSchema GetInputSchema() const override { return m_worker->GetInputSchema(); }
+
+    virtual void ForwardPass(const std::vector<uint64_t>& sessionIds, const std::vector<Values<ElemType>>& inputs, std::vector<Values<ElemType>>& outputs) override;
+
+    virtual void EndSession(uint64_t sessionId) override { m_sessions.erase(sessionId); }
+
+    virtual size_t GetNumSessions() const override { return m_sessions.size(); }
+
+    virtual void Destroy() override;
+
+private:
+    struct Session
+    {
+        size_t m_numFrames = 0;                        // frames evaluated so far
+        std::vector<std::vector<ElemType>> m_histories; // one per delay node in m_delayNodes
+    };
+
+    CNTKEvalExtended<ElemType>* m_worker;
+    std::vector<shared_ptr<PastValueNode<ElemType>>> m_delayNodes; // all PastValue nodes that the outputs depend on
+    std::unordered_map<uint64_t, Session> m_sessions;
+};
+
+}}}
@@ -10,6 +10,7 @@
 #include "File.h"
 
 #include "CPUMatrix.h"
+#include "CPURNN.h"
 #include "TensorOps.h"
 #include <assert.h>
 #include <stdexcept>
@@ -4593,6 +4594,32 @@ void CPUMatrix<ElemType>::AveragePoolingBackward(const CPUMatrix<int>& mpRowCol,
     }
 }
 
+// Per-channel statistics of one part of the data: element count, mean, and sum of squared deviations from the mean (m2).
+// Partial statistics are merged with the parallel variant of Welford's algorithm (Chan et al.), which,
+// unlike accumulating sums of squares, stays numerically stable when the mean is large compared to the variance.
+struct BatchNormPartialStatistics
+{
+    size_t n = 0;
+    vector<double> mean;
+    vector<double> m2;
+
+    BatchNormPartialStatistics(size_t numChannels = 0) : mean(numChannels, 0), m2(numChannels, 0) { }
+
+    // merge the statistics of n2 more elements into channel c
+    void Merge(size_t c, size_t n2, double mean2, double m22)
+    {
+        double delta = mean2 - mean[c];
+        double nsum = (double) (n + n2);
+        mean[c] += delta * n2 / nsum;
+        m2[c] += m22 + delta * delta * ((double) n * n2 / nsum);
+    }
+};
+
+// Batch normalization on the CPU, with the same semantics as the CNTK GPU kernels (CntkBatchNormalization.cuh).
+// The data is a column-major [vectorSize x batchSize] matrix. In spatial mode, each column consists of
+// scale.GetNumRows() maps of spatialSize consecutive values (CHW layout), and statistics are per map; otherwise they are per row.
+// Training takes two passes over the data: one that computes the minibatch mean and variance of all channels at once,
+// and one that normalizes, scales, and shifts.
 template <class ElemType>
 void CPUMatrix<ElemType>::BatchNormalizationForward(const CPUMatrix<ElemType>& scale, const CPUMatrix<ElemType>& bias, bool inferenceOnly, double expAvgFactor, double blendFactor,
                                                     CPUMatrix<ElemType>& runMean, CPUMatrix<ElemType>& runVariance, CPUMatrix<ElemType>& out, double epsilon,
@@ -4600,50 +4627,295 @@ void CPUMatrix<ElemType>::BatchNormalizationForward(const CPUMatrix<ElemType>& s
 {
     assert((GetNumRows() % scale.GetNumRows()) == 0);
 
-    if (!inferenceOnly || expAvgFactor != 0 || blendFactor != 1)
-        RuntimeError("Batch normalization training on CPU is not yet implemented.");
-
-    saveMean.Resize(0, 0); // only doing inference: these two are not produced
-    saveInvStdDev.Resize(0, 0);
+    const size_t vectorSize = GetNumRows();
+    const size_t batchSize = GetNumCols();
+    const size_t numChannels = scale.GetNumRows();
+    const size_t spatialSize = vectorSize / numChannels; // (1 if not spatial)
+    const bool spatial = spatialSize != 1 || vectorSize != numChannels;
 
-    bool spatial = GetNumRows() != scale.GetNumRows();
-    if (spatial)
+    // determine mean and inverse standard deviation to normalize with
+    vector<ElemType> mean(numChannels);
+    vector<ElemType> invStdDev(numChannels);
+    if (inferenceOnly || (expAvgFactor == 0 && blendFactor == 1))
     {
-        size_t spatialSize = GetNumRows() / scale.GetNumRows();
-#pragma omp parallel for
-        for (long icol = 0; icol < out.GetNumCols(); icol++)
+        // running statistics only, nothing to update
+        assert(!inferenceOnly || (expAvgFactor == 0 && blendFactor == 1));
+        for (size_t c = 0; c < numChannels; c++)
         {
-            for (long irow = 0; irow < out.GetNumRows(); irow++)
+            mean[c] = runMean(c, 0);
+            invStdDev[c] = (ElemType) (1.0 / sqrt((double) runVariance(c, 0) + epsilon));
+        }
+    }
+    else
+    {
+        // pass 1: minibatch mean and variance
+        // Each thread accumulates the statistics of a range of columns for all channels; these are merged at the end.
+        vector<BatchNormPartialStatistics> partialStats(omp_get_max_threads());
+#pragma omp parallel
+        {
+            auto& stats = partialStats[omp_get_thread_num()];
+            stats = BatchNormPartialStatistics(numChannels);
+            double* pmean = stats.mean.data();
+            double* pm2 = stats.m2.data();
+#pragma omp for schedule(static)
+            for (long j = 0; j < (long) batchSize; j++)
             {
-                size_t imap = irow / spatialSize;
-                ElemType stdDev = sqrt(runVariance(imap, 0) + epsilon);
-                out(irow, icol) = scale(imap, 0) * ((*this)(irow, icol) - runMean(imap, 0)) / stdDev + bias(imap, 0);
+                const ElemType* x = Data() + j * vectorSize;
+                if (!spatial)
+                {
+                    // plain Welford update, vectorized across channels
+                    stats.n++;
+                    const double invN = 1.0 / stats.n;
+                    for (size_t c = 0; c < numChannels; c++)
+                    {
+                        double d = x[c] - pmean[c];
+                        pmean[c] += d * invN;
+                        pm2[c] += d * (x[c] - pmean[c]);
+                    }
+                }
+                else
+                {
+                    // each map of a column is contiguous: get its statistics (while it is in cache), then merge them in
+                    for (size_t c = 0; c < numChannels; c++)
+                    {
+                        const ElemType* xc = x + c * spatialSize;
+                        double sum = 0;
+                        for (size_t i = 0; i < spatialSize; i++)
+                            sum += xc[i];
+                        double blockMean = sum / spatialSize;
+                        double blockM2 = 0;
+                        for (size_t i = 0; i < spatialSize; i++)
+                        {
+                            double d = xc[i] - blockMean;
+                            blockM2 += d * d;
+                        }
+                        stats.Merge(c, spatialSize, blockMean, blockM2);
+                    }
+                    stats.n += spatialSize;
+                }
             }
         }
+        BatchNormPartialStatistics batchStats(numChannels);
+        for (const auto& stats : partialStats)
+        {
+            if (stats.n == 0)
+                continue;
+            for (size_t c = 0; c < numChannels; c++)
+                batchStats.Merge(c, stats.n, stats.mean[c], stats.m2[c]);
+            batchStats.n += stats.n;
+        }
+
+        // update running statistics, and blend them with the minibatch statistics
+        const size_t m = batchStats.n; // = batchSize * spatialSize
+        for (size_t c = 0; c < numChannels; c++)
+        {
+            double runM = expAvgFactor * batchStats.mean[c] + (1.0 - expAvgFactor) * runMean(c, 0);
+            mean[c] = (ElemType) (blendFactor * runM + (1.0 - blendFactor) * batchStats.mean[c]);
+            runMean(c, 0) = (ElemType) runM;
+
+            double unbiasedVariance = m == 1 ? 0 : batchStats.m2[c] / (m - 1);
+            double runV = expAvgFactor * unbiasedVariance + (1.0 - expAvgFactor) * runVariance(c, 0);
+            double isd = 1.0 / sqrt(batchStats.m2[c] / m + epsilon);
+            if (blendFactor != 0)
+                isd = blendFactor / sqrt(runV + epsilon) + (1.0 - blendFactor) * isd;
+            invStdDev[c] = (ElemType) isd;
+            runVariance(c, 0) = (ElemType) runV;
+        }
+    }
+
+    if (inferenceOnly)
+    {
+        saveMean.Resize(0, 0); // only doing inference: these two are not produced
+        saveInvStdDev.Resize(0, 0);
     }
     else
     {
+        saveMean.RequireSize(numChannels, 1);
+        saveInvStdDev.RequireSize(numChannels, 1);
+        memcpy(saveMean.Data(), mean.data(), sizeof(ElemType) * numChannels);
+        memcpy(saveInvStdDev.Data(), invStdDev.data(), sizeof(ElemType) * numChannels);
+    }
+
+    // pass 2: out = scale * (x - mean) * invStdDev + bias, as out = x * a + b with per-channel a and b
+    vector<ElemType> a(numChannels);
+    vector<ElemType> b(numChannels);
+    for (size_t c = 0; c < numChannels; c++)
+    {
+        a[c] = scale(c, 0) * invStdDev[c];
+        b[c] = bias(c, 0) - mean[c] * a[c];
+    }
+    const ElemType* pa = a.data();
+    const ElemType* pb = b.data();
 #pragma omp parallel for
-        for (long icol = 0; icol < out.GetNumCols(); icol++)
+    for (long j = 0; j < (long) batchSize; j++)
+    {
+        const ElemType* x = Data() + j * vectorSize;
+        ElemType* y = out.Data() + j * vectorSize;
+        if (!spatial)
         {
-            for (long irow = 0; irow < out.GetNumRows(); irow++)
+            for (size_t i = 0; i < vectorSize; i++)
+                y[i] = x[i] * pa[i] + pb[i];
+        }
+        else
+        {
+            for (size_t c = 0; c < numChannels; c++)
             {
-                ElemType stdDev = sqrt(runVariance(irow, 0) + epsilon);
-                out(irow, icol) = scale(irow, 0) * ((*this)(irow, icol) - runMean(irow, 0)) / stdDev + bias(irow, 0);
+                const ElemType ac = pa[c];
+                const ElemType bc = pb[c];
+                const ElemType* xc = x + c * spatialSize;
+                ElemType* yc = y + c * spatialSize;
+                for (size_t i = 0; i < spatialSize; i++)
+                    yc[i] = xc[i] * ac + bc;
             }
         }
     }
 }
 
+// Gradients of batch normalization, with the same semantics as the CNTK GPU kernels:
+// scaleGrad and biasGrad are overwritten, grad is added to. 'this' is the gradient of the output.
+// savedMean/savedInvStdDev are the interpolated mean/inverse standard deviation as used in BatchNormalizationForward().
 template <class ElemType>
 void CPUMatrix<ElemType>::BatchNormalizationBackward(const CPUMatrix<ElemType>& in, CPUMatrix<ElemType>& grad, const CPUMatrix<ElemType>& scale, double blendFactor,
                                                      const CPUMatrix<ElemType>& saveMean, const CPUMatrix<ElemType>& saveInvStdDev,
                                                      CPUMatrix<ElemType>& scaleGrad, CPUMatrix<ElemType>& biasGrad) const
 {
-    UNUSED(in); UNUSED(grad); UNUSED(scale); UNUSED(blendFactor), UNUSED(saveMean); UNUSED(saveInvStdDev); UNUSED(scaleGrad); UNUSED(biasGrad);
-    RuntimeError("Batch normalization training on CPU is not yet implemented.");
+    assert((GetNumRows() % scale.GetNumRows()) == 0);
+    assert(in.GetNumRows() == GetNumRows() && in.GetNumCols() == GetNumCols());
+    assert(grad.GetNumRows() == GetNumRows() && grad.GetNumCols() == GetNumCols());
+
+    const size_t vectorSize = GetNumRows();
+    const size_t batchSize = GetNumCols();
+    const size_t numChannels = scale.GetNumRows();
+    const size_t spatialSize = vectorSize / numChannels;
+    const bool spatial = spatialSize != 1 || vectorSize != numChannels;
+    const ElemType* mean = saveMean.Data();
+    const ElemType* invStdDev = saveInvStdDev.Data();
+
+    // pass 1: dScale = sum(dy * xHat), dBias = sum(dy), per channel
+    int numThreads = omp_get_max_threads();
+    vector<vector<double>> partialScaleGrad(numThreads);
+    vector<vector<double>> partialBiasGrad(numThreads);
+#pragma omp parallel
+    {
+        auto& ds = partialScaleGrad[omp_get_thread_num()];
+        auto& db = partialBiasGrad[omp_get_thread_num()];
+        ds.assign(numChannels, 0);
+        db.assign(numChannels, 0);
+#pragma omp for schedule(static)
+        for (long j = 0; j < (long) batchSize; j++)
+        {
+            const ElemType* x = in.Data() + j * vectorSize;
+            const ElemType* dy = Data() + j * vectorSize;
+            if (!spatial)
+            {
+                for (size_t c = 0; c < numChannels; c++)
+                {
+                    ds[c] += dy[c] * (x[c] - mean[c]) * invStdDev[c];
+                    db[c] += dy[c];
+                }
+            }
+            else
+            {
+                for (size_t c = 0; c < numChannels; c++)
+                {
+                    const ElemType* xc = x + c * spatialSize;
+                    const ElemType* dyc = dy + c * spatialSize;
+                    double sumDyX = 0, sumDy = 0;
+                    for (size_t i = 0; i < spatialSize; i++)
+                    {
+                        sumDyX += dyc[i] * xc[i];
+                        sumDy += dyc[i];
+                    }
+                    ds[c] += (sumDyX - mean[c] * sumDy) * invStdDev[c];
+                    db[c] += sumDy;
+                }
+            }
+        }
+    }
+    scaleGrad.RequireSize(numChannels, 1);
+    biasGrad.RequireSize(numChannels, 1);
+    for (size_t c = 0; c < numChannels; c++)
+    {
+        double ds = 0, db = 0;
+        for (int t = 0; t < numThreads; t++)
+        {
+            ds += partialScaleGrad[t][c];
+            db += partialBiasGrad[t][c];
+        }
+        scaleGrad(c, 0) = (ElemType) ds;
+        biasGrad(c, 0) = (ElemType) db;
+    }
+
+    // pass 2: dx += scale * invStdDev * (dy - mbStatsWeight * (xHat * dScale + dBias) / m)
+    // where mbStatsWeight is the weight with which the minibatch statistics were used (0 if the node is locked).
+    // Written as dx += p * dy + q * x + r with per-channel p, q, r.
+    const double mbStatsWeight = 1 - blendFactor;
+    const double m = (double) batchSize * spatialSize;
+    vector<ElemType> p(numChannels), q(numChannels), r(numChannels);
+    for (size_t c = 0; c < numChannels; c++)
+    {
+        double scaleInvStdDev = scale(c, 0) * invStdDev[c];
+        double k = scaleInvStdDev * mbStatsWeight / m;
+        p[c] = (ElemType) scaleInvStdDev;
+        q[c] = (ElemType) (-k * scaleGrad(c, 0) * invStdDev[c]);
+        r[c] = (ElemType) (k * (scaleGrad(c, 0) * invStdDev[c] * mean[c] - biasGrad(c, 0)));
+    }
+    const ElemType* pp = p.data();
+    const ElemType* pq = q.data();
+    const ElemType* pr = r.data();
+#pragma omp parallel for
+    for (long j = 0; j < (long) batchSize; j++)
+    {
+        const ElemType* x = in.Data() + j * vectorSize;
+        const ElemType* dy = Data() + j * vectorSize;
+        ElemType* dx = grad.Data() + j * vectorSize;
+        if (!spatial)
+        {
+            for (size_t i = 0; i < vectorSize; i++)
+                dx[i] += pp[i] * dy[i] + pq[i] * x[i] + pr[i];
+        }
+        else
+        {
+            for (size_t c = 0; c < numChannels; c++)
+            {
+                const ElemType pc = pp[c], qc = pq[c], rc = pr[c];
+                const ElemType* xc = x + c * spatialSize;
+                const ElemType* dyc = dy + c * spatialSize;
+                ElemType* dxc = dx + c * spatialSize;
+                for (size_t i = 0; i < spatialSize; i++)
+                    dxc[i] += pc * dyc[i] + qc * xc[i] + rc;
+            }
+        }
+    }
+}
+
+#pragma region RNN Functions
+
+template <class ElemType>
+void CPUMatrix<ElemType>::RNNForward(const CPUMatrix<ElemType>& inputX, const CPUMatrix<ElemType>& paramW, size_t xDim, size_t yDim, const vector<size_t>& numSequencesForFrame, const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace)
+{
+    if (!m_rnnExecutor)
+        m_rnnExecutor = std::make_shared<CPURNNExecutor<ElemType>>(xDim, yDim, rnnAttributes);
+    m_rnnExecutor->ForwardCore(paramW, inputX, *this, numSequencesForFrame, rnnAttributes, reserve, workspace);
+}
+
+template <class ElemType>
+void CPUMatrix<ElemType>::RNNBackwardData(const CPUMatrix<ElemType>& outputDY, const CPUMatrix<ElemType>& paramW, CPUMatrix<ElemType>& outputDX, const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace)
+{
+    if (!m_rnnExecutor)
+        LogicError("RNNBackwardData called, but RNNWrapper object is not yet initialized");
+    m_rnnExecutor->BackwardDataCore(*this, outputDY, paramW, outputDX, rnnAttributes, reserve, workspace);
+}
+
+template <class ElemType>
+void CPUMatrix<ElemType>::RNNBackwardWeights(const CPUMatrix<ElemType>& inputX, const CPUMatrix<ElemType>& outputY, CPUMatrix<ElemType>& dw, const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace)
+{
+    if (!m_rnnExecutor)
+        LogicError("RNNBackwardWeights called, but RNNWrapper object is not yet initialized");
+    m_rnnExecutor->BackwardWeightsCore(inputX, outputY, dw, rnnAttributes, reserve, workspace);
 }
 
+#pragma endregion RNN Functions
 
 #pragma region Static BLAS Functions
 
@@ -28,6 +28,8 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 
 double logadd(double x, double y);
 
+template <class ElemType> class CPURNNExecutor;
+
 // To comply with BLAS libraries matrices are stored in ColMajor. However, by default C/C++/C# use RowMajor
 // conversion is need when passing data between CPUMatrix and C++ matrices
 template <class ElemType>
@@ -392,6 +394,12 @@ public:
     void BatchNormalizationBackward(const CPUMatrix<ElemType>& in, CPUMatrix<ElemType>& grad, const CPUMatrix<ElemType>& scale, double blendFactor, const CPUMatrix<ElemType>& saveMean, const CPUMatrix<ElemType>& saveInvStdDev,
                                     CPUMatrix<ElemType>& scaleGrad, CPUMatrix<ElemType>& biasGrad) const;
 
+public:
+    // RNN support functions
+    void RNNForward(const CPUMatrix<ElemType>& inputX, const CPUMatrix<ElemType>& paramW, size_t xDim, size_t yDim, const vector<size_t>& numSequencesForFrame, const struct RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace);
+    void RNNBackwardData(const CPUMatrix<ElemType>& outputDY, const CPUMatrix<ElemType>& paramW, CPUMatrix<ElemType>& outputDX, const struct RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace);
+    void RNNBackwardWeights(const CPUMatrix<ElemType>& inputX, const CPUMatrix<ElemType>& outputY, CPUMatrix<ElemType>& dw, const struct RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace);
+
 public:
     // This functions do not depend on <ElemType>, i.e. you can call them on any <ElemType>
     static int SetNumThreads(int numThreads);
@@ -529,6 +537,11 @@ protected:
 
 private:
     void Clear();
+
+#pragma warning(push)
+#pragma warning(disable : 4251)
+    mutable std::shared_ptr<CPURNNExecutor<ElemType>> m_rnnExecutor; // for OptimizedRNNStack
+#pragma warning(pop)
 };
 
 typedef CPUMatrix<float> CPUSingleMatrix;
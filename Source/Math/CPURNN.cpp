@@ -0,0 +1,470 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "CPURNN.h"
+#include "TensorOps.h"
+#include <omp.h>
+#include <algorithm>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// returns a [numRows x numCols] matrix that references the elements of 'buffer' starting at 'offset', without copying them
+template <class ElemType>
+static CPUMatrix<ElemType> ViewOf(const CPUMatrix<ElemType>& buffer, size_t offset, size_t numRows, size_t numCols)
+{
+    assert(offset + numRows * numCols <= buffer.GetNumElements());
+    return CPUMatrix<ElemType>(numRows, numCols, buffer.Data() + offset, matrixFlagDontOwnBuffer);
+}
+
+// c = alpha * op(a) * op(b) + beta * c, skipping empty products (BLAS does not accept zero leading dimensions)
+template <class ElemType>
+static void Gemm(ElemType alpha, const CPUMatrix<ElemType>& a, bool transposeA, const CPUMatrix<ElemType>& b, bool transposeB, ElemType beta, CPUMatrix<ElemType>& c)
+{
+    if (c.IsEmpty())
+        return;
+    if (a.IsEmpty() || b.IsEmpty())
+    {
+        assert(beta == 0 || beta == 1);
+        if (beta == 0)
+            c.SetValue(0);
+        return;
+    }
+    CPUMatrix<ElemType>::MultiplyAndWeightedAdd(alpha, a, transposeA, b, transposeB, beta, c);
+}
+
+template <class ElemType>
+CPURNNExecutor<ElemType>::CPURNNExecutor(size_t xDim, size_t yDim, const RnnAttributes& rnnAttributes)
+    : m_xDim(xDim), m_yDim(yDim), m_rnnAttributes(rnnAttributes), m_hiddenSize(rnnAttributes.m_hiddenSize),
+      m_numSteps(0), m_numFrames(0), m_backwardDataCalledYet(false)
+{
+    if      (m_rnnAttributes.m_recurrentOp == wstring(L"lstm"))    { m_cellKind = CellKind::LSTM; m_numGates = 4; }
+    else if (m_rnnAttributes.m_recurrentOp == wstring(L"gru"))     { m_cellKind = CellKind::GRU;  m_numGates = 3; }
+    else if (m_rnnAttributes.m_recurrentOp == wstring(L"rnnReLU")) { m_cellKind = CellKind::ReLU; m_numGates = 1; }
+    else if (m_rnnAttributes.m_recurrentOp == wstring(L"rnnTanh")) { m_cellKind = CellKind::Tanh; m_numGates = 1; }
+    else InvalidArgument("Unknown cell type '%ls'. Supported values are 'lstm', 'gru', 'rnnReLU', 'rnnTanh'.", m_rnnAttributes.m_recurrentOp.c_str());
+
+    if (m_rnnAttributes.m_numLayers == 0 || m_hiddenSize == 0)
+        InvalidArgument("CPURNNExecutor: numLayers and hiddenSize must be positive.");
+}
+
+template <class ElemType>
+size_t CPURNNExecutor<ElemType>::NumParameters() const
+{
+    size_t total = 0;
+    for (size_t layer = 0; layer < m_rnnAttributes.m_numLayers; layer++)
+        total += NumDirections() * GatesDim() * (LayerInputDim(layer) + m_hiddenSize + 2);
+    return total;
+}
+
+template <class ElemType>
+typename CPURNNExecutor<ElemType>::ParameterOffsets CPURNNExecutor<ElemType>::GetParameterOffsets(size_t layer, size_t direction) const
+{
+    // weight matrices of all pseudo-layers first, then the biases of all pseudo-layers
+    size_t weightsOffset = 0;
+    for (size_t l = 0; l < layer; l++)
+        weightsOffset += NumDirections() * GatesDim() * (LayerInputDim(l) + m_hiddenSize);
+    weightsOffset += direction * GatesDim() * (LayerInputDim(layer) + m_hiddenSize);
+
+    size_t biasesOffset = NumParameters() - NumPseudoLayers() * 2 * GatesDim();
+    biasesOffset += (layer * NumDirections() + direction) * 2 * GatesDim();
+
+    ParameterOffsets offsets;
+    offsets.m_W  = weightsOffset;
+    offsets.m_R  = weightsOffset + GatesDim() * LayerInputDim(layer);
+    offsets.m_bW = biasesOffset;
+    offsets.m_bR = biasesOffset + GatesDim();
+    return offsets;
+}
+
+template <class ElemType>
+size_t CPURNNExecutor<ElemType>::PseudoLayerReserveSize() const
+{
+    // gate activations, hidden state, and for LSTM the cell state, for GRU R_n' h + bR_n
+    size_t numRows = GatesDim() + m_hiddenSize + (m_cellKind == CellKind::LSTM || m_cellKind == CellKind::GRU ? m_hiddenSize : 0);
+    return numRows * m_numFrames;
+}
+
+template <class ElemType>
+size_t CPURNNExecutor<ElemType>::NumSequencesWithPreviousStep(size_t step, size_t direction) const
+{
+    if (!HasPreviousStep(step, direction))
+        return 0;
+    // sequences are sorted by decreasing length, so they are active in a prefix of the columns of each frame
+    return min(m_numSequencesForFrame[step], m_numSequencesForFrame[PreviousStep(step, direction)]);
+}
+
+// -----------------------------------------------------------------------
+// forward
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+void CPURNNExecutor<ElemType>::ForwardCore(const CPUMatrix<ElemType>& weightsW, const CPUMatrix<ElemType>& inputX, CPUMatrix<ElemType>& outputY,
+                                           const vector<size_t>& numSequencesForFrame, const RnnAttributes& rnnAttributes,
+                                           CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace)
+{
+    // test that the RNN shape is correct
+    if (!(m_rnnAttributes == rnnAttributes))
+        LogicError("RNN Layout has changed during processing");
+
+    if (m_yDim != NumDirections() * m_hiddenSize)
+        InvalidArgument("CPURNNExecutor ForwardCore: Output leading dimension must be twice hidden size for bidirectional networks");
+    if (NumParameters() != weightsW.GetNumElements())
+        InvalidArgument("RNN needs %ld parameters, but %ld were allocated", (long)NumParameters(), (long)weightsW.GetNumElements());
+
+    m_numSequencesForFrame = numSequencesForFrame;
+    m_numSteps = m_numSequencesForFrame.size();
+    m_frameOffsets.resize(m_numSteps + 1);
+    m_frameOffsets[0] = 0;
+    for (size_t t = 0; t < m_numSteps; t++)
+    {
+        if (t > 0 && m_numSequencesForFrame[t] > m_numSequencesForFrame[t - 1])
+            InvalidArgument("CPURNNExecutor ForwardCore: Sequences must be sorted by decreasing length.");
+        m_frameOffsets[t + 1] = m_frameOffsets[t] + m_numSequencesForFrame[t];
+    }
+    m_numFrames = m_frameOffsets[m_numSteps];
+
+    if (inputX.GetNumRows() != m_xDim || inputX.GetNumCols() != m_numFrames)
+        InvalidArgument("CPURNNExecutor ForwardCore: Input must have %d x %d elements.", (int)m_xDim, (int)m_numFrames);
+    if (outputY.GetNumRows() != m_yDim || outputY.GetNumCols() != m_numFrames)
+        InvalidArgument("CPURNNExecutor ForwardCore: Output must have %d x %d elements.", (int)m_yDim, (int)m_numFrames);
+
+    size_t maxNumSequences = m_numSteps > 0 ? m_numSequencesForFrame[0] : 0;
+    m_stepRecurrent.Resize(GatesDim(), maxNumSequences);
+
+    reserve.Resize(ReserveSize(), 1);
+    UNUSED(workspace); // only used by the backward pass
+    m_backwardDataCalledYet = false;
+
+    if (m_numFrames == 0)
+        return;
+
+    for (size_t layer = 0; layer < m_rnnAttributes.m_numLayers; layer++)
+    {
+        bool isTopLayer = layer + 1 == m_rnnAttributes.m_numLayers;
+        CPUMatrix<ElemType> layerInput = layer == 0 ? ViewOf(inputX, 0, m_xDim, m_numFrames) : ViewOf(reserve, ReserveLayerOutputOffset(layer - 1), LayerInputDim(layer), m_numFrames);
+        CPUMatrix<ElemType> layerOutput = isTopLayer ? ViewOf(outputY, 0, m_yDim, m_numFrames) : ViewOf(reserve, ReserveLayerOutputOffset(layer), m_yDim, m_numFrames);
+
+        for (size_t direction = 0; direction < NumDirections(); direction++)
+        {
+            ForwardPseudoLayer(layer, direction, weightsW, layerInput, reserve);
+
+            // the layer output stacks the hidden states of both directions
+            const ElemType* hidden = reserve.Data() + ReserveHiddenOffset(layer * NumDirections() + direction);
+            ElemType* output = layerOutput.Data() + direction * m_hiddenSize;
+#pragma omp parallel for
+            for (long j = 0; j < (long)m_numFrames; j++)
+                memcpy(output + j * m_yDim, hidden + j * m_hiddenSize, sizeof(ElemType) * m_hiddenSize);
+        }
+    }
+}
+
+template <class ElemType>
+void CPURNNExecutor<ElemType>::ForwardPseudoLayer(size_t layer, size_t direction, const CPUMatrix<ElemType>& weightsW, const CPUMatrix<ElemType>& layerInput, CPUMatrix<ElemType>& reserve)
+{
+    const size_t H = m_hiddenSize;
+    const size_t G = GatesDim();
+    const size_t pseudoLayer = layer * NumDirections() + direction;
+    const ParameterOffsets offsets = GetParameterOffsets(layer, direction);
+    const CPUMatrix<ElemType> W = ViewOf(weightsW, offsets.m_W, LayerInputDim(layer), G);
+    const CPUMatrix<ElemType> R = ViewOf(weightsW, offsets.m_R, H, G);
+    const ElemType* bW = weightsW.Data() + offsets.m_bW;
+    const ElemType* bR = weightsW.Data() + offsets.m_bR;
+
+    CPUMatrix<ElemType> gates = ViewOf(reserve, ReserveGatesOffset(pseudoLayer), G, m_numFrames);
+    ElemType* gatesData = gates.Data();
+    ElemType* hiddenData = reserve.Data() + ReserveHiddenOffset(pseudoLayer);
+    ElemType* cellData = reserve.Data() + ReserveCellOffset(pseudoLayer); // LSTM: cell state; GRU: R_n' h + bR_n
+
+    // input projection of all frames at once: gates = W' x + bW (+ bR, except for the GRU candidate, where bR is applied inside the reset gate)
+    Gemm<ElemType>(1, W, true, layerInput, false, 0, gates);
+    const size_t numRowsWithBothBiases = m_cellKind == CellKind::GRU ? 2 * H : G;
+#pragma omp parallel for
+    for (long j = 0; j < (long)m_numFrames; j++)
+    {
+        ElemType* a = gatesData + j * G;
+        for (size_t k = 0; k < numRowsWithBothBiases; k++)
+            a[k] += bW[k] + bR[k];
+        for (size_t k = numRowsWithBothBiases; k < G; k++)
+            a[k] += bW[k];
+    }
+
+    for (size_t s = 0; s < m_numSteps; s++)
+    {
+        const size_t step = direction == 0 ? s : m_numSteps - 1 - s;
+        const size_t n = m_numSequencesForFrame[step];
+        const size_t nPrev = NumSequencesWithPreviousStep(step, direction);
+        const size_t offset = m_frameOffsets[step];
+        const size_t prevOffset = nPrev > 0 ? m_frameOffsets[PreviousStep(step, direction)] : 0;
+        const CPUMatrix<ElemType> hiddenPrev = ViewOf(reserve, ReserveHiddenOffset(pseudoLayer) + prevOffset * H, H, nPrev);
+
+        // recurrent projection
+        if (m_cellKind == CellKind::GRU)
+        {
+            // m_stepRecurrent = R' h_prev + bR, kept separate because the candidate gate applies the reset gate to it
+            CPUMatrix<ElemType> recurrent = ViewOf(m_stepRecurrent, 0, G, nPrev);
+            Gemm<ElemType>(1, R, true, hiddenPrev, false, 0, recurrent);
+        }
+        else
+        {
+            CPUMatrix<ElemType> stepGates = ViewOf(gates, offset * G, G, nPrev);
+            Gemm<ElemType>(1, R, true, hiddenPrev, false, 1, stepGates);
+        }
+
+        // fused gate nonlinearities
+#pragma omp parallel for if (n * G > 4096)
+        for (long j = 0; j < (long)n; j++)
+        {
+            const bool hasPrev = (size_t)j < nPrev;
+            ElemType* a = gatesData + (offset + j) * G;
+            ElemType* h = hiddenData + (offset + j) * H;
+            ElemType* c = cellData + (offset + j) * H;
+            const ElemType* hPrev = hasPrev ? hiddenData + (prevOffset + j) * H : nullptr;
+            const ElemType* cPrev = hasPrev ? cellData + (prevOffset + j) * H : nullptr;
+            if (m_cellKind == CellKind::LSTM)
+            {
+                for (size_t k = 0; k < H; k++)
+                {
+                    ElemType i = Sigmoid(a[k]);
+                    ElemType f = Sigmoid(a[H + k]);
+                    ElemType g = tanh_(a[2 * H + k]);
+                    ElemType o = Sigmoid(a[3 * H + k]);
+                    c[k] = i * g + (hasPrev ? f * cPrev[k] : 0);
+                    h[k] = o * tanh_(c[k]);
+                    a[k] = i; a[H + k] = f; a[2 * H + k] = g; a[3 * H + k] = o;
+                }
+            }
+            else if (m_cellKind == CellKind::GRU)
+            {
+                const ElemType* rh = m_stepRecurrent.Data() + j * G;
+                for (size_t k = 0; k < H; k++)
+                {
+                    ElemType r = Sigmoid(a[k]         + (hasPrev ? rh[k]     : 0));
+                    ElemType z = Sigmoid(a[H + k]     + (hasPrev ? rh[H + k] : 0));
+                    c[k] = (hasPrev ? rh[2 * H + k] : 0) + bR[2 * H + k];
+                    ElemType candidate = tanh_(a[2 * H + k] + r * c[k]);
+                    h[k] = (1 - z) * candidate + (hasPrev ? z * hPrev[k] : 0);
+                    a[k] = r; a[H + k] = z; a[2 * H + k] = candidate;
+                }
+            }
+            else if (m_cellKind == CellKind::ReLU)
+            {
+                for (size_t k = 0; k < H; k++)
+                    a[k] = h[k] = a[k] > 0 ? a[k] : 0;
+            }
+            else // Tanh
+            {
+                for (size_t k = 0; k < H; k++)
+                    a[k] = h[k] = tanh_(a[k]);
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------
+// backward
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+void CPURNNExecutor<ElemType>::BackwardDataCore(const CPUMatrix<ElemType>& outputY, const CPUMatrix<ElemType>& outputDY, const CPUMatrix<ElemType>& weightsW, CPUMatrix<ElemType>& dx,
+                                                const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace)
+{
+    // test that the RNN shape is correct
+    if (!(m_rnnAttributes == rnnAttributes))
+        LogicError("RNN Layout has changed during processing");
+    if (m_backwardDataCalledYet)
+        return;
+
+    if (outputDY.GetNumRows() != m_yDim || outputDY.GetNumCols() != m_numFrames)
+        InvalidArgument("CPURNNExecutor BackwardDataCore: Output gradient must have %d x %d elements.", (int)m_yDim, (int)m_numFrames);
+    if (dx.GetNumRows() != m_xDim || dx.GetNumCols() != m_numFrames)
+        InvalidArgument("CPURNNExecutor BackwardDataCore: Input gradient must have %d x %d elements.", (int)m_xDim, (int)m_numFrames);
+    if (reserve.GetNumElements() != ReserveSize())
+        LogicError("CPURNNExecutor BackwardDataCore: The reserve buffer does not match the last forward pass.");
+
+    size_t maxNumSequences = m_numSteps > 0 ? m_numSequencesForFrame[0] : 0;
+    m_stepHiddenGradient.Resize(m_hiddenSize, maxNumSequences);
+    m_stepCellGradient.Resize(m_hiddenSize, maxNumSequences);
+    m_stepNextCellGradient.Resize(m_hiddenSize, maxNumSequences);
+    workspace.Resize(WorkspaceSize(), 1);
+    m_backwardDataCalledYet = true;
+
+    if (m_numFrames == 0)
+        return;
+
+    for (size_t layer = m_rnnAttributes.m_numLayers; layer-- > 0;)
+    {
+        bool isTopLayer = layer + 1 == m_rnnAttributes.m_numLayers;
+        // the gradient of the layer output is the output gradient for the top layer, and was computed by the layer above otherwise
+        CPUMatrix<ElemType> layerOutputGradient = isTopLayer ? ViewOf(outputDY, 0, m_yDim, m_numFrames) : ViewOf(workspace, WorkspaceLayerGradientOffset(), m_yDim, m_numFrames);
+
+        for (size_t direction = 0; direction < NumDirections(); direction++)
+            BackwardDataPseudoLayer(layer, direction, weightsW, layerOutputGradient, reserve, workspace);
+
+        // gradient of the layer input: sum of W dG over both directions
+        CPUMatrix<ElemType> layerInputGradient = layer == 0 ? ViewOf(dx, 0, m_xDim, m_numFrames) : ViewOf(workspace, WorkspaceLayerGradientOffset(), LayerInputDim(layer), m_numFrames);
+        for (size_t direction = 0; direction < NumDirections(); direction++)
+        {
+            const ParameterOffsets offsets = GetParameterOffsets(layer, direction);
+            const CPUMatrix<ElemType> W = ViewOf(weightsW, offsets.m_W, LayerInputDim(layer), GatesDim());
+            const CPUMatrix<ElemType> gateGradient = ViewOf(workspace, WorkspaceGateGradientOffset(layer * NumDirections() + direction), GatesDim(), m_numFrames);
+            Gemm<ElemType>(1, W, false, gateGradient, false, direction == 0 ? 0 : 1, layerInputGradient);
+        }
+    }
+}
+
+template <class ElemType>
+void CPURNNExecutor<ElemType>::BackwardDataPseudoLayer(size_t layer, size_t direction, const CPUMatrix<ElemType>& weightsW, const CPUMatrix<ElemType>& layerOutputGradient,
+                                                       CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace)
+{
+    const size_t H = m_hiddenSize;
+    const size_t G = GatesDim();
+    const size_t pseudoLayer = layer * NumDirections() + direction;
+    const ParameterOffsets offsets = GetParameterOffsets(layer, direction);
+    const CPUMatrix<ElemType> R = ViewOf(weightsW, offsets.m_R, H, G);
+
+    const ElemType* gatesData = reserve.Data() + ReserveGatesOffset(pseudoLayer);
+    const ElemType* hiddenData = reserve.Data() + ReserveHiddenOffset(pseudoLayer);
+    const ElemType* cellData = reserve.Data() + ReserveCellOffset(pseudoLayer);
+    const ElemType* dyData = layerOutputGradient.Data() + direction * H;
+    ElemType* dGateData = workspace.Data() + WorkspaceGateGradientOffset(pseudoLayer);
+    ElemType* dRecurrentData = workspace.Data() + WorkspaceRecurrentGateGradientOffset(pseudoLayer); // same as dGateData except for GRU
+    const CPUMatrix<ElemType> recurrentGateGradient = ViewOf(workspace, WorkspaceRecurrentGateGradientOffset(pseudoLayer), G, m_numFrames);
+
+    // number of valid columns in m_stepHiddenGradient/m_stepCellGradient, i.e. of sequences whose state was continued by the step processed before
+    size_t nCarry = 0;
+    // process the steps in the reverse order of the forward pass
+    for (size_t s = 0; s < m_numSteps; s++)
+    {
+        const size_t step = direction == 0 ? m_numSteps - 1 - s : s;
+        const size_t n = m_numSequencesForFrame[step];
+        const size_t nPrev = NumSequencesWithPreviousStep(step, direction);
+        const size_t offset = m_frameOffsets[step];
+        const size_t prevOffset = nPrev > 0 ? m_frameOffsets[PreviousStep(step, direction)] : 0;
+        const ElemType* dhCarry = m_stepHiddenGradient.Data();
+        const ElemType* dcCarry = m_stepCellGradient.Data();
+        ElemType* dcNext = m_stepNextCellGradient.Data(); // LSTM: gradient of the previous cell state; GRU: direct gradient of the previous hidden state
+
+#pragma omp parallel for if (n * G > 4096)
+        for (long j = 0; j < (long)n; j++)
+        {
+            const bool hasCarry = (size_t)j < nCarry;
+            const bool hasPrev = (size_t)j < nPrev;
+            const ElemType* a = gatesData + (offset + j) * G;
+            const ElemType* h = hiddenData + (offset + j) * H;
+            const ElemType* c = cellData + (offset + j) * H;
+            const ElemType* dy = dyData + (offset + j) * m_yDim;
+            ElemType* da = dGateData + (offset + j) * G;
+            ElemType* daRecurrent = dRecurrentData + (offset + j) * G;
+            for (size_t k = 0; k < H; k++)
+            {
+                ElemType dh = dy[k] + (hasCarry ? dhCarry[j * H + k] : 0);
+                if (m_cellKind == CellKind::LSTM)
+                {
+                    ElemType i = a[k], f = a[H + k], g = a[2 * H + k], o = a[3 * H + k];
+                    ElemType tanhC = tanh_(c[k]);
+                    ElemType dc = dh * o * (1 - tanhC * tanhC) + (hasCarry ? dcCarry[j * H + k] : 0);
+                    ElemType cPrev = hasPrev ? cellData[(prevOffset + j) * H + k] : 0;
+                    da[k]         = dc * g * i * (1 - i);
+                    da[H + k]     = dc * cPrev * f * (1 - f);
+                    da[2 * H + k] = dc * i * (1 - g * g);
+                    da[3 * H + k] = dh * tanhC * o * (1 - o);
+                    dcNext[j * H + k] = dc * f;
+                }
+                else if (m_cellKind == CellKind::GRU)
+                {
+                    ElemType r = a[k], z = a[H + k], candidate = a[2 * H + k];
+                    ElemType hPrev = hasPrev ? hiddenData[(prevOffset + j) * H + k] : 0;
+                    ElemType dCandidate = dh * (1 - z) * (1 - candidate * candidate);
+                    da[k]         = dCandidate * c[k] * r * (1 - r);
+                    da[H + k]     = dh * (hPrev - candidate) * z * (1 - z);
+                    da[2 * H + k] = dCandidate;
+                    daRecurrent[k]         = da[k];
+                    daRecurrent[H + k]     = da[H + k];
+                    daRecurrent[2 * H + k] = dCandidate * r;
+                    dcNext[j * H + k] = dh * z;
+                }
+                else if (m_cellKind == CellKind::ReLU)
+                    da[k] = h[k] > 0 ? dh : 0;
+                else // Tanh
+                    da[k] = dh * (1 - h[k] * h[k]);
+            }
+        }
+
+        // gradient of the previous hidden state (and cell state) to be consumed by the next step to be processed
+        CPUMatrix<ElemType> dhPrev = ViewOf(m_stepHiddenGradient, 0, H, nPrev);
+        Gemm<ElemType>(1, R, false, ViewOf(recurrentGateGradient, offset * G, G, nPrev), false, 0, dhPrev);
+        if (m_cellKind == CellKind::GRU)
+        {
+            ElemType* dh = m_stepHiddenGradient.Data();
+            for (size_t k = 0; k < nPrev * H; k++)
+                dh[k] += dcNext[k];
+        }
+        else if (m_cellKind == CellKind::LSTM)
+            m_stepCellGradient.SetValue(m_stepNextCellGradient);
+        nCarry = nPrev;
+    }
+}
+
+template <class ElemType>
+void CPURNNExecutor<ElemType>::BackwardWeightsCore(const CPUMatrix<ElemType>& inputX, const CPUMatrix<ElemType>& outputY, CPUMatrix<ElemType>& dw,
+                                                   const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace)
+{
+    // test that the RNN shape is correct
+    if (!(m_rnnAttributes == rnnAttributes))
+        LogicError("RNN Layout has changed during processing");
+    if (!m_backwardDataCalledYet)
+        LogicError("CPURNNExecutor: BackwardWeightsCore() called before BackwardDataCore().");
+    if (dw.GetNumElements() != NumParameters())
+        InvalidArgument("RNN needs %ld parameters, but %ld were allocated", (long)NumParameters(), (long)dw.GetNumElements());
+    UNUSED(outputY);
+
+    if (m_numFrames == 0)
+        return;
+
+    const size_t H = m_hiddenSize;
+    const size_t G = GatesDim();
+    CPUMatrix<ElemType> ones(m_numFrames, 1);
+    ones.SetValue(1);
+    // the hidden state each column continued from (zero at sequence boundaries); reuses the layer gradient buffer, which is not needed anymore
+    CPUMatrix<ElemType> hiddenPrev = ViewOf(workspace, WorkspaceLayerGradientOffset(), H, m_numFrames);
+
+    for (size_t layer = 0; layer < m_rnnAttributes.m_numLayers; layer++)
+    {
+        CPUMatrix<ElemType> layerInput = layer == 0 ? ViewOf(inputX, 0, m_xDim, m_numFrames) : ViewOf(reserve, ReserveLayerOutputOffset(layer - 1), LayerInputDim(layer), m_numFrames);
+        for (size_t direction = 0; direction < NumDirections(); direction++)
+        {
+            const size_t pseudoLayer = layer * NumDirections() + direction;
+            const ParameterOffsets offsets = GetParameterOffsets(layer, direction);
+            CPUMatrix<ElemType> dW  = ViewOf(dw, offsets.m_W, LayerInputDim(layer), G);
+            CPUMatrix<ElemType> dR  = ViewOf(dw, offsets.m_R, H, G);
+            CPUMatrix<ElemType> dbW = ViewOf(dw, offsets.m_bW, G, 1);
+            CPUMatrix<ElemType> dbR = ViewOf(dw, offsets.m_bR, G, 1);
+            const CPUMatrix<ElemType> gateGradient = ViewOf(workspace, WorkspaceGateGradientOffset(pseudoLayer), G, m_numFrames);
+            const CPUMatrix<ElemType> recurrentGateGradient = ViewOf(workspace, WorkspaceRecurrentGateGradientOffset(pseudoLayer), G, m_numFrames);
+
+            const ElemType* hiddenData = reserve.Data() + ReserveHiddenOffset(pseudoLayer);
+            for (size_t step = 0; step < m_numSteps; step++)
+            {
+                const size_t n = m_numSequencesForFrame[step];
+                const size_t nPrev = NumSequencesWithPreviousStep(step, direction);
+                ElemType* dst = hiddenPrev.Data() + m_frameOffsets[step] * H;
+                if (nPrev > 0)
+                    memcpy(dst, hiddenData + m_frameOffsets[PreviousStep(step, direction)] * H, sizeof(ElemType) * nPrev * H);
+                memset(dst + nPrev * H, 0, sizeof(ElemType) * (n - nPrev) * H);
+            }
+
+            Gemm<ElemType>(1, layerInput, false, gateGradient, true, 1, dW);
+            Gemm<ElemType>(1, hiddenPrev, false, recurrentGateGradient, true, 1, dR);
+            Gemm<ElemType>(1, gateGradient, false, ones, false, 1, dbW);
+            Gemm<ElemType>(1, recurrentGateGradient, false, ones, false, 1, dbR);
+        }
+    }
+}
+
+template class CPURNNExecutor<float>;
+template class CPURNNExecutor<double>;
+
+}}}
@@ -0,0 +1,99 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPURNN.h - CPU implementation of the fused RNN stack used by OptimizedRNNStackNode
+//
+
+#pragma once
+
+#include "CPUMatrix.h"
+#include "RNNCommon.h"
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// CPURNNExecutor is the CPU counterpart of CuDnnRNNExecutor. It accepts the same inputs: sequences packed
+// frame by frame in decreasing order of length (numSequencesForFrame[t] sequences are active in frame t),
+// and the parameters in the packed cuDNN layout, so that models trained on GPU can be evaluated on CPU
+// and vice versa.
+//
+// The cuDNN parameter layout is: the weight matrices of all pseudo-layers (a pseudo-layer is one direction
+// of one layer, ordered by layer, then direction), each being the input matrix W followed by the recurrent
+// matrix R, followed by the biases of all pseudo-layers, each being bW followed by bR. W, R, bW and bR are
+// stacked over the gates, in the order (i, f, g, o) for LSTM and (r, z, n) for GRU. Read as column-major
+// matrices, W is [inputDim x numGates * hiddenSize] and R is [hiddenSize x numGates * hiddenSize].
+//
+// The input projections W' x of all frames are computed by a single GEMM per pseudo-layer. Each time step then
+// only adds R' h for the active sequences (one GEMM) and applies the gate nonlinearities in a fused loop.
+//
+// 'reserve' keeps the gate activations and states of the forward pass for the backward pass, and 'workspace'
+// keeps the gate gradients computed by BackwardDataCore() for BackwardWeightsCore(). As with cuDNN,
+// BackwardDataCore() must be called before BackwardWeightsCore(), and the weight gradient is accumulated into dw.
+template <class ElemType>
+class CPURNNExecutor
+{
+public:
+    CPURNNExecutor(size_t xDim, size_t yDim, const RnnAttributes& rnnAttributes);
+
+    void ForwardCore(const CPUMatrix<ElemType>& weightsW, const CPUMatrix<ElemType>& inputX, CPUMatrix<ElemType>& outputY, const vector<size_t>& numSequencesForFrame, const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace);
+    void BackwardWeightsCore(const CPUMatrix<ElemType>& inputX, const CPUMatrix<ElemType>& outputY, CPUMatrix<ElemType>& dw, const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace);
+    void BackwardDataCore(const CPUMatrix<ElemType>& outputY, const CPUMatrix<ElemType>& outputDY, const CPUMatrix<ElemType>& w, CPUMatrix<ElemType>& dx, const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace);
+
+private:
+    enum class CellKind { LSTM, GRU, ReLU, Tanh };
+
+    // offsets (in elements) of the parts of one pseudo-layer in the parameter vector
+    struct ParameterOffsets
+    {
+        size_t m_W, m_R, m_bW, m_bR;
+    };
+
+    size_t NumDirections() const { return m_rnnAttributes.m_bidirectional ? 2 : 1; }
+    size_t NumPseudoLayers() const { return m_rnnAttributes.m_numLayers * NumDirections(); }
+    size_t LayerInputDim(size_t layer) const { return layer == 0 ? m_xDim : NumDirections() * m_hiddenSize; }
+    size_t GatesDim() const { return m_numGates * m_hiddenSize; }
+    size_t NumParameters() const;
+    ParameterOffsets GetParameterOffsets(size_t layer, size_t direction) const;
+
+    // the sizes and offsets of the buffers in 'reserve' and 'workspace'
+    size_t PseudoLayerReserveSize() const;
+    size_t ReserveGatesOffset(size_t pseudoLayer) const { return pseudoLayer * PseudoLayerReserveSize(); }
+    size_t ReserveHiddenOffset(size_t pseudoLayer) const { return ReserveGatesOffset(pseudoLayer) + GatesDim() * m_numFrames; }
+    size_t ReserveCellOffset(size_t pseudoLayer) const { return ReserveHiddenOffset(pseudoLayer) + m_hiddenSize * m_numFrames; }
+    size_t ReserveLayerOutputOffset(size_t layer) const { return NumPseudoLayers() * PseudoLayerReserveSize() + layer * NumDirections() * m_hiddenSize * m_numFrames; }
+    size_t ReserveSize() const { return ReserveLayerOutputOffset(m_rnnAttributes.m_numLayers - 1); }
+    size_t WorkspaceGateGradientOffset(size_t pseudoLayer) const { return pseudoLayer * GatesDim() * m_numFrames * (m_cellKind == CellKind::GRU ? 2 : 1); }
+    size_t WorkspaceRecurrentGateGradientOffset(size_t pseudoLayer) const { return WorkspaceGateGradientOffset(pseudoLayer) + (m_cellKind == CellKind::GRU ? GatesDim() * m_numFrames : 0); }
+    size_t WorkspaceLayerGradientOffset() const { return WorkspaceGateGradientOffset(NumPseudoLayers()); }
+    size_t WorkspaceSize() const { return WorkspaceLayerGradientOffset() + NumDirections() * m_hiddenSize * m_numFrames; }
+
+    // step 'step' of the given direction continues the state of step PreviousStep(), if that one exists and has a column for the sequence
+    bool HasPreviousStep(size_t step, size_t direction) const { return direction == 0 ? step > 0 : step + 1 < m_numSteps; }
+    size_t PreviousStep(size_t step, size_t direction) const { return direction == 0 ? step - 1 : step + 1; }
+    size_t NumSequencesWithPreviousStep(size_t step, size_t direction) const;
+
+    void ForwardPseudoLayer(size_t layer, size_t direction, const CPUMatrix<ElemType>& weightsW, const CPUMatrix<ElemType>& layerInput, CPUMatrix<ElemType>& reserve);
+    void BackwardDataPseudoLayer(size_t layer, size_t direction, const CPUMatrix<ElemType>& weightsW, const CPUMatrix<ElemType>& layerOutputGradient, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace);
+
+    size_t m_xDim, m_yDim;
+    RnnAttributes m_rnnAttributes;
+    CellKind m_cellKind;
+    size_t m_numGates;
+    size_t m_hiddenSize;
+
+    // layout of the current minibatch
+    vector<size_t> m_numSequencesForFrame;
+    vector<size_t> m_frameOffsets; // [t] -> index of the first column of frame t
+    size_t m_numSteps;
+    size_t m_numFrames; // total number of columns
+    bool m_backwardDataCalledYet;
+
+    // per-step temporaries, [* x numSequencesForFrame[0]]
+    CPUMatrix<ElemType> m_stepRecurrent;         // GRU: R' h + bR
+    CPUMatrix<ElemType> m_stepHiddenGradient;    // gradient of the hidden state, passed to the previous step
+    CPUMatrix<ElemType> m_stepCellGradient;      // LSTM: gradient of the cell state, passed to the previous step
+    CPUMatrix<ElemType> m_stepNextCellGradient;
+};
+
+}}}
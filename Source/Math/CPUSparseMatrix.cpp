@@ -231,8 +231,9 @@ void CPUSparseMatrix<ElemType>::SetValue(const size_t row, const size_t col, con
         SetColIdx((int) c);
     }
     // Note we don't have m_nz anymore. In order for the change from m_nz to
-    // NzCount to make sense, we need to propogate nz+1 to all col slices.
-    for (size_t max = c + 1; max < m_numCols + 1; max++)
+    // NzCount to make sense, we need to propogate nz+1 to all col slices (row slices for CSR).
+    const size_t numCompressed = (GetFormat() == matrixFormatSparseCSC) ? m_numCols : m_numRows;
+    for (size_t max = c + 1; max < numCompressed + 1; max++)
     {
         SecondaryIndexLocation()[max] = CPUSPARSE_INDEX_TYPE(nz + 1);
     }
@@ -811,9 +812,22 @@ void CPUSparseMatrix<ElemType>::Reset()
 }
 
 // Implements product of one sparse and one dense matrix updating a third dense matrix. Input matrices are optionally transposed.
+// The sparse matrix may be in CSC or CSR format; CSR is processed as the transpose of a CSC matrix with the same index arrays.
+//
+// Every nonzero element of the sparse matrix adds a scaled row or column of the dense matrix to a row or column of c. The work is
+// split across OpenMP threads such that no two threads write the same element of c:
+//  - If the 'outer' dimension of the dense matrix (the one not summed over) is large enough, each thread processes all nonzero
+//    elements, but only for its own block of that dimension (a block of rows of c for dense * sparse, of columns for sparse * dense).
+//  - Otherwise the compressed dimension of the sparse matrix is split across threads. If it is also the dimension that selects the
+//    row/column of c to update (e.g. the columns of a CSC matrix in dense * sparse), threads update disjoint parts of c. If not, each
+//    thread accumulates into a private copy of c, and the copies are added up at the end. If c is too large for private copies,
+//    the product is computed by a single thread.
 // NOTE: The only for using a class template instead of a function template was that I couldn't make the function template compile.
 template <class ElemType, bool denseTimesSparse /* false means SparseTimesDense */, bool transposeA, bool transposeB>
 class MultiplyDenseAndSparse{
+    static const size_t MinOuterBlockSize = 32;                        // minimum block of the dense outer dimension per thread
+    static const size_t MaxPrivateAccumulatorElements = 16 * 1024 * 1024; // upper bound for the total size of per-thread copies of c
+
 public:
     // Note: Below the ordering of the matrix parameters 'sparse' and 'dense' does not imply the order of the matrices in the product which is instead controlled
     // by the value of the boolean template parameter 'denseTimesSparse'.
@@ -860,8 +874,8 @@ public:
         if (sparse.IsEmpty() || dense.IsEmpty())
             return;
 
-        // TODO: Implement CSR as a transposition of b, like we do for GPU.
-        if (sparse.GetFormat() != matrixFormatSparseCSC)
+        const bool isCSC = sparse.GetFormat() == matrixFormatSparseCSC;
+        if (!isCSC && sparse.GetFormat() != matrixFormatSparseCSR)
             NOT_IMPLEMENTED;
 
         // Up to here we have:
@@ -869,20 +883,86 @@ public:
         // * Initialized the output matrix c
 
         // Now do the actual multiplication.
-        ElemType* valueBuffer = sparse.Buffer() + *sparse.SecondaryIndexLocation(); // Points to the value buffer of the current view (i.e. buffer containing values of non-zero elements).
-        int* rowIndexBuffer = sparse.MajorIndexLocation();                          // Points to the index buffer of the current view (i.e. buffer containing indices of non-zero elements).
-        size_t iNonzero = 0;                                                           // Number of nonzero elements handled so far for curent slice view.
-        int numPreviosNonzero = sparse.SecondaryIndexLocation()[0];                 // Total number of nonzero values handled in previous slices.
+        const size_t numCompressed = isCSC ? sparse.GetNumCols() : sparse.GetNumRows();
+        // does the compressed index of the sparse matrix select the row/column of c that its nonzero elements update?
+        const bool outerIndexSparseIsCol = (denseTimesSparse && !transposeB) || (!denseTimesSparse && transposeA);
+        const bool compressedIndexSelectsOutput = (outerIndexSparseIsCol == isCSC);
+        const size_t numThreads = (size_t)omp_get_max_threads();
+
+        if (numThreads > 1 && outerDimensionDense >= numThreads * MinOuterBlockSize)
+        {
+            // each thread handles a block of the dense outer dimension
+            const size_t blockSize = (outerDimensionDense + numThreads - 1) / numThreads;
+#pragma omp parallel for
+            for (long block = 0; block < (long)numThreads; block++)
+            {
+                size_t outerBegin = block * blockSize;
+                size_t outerEnd = min(outerDimensionDense, outerBegin + blockSize);
+                if (outerBegin < outerEnd)
+                    AddProductsOfNonzeros(alpha, sparse, isCSC, dense, 0, numCompressed, outerBegin, outerEnd, c.Data(), c.GetNumRows());
+            }
+        }
+        else if (numThreads > 1 && numCompressed >= 2 * numThreads && compressedIndexSelectsOutput)
+        {
+            // each thread handles a set of sparse columns (CSC) or rows (CSR), which update disjoint parts of c
+#pragma omp parallel for schedule(dynamic, 16)
+            for (long index = 0; index < (long)numCompressed; index++)
+                AddProductsOfNonzeros(alpha, sparse, isCSC, dense, index, index + 1, 0, outerDimensionDense, c.Data(), c.GetNumRows());
+        }
+        else if (numThreads > 1 && numCompressed >= 2 * numThreads && c.GetNumElements() * numThreads <= MaxPrivateAccumulatorElements)
+        {
+            // each thread handles a set of sparse columns (CSC) or rows (CSR) and accumulates into its own copy of c
+            const size_t numElements = c.GetNumElements();
+            vector<vector<ElemType>> accumulators(numThreads);
+            ElemType* cData = c.Data();
+#pragma omp parallel num_threads((int)numThreads)
+            {
+                auto& accumulator = accumulators[omp_get_thread_num()];
+                accumulator.assign(numElements, 0);
+#pragma omp for schedule(dynamic, 16)
+                for (long index = 0; index < (long)numCompressed; index++)
+                    AddProductsOfNonzeros(alpha, sparse, isCSC, dense, index, index + 1, 0, outerDimensionDense, accumulator.data(), c.GetNumRows());
+                // (implicit barrier: all accumulators are complete)
+#pragma omp for
+                for (long i = 0; i < (long)numElements; i++)
+                {
+                    ElemType sum = 0;
+                    for (const auto& partial : accumulators)
+                    {
+                        if (!partial.empty())
+                            sum += partial[i];
+                    }
+                    cData[i] += sum;
+                }
+            }
+        }
+        else
+            AddProductsOfNonzeros(alpha, sparse, isCSC, dense, 0, numCompressed, 0, outerDimensionDense, c.Data(), c.GetNumRows());
+    }
 
-        // Loop over columns of the sparse matrix
-        for (size_t colSparse = 0; colSparse < sparse.GetNumCols(); colSparse++)
+private:
+    // Adds the contributions of the nonzero elements in the compressed index range [compressedBegin, compressedEnd) of the sparse matrix,
+    // restricted to the dense outer index range [outerBegin, outerEnd), to the column-major matrix at cData with cNumRows rows.
+    static void AddProductsOfNonzeros(ElemType alpha, const CPUSparseMatrix<ElemType>& sparse, bool isCSC, const CPUMatrix<ElemType>& dense,
+                                      size_t compressedBegin, size_t compressedEnd, size_t outerBegin, size_t outerEnd,
+                                      ElemType* cData, size_t cNumRows)
+    {
+        const ElemType* valueBuffer = sparse.Buffer() + *sparse.SecondaryIndexLocation(); // Points to the value buffer of the current view (i.e. buffer containing values of non-zero elements).
+        const CPUSPARSE_INDEX_TYPE* majorIndexBuffer = sparse.MajorIndexLocation();        // Points to the index buffer of the current view (row ids for CSC, column ids for CSR).
+        const CPUSPARSE_INDEX_TYPE* secondaryIndex = sparse.SecondaryIndexLocation();
+        const size_t numPreviousNonzero = secondaryIndex[0];                                // Total number of nonzero values handled in previous slices.
+        const ElemType* denseData = dense.Data();
+        const size_t denseNumRows = dense.GetNumRows();
+
+        for (size_t compressedIndex = compressedBegin; compressedIndex < compressedEnd; compressedIndex++)
         {
-            size_t numNonzeroInSparseCol = sparse.SecondaryIndexLocation()[colSparse + 1] - numPreviosNonzero;
-            // Loop over the nonzero rows of the current column of the sparse matrix
-            for (; iNonzero < numNonzeroInSparseCol; iNonzero++)
+            // Loop over the nonzero elements of the current column (CSC) or row (CSR) of the sparse matrix
+            size_t nonzeroEnd = secondaryIndex[compressedIndex + 1] - numPreviousNonzero;
+            for (size_t iNonzero = secondaryIndex[compressedIndex] - numPreviousNonzero; iNonzero < nonzeroEnd; iNonzero++)
             {
-                size_t rowSparse = rowIndexBuffer[iNonzero]; // RowLocation
-                ElemType sparseVal = valueBuffer[iNonzero];
+                size_t rowSparse = isCSC ? majorIndexBuffer[iNonzero] : compressedIndex;
+                size_t colSparse = isCSC ? compressedIndex : majorIndexBuffer[iNonzero];
+                ElemType scaledSparseVal = alpha * valueBuffer[iNonzero];
 
                 // Determine the index of the 'outer' dimension of the sparse matrix and the common inner index.
                 size_t outerIndexSparse;
@@ -893,23 +973,26 @@ public:
                 else if (!denseTimesSparse && !transposeA) { outerIndexSparse = rowSparse; innerIndex = colSparse; }
                 else if (!denseTimesSparse &&  transposeA) { outerIndexSparse = colSparse; innerIndex = rowSparse; }
 
-                // Loop over the outer index of the dense matrix
-                for (size_t outerIndexDense = 0; outerIndexDense < outerDimensionDense; outerIndexDense++)
+                // The dense value for outer index o is denseBase[o * denseStride], and the element of c it updates is cBase[o * cStride].
+                // Below if-statements are evaluated at compile time, so that unit strides are known to the compiler.
+                const ElemType* denseBase;
+                size_t denseStride;
+                if      ( denseTimesSparse && !transposeA) { denseBase = denseData + innerIndex * denseNumRows; denseStride = 1; }            // dense(o, innerIndex)
+                else if ( denseTimesSparse &&  transposeA) { denseBase = denseData + innerIndex;                denseStride = denseNumRows; } // dense(innerIndex, o)
+                else if (!denseTimesSparse && !transposeB) { denseBase = denseData + innerIndex;                denseStride = denseNumRows; } // dense(innerIndex, o)
+                else if (!denseTimesSparse &&  transposeB) { denseBase = denseData + innerIndex * denseNumRows; denseStride = 1; }            // dense(o, innerIndex)
+
+                if (denseTimesSparse) // c(o, outerIndexSparse)
+                {
+                    ElemType* cBase = cData + outerIndexSparse * cNumRows;
+                    for (size_t o = outerBegin; o < outerEnd; o++)
+                        cBase[o] += scaledSparseVal * denseBase[o * denseStride];
+                }
+                else // c(outerIndexSparse, o)
                 {
-                    // Determine the row index of the dense input matrix.
-                    // Below if-statements are evaluated at compile time.
-                    ElemType denseVal;
-                    if      ( denseTimesSparse && !transposeA) denseVal = dense(outerIndexDense,      innerIndex);
-                    else if ( denseTimesSparse &&  transposeA) denseVal = dense(     innerIndex, outerIndexDense);
-                    else if (!denseTimesSparse && !transposeB) denseVal = dense(     innerIndex, outerIndexDense);
-                    else if (!denseTimesSparse &&  transposeB) denseVal = dense(outerIndexDense,      innerIndex);
-                    
-
-                    // Update matrix c.
-                    if (denseTimesSparse)
-                        c(outerIndexDense, outerIndexSparse) += alpha * denseVal * sparseVal;
-                    else /*Sparse times dense */
-                        c(outerIndexSparse, outerIndexDense) += alpha * denseVal * sparseVal;
+                    ElemType* cBase = cData + outerIndexSparse;
+                    for (size_t o = outerBegin; o < outerEnd; o++)
+                        cBase[o * cNumRows] += scaledSparseVal * denseBase[o * denseStride];
                 }
             }
         }
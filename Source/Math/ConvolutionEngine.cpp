@@ -848,6 +848,807 @@ public:
     }
 };
 
+//------------------------------------------------------------------
+// Direct convolution engine implementation.
+//------------------------------------------------------------------
+// CPU engine for 2D convolutions with 1x1 and 3x3 kernels (the bulk of ResNet/VGG-style networks)
+// that does not build the large unrolled input matrix of GEMM engine nor walks the index tables
+// of the reference engine. Forward uses one of the following algorithms:
+// 1. Winograd minimal filtering F(2x2, 3x3) or F(4x4, 3x3) for 3x3 kernels with stride 1 and enough maps.
+//    Input tiles and kernels are transformed, the element-wise products summed over input maps become
+//    alpha^2 independent GEMMs of [K x C] * [C x tiles] and results are transformed back to the output.
+// 2. 1x1 kernels: convolution is a GEMM of the (subsampled) input [W'H' x C] with the kernels [C x K].
+// 3. Direct convolution on a channel-blocked layout for the other 3x3 stride 1 cases. Input is repacked (together
+//    with zero padding) into [B x W x H x C/B] blocks, kernel into [B(k) x B(c) x X x Y x C/B x K/B] blocks,
+//    B == BlockSize. A tile of TileWidth output pixels for B output maps is accumulated in a small local array
+//    which the compiler keeps in vector registers, so each loaded input value is reused B times and each
+//    loaded kernel vector TileWidth times.
+// Strided 3x3 convolutions, convolutions with few input maps (which would be mostly padding in the blocked
+// layout) or narrow outputs, as well as direct convolution in builds without AVX fall back to GEMM engine
+// which is faster for them. Both backward passes are inherited from GEMM engine as well.
+// The engine also implements max and average pooling in 2D windows without index tables (see ForwardPoolingCore).
+template <class ElemType>
+class DirectConvolutionEngine : public GemmConvolutionEngine<ElemType>
+{
+public:
+    using Base = GemmConvolutionEngine<ElemType>;
+    using typename Base::Mat;
+
+public:
+    DirectConvolutionEngine(ConvolveGeometryPtr geometry, DEVICEID_TYPE deviceId, ImageLayoutKind imageLayout, size_t maxTempMemSizeInSamples, PoolKind poolKind)
+        : Base(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind)
+    {
+    }
+
+protected:
+    using Base::m_geometry;
+    using Base::m_deviceId;
+    using Base::m_imageLayout;
+    using Base::m_maxTempMemSizeInSamples;
+    using Base::m_poolKind;
+
+    // Number of channels in one block of the blocked layout (one AVX register of floats).
+    static const size_t BlockSize = 8;
+    // Number of output pixels accumulated at once by direct convolution.
+    static const size_t TileWidth = 8;
+    // Number of input blocks processed by direct convolution in one pass over an output row.
+    static const size_t InputBlocksPerPass = 4;
+    // Minimum number of input and output maps for which Winograd transforms pay off.
+    static const size_t WinogradMinMapCount = 8;
+#ifdef __AVX__
+    static const bool UseDirect = true;
+#else
+    // The accumulators of a tile do not fit into SSE registers, GEMM engine is faster then.
+    static const bool UseDirect = false;
+#endif
+
+    void EnsureCompatible() override
+    {
+        if (m_imageLayout != ImageLayoutKind::CHW)
+            LogicError("Direct convolution engine supports only CHW/cudnn layout.");
+        if (!IsSupported(m_deviceId, m_geometry, m_poolKind))
+            LogicError("Direct convolution engine does not support this configuration. Geometry: %s", ((string)*m_geometry).c_str());
+    }
+
+    void ForwardCore(const Mat& in, const Mat& kernel, Mat& out, Mat& workspace) override
+    {
+        size_t tileSize = GetWinogradTileSize();
+        bool unitStride = m_geometry->GetStride(0) == 1 && m_geometry->GetStride(1) == 1;
+        if (tileSize > 0)
+            ForwardWinograd(tileSize, in, kernel, out, workspace);
+        else if (m_geometry->KernelShape()[0] == 1)
+            ForwardPointwise(in, kernel, out, workspace);
+        else if (UseDirect && unitStride && m_geometry->InputShape()[2] >= BlockSize && m_geometry->OutputShape()[0] >= TileWidth)
+            ForwardDirect(in, kernel, out, workspace);
+        else
+            Base::ForwardCore(in, kernel, out, workspace);
+    }
+
+    // Returns output tile size of Winograd algorithm to use or 0 if Winograd algorithm should not be used.
+    size_t GetWinogradTileSize() const
+    {
+        const auto& kernT = m_geometry->KernelShape();
+        const auto& outT = m_geometry->OutputShape();
+        if (kernT[0] != 3 || m_geometry->GetStride(0) != 1 || m_geometry->GetStride(1) != 1)
+            return 0;
+        if (kernT[2] < WinogradMinMapCount || outT[2] < WinogradMinMapCount)
+            return 0;
+        // F(4x4, 3x3) does 4 times less multiplications than direct convolution (F(2x2, 3x3) - 2.25 times)
+        // but wastes more work on partial tiles, so use it only for larger outputs. On small outputs
+        // the cost of transforming kernels and the small GEMMs outweigh the savings.
+        size_t outSize = min(outT[0], outT[1]);
+        if (outSize >= 16)
+            return 4;
+        return outSize >= 8 ? 2 : 0;
+    }
+
+    // 1x1 convolution: out = in * kern, where in is [W'H' x C] and out is [W'H' x K] for each sample.
+    // Input is used as is if it does not need subsampling or padding, otherwise it is gathered into workspace first.
+    void ForwardPointwise(const Mat& in, const Mat& kernel, Mat& out, Mat& workspace)
+    {
+        const auto& inT = m_geometry->InputShape();
+        const auto& outT = m_geometry->OutputShape();
+        size_t inW = inT[0], inH = inT[1], inC = inT[2];
+        size_t outW = outT[0], outH = outT[1], outC = outT[2];
+        size_t strideW = m_geometry->GetStride(0), strideH = m_geometry->GetStride(1);
+        int padW = m_geometry->GetLowerPad(0), padH = m_geometry->GetLowerPad(1);
+        size_t mapOutSize = outW * outH;
+        bool gather = inW != outW || inH != outH || padW != 0 || padH != 0;
+
+        size_t batchSize = in.GetNumCols();
+        size_t subBatchSize = m_maxTempMemSizeInSamples == 0 ? batchSize : min(batchSize, m_maxTempMemSizeInSamples);
+        if (gather)
+            workspace.Resize(mapOutSize * inC, subBatchSize);
+
+        // cudnn layout uses row-major kernel weight matrix.
+        auto kern = kernel.ColumnSlice(0, kernel.GetNumCols());
+        kern.Reshape(inC, outC);
+
+        for (size_t start = 0; start < batchSize; start += subBatchSize)
+        {
+            size_t curBatchSize = min(subBatchSize, batchSize - start);
+            if (gather)
+            {
+                const ElemType* pin = in.Data() + start * in.GetNumRows();
+                ElemType* pws = workspace.Data();
+#pragma omp parallel for
+                for (int row = 0; row < (int)(curBatchSize * inC * outH); row++)
+                {
+                    size_t oh = row % outH;
+                    size_t c = (row / outH) % inC;
+                    size_t s = row / outH / inC;
+                    int ih = (int)(oh * strideH) - padH;
+                    const ElemType* src = pin + s * in.GetNumRows() + c * inH * inW;
+                    ElemType* dst = pws + s * mapOutSize * inC + (c * outH + oh) * outW;
+                    for (size_t ow = 0; ow < outW; ow++)
+                    {
+                        int iw = (int)(ow * strideW) - padW;
+                        dst[ow] = 0 <= ih && ih < (int)inH && 0 <= iw && iw < (int)inW ? src[ih * inW + iw] : 0;
+                    }
+                }
+            }
+
+            for (size_t s = 0; s < curBatchSize; s++)
+            {
+                auto inSlice = gather ? workspace.ColumnSlice(s, 1) : in.ColumnSlice(start + s, 1);
+                inSlice.Reshape(mapOutSize, inC);
+                auto outSlice = out.ColumnSlice(start + s, 1);
+                outSlice.Reshape(mapOutSize, outC);
+                Mat::Multiply(inSlice, false, kern, false, outSlice);
+            }
+        }
+    }
+
+    void ForwardDirect(const Mat& in, const Mat& kernel, Mat& out, Mat& workspace)
+    {
+        const size_t B = BlockSize;
+        const size_t groupSize = InputBlocksPerPass;
+
+        const auto& inT = m_geometry->InputShape();
+        const auto& kernT = m_geometry->KernelShape();
+        const auto& outT = m_geometry->OutputShape();
+        size_t inW = inT[0], inH = inT[1], inC = inT[2];
+        size_t kW = kernT[0], kH = kernT[1];
+        size_t outW = outT[0], outH = outT[1], outC = outT[2];
+        int padW = m_geometry->GetLowerPad(0), padH = m_geometry->GetLowerPad(1);
+        size_t kernelSize = kernT.GetNumElements();
+        assert(m_geometry->GetStride(0) == 1 && m_geometry->GetStride(1) == 1);
+
+        size_t inBlocks = (inC + B - 1) / B;
+        size_t outBlocks = (outC + B - 1) / B;
+        // Dimensions of padded input, that is, all input cells touched by the kernel.
+        size_t padInW = outW + kW - 1;
+        size_t padInH = outH + kH - 1;
+        size_t packedInSize = inBlocks * padInH * padInW * B;
+        size_t packedKernSize = outBlocks * inBlocks * kH * kW * B * B;
+
+        size_t batchSize = in.GetNumCols();
+        size_t subBatchSize = m_maxTempMemSizeInSamples == 0 ? batchSize : min(batchSize, m_maxTempMemSizeInSamples);
+        // The last tile of a row may read up to TileWidth pixels past the end of the packed input.
+        workspace.Resize(1, packedKernSize + subBatchSize * packedInSize + TileWidth * B);
+        ElemType* packedKern = workspace.Data();
+        ElemType* packedIn = packedKern + packedKernSize;
+
+        // Repack kernels: output and input maps are padded with zeros to whole blocks.
+        const ElemType* pkern = kernel.Data();
+#pragma omp parallel for
+        for (int kb = 0; kb < (int)outBlocks; kb++)
+        {
+            ElemType* dst = packedKern + kb * inBlocks * kH * kW * B * B;
+            for (size_t cb = 0; cb < inBlocks; cb++)
+            for (size_t y = 0; y < kH; y++)
+            for (size_t x = 0; x < kW; x++)
+            for (size_t ci = 0; ci < B; ci++)
+            for (size_t ko = 0; ko < B; ko++)
+            {
+                size_t k = kb * B + ko;
+                size_t c = cb * B + ci;
+                *dst++ = k < outC && c < inC ? pkern[k * kernelSize + (c * kH + y) * kW + x] : 0;
+            }
+        }
+
+        for (size_t start = 0; start < batchSize; start += subBatchSize)
+        {
+            size_t curBatchSize = min(subBatchSize, batchSize - start);
+            const ElemType* pin = in.Data() + start * in.GetNumRows();
+            ElemType* pout = out.Data() + start * out.GetNumRows();
+
+            // Repack inputs into blocked layout.
+#pragma omp parallel for
+            for (int row = 0; row < (int)(curBatchSize * inBlocks * padInH); row++)
+            {
+                size_t p = row % padInH;
+                size_t cb = (row / padInH) % inBlocks;
+                size_t s = row / padInH / inBlocks;
+                int ih = (int)p - padH;
+                ElemType* dst = packedIn + row * padInW * B;
+                const ElemType* src = pin + s * in.GetNumRows();
+                for (size_t q = 0; q < padInW; q++)
+                {
+                    int iw = (int)q - padW;
+                    bool inside = 0 <= ih && ih < (int)inH && 0 <= iw && iw < (int)inW;
+                    for (size_t ci = 0; ci < B; ci++)
+                    {
+                        size_t c = cb * B + ci;
+                        *dst++ = inside && c < inC ? src[(c * inH + ih) * inW + iw] : 0;
+                    }
+                }
+            }
+
+            // Convolve. Each work item produces one output row of one block of output maps.
+#pragma omp parallel for
+            for (int item = 0; item < (int)(curBatchSize * outBlocks * outH); item++)
+            {
+                size_t oh = item % outH;
+                size_t kb = (item / outH) % outBlocks;
+                size_t s = item / outH / outBlocks;
+                const ElemType* src = packedIn + (s * inBlocks * padInH + oh) * padInW * B;
+                const ElemType* kern = packedKern + kb * inBlocks * kH * kW * B * B;
+                ElemType* dst = pout + s * out.GetNumRows() + oh * outW;
+                size_t kCount = min(B, outC - kb * B);
+                // Go over input maps in groups so that kernels of a group stay in L1 cache while the row is computed.
+                for (size_t cb = 0; cb < inBlocks; cb += groupSize)
+                {
+                    size_t cbCount = min(groupSize, inBlocks - cb);
+                    const ElemType* srcGroup = src + cb * padInH * padInW * B;
+                    const ElemType* kernGroup = kern + cb * kH * kW * B * B;
+                    ConvolveRow(srcGroup, kernGroup, cbCount, kW, kH, padInW, padInH, outW, kb * B, kCount, outW * outH, cb > 0, dst);
+                }
+            }
+        }
+    }
+
+    // Computes one output row for one block of output maps from a range of input blocks. The last tile of the row
+    // is computed in full but only its valid pixels are stored (inputs it reads past the row are ignored).
+    static void ConvolveRow(const ElemType* src, const ElemType* kern, size_t inBlocks, size_t kW, size_t kH, size_t padInW, size_t padInH,
+                            size_t outW, size_t firstMap, size_t mapCount, size_t mapSize, bool accumulate, ElemType* dst)
+    {
+        const size_t B = BlockSize;
+        const size_t tileWidth = TileWidth;
+        for (size_t ow = 0; ow < outW; ow += tileWidth)
+        {
+            ConvolveTile<TileWidth>(src + ow * B, kern, inBlocks, kW, kH, padInW, padInH,
+                                    min(tileWidth, outW - ow), firstMap, mapCount, mapSize, accumulate, dst + ow);
+        }
+    }
+
+    // Computes up to TileW adjacent output pixels of one row for one block of output maps.
+    // src points to the packed input cell of the first kernel tap of the first pixel,
+    // kern to the packed kernels of the block and dst to the output of map 0 of the first pixel.
+    template <size_t TileW>
+    static void ConvolveTile(const ElemType* src, const ElemType* kern, size_t inBlocks, size_t kW, size_t kH, size_t padInW, size_t padInH,
+                             size_t pixelCount, size_t firstMap, size_t mapCount, size_t mapSize, bool accumulate, ElemType* dst)
+    {
+        const size_t B = BlockSize;
+        ElemType acc[TileW][B];
+        for (size_t t = 0; t < TileW; t++)
+            for (size_t ko = 0; ko < B; ko++)
+                acc[t][ko] = 0;
+        if (accumulate)
+        {
+            for (size_t ko = 0; ko < mapCount; ko++)
+                for (size_t t = 0; t < pixelCount; t++)
+                    acc[t][ko] = dst[(firstMap + ko) * mapSize + t];
+        }
+
+        for (size_t cb = 0; cb < inBlocks; cb++)
+        {
+            for (size_t y = 0; y < kH; y++)
+            {
+                const ElemType* row = src + (cb * padInH + y) * padInW * B;
+                for (size_t x = 0; x < kW; x++)
+                {
+                    const ElemType* px = row + x * B;
+                    for (size_t ci = 0; ci < B; ci++)
+                    {
+                        const ElemType* w = kern + ci * B;
+                        for (size_t t = 0; t < TileW; t++)
+                        {
+                            ElemType v = px[t * B + ci];
+                            for (size_t ko = 0; ko < B; ko++)
+                                acc[t][ko] += v * w[ko];
+                        }
+                    }
+                    kern += B * B;
+                }
+            }
+        }
+
+        for (size_t ko = 0; ko < mapCount; ko++)
+        {
+            ElemType* o = dst + (firstMap + ko) * mapSize;
+            for (size_t t = 0; t < pixelCount; t++)
+                o[t] = acc[t][ko];
+        }
+    }
+
+    // Winograd F(m x m, 3x3) transform matrices (row-major), alpha == m + 2. See Lavin and Gray,
+    // "Fast Algorithms for Convolutional Neural Networks".
+    struct WinogradMatrices
+    {
+        size_t m;
+        size_t alpha;
+        const ElemType* BT; // alpha x alpha, input transform.
+        const ElemType* G;  // alpha x 3, kernel transform.
+        const ElemType* AT; // m x alpha, output transform.
+    };
+
+    static WinogradMatrices GetWinogradMatrices(size_t m)
+    {
+        static const ElemType BT2[] = {
+            1,  0, -1,  0,
+            0,  1,  1,  0,
+            0, -1,  1,  0,
+            0,  1,  0, -1 };
+        static const ElemType G2[] = {
+            1,               0,               0,
+            (ElemType)0.5,   (ElemType)0.5,   (ElemType)0.5,
+            (ElemType)0.5,   (ElemType)-0.5,  (ElemType)0.5,
+            0,               0,               1 };
+        static const ElemType AT2[] = {
+            1, 1,  1,  0,
+            0, 1, -1, -1 };
+
+        static const ElemType BT4[] = {
+            4,  0, -5,  0, 1, 0,
+            0, -4, -4,  1, 1, 0,
+            0,  4, -4, -1, 1, 0,
+            0, -2, -1,  2, 1, 0,
+            0,  2, -1, -2, 1, 0,
+            0,  4,  0, -5, 0, 1 };
+        static const ElemType G4[] = {
+            (ElemType)(1.0 / 4),   0,                      0,
+            (ElemType)(-1.0 / 6),  (ElemType)(-1.0 / 6),   (ElemType)(-1.0 / 6),
+            (ElemType)(-1.0 / 6),  (ElemType)(1.0 / 6),    (ElemType)(-1.0 / 6),
+            (ElemType)(1.0 / 24),  (ElemType)(1.0 / 12),   (ElemType)(1.0 / 6),
+            (ElemType)(1.0 / 24),  (ElemType)(-1.0 / 12),  (ElemType)(1.0 / 6),
+            0,                     0,                      1 };
+        static const ElemType AT4[] = {
+            1, 1,  1, 1,  1, 0,
+            0, 1, -1, 2, -2, 0,
+            0, 1,  1, 4,  4, 0,
+            0, 1, -1, 8, -8, 1 };
+
+        if (m == 2)
+            return WinogradMatrices{ 2, 4, BT2, G2, AT2 };
+        if (m == 4)
+            return WinogradMatrices{ 4, 6, BT4, G4, AT4 };
+        LogicError("Unsupported Winograd tile size: %d.", (int)m);
+    }
+
+    // Computes dst = L * src * R^T where L is [rows x inner], src is [inner x inner2] and R is [cols x inner2], all row-major.
+    static void Sandwich(const ElemType* L, const ElemType* src, const ElemType* R, size_t rows, size_t inner, size_t inner2, size_t cols, ElemType* tmp, ElemType* dst)
+    {
+        for (size_t i = 0; i < rows; i++)
+        {
+            for (size_t j = 0; j < inner2; j++)
+            {
+                ElemType sum = 0;
+                for (size_t k = 0; k < inner; k++)
+                    sum += L[i * inner + k] * src[k * inner2 + j];
+                tmp[i * inner2 + j] = sum;
+            }
+        }
+        for (size_t i = 0; i < rows; i++)
+        {
+            for (size_t j = 0; j < cols; j++)
+            {
+                ElemType sum = 0;
+                for (size_t k = 0; k < inner2; k++)
+                    sum += tmp[i * inner2 + k] * R[j * inner2 + k];
+                dst[i * cols + j] = sum;
+            }
+        }
+    }
+
+    // Layout of the transformed tensors in workspace (each is a column-major matrix per transform point xi):
+    // U: [K x C] transformed kernels, V: [C x T] transformed input tiles, M: [K x T] products, T - number of tiles.
+    void ForwardWinograd(size_t m, const Mat& in, const Mat& kernel, Mat& out, Mat& workspace)
+    {
+        const size_t maxAlpha = 6;
+        WinogradMatrices wm = GetWinogradMatrices(m);
+        size_t alpha = wm.alpha;
+        size_t points = alpha * alpha;
+
+        const auto& inT = m_geometry->InputShape();
+        const auto& outT = m_geometry->OutputShape();
+        size_t inW = inT[0], inH = inT[1], inC = inT[2];
+        size_t outW = outT[0], outH = outT[1], outC = outT[2];
+        int padW = m_geometry->GetLowerPad(0), padH = m_geometry->GetLowerPad(1);
+        size_t kernelSize = m_geometry->KernelShape().GetNumElements();
+
+        size_t tilesW = (outW + m - 1) / m;
+        size_t tilesH = (outH + m - 1) / m;
+        size_t tilesPerSample = tilesW * tilesH;
+
+        size_t batchSize = in.GetNumCols();
+        size_t subBatchSize = m_maxTempMemSizeInSamples == 0 ? batchSize : min(batchSize, m_maxTempMemSizeInSamples);
+        size_t maxTiles = subBatchSize * tilesPerSample;
+        size_t uSize = points * outC * inC;
+        workspace.Resize(1, uSize + points * maxTiles * (inC + outC));
+
+        // Transform kernels: U = G * g * G^T.
+        ElemType* pu = workspace.Data();
+        const ElemType* pkern = kernel.Data();
+#pragma omp parallel for
+        for (int kc = 0; kc < (int)(outC * inC); kc++)
+        {
+            size_t k = kc % outC;
+            size_t c = kc / outC;
+            ElemType tmp[maxAlpha * 3];
+            ElemType u[maxAlpha * maxAlpha];
+            Sandwich(wm.G, pkern + k * kernelSize + c * 9, wm.G, alpha, 3, 3, alpha, tmp, u);
+            for (size_t xi = 0; xi < points; xi++)
+                pu[(xi * inC + c) * outC + k] = u[xi];
+        }
+
+        for (size_t start = 0; start < batchSize; start += subBatchSize)
+        {
+            size_t curBatchSize = min(subBatchSize, batchSize - start);
+            size_t tiles = curBatchSize * tilesPerSample;
+            size_t vOffset = uSize;
+            size_t mOffset = uSize + points * tiles * inC;
+            ElemType* pv = workspace.Data() + vOffset;
+            ElemType* pm = workspace.Data() + mOffset;
+            const ElemType* pin = in.Data() + start * in.GetNumRows();
+            ElemType* pout = out.Data() + start * out.GetNumRows();
+
+            // Transform input tiles: V = B^T * d * B.
+#pragma omp parallel for
+            for (int t = 0; t < (int)tiles; t++)
+            {
+                size_t s = t / tilesPerSample;
+                size_t th = (t % tilesPerSample) / tilesW;
+                size_t tw = t % tilesW;
+                const ElemType* src = pin + s * in.GetNumRows();
+                ElemType d[maxAlpha * maxAlpha];
+                ElemType tmp[maxAlpha * maxAlpha];
+                ElemType v[maxAlpha * maxAlpha];
+                for (size_t c = 0; c < inC; c++)
+                {
+                    for (size_t i = 0; i < alpha; i++)
+                    {
+                        int ih = (int)(th * m + i) - padH;
+                        for (size_t j = 0; j < alpha; j++)
+                        {
+                            int iw = (int)(tw * m + j) - padW;
+                            bool inside = 0 <= ih && ih < (int)inH && 0 <= iw && iw < (int)inW;
+                            d[i * alpha + j] = inside ? src[(c * inH + ih) * inW + iw] : 0;
+                        }
+                    }
+                    Sandwich(wm.BT, d, wm.BT, alpha, alpha, alpha, alpha, tmp, v);
+                    for (size_t xi = 0; xi < points; xi++)
+                        pv[(xi * tiles + t) * inC + c] = v[xi];
+                }
+            }
+
+            // Multiply in transformed domain: M[xi] = U[xi] * V[xi].
+            for (size_t xi = 0; xi < points; xi++)
+            {
+                auto u = workspace.ColumnSlice(xi * outC * inC, outC * inC);
+                u.Reshape(outC, inC);
+                auto v = workspace.ColumnSlice(vOffset + xi * inC * tiles, inC * tiles);
+                v.Reshape(inC, tiles);
+                auto prod = workspace.ColumnSlice(mOffset + xi * outC * tiles, outC * tiles);
+                prod.Reshape(outC, tiles);
+                Mat::Multiply(u, false, v, false, prod);
+            }
+
+            // Transform products back: Y = A^T * M * A.
+#pragma omp parallel for
+            for (int t = 0; t < (int)tiles; t++)
+            {
+                size_t s = t / tilesPerSample;
+                size_t th = (t % tilesPerSample) / tilesW;
+                size_t tw = t % tilesW;
+                ElemType* dst = pout + s * out.GetNumRows();
+                ElemType mt[maxAlpha * maxAlpha];
+                ElemType tmp[maxAlpha * maxAlpha];
+                ElemType y[maxAlpha * maxAlpha];
+                size_t rows = min(m, outH - th * m);
+                size_t cols = min(m, outW - tw * m);
+                for (size_t k = 0; k < outC; k++)
+                {
+                    for (size_t xi = 0; xi < points; xi++)
+                        mt[xi] = pm[(xi * tiles + t) * outC + k];
+                    Sandwich(wm.AT, mt, wm.AT, m, alpha, alpha, m, tmp, y);
+                    for (size_t i = 0; i < rows; i++)
+                        for (size_t j = 0; j < cols; j++)
+                            dst[(k * outH + th * m + i) * outW + tw * m + j] = y[i * m + j];
+                }
+            }
+        }
+    }
+
+    // Pooling works on each input map separately. Window bounds are computed arithmetically instead of being
+    // looked up in the index tables of reference engine, and forward passes are split into a pass over window
+    // rows and a pass over window columns, both of which vectorize across width.
+    struct PoolingDims
+    {
+        size_t inW, inH, outW, outH;
+        size_t kW, kH;
+        size_t strideW, strideH;
+        int padW, padH;
+        // Width of the input row extended by padding, that is, all cells touched by the windows of one output row.
+        size_t padInW;
+        // Number of maps in the minibatch.
+        size_t planeCount;
+
+        // Returns input range [lo, hi) covered by the window at output position o, clipped to the input.
+        static void WindowRange(size_t o, size_t stride, int pad, size_t kernel, size_t size, int& lo, int& hi)
+        {
+            lo = (int)(o * stride) - pad;
+            hi = min(lo + (int)kernel, (int)size);
+            lo = max(lo, 0);
+        }
+
+        void RowRange(size_t oh, int& lo, int& hi) const { WindowRange(oh, strideH, padH, kH, inH, lo, hi); }
+        void ColRange(size_t ow, int& lo, int& hi) const { WindowRange(ow, strideW, padW, kW, inW, lo, hi); }
+    };
+
+    PoolingDims GetPoolingDims(size_t batchSize) const
+    {
+        const auto& inT = m_geometry->InputShape();
+        const auto& kernT = m_geometry->KernelShape();
+        const auto& outT = m_geometry->OutputShape();
+        PoolingDims d;
+        d.inW = inT[0];
+        d.inH = inT[1];
+        d.outW = outT[0];
+        d.outH = outT[1];
+        d.kW = kernT[0];
+        d.kH = kernT[1];
+        d.strideW = m_geometry->GetStride(0);
+        d.strideH = m_geometry->GetStride(1);
+        d.padW = m_geometry->GetLowerPad(0);
+        d.padH = m_geometry->GetLowerPad(1);
+        d.padInW = (d.outW - 1) * d.strideW + d.kW;
+        d.planeCount = inT[2] * batchSize;
+        return d;
+    }
+
+    void ForwardPoolingCore(const Mat& in, Mat& out) override
+    {
+        if (m_poolKind != PoolKind::Max && m_poolKind != PoolKind::Average)
+            InvalidArgument("Pooling type %d is not supported.", (int)m_poolKind);
+
+        bool isMax = m_poolKind == PoolKind::Max;
+        PoolingDims d = GetPoolingDims(in.GetNumCols());
+        // Cells of the extended row outside of the input: [0, qLo) and [qHi, padInW).
+        int qLo = max(d.padW, 0);
+        int qHi = min((int)d.padInW, (int)d.inW + d.padW);
+        // Average pooling divides by the number of cells of the window inside the input (padding is not counted).
+        std::vector<ElemType> colCounts(d.outW);
+        for (size_t ow = 0; ow < d.outW; ow++)
+        {
+            int lo, hi;
+            d.ColRange(ow, lo, hi);
+            colCounts[ow] = (ElemType)(hi - lo);
+        }
+        ElemType init = isMax ? -std::numeric_limits<ElemType>::infinity() : 0;
+
+        const ElemType* pin = in.Data();
+        ElemType* pout = out.Data();
+#pragma omp parallel for
+        for (int plane = 0; plane < (int)d.planeCount; plane++)
+        {
+            const ElemType* src = pin + plane * d.inW * d.inH;
+            ElemType* dst = pout + plane * d.outW * d.outH;
+            std::vector<ElemType> rowBuf(d.padInW);
+            ElemType* row = rowBuf.data();
+            for (size_t oh = 0; oh < d.outH; oh++, dst += d.outW)
+            {
+                // Reduce window rows into one extended row.
+                int hLo, hHi;
+                d.RowRange(oh, hLo, hHi);
+                std::fill(row, row + d.padInW, init);
+                for (int h = hLo; h < hHi; h++)
+                {
+                    const ElemType* x = src + h * d.inW;
+                    if (isMax)
+                    {
+                        for (int q = qLo; q < qHi; q++)
+                            row[q] = max(row[q], x[q - d.padW]);
+                    }
+                    else
+                    {
+                        for (int q = qLo; q < qHi; q++)
+                            row[q] += x[q - d.padW];
+                    }
+                }
+                // Reduce window columns.
+                for (size_t ow = 0; ow < d.outW; ow++)
+                    dst[ow] = row[ow * d.strideW];
+                for (size_t x = 1; x < d.kW; x++)
+                {
+                    if (isMax)
+                    {
+                        for (size_t ow = 0; ow < d.outW; ow++)
+                            dst[ow] = max(dst[ow], row[ow * d.strideW + x]);
+                    }
+                    else
+                    {
+                        for (size_t ow = 0; ow < d.outW; ow++)
+                            dst[ow] += row[ow * d.strideW + x];
+                    }
+                }
+                if (!isMax)
+                {
+                    ElemType rowCount = (ElemType)(hHi - hLo);
+                    for (size_t ow = 0; ow < d.outW; ow++)
+                        dst[ow] /= rowCount * colCounts[ow];
+                }
+            }
+        }
+    }
+
+    void BackwardPoolingCore(const Mat& out, const Mat& srcGrad, const Mat& in, Mat& grad) override
+    {
+        if (m_poolKind == PoolKind::Max)
+            MaxPoolingBackward(out, srcGrad, in, grad);
+        else if (m_poolKind == PoolKind::Average)
+            AveragePoolingBackward(srcGrad, grad);
+        else
+            InvalidArgument("Pooling type %d is not supported.", (int)m_poolKind);
+    }
+
+    // Gradient goes to the first input cell of the window (in row-major order) that is equal to the maximum,
+    // same as in reference engine. Each thread processes whole maps so, unlike reference engine, no atomics are needed.
+    void MaxPoolingBackward(const Mat& out, const Mat& srcGrad, const Mat& in, Mat& grad)
+    {
+        PoolingDims d = GetPoolingDims(in.GetNumCols());
+        const ElemType* pout = out.Data();
+        const ElemType* psrcGrad = srcGrad.Data();
+        const ElemType* pin = in.Data();
+        ElemType* pgrad = grad.Data();
+#pragma omp parallel for
+        for (int plane = 0; plane < (int)d.planeCount; plane++)
+        {
+            const ElemType* x = pin + plane * d.inW * d.inH;
+            ElemType* dx = pgrad + plane * d.inW * d.inH;
+            size_t outOffset = plane * d.outW * d.outH;
+            for (size_t oh = 0; oh < d.outH; oh++)
+            {
+                int hLo, hHi;
+                d.RowRange(oh, hLo, hHi);
+                for (size_t ow = 0; ow < d.outW; ow++)
+                {
+                    int wLo, wHi;
+                    d.ColRange(ow, wLo, wHi);
+                    size_t o = outOffset + oh * d.outW + ow;
+                    ElemType m = pout[o];
+                    int argMax = FindInWindow(x, d.inW, hLo, hHi, wLo, wHi, [m](ElemType v) { return v >= m; });
+                    if (argMax >= 0)
+                        dx[argMax] += psrcGrad[o];
+                }
+            }
+        }
+    }
+
+    // Returns index of the first cell of the window (in row-major order) that satisfies the predicate, or -1.
+    template <class Pred>
+    static int FindInWindow(const ElemType* x, size_t inW, int hLo, int hHi, int wLo, int wHi, const Pred& pred)
+    {
+        for (int h = hLo; h < hHi; h++)
+        {
+            for (int w = wLo; w < wHi; w++)
+            {
+                int i = h * (int)inW + w;
+                if (pred(x[i]))
+                    return i;
+            }
+        }
+        return -1;
+    }
+
+    // Spreads gradient of each window evenly over its cells inside the input. Window columns are first
+    // accumulated into one extended row which is then added to all rows of the window.
+    void AveragePoolingBackward(const Mat& srcGrad, Mat& grad)
+    {
+        PoolingDims d = GetPoolingDims(srcGrad.GetNumCols());
+        int qLo = max(d.padW, 0);
+        int qHi = min((int)d.padInW, (int)d.inW + d.padW);
+        std::vector<ElemType> colCounts(d.outW);
+        for (size_t ow = 0; ow < d.outW; ow++)
+        {
+            int lo, hi;
+            d.ColRange(ow, lo, hi);
+            colCounts[ow] = (ElemType)(hi - lo);
+        }
+
+        const ElemType* psrcGrad = srcGrad.Data();
+        ElemType* pgrad = grad.Data();
+#pragma omp parallel for
+        for (int plane = 0; plane < (int)d.planeCount; plane++)
+        {
+            const ElemType* dy = psrcGrad + plane * d.outW * d.outH;
+            ElemType* dx = pgrad + plane * d.inW * d.inH;
+            std::vector<ElemType> scaledBuf(d.outW);
+            std::vector<ElemType> rowBuf(d.padInW);
+            ElemType* scaled = scaledBuf.data();
+            ElemType* row = rowBuf.data();
+            for (size_t oh = 0; oh < d.outH; oh++, dy += d.outW)
+            {
+                int hLo, hHi;
+                d.RowRange(oh, hLo, hHi);
+                ElemType rowCount = (ElemType)(hHi - hLo);
+                for (size_t ow = 0; ow < d.outW; ow++)
+                    scaled[ow] = dy[ow] / (rowCount * colCounts[ow]);
+                std::fill(row, row + d.padInW, (ElemType)0);
+                for (size_t x = 0; x < d.kW; x++)
+                {
+                    for (size_t ow = 0; ow < d.outW; ow++)
+                        row[ow * d.strideW + x] += scaled[ow];
+                }
+                for (int h = hLo; h < hHi; h++)
+                {
+                    ElemType* g = dx + h * d.inW;
+                    for (int q = qLo; q < qHi; q++)
+                        g[q - d.padW] += row[q];
+                }
+            }
+        }
+    }
+
+    // Writes each pooled value to the first cell of its window (in row-major order) that holds the maximum of the window.
+    void MaxUnpoolingCore(const Mat& out, const Mat& poolIn, Mat& in) override
+    {
+        PoolingDims d = GetPoolingDims(poolIn.GetNumCols());
+        const ElemType* pout = out.Data();
+        const ElemType* ppoolIn = poolIn.Data();
+        ElemType* pin = in.Data();
+#pragma omp parallel for
+        for (int plane = 0; plane < (int)d.planeCount; plane++)
+        {
+            const ElemType* x = ppoolIn + plane * d.inW * d.inH;
+            ElemType* dst = pin + plane * d.inW * d.inH;
+            const ElemType* y = pout + plane * d.outW * d.outH;
+            for (size_t oh = 0; oh < d.outH; oh++)
+            {
+                int hLo, hHi;
+                d.RowRange(oh, hLo, hHi);
+                for (size_t ow = 0; ow < d.outW; ow++)
+                {
+                    int wLo, wHi;
+                    d.ColRange(ow, wLo, wHi);
+                    int argMax = hLo * (int)d.inW + wLo;
+                    for (int h = hLo; h < hHi; h++)
+                    {
+                        for (int w = wLo; w < wHi; w++)
+                        {
+                            int i = h * (int)d.inW + w;
+                            if (x[i] > x[argMax])
+                                argMax = i;
+                        }
+                    }
+                    dst[argMax] = y[oh * d.outW + ow];
+                }
+            }
+        }
+    }
+
+public:
+    static bool IsSupported(DEVICEID_TYPE deviceId, ConvolveGeometryPtr geometry, PoolKind poolKind)
+    {
+        if (deviceId >= 0)
+            return false;
+        const auto& inT = geometry->InputShape();
+        const auto& kernT = geometry->KernelShape();
+        const auto& outT = geometry->OutputShape();
+        if (inT.GetRank() != 3 || kernT.GetRank() != 3 || outT.GetRank() != 3)
+            return false;
+        // Pooling is supported for any 2D windows within each map.
+        if (poolKind != PoolKind::None)
+            return kernT[2] == 1 && geometry->GetStride(2) == 1 && outT[2] == inT[2];
+        if (find(begin(geometry->Sharing()), end(geometry->Sharing()), false) != end(geometry->Sharing()))
+            return false;
+        // Only square 1x1 and 3x3 kernels which span all input maps are supported.
+        if (kernT[0] != kernT[1] || (kernT[0] != 1 && kernT[0] != 3))
+            return false;
+        return kernT[2] == inT[2] && outT[2] == geometry->GetMapCount(2);
+    }
+};
+
 template <class ElemType>
 std::unique_ptr<ConvolutionEngine<ElemType>> ConvolutionEngine<ElemType>::Create(ConvolveGeometryPtr geometry, DEVICEID_TYPE deviceId,
                                                                                  ImageLayoutKind imageLayout, size_t maxTempMemSizeInSamples, PoolKind poolKind,
@@ -883,6 +1684,14 @@ std::unique_ptr<ConvolutionEngine<ElemType>> ConvolutionEngine<ElemType>::Create
         return CuDnnConvolutionEngineFactory<ElemType>::Create(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind, forceDeterministicAlgorithms);
     }
 
+    if (isEnabled(ConvolutionEngineKind::Direct) && DirectConvolutionEngine<ElemType>::IsSupported(deviceId, geometry, poolKind))
+    {
+        if (GetMathLibTraceLevel() > 0)
+            fprintf(stderr, "%lsusing direct convolution engine for geometry: %s.\n", logPrefix.c_str(), engStr.c_str());
+
+        return std::make_unique<DirectConvolutionEngine<ElemType>>(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind);
+    }
+
     if (isEnabled(ConvolutionEngineKind::Gemm) && GemmConvolutionEngine<ElemType>::IsSupported(deviceId, geometry))
     {
         if (GetMathLibTraceLevel() > 0)
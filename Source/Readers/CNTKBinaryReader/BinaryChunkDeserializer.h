@@ -74,6 +74,12 @@ public:
     // Get information about particular chunk.
     void GetSequencesForChunk(ChunkIdType chunkId, vector<SequenceDescription>& result) override;
 
+    // Gets the input file.
+    std::vector<std::wstring> GetInputFiles() const override
+    {
+        return std::vector<std::wstring>(1, m_filename);
+    }
+
     // Parses buffer into a BinaryChunkPtr
     void ParseChunk(ChunkIdType chunkId, unique_ptr<byte[]> const& buffer, std::vector<std::vector<SequenceDataPtr>>& data);
 
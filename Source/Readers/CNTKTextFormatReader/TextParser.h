@@ -35,6 +35,18 @@ public:
 
     bool GetSequenceDescriptionByKey(const KeyType&, SequenceDescription&) override;
 
+    // Sequence descriptions are served from the index, which is not changed after construction.
+    bool SupportsConcurrentSequenceDescriptions() const override
+    {
+        return true;
+    }
+
+    // Gets the input file.
+    std::vector<std::wstring> GetInputFiles() const override
+    {
+        return std::vector<std::wstring>(1, m_filename);
+    }
+
 private:
     TextParser(CorpusDescriptorPtr corpus, const std::wstring& filename, const vector<StreamDescriptor>& streams, bool isPrimary);
 
@@ -40,7 +40,8 @@ CompositeDataReader::CompositeDataReader(const ConfigParameters& config) :
         ContainsDeserializer(config, L"ImageDeserializer");
 
     useNumericSequenceKeys = config(L"useNumericSequenceKeys", useNumericSequenceKeys);
-    m_corpus = std::make_shared<CorpusDescriptor>(useNumericSequenceKeys);
+    wstring keyRegistryFile = config(L"sequenceKeyRegistry", L"");
+    m_corpus = std::make_shared<CorpusDescriptor>(useNumericSequenceKeys, keyRegistryFile);
 
     // Identifying packing mode.
     bool frameMode = config(L"frameMode", false);
@@ -77,6 +78,7 @@ CompositeDataReader::CompositeDataReader(const ConfigParameters& config) :
     // Creating deserializers.
     // TODO: Currently the primary deserializer defines the corpus. The logic will be moved to CorpusDescriptor class.
     CreateDeserializers(config);
+    m_corpus->FinalizeKeyRegistry();
 
     if (m_deserializers.empty())
     {
@@ -136,9 +138,13 @@ CompositeDataReader::CompositeDataReader(const ConfigParameters& config) :
             }
         }
 
+        // Optionally order the sequences of each randomized chunk into shuffled buckets of similar length,
+        // so that minibatches need less padding.
+        size_t lengthBucketSizeInSamples = config(L"lengthBucketSizeInSamples", 0);
+
         bool shouldPrefetch = true;
         m_sequenceEnumerator = std::make_shared<BlockRandomizer>(verbosity, randomizationWindow, deserializer, shouldPrefetch, 
-            multiThreadedDeserialization, maxErrors, sampleBasedRandomizationWindow);
+            multiThreadedDeserialization, maxErrors, sampleBasedRandomizationWindow, lengthBucketSizeInSamples);
     }
     else
     {
@@ -170,6 +176,9 @@ CompositeDataReader::CompositeDataReader(const ConfigParameters& config) :
 
     // Check whether to use local timeline, by default we use it for better performance.
     bool localTimeline = config(L"localTimeline", true);
+
+    // Check whether to pack sequences best-fit-decreasing, which leaves fewer gaps than the default first-fit.
+    bool bestFitDecreasingPacking = config(L"bestFitDecreasingPacking", false);
     switch (m_packingMode)
     {
     case PackingMode::sample:
@@ -184,7 +193,8 @@ CompositeDataReader::CompositeDataReader(const ConfigParameters& config) :
             m_sequenceEnumerator,
             m_streams,
             numAlternatingBuffers,
-            localTimeline);
+            localTimeline,
+            bestFitDecreasingPacking);
         break;
     case PackingMode::truncated:
     {
@@ -4,6 +4,7 @@
 //
 #include "stdafx.h"
 #include <regex>
+#include <thread>
 #include "ConfigHelper.h"
 #include "DataReader.h"
 #include "StringUtil.h"
@@ -162,7 +163,7 @@ vector<wstring> ConfigHelper::GetMlfPaths() const
             InvalidArgument("Either mlfFile or mlfFileList must exist in the reader configuration.");
         }
 
-        wstring list = m_config(L"mlfFileList");
+        wstring list = GetMlfListFile();
         for (msra::files::textreader r(list); r;)
         {
             result.push_back(r.wgetline());
@@ -172,6 +173,23 @@ vector<wstring> ConfigHelper::GetMlfPaths() const
     return result;
 }
 
+wstring ConfigHelper::GetMlfListFile() const
+{
+    return m_config.ExistsCurrent(L"mlfFile") ? wstring() : (wstring)m_config(L"mlfFileList", L"");
+}
+
+wstring ConfigHelper::GetMlfCacheFile() const
+{
+    return (wstring)m_config(L"mlfCache", L"");
+}
+
+size_t ConfigHelper::GetMlfParserThreads() const
+{
+    // By default one per core.
+    size_t threads = m_config(L"mlfParserThreads", (size_t)max(thread::hardware_concurrency(), 1u));
+    return threads == 0 ? 1 : threads;
+}
+
 size_t ConfigHelper::GetRandomizationWindow()
 {
     size_t result = randomizeAuto;
@@ -217,9 +235,14 @@ wstring ConfigHelper::GetRandomizer()
     return randomizer;
 }
 
+wstring ConfigHelper::GetScriptFile() const
+{
+    return m_config(L"scpFile");
+}
+
 vector<wstring> ConfigHelper::GetSequencePaths()
 {
-    wstring scriptPath = m_config(L"scpFile");
+    wstring scriptPath = GetScriptFile();
     wstring rootPath = m_config(L"prefixPathInSCP", L"");
 
     vector<wstring> filelist;
@@ -49,6 +49,18 @@ public:
     // Gets mlf file paths from the configuraiton.
     std::vector<std::wstring> GetMlfPaths() const;
 
+    // Gets the path of the file that lists the mlf files, empty if they are given directly.
+    std::wstring GetMlfListFile() const;
+
+    // Gets the path of the binary label cache, empty if labels are not cached.
+    std::wstring GetMlfCacheFile() const;
+
+    // Gets the number of threads that parse mlf files.
+    size_t GetMlfParserThreads() const;
+
+    // Gets the path of the script file that lists the utterances.
+    std::wstring GetScriptFile() const;
+
     // Gets utterance paths from the configuration.
     std::vector<std::wstring> GetSequencePaths();
 
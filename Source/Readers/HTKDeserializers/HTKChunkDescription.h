@@ -11,9 +11,21 @@
 #include "../HTKMLFReader/htkfeatio.h"
 #include "UtteranceDescription.h"
 #include "ssematrix.h"
+#include "Float16.h"
+#include <stdint.h>
+#include <math.h>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// How the frames of a chunk are held in memory while the chunk is paged in.
+// Compressed chunks are expanded to float only when frames are copied out, so more chunks fit into the same memory.
+enum class ChunkCompression
+{
+    None,    // float
+    Float16, // IEEE half precision, 2 bytes per value
+    Int8     // 1 byte per value, quantized linearly between the minimum and maximum of each dimension of an utterance
+};
+
 // Class represents a description of an HTK chunk.
 // It is only used internally by the HTK deserializer.
 // Can exist without associated data and provides methods for requiring/releasing chunk data.
@@ -26,6 +38,16 @@ class HTKChunkDescription
     // Stores all frames of the chunk consecutively (mutable since this is a cache).
     mutable msra::dbn::matrix m_frames;
 
+    // Compressed frames, used instead of m_frames depending on m_compression.
+    // Frames of all utterances are stored consecutively, each frame as m_dimension values without padding.
+    mutable ChunkCompression m_compression = ChunkCompression::None;
+    mutable size_t m_dimension = 0;
+    mutable std::vector<uint16_t> m_halfFrames;
+    mutable std::vector<uint8_t> m_quantizedFrames;
+    // For Int8: value = offset + step * quantized value; [utteranceIndex * m_dimension + i] for dimension i of an utterance.
+    mutable std::vector<float> m_quantizationOffsets;
+    mutable std::vector<float> m_quantizationSteps;
+
     // First frames of all utterances. m_firstFrames[utteranceIndex] == index of the first frame of the utterance.
     // Size of m_firstFrames should be equal to the number of utterances.
     std::vector<size_t> m_firstFrames;
@@ -115,10 +137,49 @@ public:
         return msra::dbn::matrixstripe(m_frames, ts, n);
     }
 
+    // Returns frames [firstFrame, firstFrame + numFrames) of a given utterance.
+    // For a compressed chunk they are expanded into 'buffer', which must stay alive as long as the returned stripe is used.
+    msra::dbn::matrixstripe GetUtteranceFrames(size_t index, size_t firstFrame, size_t numFrames, msra::dbn::matrix& buffer) const
+    {
+        if (!IsInRam())
+        {
+            LogicError("GetUtteranceFrames was called when data have not yet been paged in.");
+        }
+
+        if (m_compression == ChunkCompression::None)
+        {
+            return msra::dbn::matrixstripe(m_frames, m_firstFrames[index] + firstFrame, numFrames);
+        }
+
+        buffer.resize(m_dimension, numFrames);
+        const size_t first = (m_firstFrames[index] + firstFrame) * m_dimension;
+        if (m_compression == ChunkCompression::Float16)
+        {
+            for (size_t t = 0; t < numFrames; t++)
+            {
+                const uint16_t* frame = m_halfFrames.data() + first + t * m_dimension;
+                for (size_t i = 0; i < m_dimension; i++)
+                    buffer(i, t) = HalfToFloat(frame[i]);
+            }
+        }
+        else
+        {
+            const float* offsets = m_quantizationOffsets.data() + index * m_dimension;
+            const float* steps = m_quantizationSteps.data() + index * m_dimension;
+            for (size_t t = 0; t < numFrames; t++)
+            {
+                const uint8_t* frame = m_quantizedFrames.data() + first + t * m_dimension;
+                for (size_t i = 0; i < m_dimension; i++)
+                    buffer(i, t) = offsets[i] + steps[i] * frame[i];
+            }
+        }
+        return msra::dbn::matrixstripe(buffer, 0, numFrames);
+    }
+
     // Pages-in the data for this chunk.
     // this function supports retrying since we read from the unreliable network, i.e. do not return in a broken state
     // We pass in the feature info variables to check that that data being read has expected properties.
-    void RequireData(const string& featureKind, size_t featureDimension, unsigned int samplePeriod, int verbosity = 0) const
+    void RequireData(const string& featureKind, size_t featureDimension, unsigned int samplePeriod, int verbosity = 0, ChunkCompression compression = ChunkCompression::None) const
     {
         if (GetNumberOfUtterances() == 0)
         {
@@ -136,13 +197,43 @@ public:
             // if this is the first feature read ever, we explicitly open the first file to get the information such as feature dimension
             msra::asr::htkfeatreader reader;
 
-            // read all utterances; if they are in the same archive, htkfeatreader will be efficient in not closing the file
-            m_frames.resize(featureDimension, m_totalFrames);
-            foreach_index(i, m_utterances)
+            m_compression = compression;
+            m_dimension = featureDimension;
+            if (compression == ChunkCompression::None)
+            {
+                // read all utterances; if they are in the same archive, htkfeatreader will be efficient in not closing the file
+                m_frames.resize(featureDimension, m_totalFrames);
+                foreach_index(i, m_utterances)
+                {
+                    // read features for this file
+                    auto framesWrapper = GetUtteranceFrames(i);
+                    reader.read(m_utterances[i].GetPath(), featureKind, samplePeriod, framesWrapper);
+                }
+            }
+            else
             {
-                // read features for this file
-                auto framesWrapper = GetUtteranceFrames(i);
-                reader.read(m_utterances[i].GetPath(), featureKind, samplePeriod, framesWrapper);
+                if (compression == ChunkCompression::Float16)
+                {
+                    m_halfFrames.resize(featureDimension * m_totalFrames);
+                }
+                else
+                {
+                    m_quantizedFrames.resize(featureDimension * m_totalFrames);
+                    m_quantizationOffsets.resize(featureDimension * m_utterances.size());
+                    m_quantizationSteps.resize(featureDimension * m_utterances.size());
+                }
+
+                // read the utterances one at a time into a float buffer and compress them into the chunk
+                size_t maxFrames = 0;
+                for (const auto& utterance : m_utterances)
+                    maxFrames = std::max(maxFrames, utterance.GetNumberOfFrames());
+                msra::dbn::matrix buffer(featureDimension, maxFrames);
+                foreach_index(i, m_utterances)
+                {
+                    msra::dbn::matrixstripe framesWrapper(buffer, 0, m_utterances[i].GetNumberOfFrames());
+                    reader.read(m_utterances[i].GetPath(), featureKind, samplePeriod, framesWrapper);
+                    CompressUtterance(i, framesWrapper);
+                }
             }
 
             if (verbosity)
@@ -151,13 +242,13 @@ public:
                         m_chunkId,
                         m_utterances.size(),
                         m_totalFrames,
-                        sizeof(float) * m_frames.rows() * m_frames.cols());
+                        GetSizeInBytes());
             }
         }
         catch (...)
         {
             // Releasing all data
-            m_frames.resize(0, 0);
+            ClearData();
             throw;
         }
     }
@@ -181,18 +272,76 @@ public:
                     m_chunkId,
                     m_utterances.size(),
                     m_totalFrames,
-                    sizeof(float) * m_frames.rows() * m_frames.cols());
+                    GetSizeInBytes());
         }
 
         // release frames
-        m_frames.resize(0, 0);
+        ClearData();
     }
 
     private:
         // test if data is in memory at the moment
         bool IsInRam() const
         {
-            return !m_frames.empty();
+            return !m_frames.empty() || !m_halfFrames.empty() || !m_quantizedFrames.empty();
+        }
+
+        size_t GetSizeInBytes() const
+        {
+            return sizeof(float) * m_frames.rows() * m_frames.cols() +
+                   sizeof(uint16_t) * m_halfFrames.size() +
+                   sizeof(uint8_t) * m_quantizedFrames.size() +
+                   sizeof(float) * (m_quantizationOffsets.size() + m_quantizationSteps.size());
+        }
+
+        void ClearData() const
+        {
+            m_frames.resize(0, 0);
+            std::vector<uint16_t>().swap(m_halfFrames);
+            std::vector<uint8_t>().swap(m_quantizedFrames);
+            std::vector<float>().swap(m_quantizationOffsets);
+            std::vector<float>().swap(m_quantizationSteps);
+        }
+
+        // Stores the frames of an utterance in the compressed format of the chunk.
+        void CompressUtterance(size_t index, const msra::dbn::matrixstripe& frames) const
+        {
+            const size_t first = m_firstFrames[index] * m_dimension;
+            const size_t numFrames = frames.cols();
+            if (m_compression == ChunkCompression::Float16)
+            {
+                for (size_t t = 0; t < numFrames; t++)
+                {
+                    uint16_t* frame = m_halfFrames.data() + first + t * m_dimension;
+                    for (size_t i = 0; i < m_dimension; i++)
+                        frame[i] = FloatToHalf(frames(i, t));
+                }
+                return;
+            }
+
+            float* offsets = m_quantizationOffsets.data() + index * m_dimension;
+            float* steps = m_quantizationSteps.data() + index * m_dimension;
+            for (size_t i = 0; i < m_dimension; i++)
+            {
+                float minValue = numFrames > 0 ? frames(i, 0) : 0.0f;
+                float maxValue = minValue;
+                for (size_t t = 1; t < numFrames; t++)
+                {
+                    minValue = std::min(minValue, frames(i, t));
+                    maxValue = std::max(maxValue, frames(i, t));
+                }
+                offsets[i] = minValue;
+                steps[i] = (maxValue - minValue) / 255.0f;
+            }
+            for (size_t t = 0; t < numFrames; t++)
+            {
+                uint8_t* frame = m_quantizedFrames.data() + first + t * m_dimension;
+                for (size_t i = 0; i < m_dimension; i++)
+                {
+                    float q = steps[i] > 0 ? (frames(i, t) - offsets[i]) / steps[i] : 0.0f;
+                    frame[i] = (uint8_t)std::min(255.0f, std::max(0.0f, floorf(q + 0.5f)));
+                }
+            }
         }
 };
 
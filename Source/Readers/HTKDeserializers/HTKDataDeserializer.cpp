@@ -6,6 +6,7 @@
 #include "stdafx.h"
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
+#include <set>
 #include "HTKDataDeserializer.h"
 #include "ConfigHelper.h"
 #include "Basics.h"
@@ -24,6 +25,18 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 
 using namespace std;
 
+// Parses the 'chunkCompression' option: none (default), float16 or int8.
+static ChunkCompression ParseChunkCompression(const wstring& value)
+{
+    if (AreEqualIgnoreCase(value, L"none"))
+        return ChunkCompression::None;
+    if (AreEqualIgnoreCase(value, L"float16"))
+        return ChunkCompression::Float16;
+    if (AreEqualIgnoreCase(value, L"int8"))
+        return ChunkCompression::Int8;
+    InvalidArgument("Unsupported chunkCompression '%ls'. Expected 'none', 'float16' or 'int8'.", value.c_str());
+}
+
 HTKDataDeserializer::HTKDataDeserializer(
     CorpusDescriptorPtr corpus,
     const ConfigParameters& cfg,
@@ -36,6 +49,7 @@ HTKDataDeserializer::HTKDataDeserializer(
     m_frameMode = (ConfigValue)cfg("frameMode", "true");
 
     m_verbosity = cfg(L"verbosity", 0);
+    m_chunkCompression = ParseChunkCompression(cfg(L"chunkCompression", L"none"));
 
     argvector<ConfigValue> inputs = cfg("input");
     if (inputs.size() != 1)
@@ -62,6 +76,7 @@ HTKDataDeserializer::HTKDataDeserializer(
     m_dimension = config.GetFeatureDimension();
     m_dimension = m_dimension * (1 + context.first + context.second);
 
+    m_scriptFile = config.GetScriptFile();
     InitializeChunkDescriptions(config.GetSequencePaths());
     InitializeStreams(inputName);
     InitializeFeatureInformation();
@@ -85,6 +100,7 @@ HTKDataDeserializer::HTKDataDeserializer(
     config.CheckFeatureType();
 
     m_verbosity = feature(L"verbosity", 0);
+    m_chunkCompression = ParseChunkCompression(feature(L"chunkCompression", L"none"));
 
     auto context = config.GetContextWindow();
     m_elementType = config.GetElementType();
@@ -98,6 +114,7 @@ HTKDataDeserializer::HTKDataDeserializer(
         InvalidArgument("Cannot expand utterances of the primary stream %ls, please change your configuration.", featureName.c_str());
     }
 
+    m_scriptFile = config.GetScriptFile();
     InitializeChunkDescriptions(config.GetSequencePaths());
     InitializeStreams(featureName);
     InitializeFeatureInformation();
@@ -233,6 +250,21 @@ void HTKDataDeserializer::InitializeFeatureInformation()
     });
 }
 
+// Gets the script file and the feature archives of the selected utterances.
+std::vector<std::wstring> HTKDataDeserializer::GetInputFiles() const
+{
+    set<wstring> archives;
+    for (const auto& chunk : m_chunks)
+    {
+        for (size_t i = 0; i < chunk.GetNumberOfUtterances(); ++i)
+            archives.insert(chunk.GetUtterance(i)->GetPath().physicallocation());
+    }
+
+    vector<wstring> result(1, m_scriptFile);
+    result.insert(result.end(), archives.begin(), archives.end());
+    return result;
+}
+
 // Gets information about available chunks.
 ChunkDescriptions HTKDataDeserializer::GetChunkDescriptions()
 {
@@ -337,7 +369,7 @@ public:
         // making several attempts
         msra::util::attempt(5, [&]()
         {
-            chunkDescription.RequireData(m_parent->m_featureKind, m_parent->m_ioFeatureDimension, m_parent->m_samplePeriod, m_parent->m_verbosity);
+            chunkDescription.RequireData(m_parent->m_featureKind, m_parent->m_ioFeatureDimension, m_parent->m_samplePeriod, m_parent->m_verbosity, m_parent->m_chunkCompression);
         });
     }
 
@@ -492,7 +524,24 @@ void HTKDataDeserializer::GetSequenceById(ChunkIdType chunkId, size_t id, vector
     const auto& chunkDescription = m_chunks[chunkId];
     size_t utteranceIndex = m_frameMode ? chunkDescription.GetUtteranceForChunkFrameIndex(id) : id;
     const UtteranceDescription* utterance = chunkDescription.GetUtterance(utteranceIndex);
-    auto utteranceFrames = chunkDescription.GetUtteranceFrames(utteranceIndex);
+
+    // Only the frames needed for the sequence and its augmentation are fetched, which matters for compressed chunks,
+    // where they are expanded to float. Augmentation stops at the utterance boundaries, which are within this range.
+    const size_t numberOfFrames = utterance->GetNumberOfFrames();
+    size_t firstFrame = 0, frameIndex = 0;
+    size_t numFrames = numberOfFrames;
+    if (m_frameMode)
+    {
+        frameIndex = id - chunkDescription.GetStartFrameIndexInsideChunk(utteranceIndex);
+        firstFrame = frameIndex > m_augmentationWindow.first ? frameIndex - m_augmentationWindow.first : 0;
+        numFrames = min(numberOfFrames, frameIndex + m_augmentationWindow.second + 1) - firstFrame;
+    }
+    else if (m_expandToPrimary)
+    {
+        numFrames = min(numberOfFrames, m_augmentationWindow.second + 1);
+    }
+    msra::dbn::matrix expandedFrames; // holds the frames if the chunk is compressed
+    auto utteranceFrames = chunkDescription.GetUtteranceFrames(utteranceIndex, firstFrame, numFrames, expandedFrames);
 
     // wrapper that allows m[j].size() and m[j][i] as required by augmentneighbors()
     MatrixAsVectorOfVectors utteranceFramesWrapper(utteranceFrames);
@@ -502,9 +551,8 @@ void HTKDataDeserializer::GetSequenceById(ChunkIdType chunkId, size_t id, vector
     if (m_frameMode)
     {
         // For frame mode augment a single frame.
-        size_t frameIndex = id - chunkDescription.GetStartFrameIndexInsideChunk(utteranceIndex);
         auto fillIn = features.col(0);
-        AugmentNeighbors(utteranceFramesWrapper, frameIndex, m_augmentationWindow.first, m_augmentationWindow.second, fillIn);
+        AugmentNeighbors(utteranceFramesWrapper, frameIndex - firstFrame, m_augmentationWindow.first, m_augmentationWindow.second, fillIn);
     }
     else if (m_expandToPrimary) // Broadcast a single frame to the complete utterance.
     {
@@ -565,6 +613,7 @@ bool HTKDataDeserializer::GetSequenceDescription(const SequenceDescription& prim
     {
         // Expanding for sequence length/or max seen frame.
         size_t maxLength = max(primary.m_numberOfSamples, (uint32_t)primary.m_key.m_sample + 1);
+        std::lock_guard<std::mutex> lock(m_expansionLock);
         if (utterance->GetExpansionLength() < maxLength)
         {
             utterance->SetExpansionLength(maxLength);
@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include <mutex>
 #include "DataDeserializerBase.h"
 #include "Config.h"
 #include "CorpusDescriptor.h"
@@ -37,6 +38,15 @@ public:
     // Gets sequence description by the primary one.
     virtual bool GetSequenceDescription(const SequenceDescription& primary, SequenceDescription&) override;
 
+    // Sequence descriptions can be retrieved from several threads.
+    virtual bool SupportsConcurrentSequenceDescriptions() const override
+    {
+        return true;
+    }
+
+    // Gets the script file and the feature archives it lists.
+    virtual std::vector<std::wstring> GetInputFiles() const override;
+
 private:
     class HTKChunk;
     DISABLE_COPY_AND_MOVE(HTKDataDeserializer);
@@ -59,11 +69,17 @@ private:
     // Chunk descriptions.
     std::vector<HTKChunkDescription> m_chunks;
 
+    // How chunks are held in memory ('chunkCompression' option).
+    ChunkCompression m_chunkCompression;
+
     // Augmentation window.
     std::pair<size_t, size_t> m_augmentationWindow;
 
     CorpusDescriptorPtr m_corpus;
 
+    // Script file that lists the utterances.
+    std::wstring m_scriptFile;
+
     // General configuration
     int m_verbosity;
 
@@ -88,6 +104,9 @@ private:
     // A flag that indicates whether the utterance should be extended to match the lenght of the utterance from the primary deserializer.
     // TODO: This should be moved to the packers when deserializers work in sequence mode only.
     bool m_expandToPrimary;
+
+    // Guards the expansion of utterances when sequence descriptions are requested from several threads.
+    std::mutex m_expansionLock;
 };
 
 typedef std::shared_ptr<HTKDataDeserializer> HTKDataDeserializerPtr;
@@ -33,7 +33,8 @@ std::vector<IDataDeserializerPtr> CreateDeserializers(const ConfigParameters& re
     }
 
     bool useNumericSequenceKeys = readerConfig(L"useNumericSequenceKeys", false);
-    CorpusDescriptorPtr corpus = std::make_shared<CorpusDescriptor>(useNumericSequenceKeys);
+    std::wstring keyRegistryFile = readerConfig(L"sequenceKeyRegistry", L"");
+    CorpusDescriptorPtr corpus = std::make_shared<CorpusDescriptor>(useNumericSequenceKeys, keyRegistryFile);
 
     std::vector<IDataDeserializerPtr> featureDeserializers;
     std::vector<IDataDeserializerPtr> labelDeserializers;
@@ -54,6 +55,7 @@ std::vector<IDataDeserializerPtr> CreateDeserializers(const ConfigParameters& re
 
         labelDeserializers.push_back(deserializer);
     }
+    corpus->FinalizeKeyRegistry();
 
     std::vector<IDataDeserializerPtr> deserializers;
     deserializers.insert(deserializers.end(), featureDeserializers.begin(), featureDeserializers.end());
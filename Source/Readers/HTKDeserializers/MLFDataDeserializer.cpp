@@ -13,6 +13,7 @@
 #include "../HTKMLFReader/htkfeatio.h"
 #include "../HTKMLFReader/msra_mgram.h"
 #include "latticearchive.h"
+#include "MLFLabelLoader.h"
 #include "StringUtil.h"
 
 
@@ -110,75 +111,57 @@ void MLFDataDeserializer::InitializeChunkDescriptions(CorpusDescriptorPtr corpus
 {
     // TODO: Similarly to the old reader, currently we assume all Mlfs will have same root name (key)
     // restrict MLF reader to these files--will make stuff much faster without having to use shortened input files
-
-    // TODO: currently we do not use symbol and word tables.
-    const msra::lm::CSymbolSet* wordTable = nullptr;
-    unordered_map<const char*, int>* symbolTable = nullptr;
     vector<wstring> mlfPaths = config.GetMlfPaths();
 
-    // TODO: Currently we still use the old IO module. This will be refactored later.
+    m_inputFiles = mlfPaths;
+    wstring mlfListFile = config.GetMlfListFile();
+    if (!mlfListFile.empty())
+        m_inputFiles.push_back(mlfListFile);
+    if (!stateListPath.empty())
+        m_inputFiles.push_back(stateListPath);
+
     const double htkTimeToFrame = 100000.0; // default is 10ms
-    msra::asr::htkmlfreader<msra::asr::htkmlfentry, msra::lattices::lattice::htkmlfwordsequence> labels(mlfPaths, set<wstring>(), stateListPath, wordTable, symbolTable, htkTimeToFrame);
+    MLFLabelLoader loader(stateListPath, htkTimeToFrame, config.GetMlfParserThreads());
+    MLFLabels labels;
+    loader.Load(mlfPaths, config.GetMlfCacheFile(), labels);
 
-    // Make sure 'msra::asr::htkmlfreader' type has a move constructor
-    static_assert(
-        is_move_constructible<
-        msra::asr::htkmlfreader<msra::asr::htkmlfentry,
-        msra::lattices::lattice::htkmlfwordsequence >> ::value,
-        "Type 'msra::asr::htkmlfreader' should be move constructible!");
+    // Taking over the labels of all utterances; the ones that are not included in the corpus are removed
+    // by moving the labels of the following utterances down in place.
+    m_classIds.swap(labels.m_classIds);
 
     MLFUtterance description;
     size_t numClasses = 0;
     size_t totalFrames = 0;
 
     // TODO resize m_keyToSequence with number of IDs from string registry
-    for (const auto& l : labels)
+    for (size_t utterance = 0; utterance < labels.NumberOfUtterances(); ++utterance)
     {
-        auto key = msra::strfun::utf8(l.first);
+        auto key = labels.GetKey(utterance);
         if (!corpus->IsIncluded(key))
             continue;
 
         size_t id = corpus->KeyToId(key);
         description.m_key.m_sequence = id;
 
-        const auto& utterance = l.second;
-        description.m_sequenceStart = m_classIds.size();
-        uint32_t numberOfFrames = 0;
+        size_t numberOfFrames = labels.GetNumberOfFrames(utterance);
+        if (labels.m_maxClassIds[utterance] >= dimension)
+        {
+            RuntimeError("Class id %d exceeds the model output dimension %d.", (int)labels.m_maxClassIds[utterance], (int)dimension);
+        }
 
-        foreach_index(i, utterance)
+        if (SEQUENCELEN_MAX < numberOfFrames)
         {
-            const auto& timespan = utterance[i];
-            if ((i == 0 && timespan.firstframe != 0) ||
-                (i > 0 && utterance[i - 1].firstframe + utterance[i - 1].numframes != timespan.firstframe))
-            {
-                RuntimeError("Labels are not in the consecutive order MLF in label set: %ls", l.first.c_str());
-            }
-
-            if (timespan.classid >= dimension)
-            {
-                RuntimeError("Class id %d exceeds the model output dimension %d.", (int)timespan.classid, (int)dimension);
-            }
-
-            if (timespan.classid != static_cast<msra::dbn::CLASSIDTYPE>(timespan.classid))
-            {
-                RuntimeError("CLASSIDTYPE has too few bits");
-            }
-
-            if (SEQUENCELEN_MAX < timespan.firstframe + timespan.numframes)
-            {
-                RuntimeError("Maximum number of sample per sequence exceeded.");
-            }
-
-            numClasses = max(numClasses, (size_t)(1u + timespan.classid));
-
-            for (size_t t = timespan.firstframe; t < timespan.firstframe + timespan.numframes; t++)
-            {
-                m_classIds.push_back(timespan.classid);
-                numberOfFrames++;
-            }
+            RuntimeError("Maximum number of sample per sequence exceeded.");
         }
 
-        description.m_numberOfSamples = numberOfFrames;
+        if (numberOfFrames > 0)
+            numClasses = max(numClasses, (size_t)(1u + labels.m_maxClassIds[utterance]));
+
+        size_t firstFrame = (size_t)labels.m_frameOffsets[utterance];
+        if (firstFrame != totalFrames)
+            copy(m_classIds.begin() + firstFrame, m_classIds.begin() + firstFrame + numberOfFrames, m_classIds.begin() + totalFrames);
+
+        description.m_numberOfSamples = (uint32_t)numberOfFrames;
         m_utteranceIndex.push_back(totalFrames);
         totalFrames += numberOfFrames;
 
@@ -186,11 +169,16 @@ void MLFDataDeserializer::InitializeChunkDescriptions(CorpusDescriptorPtr corpus
         {
             m_keyToSequence.resize(description.m_key.m_sequence + 1, SIZE_MAX);
         }
-        assert(m_keyToSequence[description.m_key.m_sequence] == SIZE_MAX);
+        if (m_keyToSequence[description.m_key.m_sequence] != SIZE_MAX)
+        {
+            RuntimeError("MLFDataDeserializer: duplicate entry '%s' in the MLF files.", key.c_str());
+        }
         m_keyToSequence[description.m_key.m_sequence] = m_utteranceIndex.size() - 1;
         m_numberOfSequences++;
     }
     m_utteranceIndex.push_back(totalFrames);
+    m_classIds.resize(totalFrames);
+    m_classIds.shrink_to_fit();
 
     m_totalNumberOfFrames = totalFrames;
 
@@ -37,6 +37,18 @@ public:
     // TODO: After we switch the timeline to work in chunks, we will also introduce chunking of labels.
     virtual ChunkPtr GetChunk(ChunkIdType) override;
 
+    // Sequence descriptions can be retrieved from several threads.
+    virtual bool SupportsConcurrentSequenceDescriptions() const override
+    {
+        return true;
+    }
+
+    // Gets the mlf files, the file that lists them and the state list.
+    virtual std::vector<std::wstring> GetInputFiles() const override
+    {
+        return m_inputFiles;
+    }
+
 private:
     class MLFChunk;
     DISABLE_COPY_AND_MOVE(MLFDataDeserializer);
@@ -55,7 +67,7 @@ private:
     size_t m_numberOfSequences = 0;
 
     // Array of all labels.
-    msra::dbn::biggrowablevector<msra::dbn::CLASSIDTYPE> m_classIds;
+    std::vector<msra::dbn::CLASSIDTYPE> m_classIds;
 
     // Index of utterances in the m_classIds.
     msra::dbn::biggrowablevector<size_t> m_utteranceIndex;
@@ -76,6 +88,9 @@ private:
 
     // Flag that indicates whether a single speech frames should be exposed as a sequence.
     bool m_frameMode;
+
+    // Files the labels are read from.
+    std::vector<std::wstring> m_inputFiles;
 };
 
 }}}
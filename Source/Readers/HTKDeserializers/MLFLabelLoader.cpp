@@ -0,0 +1,599 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <limits.h>
+#include <memory>
+#include <thread>
+#include <unordered_set>
+#include "MLFLabelLoader.h"
+#include "MemoryMappedFile.h"
+#include "SidecarCache.h"
+#include "fileutil.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+using namespace std;
+
+void MLFLabels::Append(const MLFLabels& other)
+{
+    uint64_t keyBase = m_keys.size();
+    uint64_t frameBase = m_classIds.size();
+    m_keys.insert(m_keys.end(), other.m_keys.begin(), other.m_keys.end());
+    for (size_t i = 1; i < other.m_keyOffsets.size(); ++i)
+        m_keyOffsets.push_back(keyBase + other.m_keyOffsets[i]);
+    for (size_t i = 1; i < other.m_frameOffsets.size(); ++i)
+        m_frameOffsets.push_back(frameBase + other.m_frameOffsets[i]);
+    m_maxClassIds.insert(m_maxClassIds.end(), other.m_maxClassIds.begin(), other.m_maxClassIds.end());
+    m_classIds.insert(m_classIds.end(), other.m_classIds.begin(), other.m_classIds.end());
+}
+
+// FNV-1a, with the seed folded into the offset basis and a final mix so that the low bits are usable as bucket index.
+uint64_t StateListIndex::Hash(const char* name, size_t length, uint64_t seed)
+{
+    uint64_t hash = 14695981039346656037ull ^ (seed * 0x9e3779b97f4a7c15ull);
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash ^= (unsigned char)name[i];
+        hash *= 1099511628211ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static size_t NextPrime(size_t n)
+{
+    for (;; ++n)
+    {
+        bool prime = n >= 2;
+        for (size_t d = 2; prime && d * d <= n; ++d)
+            prime = n % d != 0;
+        if (prime)
+            return n;
+    }
+}
+
+void StateListIndex::Build(const vector<string>& names)
+{
+    m_seed = 0;
+    m_displacements.clear();
+    m_slots.clear();
+    m_offsets.assign(1, 0);
+    m_chars.clear();
+    if (names.empty())
+        return;
+    if (names.size() >= EmptySlot)
+        RuntimeError("StateListIndex: too many state names (%d).", (int)names.size());
+
+    unordered_set<string> unique;
+    for (const auto& name : names)
+    {
+        if (!unique.insert(name).second)
+            RuntimeError("StateListIndex: duplicate state name '%s'.", name.c_str());
+        m_chars.insert(m_chars.end(), name.begin(), name.end());
+        if (m_chars.size() >= UINT32_MAX)
+            RuntimeError("StateListIndex: state names are too long.");
+        m_offsets.push_back((uint32_t)m_chars.size());
+    }
+
+    // About four names per bucket and a load factor of 0.8 keep the construction fast.
+    const size_t numberOfBuckets = max<size_t>(names.size() / 4, 1);
+    const size_t numberOfSlots = NextPrime(max<size_t>(names.size() + names.size() / 4, 3));
+
+    vector<uint64_t> hashes(names.size());
+    vector<vector<uint32_t>> buckets(numberOfBuckets);
+    vector<size_t> order(numberOfBuckets);
+    vector<size_t> bucketSlots;
+    for (m_seed = 0;; ++m_seed)
+    {
+        for (auto& bucket : buckets)
+            bucket.clear();
+        for (size_t i = 0; i < names.size(); ++i)
+        {
+            hashes[i] = Hash(names[i].data(), names[i].size(), m_seed);
+            buckets[(size_t)(hashes[i] % numberOfBuckets)].push_back((uint32_t)i);
+        }
+
+        // Placing the largest buckets first, while most slots are still free.
+        for (size_t b = 0; b < numberOfBuckets; ++b)
+            order[b] = b;
+        sort(order.begin(), order.end(), [&buckets](size_t a, size_t b)
+        {
+            return buckets[a].size() > buckets[b].size();
+        });
+
+        m_displacements.assign(numberOfBuckets, 0);
+        m_slots.assign(numberOfSlots, (uint32_t)EmptySlot);
+        bool success = true;
+        for (size_t b : order)
+        {
+            const auto& bucket = buckets[b];
+            if (bucket.empty())
+                break;
+
+            bool placed = false;
+            for (uint32_t displacement = 0; !placed && displacement < numberOfSlots; ++displacement)
+            {
+                bucketSlots.clear();
+                placed = true;
+                for (uint32_t i : bucket)
+                {
+                    size_t slot = Slot(hashes[i], displacement);
+                    if (m_slots[slot] != EmptySlot || find(bucketSlots.begin(), bucketSlots.end(), slot) != bucketSlots.end())
+                    {
+                        placed = false;
+                        break;
+                    }
+                    bucketSlots.push_back(slot);
+                }
+                if (placed)
+                {
+                    m_displacements[b] = displacement;
+                    for (size_t i = 0; i < bucket.size(); ++i)
+                        m_slots[bucketSlots[i]] = bucket[i];
+                }
+            }
+
+            // Two names of the bucket that collide for every displacement, trying again with another seed.
+            if (!placed)
+            {
+                success = false;
+                break;
+            }
+        }
+        if (success)
+            return;
+    }
+}
+
+// A range [m_begin, m_end) of an MLF file that starts at an utterance boundary and ends after a line ".".
+struct MLFLabelLoader::Piece
+{
+    const wstring* m_path;
+    const char* m_begin;
+    const char* m_end;
+};
+
+// Header of the label cache file, followed by the key offsets (m_numberOfUtterances + 1 uint64_t),
+// the frame offsets (m_numberOfUtterances + 1 uint64_t), the largest class id of every utterance, the keys and the class ids.
+struct MLFLabelLoader::CacheHeader
+{
+    SidecarCacheHeader m_file;
+    uint64_t m_numberOfUtterances;
+    uint64_t m_numberOfKeyBytes;
+    uint64_t m_numberOfFrames;
+};
+
+static const char* s_labelCacheMagic = "CNTKMLFC";
+static const uint32_t s_labelCacheVersion = 2;
+
+// Files are split into pieces of at least this size, smaller files are parsed by a single thread.
+static const size_t s_minPieceSize = 1 << 20;
+
+MLFLabelLoader::MLFLabelLoader(const wstring& stateListPath, double htkTimeToFrame, size_t numberOfThreads)
+    : m_stateListPath(stateListPath), m_htkTimeToFrame(htkTimeToFrame), m_numberOfThreads(max<size_t>(numberOfThreads, 1))
+{
+    if (!m_stateListPath.empty())
+        ReadStateList();
+}
+
+// Reads the state list, one name per line; the class id of a state is its index, not counting empty lines.
+void MLFLabelLoader::ReadStateList()
+{
+    MemoryMappedFile file(m_stateListPath);
+    const char* p = file.Data();
+    const char* end = p + file.Size();
+    vector<string> names;
+    while (p < end)
+    {
+        const char* lineEnd = p;
+        while (lineEnd < end && *lineEnd != '\n' && *lineEnd != '\r')
+            ++lineEnd;
+        if (lineEnd > p)
+            names.push_back(string(p, lineEnd));
+        p = lineEnd + 1;
+    }
+    m_states.Build(names);
+    fprintf(stderr, "total %lu state names in state list %ls\n", (unsigned long)m_states.Size(), m_stateListPath.c_str());
+}
+
+static bool IsLine(const char* line, size_t length, const char* text)
+{
+    return length == strlen(text) && memcmp(line, text, length) == 0;
+}
+
+// Copies a token into a zero-terminated buffer for the C library conversions.
+static const char* TerminatedToken(const char* token, size_t length, char (&buffer)[64])
+{
+    if (length >= sizeof(buffer))
+        RuntimeError("MLFLabelLoader: invalid number '%.*s'", (int)min<size_t>(length, 100), token);
+    memcpy(buffer, token, length);
+    buffer[length] = 0;
+    return buffer;
+}
+
+// Parses an HTK time stamp. HTK writes integers, which do not need strtod().
+static double ParseTime(const char* token, size_t length)
+{
+    if (length > 0 && length <= 15)
+    {
+        uint64_t value = 0;
+        size_t i = 0;
+        for (; i < length && token[i] >= '0' && token[i] <= '9'; ++i)
+            value = value * 10 + (token[i] - '0');
+        if (i == length)
+            return (double)value;
+    }
+
+    char buffer[64];
+    const char* s = TerminatedToken(token, length, buffer);
+    char* ep;
+    double value = strtod(s, &ep);
+    if (*s == 0 || *ep != 0)
+        RuntimeError("todouble: invalid input string '%s'", s);
+    return value;
+}
+
+// Gets the key of an utterance from its file name entry: without quotes, a leading "*/" and the extension
+// (the same key as msra::asr::htkmlfreader).
+static void AppendKey(const char* line, size_t length, vector<char>& keys)
+{
+    const char* begin = line + 1;
+    const char* end = line + length - 1;
+    if (end - begin >= 2 && begin[0] == '*' && begin[1] == '/')
+        begin += 2;
+    for (const char* p = end; p > begin; --p)
+    {
+#ifdef _MSC_VER
+        if (p[-1] == '\\' || p[-1] == '/' || p[-1] == ':')
+            break;
+#endif
+        if (p[-1] == '.')
+        {
+            end = p - 1;
+            break;
+        }
+    }
+    keys.insert(keys.end(), begin, end);
+}
+
+void MLFLabelLoader::ParsePiece(const Piece& piece, MLFLabels& labels) const
+{
+    labels.Clear();
+    labels.m_classIds.reserve((piece.m_end - piece.m_begin) / 8); // (a rough guess, an entry line of 20 to 40 characters is a few frames)
+
+    bool inUtterance = false;
+    bool skipping = false;
+    size_t nextFrame = 0;
+    msra::dbn::CLASSIDTYPE maxClassId = 0;
+    auto currentKey = [&labels]()
+    {
+        return string(labels.m_keys.begin() + labels.m_keyOffsets.back(), labels.m_keys.end());
+    };
+
+    const size_t maxTokens = 4;
+    const char* tokens[maxTokens];
+    size_t tokenLengths[maxTokens];
+    for (const char* p = piece.m_begin; p < piece.m_end;)
+    {
+        const char* line = p;
+        while (p < piece.m_end && *p != '\n' && *p != '\r')
+            ++p;
+        size_t length = p - line;
+        ++p;
+        if (length == 0)
+            continue;
+
+        if (!inUtterance)
+        {
+            if (IsLine(line, length, "#!MLF!#")) // embedded duplicate MLF headers (so user can 'cat' MLFs)
+                continue;
+
+            // some MLF files have write errors, so malformed entries are skipped
+            inUtterance = true;
+            skipping = length < 3 || line[0] != '"' || line[length - 1] != '"';
+            if (skipping)
+            {
+                fprintf(stderr, "warning: filename entry (%.*s)\n", (int)length, line);
+                fprintf(stderr, "skip current mlf entry in '%ls'.\n", piece.m_path->c_str());
+                continue;
+            }
+            AppendKey(line, length, labels.m_keys);
+            nextFrame = 0;
+            maxClassId = 0;
+            continue;
+        }
+
+        if (length == 1 && line[0] == '.') // utterance end delimiter: a single dot on a line
+        {
+            inUtterance = false;
+            if (!skipping)
+            {
+                labels.m_keyOffsets.push_back(labels.m_keys.size());
+                labels.m_frameOffsets.push_back(labels.m_classIds.size());
+                labels.m_maxClassIds.push_back(maxClassId);
+            }
+            continue;
+        }
+        if (skipping)
+            continue;
+
+        // Entry line: start and end time, state name (with a state list) or class id in the fourth column.
+        size_t numberOfTokens = 0;
+        for (const char* t = line; t < line + length;)
+        {
+            while (t < line + length && (*t == ' ' || *t == '\t'))
+                ++t;
+            const char* tokenEnd = t;
+            while (tokenEnd < line + length && *tokenEnd != ' ' && *tokenEnd != '\t')
+                ++tokenEnd;
+            if (tokenEnd == t)
+                break;
+            if (numberOfTokens < maxTokens)
+            {
+                tokens[numberOfTokens] = t;
+                tokenLengths[numberOfTokens] = tokenEnd - t;
+            }
+            ++numberOfTokens;
+            t = tokenEnd;
+        }
+
+        size_t classId;
+        if (m_states.Size() > 0)
+        {
+            if (numberOfTokens < 3)
+                RuntimeError("htkmlfentry: expected start time, end time and state name in utterance %s", currentKey().c_str());
+            classId = m_states.Find(tokens[2], tokenLengths[2]);
+            if (classId == SIZE_MAX)
+                RuntimeError("htkmlfentry: state %.*s not found in statelist", (int)tokenLengths[2], tokens[2]);
+        }
+        else
+        {
+            if (numberOfTokens != 4)
+                RuntimeError("htkmlfentry: currently we only support 4-column format");
+            char buffer[64];
+            classId = (size_t)atoi(TerminatedToken(tokens[3], tokenLengths[3], buffer));
+        }
+
+        // if the difference between two frames is more than htkTimeToFrame, we expect conversion to time
+        double rts = ParseTime(tokens[0], tokenLengths[0]);
+        double rte = ParseTime(tokens[1], tokenLengths[1]);
+        size_t ts, te;
+        if (rte - rts >= m_htkTimeToFrame - 1)
+        {
+            ts = (size_t)(rts / m_htkTimeToFrame + 0.5);
+            te = (size_t)(rte / m_htkTimeToFrame + 0.5);
+        }
+        else
+        {
+            ts = (size_t)(rts);
+            te = (size_t)(rte);
+        }
+
+        if (te < ts)
+            RuntimeError("htkmlfentry: end time below start time??");
+        if (te > UINT_MAX || classId != (msra::dbn::CLASSIDTYPE)classId)
+            RuntimeError("htkmlfentry: not enough bits for one of the values");
+        if (ts != nextFrame)
+            RuntimeError("Labels are not in the consecutive order MLF in label set: %s", currentKey().c_str());
+
+        labels.m_classIds.insert(labels.m_classIds.end(), te - ts, (msra::dbn::CLASSIDTYPE)classId);
+        maxClassId = max(maxClassId, (msra::dbn::CLASSIDTYPE)classId);
+        nextFrame = te;
+    }
+
+    if (inUtterance)
+        RuntimeError("htkmlfreader: unexpected end in mid-utterance in '%ls'", piece.m_path->c_str());
+}
+
+// Returns the end of the first line "." at or after 'from' (which is at the start of a line), or 'end'.
+static const char* FindUtteranceEnd(const char* from, const char* end)
+{
+    for (const char* p = from; p < end;)
+    {
+        const char* line = p;
+        while (p < end && *p != '\n' && *p != '\r')
+            ++p;
+        if (p - line == 1 && line[0] == '.')
+            return p;
+        ++p;
+    }
+    return end;
+}
+
+void MLFLabelLoader::Parse(const vector<wstring>& mlfPaths, MLFLabels& labels) const
+{
+    // Mapping all files and splitting them into pieces.
+    vector<shared_ptr<MemoryMappedFile>> files;
+    vector<Piece> pieces;
+    vector<size_t> piecesPerFile;
+    for (const auto& path : mlfPaths)
+    {
+        auto file = make_shared<MemoryMappedFile>(path);
+        files.push_back(file);
+        const char* data = file->Data();
+        const char* end = data + file->Size();
+
+        const char* body = data ? find(data, end, '\n') : end;
+        size_t headerLength = body - data;
+        if (headerLength > 0 && data[headerLength - 1] == '\r')
+            headerLength--;
+        if (!IsLine(data, headerLength, "#!MLF!#"))
+            RuntimeError("htkmlfreader: header missing in '%ls'", path.c_str());
+        if (body < end)
+            body++;
+
+        size_t size = end - body;
+        size_t numberOfPieces = m_numberOfThreads > 1 ? min(4 * m_numberOfThreads, size / s_minPieceSize + 1) : 1;
+        size_t firstPiece = pieces.size();
+        for (const char* begin = body; begin < end;)
+        {
+            // (the boundary is searched from the start of the line containing the nominal position)
+            const char* nominal = body + size * min(pieces.size() - firstPiece + 1, numberOfPieces) / numberOfPieces;
+            const char* lineStart = max(begin, nominal);
+            while (lineStart > begin && lineStart[-1] != '\n' && lineStart[-1] != '\r')
+                --lineStart;
+            const char* pieceEnd = FindUtteranceEnd(lineStart, end);
+            Piece piece = { &path, begin, pieceEnd };
+            pieces.push_back(piece);
+            begin = pieceEnd;
+        }
+        piecesPerFile.push_back(pieces.size() - firstPiece);
+    }
+
+    // Parsing the pieces on all threads.
+    vector<MLFLabels> results(pieces.size());
+    vector<exception_ptr> errors(pieces.size());
+    atomic<size_t> nextPiece(0);
+    auto parse = [&]()
+    {
+        for (size_t i = nextPiece++; i < pieces.size(); i = nextPiece++)
+        {
+            try
+            {
+                ParsePiece(pieces[i], results[i]);
+            }
+            catch (...)
+            {
+                errors[i] = current_exception();
+            }
+        }
+    };
+
+    size_t numberOfThreads = min(m_numberOfThreads, pieces.size());
+    if (numberOfThreads <= 1)
+        parse();
+    else
+    {
+        vector<thread> threads;
+        for (size_t i = 0; i < numberOfThreads; ++i)
+            threads.push_back(thread(parse));
+        for (auto& t : threads)
+            t.join();
+    }
+
+    // Reporting the first error in file order, so that it does not depend on the number of threads.
+    for (const auto& error : errors)
+    {
+        if (error)
+            rethrow_exception(error);
+    }
+
+    // Merging the results in file order.
+    size_t numberOfKeyBytes = 0, numberOfUtterances = 0, numberOfFrames = 0;
+    for (const auto& result : results)
+    {
+        numberOfKeyBytes += result.m_keys.size();
+        numberOfUtterances += result.NumberOfUtterances();
+        numberOfFrames += result.m_classIds.size();
+    }
+    labels.Clear();
+    labels.m_keys.reserve(numberOfKeyBytes);
+    labels.m_keyOffsets.reserve(numberOfUtterances + 1);
+    labels.m_frameOffsets.reserve(numberOfUtterances + 1);
+    labels.m_maxClassIds.reserve(numberOfUtterances);
+    labels.m_classIds.reserve(numberOfFrames);
+
+    size_t piece = 0;
+    for (size_t i = 0; i < mlfPaths.size(); ++i)
+    {
+        size_t before = labels.NumberOfUtterances();
+        for (size_t j = 0; j < piecesPerFile[i]; ++j, ++piece)
+        {
+            labels.Append(results[piece]);
+            results[piece] = MLFLabels();
+        }
+        fprintf(stderr, "MLFLabelLoader: read MLF file %ls, %lu entries\n", mlfPaths[i].c_str(), (unsigned long)(labels.NumberOfUtterances() - before));
+    }
+}
+
+// Fingerprint of the input files (names and sizes) and the parsing options.
+uint64_t MLFLabelLoader::ComputeFingerprint(const vector<wstring>& mlfPaths) const
+{
+    SidecarFingerprint fingerprint;
+    fingerprint.AddValue(s_labelCacheVersion);
+    fingerprint.AddValue(mlfPaths.size());
+    for (const auto& file : mlfPaths)
+        fingerprint.AddFile(file);
+    if (!m_stateListPath.empty())
+        fingerprint.AddFile(m_stateListPath);
+    fingerprint.Add(&m_htkTimeToFrame, sizeof(m_htkTimeToFrame));
+    return fingerprint.Value();
+}
+
+// Loads the labels from the cache file, returns false if it is missing or stale.
+bool MLFLabelLoader::TryLoadCache(const vector<wstring>& mlfPaths, const wstring& cacheFile, MLFLabels& labels) const
+{
+    vector<wstring> inputs(mlfPaths);
+    if (!m_stateListPath.empty())
+        inputs.push_back(m_stateListPath);
+    SidecarCacheReader reader(cacheFile, inputs);
+    if (!reader.IsOpen())
+        return false;
+
+    CacheHeader header;
+    bool valid = reader.ReadValue(header) &&
+                 header.m_file.Matches(SidecarCacheHeader(s_labelCacheMagic, s_labelCacheVersion, sizeof(msra::dbn::CLASSIDTYPE), ComputeFingerprint(mlfPaths)));
+    valid = valid &&
+            reader.ReadVector(labels.m_keyOffsets, header.m_numberOfUtterances + 1) &&
+            reader.ReadVector(labels.m_frameOffsets, header.m_numberOfUtterances + 1) &&
+            reader.ReadVector(labels.m_maxClassIds, header.m_numberOfUtterances) &&
+            reader.ReadVector(labels.m_keys, header.m_numberOfKeyBytes) &&
+            reader.ReadVector(labels.m_classIds, header.m_numberOfFrames) &&
+            reader.AtEnd() &&
+            labels.m_keyOffsets.front() == 0 && labels.m_keyOffsets.back() == header.m_numberOfKeyBytes &&
+            labels.m_frameOffsets.front() == 0 && labels.m_frameOffsets.back() == header.m_numberOfFrames &&
+            is_sorted(labels.m_keyOffsets.begin(), labels.m_keyOffsets.end()) &&
+            is_sorted(labels.m_frameOffsets.begin(), labels.m_frameOffsets.end());
+
+    if (!reader.Close(valid, "MLFLabelLoader"))
+        labels.Clear();
+    return valid;
+}
+
+// Stores the labels in the cache file.
+void MLFLabelLoader::SaveCache(const vector<wstring>& mlfPaths, const wstring& cacheFile, const MLFLabels& labels) const
+{
+    CacheHeader header;
+    header.m_file = SidecarCacheHeader(s_labelCacheMagic, s_labelCacheVersion, sizeof(msra::dbn::CLASSIDTYPE), ComputeFingerprint(mlfPaths));
+    header.m_numberOfUtterances = labels.NumberOfUtterances();
+    header.m_numberOfKeyBytes = labels.m_keys.size();
+    header.m_numberOfFrames = labels.m_classIds.size();
+
+    bool saved = TryWriteSidecarCache(cacheFile, "MLFLabelLoader", [&]()
+    {
+        SidecarCacheWriter writer(cacheFile);
+        writer.WriteValue(header);
+        writer.WriteVector(labels.m_keyOffsets);
+        writer.WriteVector(labels.m_frameOffsets);
+        writer.WriteVector(labels.m_maxClassIds);
+        writer.WriteVector(labels.m_keys);
+        writer.WriteVector(labels.m_classIds);
+        writer.Commit();
+    });
+
+    if (saved)
+        fprintf(stderr, "MLFLabelLoader: saved labels to '%ls'\n", cacheFile.c_str());
+}
+
+void MLFLabelLoader::Load(const vector<wstring>& mlfPaths, const wstring& cacheFile, MLFLabels& labels) const
+{
+    if (!cacheFile.empty() && TryLoadCache(mlfPaths, cacheFile, labels))
+    {
+        fprintf(stderr, "MLFLabelLoader: using cached labels from '%ls'\n", cacheFile.c_str());
+        return;
+    }
+
+    Parse(mlfPaths, labels);
+    if (!cacheFile.empty())
+        SaveCache(mlfPaths, cacheFile, labels);
+}
+
+}}}
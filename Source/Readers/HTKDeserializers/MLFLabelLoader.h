@@ -0,0 +1,154 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// MLFLabelLoader.h -- multi-threaded loading of frame labels from HTK MLF files, with a binary label cache
+//
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+#include "Basics.h"
+#include "../HTKMLFReader/minibatchsourcehelpers.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Frame labels of all utterances of a set of MLF files, in the order in which they appear in the files.
+struct MLFLabels
+{
+    MLFLabels()
+    {
+        Clear();
+    }
+
+    size_t NumberOfUtterances() const
+    {
+        return m_frameOffsets.size() - 1;
+    }
+
+    std::string GetKey(size_t utterance) const
+    {
+        return std::string(m_keys.data() + m_keyOffsets[utterance], m_keys.data() + m_keyOffsets[utterance + 1]);
+    }
+
+    size_t GetNumberOfFrames(size_t utterance) const
+    {
+        return (size_t)(m_frameOffsets[utterance + 1] - m_frameOffsets[utterance]);
+    }
+
+    void Clear()
+    {
+        m_keys.clear();
+        m_keyOffsets.assign(1, 0);
+        m_frameOffsets.assign(1, 0);
+        m_maxClassIds.clear();
+        m_classIds.clear();
+    }
+
+    // Appends the utterances of another set.
+    void Append(const MLFLabels& other);
+
+    std::vector<char> m_keys;                          // keys of all utterances (UTF-8, without extension), packed
+    std::vector<uint64_t> m_keyOffsets;                // [utterance] start of the key in m_keys, [NumberOfUtterances()] end of the last key
+    std::vector<uint64_t> m_frameOffsets;              // [utterance] first frame in m_classIds, [NumberOfUtterances()] total number of frames
+    std::vector<msra::dbn::CLASSIDTYPE> m_maxClassIds; // [utterance] largest class id of the utterance
+    std::vector<msra::dbn::CLASSIDTYPE> m_classIds;    // [frame] class id of every frame
+};
+
+// Maps the state names of a state list to their line index with a perfect hash (hash and displace):
+// the names are distributed into buckets by one hash, and every bucket gets a displacement that moves
+// all of its names to distinct free slots. A lookup computes one hash and compares a single string.
+class StateListIndex
+{
+public:
+    StateListIndex() : m_seed(0)
+    {}
+
+    // Builds the index; fails if a name occurs twice.
+    void Build(const std::vector<std::string>& names);
+
+    // Returns the index of the name, or SIZE_MAX if the name is not in the list.
+    size_t Find(const char* name, size_t length) const
+    {
+        if (m_slots.empty())
+            return SIZE_MAX;
+        uint64_t hash = Hash(name, length, m_seed);
+        uint32_t id = m_slots[Slot(hash, m_displacements[(size_t)(hash % m_displacements.size())])];
+        if (id == EmptySlot ||
+            m_offsets[id + 1] - m_offsets[id] != length ||
+            memcmp(m_chars.data() + m_offsets[id], name, length) != 0)
+            return SIZE_MAX;
+        return id;
+    }
+
+    size_t Size() const
+    {
+        return m_offsets.empty() ? 0 : m_offsets.size() - 1;
+    }
+
+private:
+    static const uint32_t EmptySlot = UINT32_MAX;
+
+    static uint64_t Hash(const char* name, size_t length, uint64_t seed);
+
+    // slot of a name with the given hash in a bucket with the given displacement
+    size_t Slot(uint64_t hash, uint32_t displacement) const
+    {
+        uint64_t numSlots = m_slots.size();
+        uint64_t step = (hash >> 32) % (numSlots - 1) + 1; // (the number of slots is prime, so every step cycles through all slots)
+        return (size_t)(((hash & 0xffffffff) % numSlots + (displacement % numSlots) * step) % numSlots);
+    }
+
+    uint64_t m_seed;
+    std::vector<uint32_t> m_displacements; // [bucket]
+    std::vector<uint32_t> m_slots;         // [slot] index of the name, or EmptySlot
+    std::vector<uint32_t> m_offsets;       // [index] start of the name in m_chars, [Size()] end of the last name
+    std::vector<char> m_chars;
+};
+
+// Reads MLF files like msra::asr::htkmlfreader does for the MLF deserializer, but faster:
+//  - the files are memory-mapped and split into pieces at utterance boundaries (after a line "."),
+//    the pieces are parsed concurrently and their results are concatenated in file order;
+//  - state names are mapped to class ids with a StateListIndex;
+//  - labels are stored as one class id per frame, without any per-utterance allocation.
+// The result can be stored in a binary cache file that is used instead of the MLF files as long as it is
+// newer than all of them and was written for the same files and options.
+class MLFLabelLoader
+{
+public:
+    // With an empty state list path, class ids are read from the fourth column of the MLF.
+    MLFLabelLoader(const std::wstring& stateListPath, double htkTimeToFrame, size_t numberOfThreads);
+
+    // Gets the labels from the cache file if it is up to date, otherwise parses the MLF files
+    // and (if a cache file is given) stores the result in the cache.
+    void Load(const std::vector<std::wstring>& mlfPaths, const std::wstring& cacheFile, MLFLabels& labels) const;
+
+    // Parses the MLF files.
+    void Parse(const std::vector<std::wstring>& mlfPaths, MLFLabels& labels) const;
+
+    size_t NumberOfStates() const
+    {
+        return m_states.Size();
+    }
+
+private:
+    DISABLE_COPY_AND_MOVE(MLFLabelLoader);
+
+    struct Piece;
+    struct CacheHeader;
+
+    void ReadStateList();
+    void ParsePiece(const Piece& piece, MLFLabels& labels) const;
+    uint64_t ComputeFingerprint(const std::vector<std::wstring>& mlfPaths) const;
+    bool TryLoadCache(const std::vector<std::wstring>& mlfPaths, const std::wstring& cacheFile, MLFLabels& labels) const;
+    void SaveCache(const std::vector<std::wstring>& mlfPaths, const std::wstring& cacheFile, const MLFLabels& labels) const;
+
+    std::wstring m_stateListPath;
+    double m_htkTimeToFrame;
+    size_t m_numberOfThreads;
+    StateListIndex m_states;
+};
+
+}}}
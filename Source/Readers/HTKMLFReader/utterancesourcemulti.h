@@ -212,6 +212,15 @@ class minibatchutterancesourcemulti : public minibatchsource
             }
         }
 
+        // hint that this chunk will be paged in soon: let the lattice archive read its lattices in the background
+        void prefetchlattices(const latticesource &latticesource) const
+        {
+            if (latticesource.empty())
+                return;
+            foreach_index (i, utteranceset)
+                latticesource.prefetchlattices(utteranceset[i].key());
+        }
+
         // page out data for this chunk
         void releasedata() const
         {
@@ -1517,6 +1526,9 @@ private:
                                     });
             }
             chunksinram++;
+            // randomized chunks are paged in in order, so the lattices of the next one can be read while this one is used
+            if (chunkindex + 1 < randomizedchunks[0].size() && !randomizedchunks[0][chunkindex + 1].getchunkdata().isinram())
+                randomizedchunks[0][chunkindex + 1].getchunkdata().prefetchlattices(this->lattices);
             return true;
         }
         else
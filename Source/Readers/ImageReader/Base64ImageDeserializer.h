@@ -30,6 +30,12 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         // Gets sequence description by key.
         bool GetSequenceDescriptionByKey(const KeyType&, SequenceDescription&) override;
 
+        // Gets the input file.
+        std::vector<std::wstring> GetInputFiles() const override
+        {
+            return std::vector<std::wstring>(1, m_fileName);
+        }
+
     private:
         // Creates a set of sequence descriptions.
         void CreateSequenceDescriptions(CorpusDescriptorPtr corpus, std::string mapPath);
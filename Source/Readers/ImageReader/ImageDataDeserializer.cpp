@@ -135,6 +135,7 @@ void ImageDataDeserializer::GetSequencesForChunk(ChunkIdType chunkId, std::vecto
 
 void ImageDataDeserializer::CreateSequenceDescriptions(CorpusDescriptorPtr corpus, std::string mapPath, size_t labelDimension, bool isMultiCrop)
 {
+    m_mapPath = mapPath;
     std::ifstream mapFile(mapPath);
     if (!mapFile)
     {
@@ -40,6 +40,18 @@ public:
     // Gets sequence description by key.
     bool GetSequenceDescriptionByKey(const KeyType&, SequenceDescription&) override;
 
+    // Sequence descriptions are not changed after construction.
+    bool SupportsConcurrentSequenceDescriptions() const override
+    {
+        return true;
+    }
+
+    // Gets the map file. Each image is a sequence of a single sample, so the images themselves do not change the descriptions.
+    std::vector<std::wstring> GetInputFiles() const override
+    {
+        return std::vector<std::wstring>(1, msra::strfun::utf16(m_mapPath));
+    }
+
 private:
     // Creates a set of sequence descriptions.
     void CreateSequenceDescriptions(CorpusDescriptorPtr corpus, std::string mapPath, size_t labelDimension, bool isMultiCrop);
@@ -56,6 +68,9 @@ private:
     // Sequence descriptions for all input data.
     std::vector<ImageSequenceDescription> m_imageSequences;
 
+    // Map file the sequence descriptions are read from.
+    std::string m_mapPath;
+
     // Not using nocase_compare here as it's not correct on Linux.
     using PathReaderMap = std::unordered_map<std::string, std::shared_ptr<ByteReader>>;
     using ReaderSequenceMap = std::map<std::string, std::map<std::string, std::vector<size_t>>>;
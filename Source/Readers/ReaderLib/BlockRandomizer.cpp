@@ -23,7 +23,8 @@ BlockRandomizer::BlockRandomizer(
     bool shouldPrefetch,
     bool multithreadedGetNextSequence,
     size_t maxNumberOfInvalidSequences,
-    bool sampleBasedRandomizationWindow)
+    bool sampleBasedRandomizationWindow,
+    size_t lengthBucketSizeInSamples)
     : m_verbosity(verbosity),
       m_deserializer(deserializer),
       m_sweep(SIZE_MAX),
@@ -41,7 +42,7 @@ BlockRandomizer::BlockRandomizer(
     m_launchType = shouldPrefetch ? launch::async : launch::deferred;
 
     m_streams = m_deserializer->GetStreamDescriptions();
-    m_sequenceRandomizer = std::make_shared<SequenceRandomizer>(verbosity, m_deserializer, m_chunkRandomizer);
+    m_sequenceRandomizer = std::make_shared<SequenceRandomizer>(verbosity, m_deserializer, m_chunkRandomizer, lengthBucketSizeInSamples);
 
     // Calculate total number of samples.
     m_sweepSizeInSamples = 0;
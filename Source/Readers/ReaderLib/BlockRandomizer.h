@@ -43,7 +43,8 @@ public:
         bool shouldPrefetch,
         bool multithreadedGetNextSequences = false,
         size_t maxNumberOfInvalidSequences = 0, // per worker
-        bool sampleBasedRandomizationWindow = true);
+        bool sampleBasedRandomizationWindow = true,
+        size_t lengthBucketSizeInSamples = 0); // see SequenceRandomizer
 
     // Starts a new epoch.
     virtual void StartEpoch(const EpochConfiguration& config) override;
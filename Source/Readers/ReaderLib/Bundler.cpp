@@ -8,6 +8,11 @@
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 #include <set>
+#include <atomic>
+#include <thread>
+#include <exception>
+#include "fileutil.h"
+#include "SidecarCache.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -20,6 +25,34 @@ struct Bundler::BundlerChunkDescription : public ChunkDescription
     std::set<size_t> m_invalid;
 };
 
+// Result of checking a chunk of the driving deserializer against all other deserializers.
+struct Bundler::ChunkCheckResult
+{
+    ChunkCheckResult() : m_numberOfSamples(0), m_numberOfSequences(0), m_takePrimarySequenceLength(true)
+    {}
+
+    size_t m_numberOfSamples;
+    size_t m_numberOfSequences;
+
+    // True if the primary stream has the longest sequences in the chunk.
+    bool m_takePrimarySequenceLength;
+
+    // Indices of sequences (inside the chunk) that are invalid in at least one deserializer.
+    std::set<size_t> m_invalid;
+};
+
+// Header of the bundle cache file, followed by a record per chunk of the driving deserializer:
+// number of samples, number of sequences, number of invalid sequences and their indices (all uint64_t).
+struct Bundler::CacheHeader
+{
+    SidecarCacheHeader m_file;
+    uint64_t m_takePrimarySequenceLength;
+    uint64_t m_numberOfChunks;
+};
+
+static const char* s_bundleCacheMagic = "CNTKBNDL";
+static const uint32_t s_bundleCacheVersion = 3;
+
 Bundler::Bundler(
     const ConfigParameters& readerConfig,
     IDataDeserializerPtr driver,
@@ -29,6 +62,16 @@ Bundler::Bundler(
 {
     m_verbosity = readerConfig(L"verbosity", 0);
 
+    // Number of threads used to check the chunks, by default one per core.
+    m_numberOfThreads = readerConfig(L"bundlerThreads", (size_t)std::max(std::thread::hardware_concurrency(), 1u));
+    if (m_numberOfThreads == 0)
+        m_numberOfThreads = 1;
+
+    // Optional file to store the result of the check, it is reused as long as the input files do not change.
+    m_cacheFile = (std::wstring)readerConfig(L"bundlerCache", L"");
+    if (!m_cacheFile.empty())
+        m_inputFiles = CollectInputFiles();
+
     // Combines streams of underlying deserializers.
     for (auto d : deserializers)
     {
@@ -89,64 +132,253 @@ void Bundler::CreateChunkDescriptions()
     if (m_verbosity)
         fprintf(stderr, "Bundler::CreateChunkDescriptions(): starting to clean chunks\n");
 
+    // Otherwise check all sequences of the driving deserializer against other deserializers,
+    // unless the result of a previous check is available in the cache.
+    std::vector<ChunkCheckResult> results(chunks.size());
+    uint64_t fingerprint = 0;
+    bool cached = false;
+    if (!m_cacheFile.empty())
+    {
+        fingerprint = ComputeFingerprint(chunks);
+        cached = TryLoadCache(fingerprint, results);
+        if (cached && m_verbosity)
+            fprintf(stderr, "Bundler::CreateChunkDescriptions(): using cached bundle from '%ls'\n", m_cacheFile.c_str());
+    }
+
+    if (!cached)
+    {
+        CheckChunks(chunks, results);
+        if (!m_cacheFile.empty())
+            SaveCache(fingerprint, results);
+    }
+
+    // Merging the results in the order of chunks, so that chunk ids do not depend on the number of threads.
     m_takePrimarySequenceLength = true;
+    for (ChunkIdType chunkIndex = 0; chunkIndex < chunks.size(); ++chunkIndex)
+    {
+        ChunkCheckResult& result = results[chunkIndex];
+        m_takePrimarySequenceLength = m_takePrimarySequenceLength && result.m_takePrimarySequenceLength;
+
+        // Build a chunk for valid sequences.
+        if (result.m_numberOfSamples > 0)
+        {
+            auto cd = std::make_shared<BundlerChunkDescription>();
+            cd->m_numberOfSamples = result.m_numberOfSamples;
+            cd->m_numberOfSequences = result.m_numberOfSequences;
+            cd->m_id = (ChunkIdType) m_chunks.size();
+            cd->m_original = chunks[chunkIndex];
+            cd->m_invalid = std::move(result.m_invalid);
+            m_chunks.push_back(cd);
+        }
+    }
+
+    if (m_verbosity)
+        fprintf(stderr, "Bundler::CreateChunkDescriptions(): finished cleaning of %" PRIu64 " chunks\n", m_chunks.size());
+}
+
+// Checks chunks of the driving deserializer, in parallel if all deserializers allow it.
+void Bundler::CheckChunks(const ChunkDescriptions& chunks, std::vector<ChunkCheckResult>& results)
+{
+    size_t numberOfThreads = std::min(m_numberOfThreads, chunks.size());
+    if (!m_driver->SupportsConcurrentSequenceDescriptions())
+        numberOfThreads = 1;
+    for (size_t deserializerIndex = 1; deserializerIndex < m_deserializers.size(); ++deserializerIndex)
+    {
+        if (!m_deserializers[deserializerIndex]->SupportsConcurrentSequenceDescriptions())
+            numberOfThreads = 1;
+    }
+
+    if (numberOfThreads <= 1)
+    {
+        for (size_t chunkIndex = 0; chunkIndex < chunks.size(); ++chunkIndex)
+            CheckChunk(chunks[chunkIndex], results[chunkIndex]);
+        return;
+    }
+
+    if (m_verbosity)
+        fprintf(stderr, "Bundler::CreateChunkDescriptions(): checking chunks with %" PRIu64 " threads\n", numberOfThreads);
+
+    // Chunks are handed out one at a time, because their sizes can differ a lot.
+    std::atomic<size_t> nextChunk(0);
+    std::vector<std::thread> threads;
+    std::vector<std::exception_ptr> errors(numberOfThreads);
+    for (size_t t = 0; t < numberOfThreads; t++)
+    {
+        threads.push_back(std::thread([&, t]()
+        {
+            try
+            {
+                for (size_t chunkIndex = nextChunk++; chunkIndex < chunks.size(); chunkIndex = nextChunk++)
+                    CheckChunk(chunks[chunkIndex], results[chunkIndex]);
+            }
+            catch (...)
+            {
+                errors[t] = std::current_exception();
+            }
+        }));
+    }
+    for (auto& worker : threads)
+        worker.join();
+    for (const auto& error : errors)
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
 
-    // Otherwise build bundling chunks using underlying deserializers.
+// Iterates thru all sequences of a chunk and identifies whether they are valid among all deserializers.
+void Bundler::CheckChunk(const ChunkDescriptionPtr& chunk, ChunkCheckResult& result)
+{
     std::vector<SequenceDescription> sequenceDescriptions;
-    sequenceDescriptions.reserve(chunks.front()->m_numberOfSequences);
+    sequenceDescriptions.reserve(chunk->m_numberOfSequences);
+    m_driver->GetSequencesForChunk(chunk->m_id, sequenceDescriptions);
+
     SequenceDescription s;
-    for (ChunkIdType chunkIndex = 0; chunkIndex < chunks.size(); ++chunkIndex)
+    for (size_t sequenceIndex = 0; sequenceIndex < sequenceDescriptions.size(); ++sequenceIndex)
     {
-        size_t numberOfSamples = 0;
-        size_t numberOfSequences = 0;
-        sequenceDescriptions.clear();
-
-        // Iterating thru all sequences and identifying whether they are valid among all deserializers.
-        m_driver->GetSequencesForChunk(chunks[chunkIndex]->m_id, sequenceDescriptions);
-        std::set<size_t> invalid;
-        for (size_t sequenceIndex = 0; sequenceIndex < sequenceDescriptions.size(); ++sequenceIndex)
+        const auto& sequence = sequenceDescriptions[sequenceIndex];
+        bool isValid = true;
+        size_t sequenceSamples = sequence.m_numberOfSamples;
+        for (size_t deserializerIndex = 1; deserializerIndex < m_deserializers.size(); ++deserializerIndex)
         {
-            auto sequence = sequenceDescriptions[sequenceIndex];
-            bool isValid = true;
-            size_t sequenceSamples = sequence.m_numberOfSamples;
-            for (size_t deserializerIndex = 1; deserializerIndex < m_deserializers.size(); ++deserializerIndex)
+            isValid = m_deserializers[deserializerIndex]->GetSequenceDescription(sequence, s);
+            if (!isValid)
             {
-                isValid = m_deserializers[deserializerIndex]->GetSequenceDescription(sequenceDescriptions[sequenceIndex], s);
-                if (!isValid)
-                {
-                    invalid.insert(sequenceIndex);
-                    break;
-                }
-
-                sequenceSamples = std::max<size_t>(sequenceSamples, s.m_numberOfSamples);
+                result.m_invalid.insert(sequenceIndex);
+                break;
             }
 
-            if (isValid)
-            {
-                numberOfSamples += sequenceSamples;
-                numberOfSequences++;
+            sequenceSamples = std::max<size_t>(sequenceSamples, s.m_numberOfSamples);
+        }
 
-                // Check whether the primary stream has the longest sequence.
-                // If yes, we can optimize exposed sequence descriptions in GetSequencesByChunk.
-                m_takePrimarySequenceLength = m_takePrimarySequenceLength && (sequenceSamples == sequence.m_numberOfSamples);
-            }
+        if (isValid)
+        {
+            result.m_numberOfSamples += sequenceSamples;
+            result.m_numberOfSequences++;
+
+            // Check whether the primary stream has the longest sequence.
+            // If yes, we can optimize exposed sequence descriptions in GetSequencesByChunk.
+            result.m_takePrimarySequenceLength = result.m_takePrimarySequenceLength && (sequenceSamples == sequence.m_numberOfSamples);
         }
+    }
+}
 
-        // Build a chunk for valid sequences.
-        if (numberOfSamples > 0)
+// Collects the existing input files of the deserializers (scp files and their archives, mlfs, map files, etc.).
+std::vector<std::wstring> Bundler::CollectInputFiles() const
+{
+    std::set<std::wstring> files;
+    for (size_t i = 0; i < m_deserializers.size(); ++i)
+    {
+        auto inputs = m_deserializers[i]->GetInputFiles();
+        if (inputs.empty())
         {
-            auto cd = std::make_shared<BundlerChunkDescription>();
-            cd->m_numberOfSamples = numberOfSamples;
-            cd->m_numberOfSequences = numberOfSequences;
-            cd->m_id = (ChunkIdType) m_chunks.size();
-            cd->m_original = chunks[chunkIndex];
-            m_chunks.push_back(cd);
-            cd->m_invalid = std::move(invalid);
+            fprintf(stderr, "WARNING: Bundler: deserializer %d does not report its input files, "
+                    "changes of its data are only detected through its chunks.\n", (int)i);
+        }
+
+        for (const auto& input : inputs)
+        {
+            if (fexists(input))
+                files.insert(input);
         }
     }
+    return std::vector<std::wstring>(files.begin(), files.end());
+}
 
-    if (m_verbosity)
-        fprintf(stderr, "Bundler::CreateChunkDescriptions(): finished cleaning of %" PRIu64 " chunks\n", m_chunks.size());
+// Fingerprint of the input files (names and sizes), the chunks of all deserializers and the bundling options.
+uint64_t Bundler::ComputeFingerprint(const ChunkDescriptions& chunks) const
+{
+    auto addChunks = [](SidecarFingerprint& fingerprint, const ChunkDescriptions& descriptions)
+    {
+        fingerprint.AddValue(descriptions.size());
+        for (const auto& c : descriptions)
+        {
+            fingerprint.AddValue(c->m_id);
+            fingerprint.AddValue(c->m_numberOfSequences);
+            fingerprint.AddValue(c->m_numberOfSamples);
+        }
+    };
+
+    SidecarFingerprint fingerprint;
+    fingerprint.AddValue(s_bundleCacheVersion);
+    fingerprint.AddValue(m_deserializers.size());
+    for (const auto& file : m_inputFiles)
+        fingerprint.AddFile(file);
+    addChunks(fingerprint, chunks);
+    for (const auto& d : m_deserializers)
+    {
+        if (d != m_driver)
+            addChunks(fingerprint, d->GetChunkDescriptions());
+    }
+    return fingerprint.Value();
+}
+
+// Loads the result of the check from the cache file, returns false if it is missing or stale.
+bool Bundler::TryLoadCache(uint64_t fingerprint, std::vector<ChunkCheckResult>& results) const
+{
+    SidecarCacheReader reader(m_cacheFile, m_inputFiles);
+    if (!reader.IsOpen())
+        return false;
+
+    CacheHeader header;
+    bool valid = reader.ReadValue(header) &&
+                 header.m_file.Matches(SidecarCacheHeader(s_bundleCacheMagic, s_bundleCacheVersion, sizeof(uint64_t), fingerprint)) &&
+                 header.m_numberOfChunks == results.size();
+    for (size_t chunkIndex = 0; valid && chunkIndex < results.size(); ++chunkIndex)
+    {
+        ChunkCheckResult& result = results[chunkIndex];
+        uint64_t numberOfSamples, numberOfSequences, numberOfInvalid, index;
+        valid = reader.ReadValue(numberOfSamples) && reader.ReadValue(numberOfSequences) && reader.ReadValue(numberOfInvalid);
+        for (uint64_t i = 0; valid && i < numberOfInvalid; ++i)
+        {
+            valid = reader.ReadValue(index);
+            result.m_invalid.insert(result.m_invalid.end(), (size_t)index);
+        }
+        result.m_numberOfSamples = (size_t)numberOfSamples;
+        result.m_numberOfSequences = (size_t)numberOfSequences;
+        result.m_takePrimarySequenceLength = header.m_takePrimarySequenceLength != 0;
+    }
+
+    if (!reader.Close(valid, "Bundler"))
+    {
+        for (auto& result : results)
+            result = ChunkCheckResult();
+    }
+    return valid;
+}
+
+// Stores the result of the check in the cache file.
+void Bundler::SaveCache(uint64_t fingerprint, const std::vector<ChunkCheckResult>& results) const
+{
+    CacheHeader header;
+    header.m_file = SidecarCacheHeader(s_bundleCacheMagic, s_bundleCacheVersion, sizeof(uint64_t), fingerprint);
+    header.m_takePrimarySequenceLength = 1;
+    header.m_numberOfChunks = results.size();
+    for (const auto& result : results)
+    {
+        if (!result.m_takePrimarySequenceLength)
+            header.m_takePrimarySequenceLength = 0;
+    }
+
+    bool saved = TryWriteSidecarCache(m_cacheFile, "Bundler::CreateChunkDescriptions()", [&]()
+    {
+        SidecarCacheWriter writer(m_cacheFile);
+        writer.WriteValue(header);
+        std::vector<uint64_t> record;
+        for (const auto& result : results)
+        {
+            record.clear();
+            record.push_back(result.m_numberOfSamples);
+            record.push_back(result.m_numberOfSequences);
+            record.push_back(result.m_invalid.size());
+            record.insert(record.end(), result.m_invalid.begin(), result.m_invalid.end());
+            writer.WriteVector(record);
+        }
+        writer.Commit();
+    });
+
+    if (saved && m_verbosity)
+        fprintf(stderr, "Bundler::CreateChunkDescriptions(): saved bundle to '%ls'\n", m_cacheFile.c_str());
 }
 
 // Gets chunk descriptions.
@@ -14,6 +14,11 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 // Class represents an bundler of several deserializers.
 // In case when only a single deserializer is used, the bundler can be omitted and 
 // no performance penalty is paid.
+//
+// When the data is cleansed, chunks of the driving deserializer are checked in parallel ('bundlerThreads', one thread per core by default)
+// if all deserializers support concurrent retrieval of sequence descriptions.
+// The result of the check can be stored in a file ('bundlerCache') and is reused while the input files reported by
+// the deserializers and the chunks of all deserializers stay the same.
 class Bundler : public DataDeserializerBase
 {
 public:
@@ -34,10 +39,22 @@ private:
     class BundlingChunk;
     struct BundlerChunkDescription;
     typedef std::shared_ptr<BundlerChunkDescription> BundlerChunkDescriptionPtr;
+    struct ChunkCheckResult;
+    struct CacheHeader;
 
     // Creates chunk descriptions based on chunks of underlying deserializers.
     void CreateChunkDescriptions();
 
+    // Checks sequences of the driving chunks against other deserializers.
+    void CheckChunks(const ChunkDescriptions& chunks, std::vector<ChunkCheckResult>& results);
+    void CheckChunk(const ChunkDescriptionPtr& chunk, ChunkCheckResult& result);
+
+    // Bundle cache.
+    std::vector<std::wstring> CollectInputFiles() const;
+    uint64_t ComputeFingerprint(const ChunkDescriptions& chunks) const;
+    bool TryLoadCache(uint64_t fingerprint, std::vector<ChunkCheckResult>& results) const;
+    void SaveCache(uint64_t fingerprint, const std::vector<ChunkCheckResult>& results) const;
+
     // Underlying deserializers.
     std::vector<IDataDeserializerPtr> m_deserializers;
 
@@ -63,6 +80,13 @@ private:
     // Inner vector is the table of chunk id into weak pointer, the outer vector has an element per deserializer.
     std::vector<std::vector<std::weak_ptr<Chunk>>> m_weakChunkTable;
 
+    // Number of threads used to check the chunks.
+    size_t m_numberOfThreads;
+
+    // Bundle cache file and the input files it depends on.
+    std::wstring m_cacheFile;
+    std::vector<std::wstring> m_inputFiles;
+
     // General configuration
     int m_verbosity;
 };
@@ -42,6 +42,11 @@ public:
         return m_deserializer->GetSequenceDescription(primary, description);
     }
 
+    virtual std::vector<std::wstring> GetInputFiles() const override
+    {
+        return m_deserializer->GetInputFiles();
+    }
+
     // Gets chunk data given its id.
     virtual ChunkPtr GetChunk(ChunkIdType chunkId);
 
@@ -33,8 +33,17 @@ public:
     }
 
     // By default include all sequences.
-    CorpusDescriptor(bool numericSequenceKeys) : m_includeAll(true), m_numericSequenceKeys(numericSequenceKeys)
+    // If 'keyRegistryFile' is given and exists, the registry of literal sequence keys is memory-mapped from it;
+    // otherwise the registry is written there by FinalizeKeyRegistry(), so that later runs over the same corpus can map it.
+    CorpusDescriptor(bool numericSequenceKeys, const std::wstring& keyRegistryFile = std::wstring())
+        : m_includeAll(true), m_numericSequenceKeys(numericSequenceKeys), m_keyRegistryFile(keyRegistryFile), m_numLoadedKeys(0)
     {
+        if (!numericSequenceKeys && !keyRegistryFile.empty() && fexists(keyRegistryFile))
+        {
+            m_keyToIdMap.Load(keyRegistryFile);
+            m_numLoadedKeys = m_keyToIdMap.Size();
+        }
+
         if (numericSequenceKeys)
         {
             KeyToId = [](const std::string& key)
@@ -58,10 +67,6 @@ public:
                 // The function has to provide a size_t unique "hash" for the input key
                 // If we see the key for the first time, we add it to the registry.
                 // Otherwise we retrieve the hash value for the key from the registry.
-                size_t id;
-                if (m_keyToIdMap.TryGet(key, id))
-                    return id;
-                m_keyToIdMap.AddValue(key);
                 return m_keyToIdMap[key];
             };
 
@@ -92,6 +97,24 @@ public:
         return m_sequenceIds.find(id) != m_sequenceIds.end();
     }
 
+    // To be called once all deserializers have registered their sequence keys.
+    // Saves the key registry to its file if it has not been loaded from there or has grown since, and reports its size.
+    // The file only speeds up later runs, so failing to write it is not an error.
+    void FinalizeKeyRegistry()
+    {
+        if (m_numericSequenceKeys)
+            return;
+
+        if (!m_keyRegistryFile.empty() && m_keyToIdMap.Size() != m_numLoadedKeys)
+        {
+            if (TryWriteSidecarCache(m_keyRegistryFile, "CorpusDescriptor", [&]() { m_keyToIdMap.Save(m_keyRegistryFile); }))
+                m_numLoadedKeys = m_keyToIdMap.Size();
+        }
+
+        fprintf(stderr, "CorpusDescriptor: %" PRIu64 " sequence keys, key registry uses %.1f MB\n",
+                (uint64_t)m_keyToIdMap.Size(), m_keyToIdMap.GetMemoryUsage() / (1024.0 * 1024.0));
+    }
+
     std::function<size_t(const std::string&)> KeyToId;
     std::function<std::string(size_t)> IdToKey;
 
@@ -102,6 +125,8 @@ private:
     std::set<size_t> m_sequenceIds;
 
     StringToIdMap m_keyToIdMap;
+    std::wstring m_keyRegistryFile; // sidecar file of m_keyToIdMap, if any
+    size_t m_numLoadedKeys;         // number of keys in m_keyRegistryFile
 };
 
 typedef std::shared_ptr<CorpusDescriptor> CorpusDescriptorPtr;
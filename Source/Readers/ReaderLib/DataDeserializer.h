@@ -172,6 +172,21 @@ public:
     // Gets chunk data given its id.
     virtual ChunkPtr GetChunk(ChunkIdType chunkId) = 0;
 
+    // Returns true if GetSequencesForChunk and GetSequenceDescription can be called concurrently from several threads.
+    // Used by the bundler to check chunks in parallel.
+    virtual bool SupportsConcurrentSequenceDescriptions() const
+    {
+        return false;
+    }
+
+    // Gets the files this deserializer reads, including files reached through other files
+    // (e.g. the archives listed in a script file or the mlfs listed in an mlf list file).
+    // Used by the bundler to detect a stale cache. Empty if the inputs are not known.
+    virtual std::vector<std::wstring> GetInputFiles() const
+    {
+        return std::vector<std::wstring>();
+    }
+
     virtual ~IDataDeserializer() {};
 };
 
@@ -32,7 +32,7 @@ MBLayoutPtr SequencePacker::CreateMBLayout(const StreamBatch& batch)
 
     // Creating the minibatch layout.
     MBLayoutPtr pMBLayout = make_shared<MBLayout>();
-    pMBLayout->InitAsPackedSequences(infos, placement, rowAllocations);
+    pMBLayout->InitAsPackedSequences(infos, placement, rowAllocations, m_bestFitDecreasingPacking);
     return pMBLayout;
 }
 
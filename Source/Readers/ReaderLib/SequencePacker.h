@@ -18,9 +18,11 @@ public:
         SequenceEnumeratorPtr sequenceEnumerator,
         const std::vector<StreamDescriptionPtr>& streams,
         size_t numberOfBuffers = 2,
-        bool useLocalTimeline = false) :
+        bool useLocalTimeline = false,
+        bool bestFitDecreasingPacking = false) :
         PackerBase(sequenceEnumerator, streams, numberOfBuffers),
         m_useLocalTimeline(useLocalTimeline),
+        m_bestFitDecreasingPacking(bestFitDecreasingPacking),
         m_globalMinibatchSizeInSamples(0),
         m_localMinibatchSizeInSamples(0)
     {}
@@ -44,6 +46,10 @@ protected:
     // A flag indicating whether to use local timeline for data.
     bool m_useLocalTimeline;
 
+    // A flag indicating whether sequences are packed best-fit-decreasing instead of first-fit
+    // (see MBLayout::InitAsPackedSequences).
+    bool m_bestFitDecreasingPacking;
+
     // A minibatch size for this worker in local samples.
     size_t m_localMinibatchSizeInSamples;
 
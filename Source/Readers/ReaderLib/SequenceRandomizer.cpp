@@ -18,8 +18,10 @@ namespace Microsoft { namespace MSR { namespace CNTK {
     SequenceRandomizer::SequenceRandomizer(
         int verbosity,
         IDataDeserializerPtr deserializer,
-        ChunkRandomizerPtr chunkRandomizer)
+        ChunkRandomizerPtr chunkRandomizer,
+        size_t lengthBucketSizeInSamples)
         : m_verbosity(verbosity),
+        m_lengthBucketSizeInSamples(lengthBucketSizeInSamples),
         m_randomizedChunks(chunkRandomizer->GetRandomizedChunks()),
         m_chunkWindowBegin(0),
         m_randomizedWindowEnd(0),
@@ -272,9 +274,14 @@ namespace Microsoft { namespace MSR { namespace CNTK {
             }
         }
 
+        // Sequences of the chunk at m_randomizedWindowEnd are at their final chunk now,
+        // so they can be reordered within it.
+        size_t randomizedChunk = m_randomizedWindowEnd - m_chunkWindowBegin;
+        if (m_lengthBucketSizeInSamples > 0)
+            BucketSequencesByLength(m_sequenceWindow[randomizedChunk]);
+
         // Let's recalculate number of samples in the randomized chunks for efficient indexing in seek.
         size_t sampleCount = 0;
-        size_t randomizedChunk = m_randomizedWindowEnd - m_chunkWindowBegin;
         for (size_t index = 0; index < m_sequenceWindow[randomizedChunk].size(); index++)
         {
             sampleCount += m_sequenceWindow[randomizedChunk][index].m_numberOfSamples;
@@ -391,6 +398,42 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         return (ChunkIdType)(result - 1 - m_randomizedChunks.begin());
     }
 
+    // Orders the sequences of a fully randomized chunk into shuffled buckets of sequences of similar length.
+    void SequenceRandomizer::BucketSequencesByLength(std::vector<RandomizedSequenceDescription>& chunkSequences)
+    {
+        // Stable sort, so that sequences of the same length stay in their randomized order.
+        std::stable_sort(chunkSequences.begin(), chunkSequences.end(),
+            [](const RandomizedSequenceDescription& a, const RandomizedSequenceDescription& b)
+            {
+                return a.m_numberOfSamples < b.m_numberOfSamples;
+            });
+
+        // Cut the sorted sequences into consecutive buckets of at least m_lengthBucketSizeInSamples samples
+        // (the last one may be smaller).
+        std::vector<std::pair<size_t, size_t>> buckets; // [begin, end) sequence indices
+        size_t bucketBegin = 0, bucketSamples = 0;
+        for (size_t i = 0; i < chunkSequences.size(); ++i)
+        {
+            bucketSamples += chunkSequences[i].m_numberOfSamples;
+            if (bucketSamples >= m_lengthBucketSizeInSamples || i + 1 == chunkSequences.size())
+            {
+                buckets.push_back(std::make_pair(bucketBegin, i + 1));
+                bucketBegin = i + 1;
+                bucketSamples = 0;
+            }
+        }
+
+        if (buckets.size() < 2)
+            return;
+
+        RandomShuffleMT(buckets, m_rng);
+
+        std::vector<RandomizedSequenceDescription> sorted;
+        sorted.swap(chunkSequences);
+        for (const auto& bucket : buckets)
+            chunkSequences.insert(chunkSequences.end(), sorted.begin() + bucket.first, sorted.begin() + bucket.second);
+    }
+
     // Add randomizes sequences for the chunk with a given index.
     void SequenceRandomizer::AddRandomizedSequencesForChunk(ChunkIdType chunkIdx)
     {
@@ -27,6 +27,10 @@ struct RandomizedSequenceDescription
 };
 
 // Class that given randomized chunks, randomizes sequence descriptions in a window of chunks.
+// Optionally (lengthBucketSizeInSamples > 0), once the sequences of a chunk have reached their final
+// randomized chunk, they are ordered by length, cut into buckets of about lengthBucketSizeInSamples samples,
+// and the buckets are shuffled. Minibatches then consist of sequences of similar length, which reduces
+// padding, while the set of sequences of each chunk (and thus seeking) is the same as without bucketing.
 // TODO: This code is still based on the old behavior, so that all current tests pass.
 // TODO: Can be simplified if we only randomized sequences forward.
 class SequenceRandomizer
@@ -35,7 +39,8 @@ public:
     SequenceRandomizer(
         int verbosity,
         IDataDeserializerPtr deserializer,
-        ChunkRandomizerPtr chunkRandomizer);
+        ChunkRandomizerPtr chunkRandomizer,
+        size_t lengthBucketSizeInSamples = 0);
 
     // Resets the current sweep according to the randomization seed provided.
     void Reset(size_t seed);
@@ -75,6 +80,9 @@ private:
     // Gets randomized sequence by sequence position in sweep and its randomized chunk index.
     RandomizedSequenceDescription& GetRandomizedSequenceDescriptionByPosition(ChunkIdType chunkIndex, size_t sequenceSweepPosition);
 
+    // Orders the sequences of a fully randomized chunk into shuffled buckets of sequences of similar length.
+    void BucketSequencesByLength(std::vector<RandomizedSequenceDescription>& chunkSequences);
+
     // Add randomizes sequences for the chunk with a given index.
     void AddRandomizedSequencesForChunk(ChunkIdType chunkIndex);
 
@@ -164,6 +172,9 @@ private:
     // General configuration
     int m_verbosity;
 
+    // Approximate number of samples per length bucket, 0 if sequences are not bucketed by length.
+    size_t m_lengthBucketSizeInSamples;
+
     std::mt19937_64 m_rng;
 };
 
@@ -8,84 +8,288 @@
 #include <string>
 #include <memory>
 #include <vector>
-#include <map>
+#include <stdint.h>
+#include <string.h>
 #include "Basics.h"
+#include "fileutil.h"
+#include "MemoryMappedFile.h"
+#include "SidecarCache.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 // This class represents a string registry pattern to share strings between different deserializers if needed.
-// It associates a unique key for a given string.
-// Currently it is implemented in-memory, but can be unloaded to external disk if needed.
+// It associates a unique key for a given string, ids are assigned consecutively in the order strings are added.
+//
+// The strings are interned: their characters are packed back to back into a single arena, and an open-addressing
+// hash index maps them to ids. With tens of millions of sequence keys this needs a fraction of the memory of
+// a node-based map (no per-string allocation, no tree nodes) and a lookup does one string comparison in the common case.
+//
+// The table can be saved to a file and later be memory-mapped from it (Save()/Load()), so that it is built once
+// per corpus and its pages are shared between all workers on a machine. A mapped table is copied into
+// memory the first time a new string is added to it.
 // TODO: Move this class to Basics.h when it is required by more than one reader.
 template<class TString>
 class TStringToIdMap
 {
+    typedef typename TString::value_type TChar;
+
 public:
-    TStringToIdMap()
-    {}
+    TStringToIdMap() : m_numValues(0), m_numSlots(0), m_offsets(nullptr), m_slots(nullptr), m_chars(nullptr)
+    {
+        m_ownOffsets.push_back(0);
+        Detach();
+        Attach();
+    }
 
-    // Adds string value to the registry.
+    // Adds string value to the registry, if it is not present already.
     void AddValue(const TString& value)
     {
-        auto iter = m_values.insert(std::make_pair(value, m_indexedValues.size()));
-        m_indexedValues.push_back(&((iter.first)->first));
+        Insert(value.data(), value.size(), Hash(value.data(), value.size()));
     }
 
     // Tries to get a value by id.
     bool TryGet(const TString& value, size_t& id) const
     {
-        const auto& it = m_values.find(value);
-        if (it == m_values.end())
-        {
+        size_t slot = Find(value.data(), value.size(), Hash(value.data(), value.size()));
+        if (m_slots[slot].m_id == EmptySlot)
             return false;
-        }
-        else
-        {
-            id = it->second;
-            return true;
-        }
+        id = m_slots[slot].m_id;
+        return true;
     }
 
     // Get integer id for the string value, adding if not exists.
     size_t operator[](const TString& value)
     {
-        const auto& it = m_values.find(value);
-        if (it == m_values.end())
-        {
-            AddValue(value);
-            return m_values[value];
-        }
-        return it->second;
+        return Insert(value.data(), value.size(), Hash(value.data(), value.size()));
     }
 
     // Get integer id for the string value.
     size_t operator[](const TString& value) const
     {
-        const auto& it = m_values.find(value);
-        assert(it != m_values.end());
-        return it->second;
+        size_t id = SIZE_MAX;
+        bool found = TryGet(value, id);
+        assert(found);
+        UNUSED(found);
+        return id;
     }
 
     // Get string value by its integer id.
-    const TString& operator[](size_t id) const
+    TString operator[](size_t id) const
     {
-        if (id >= m_indexedValues.size())
+        if (id >= m_numValues)
             RuntimeError("Unknown id requested");
-        return *m_indexedValues[id];
+        return TString(m_chars + m_offsets[id], m_chars + m_offsets[id + 1]);
     }
 
     // Checks whether the value exists.
     bool Contains(const TString& value) const
     {
-        return m_values.find(value) != m_values.end();
+        size_t id;
+        return TryGet(value, id);
+    }
+
+    // Number of strings in the registry.
+    size_t Size() const
+    {
+        return m_numValues;
+    }
+
+    // Number of bytes used by the registry (memory-mapped tables count the size of the mapping).
+    size_t GetMemoryUsage() const
+    {
+        if (m_mappedFile)
+            return (size_t)m_mappedFile->Size();
+        return m_ownOffsets.capacity() * sizeof(uint64_t) + m_ownSlots.capacity() * sizeof(Slot) + m_ownChars.capacity() * sizeof(TChar);
+    }
+
+    // Writes the registry to a file that can be memory-mapped with Load().
+    // The file is written under a temporary name first, so concurrent readers (or writers in other processes) never see a partial file.
+    void Save(const std::wstring& path) const
+    {
+        Header header;
+        header.m_file = SidecarCacheHeader(FileMagic(), FileVersion, sizeof(TChar), 0);
+        header.m_numValues = m_numValues;
+        header.m_numSlots = m_numSlots;
+        header.m_numChars = m_offsets[m_numValues];
+
+        SidecarCacheWriter writer(path);
+        writer.WriteValue(header);
+        writer.Write(m_offsets, sizeof(uint64_t) * (m_numValues + 1));
+        writer.Write(m_slots, sizeof(Slot) * m_numSlots);
+        writer.Write(m_chars, sizeof(TChar) * header.m_numChars);
+        writer.Commit();
+    }
+
+    // Replaces the content of the registry with the one memory-mapped from a file written by Save().
+    void Load(const std::wstring& path)
+    {
+        auto mappedFile = std::make_shared<MemoryMappedFile>(path);
+        const char* data = mappedFile->Data();
+        Header header;
+        if (mappedFile->Size() < sizeof(header))
+            RuntimeError("String registry file '%ls' is truncated.", path.c_str());
+        memcpy(&header, data, sizeof(header));
+        if (!header.m_file.HasMagic(SidecarCacheHeader(FileMagic(), FileVersion, sizeof(TChar), 0)))
+            RuntimeError("'%ls' is not a string registry file or has an unsupported version.", path.c_str());
+        if (header.m_file.m_elementSize != sizeof(TChar))
+            RuntimeError("String registry file '%ls' has character size %d, expected %d.", path.c_str(), (int)header.m_file.m_elementSize, (int)sizeof(TChar));
+        if (header.m_numSlots == 0 || (header.m_numSlots & (header.m_numSlots - 1)) != 0 || header.m_numValues >= header.m_numSlots)
+            RuntimeError("String registry file '%ls' has an invalid hash index.", path.c_str());
+
+        uint64_t expectedSize = sizeof(header) + (header.m_numValues + 1) * sizeof(uint64_t) + header.m_numSlots * sizeof(Slot) + header.m_numChars * sizeof(TChar);
+        if (mappedFile->Size() != expectedSize)
+            RuntimeError("String registry file '%ls' has size %llu, expected %llu.", path.c_str(), (unsigned long long)mappedFile->Size(), (unsigned long long)expectedSize);
+
+        m_mappedFile = mappedFile;
+        m_ownOffsets.clear();
+        m_ownOffsets.shrink_to_fit();
+        m_ownSlots.clear();
+        m_ownSlots.shrink_to_fit();
+        m_ownChars.clear();
+        m_ownChars.shrink_to_fit();
+
+        m_numValues = (size_t)header.m_numValues;
+        m_numSlots = (size_t)header.m_numSlots;
+        m_offsets = (const uint64_t*)(data + sizeof(header));
+        m_slots = (const Slot*)(m_offsets + m_numValues + 1);
+        m_chars = (const TChar*)(m_slots + m_numSlots);
     }
 
 private:
     // TODO: Move NonCopyable as a separate class to Basics.h
     DISABLE_COPY_AND_MOVE(TStringToIdMap);
 
-    std::map<TString, size_t> m_values;
-    std::vector<const TString*> m_indexedValues;
+    // Entry of the hash index. The hash is kept to skip most string comparisons on collisions.
+    struct Slot
+    {
+        uint32_t m_id;
+        uint32_t m_hash;
+    };
+
+    struct Header
+    {
+        SidecarCacheHeader m_file;
+        uint64_t m_numValues;
+        uint64_t m_numSlots;
+        uint64_t m_numChars;
+    };
+
+    static const uint32_t EmptySlot = UINT32_MAX;
+    static const uint32_t FileVersion = 2;
+    static const size_t InitialNumSlots = 1024;
+    static const char* FileMagic()
+    {
+        return "CNTKSTRM";
+    }
+
+    // FNV-1a over the characters.
+    static uint32_t Hash(const TChar* value, size_t length)
+    {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; ++i)
+        {
+            hash ^= (uint32_t)value[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    // Returns the slot that holds the value, or the empty slot where it would be inserted.
+    size_t Find(const TChar* value, size_t length, uint32_t hash) const
+    {
+        const size_t mask = m_numSlots - 1;
+        for (size_t slot = hash & mask;; slot = (slot + 1) & mask)
+        {
+            const Slot& s = m_slots[slot];
+            if (s.m_id == EmptySlot)
+                return slot;
+            if (s.m_hash == hash &&
+                m_offsets[s.m_id + 1] - m_offsets[s.m_id] == length &&
+                std::char_traits<TChar>::compare(m_chars + m_offsets[s.m_id], value, length) == 0)
+                return slot;
+        }
+    }
+
+    size_t Insert(const TChar* value, size_t length, uint32_t hash)
+    {
+        size_t slot = Find(value, length, hash);
+        if (m_slots[slot].m_id != EmptySlot)
+            return m_slots[slot].m_id;
+
+        if (m_numValues >= EmptySlot - 1)
+            RuntimeError("String registry cannot hold more than %u strings.", (unsigned int)(EmptySlot - 1));
+
+        Detach();
+        size_t id = m_numValues;
+        m_ownChars.insert(m_ownChars.end(), value, value + length);
+        m_ownOffsets.push_back(m_ownChars.size());
+        m_ownSlots[slot].m_id = (uint32_t)id;
+        m_ownSlots[slot].m_hash = hash;
+        m_numValues++;
+
+        // keep the load factor below 1/2, so that probe sequences stay short
+        if (2 * m_numValues > m_numSlots)
+            Rehash(2 * m_numSlots);
+        Attach();
+        return id;
+    }
+
+    void Rehash(size_t numSlots)
+    {
+        Slot empty = { EmptySlot, 0 };
+        std::vector<Slot> slots(numSlots, empty);
+        const size_t mask = numSlots - 1;
+        for (size_t i = 0; i < m_ownSlots.size(); ++i)
+        {
+            if (m_ownSlots[i].m_id == EmptySlot)
+                continue;
+            size_t slot = m_ownSlots[i].m_hash & mask;
+            while (slots[slot].m_id != EmptySlot)
+                slot = (slot + 1) & mask;
+            slots[slot] = m_ownSlots[i];
+        }
+        m_ownSlots.swap(slots);
+        m_numSlots = numSlots;
+    }
+
+    // Makes the content owned and writable (copies a memory-mapped table into memory).
+    void Detach()
+    {
+        if (m_mappedFile)
+        {
+            m_ownOffsets.assign(m_offsets, m_offsets + m_numValues + 1);
+            m_ownSlots.assign(m_slots, m_slots + m_numSlots);
+            m_ownChars.assign(m_chars, m_chars + m_offsets[m_numValues]);
+            m_mappedFile.reset();
+        }
+        else if (m_ownSlots.empty())
+        {
+            Slot empty = { EmptySlot, 0 };
+            m_ownSlots.assign(InitialNumSlots, empty);
+            m_numSlots = InitialNumSlots;
+        }
+    }
+
+    // Points the accessors to the owned content.
+    void Attach()
+    {
+        m_offsets = m_ownOffsets.data();
+        m_slots = m_ownSlots.data();
+        m_chars = m_ownChars.data();
+    }
+
+    size_t m_numValues;
+    size_t m_numSlots;
+
+    // Views used for all lookups, they point either to the vectors below or into the mapped file.
+    const uint64_t* m_offsets; // [id] start of string in m_chars, [id + 1] its end
+    const Slot* m_slots;       // hash index, number of slots is a power of two
+    const TChar* m_chars;      // all strings, packed without separators
+
+    std::vector<uint64_t> m_ownOffsets;
+    std::vector<Slot> m_ownSlots;
+    std::vector<TChar> m_ownChars;
+    std::shared_ptr<MemoryMappedFile> m_mappedFile;
 };
 
 typedef TStringToIdMap<std::wstring> WStringToIdMap;
@@ -0,0 +1,476 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// BeamSearchDecoder.h -- batched beam-search decoding of sequence-to-sequence networks
+//
+#pragma once
+
+#include "Basics.h"
+#include "DataReader.h"
+#include "ComputationNetwork.h"
+#include "DataReaderHelpers.h"
+#include "InputAndParamNodes.h"
+#include "RecurrentNodes.h"
+#include "RNNNodes.h"
+#include "File.h"
+#include "fileutil.h"
+#include "ProgressTracing.h"
+#include <vector>
+#include <string>
+#include <set>
+#include <map>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <cmath>
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// BeamSearchDecoder -- decodes the output sequences of an encoder-decoder network with beam search
+//
+// The network is expected to have
+//  - source inputs that are read from the reader (all input nodes the output depends on, except the decoder input),
+//  - a decoder input: an Input node with its own dynamic axis. At each step it receives, for each hypothesis,
+//    the one-hot vector of the token that the hypothesis emitted in the previous step (the start symbol in the first step),
+//  - an output node on the decoder axis that computes the scores of the next token (logits, or log probabilities if
+//    normalizeScores=false). The decoder's recurrence must go through PastValue nodes.
+//
+// All hypotheses of all utterances of a minibatch are decoded together: the decoder axis holds beamWidth parallel
+// sequences per utterance, and each step is a single ForwardProp() of one frame. Every utterance is replicated beamWidth
+// times on the source axis as well, so that the decoder's parallel sequences line up with the encoder's. The source inputs
+// are set once per minibatch and their time stamps are not bumped afterwards, so the encoder is computed in the first step
+// only, and its outputs are kept out of memory sharing so that the later steps can read them.
+// When the beam is pruned, the PastValue nodes of the decoder are reordered so that each surviving hypothesis continues
+// from the recurrent state of its parent.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class BeamSearchDecoder
+{
+public:
+    BeamSearchDecoder(ComputationNetworkPtr net, const std::wstring& outputNodeName, const std::wstring& decoderInputNodeName,
+                      size_t beamWidth, size_t maxLength, size_t startSymbol, size_t endSymbol, bool normalizeScores = true, double lengthPenalty = 0, int verbosity = 0)
+        : m_net(net), m_outputNodeName(outputNodeName), m_decoderInputNodeName(decoderInputNodeName),
+          m_beamWidth(beamWidth), m_maxLength(maxLength), m_startSymbol(startSymbol), m_endSymbol(endSymbol),
+          m_normalizeScores(normalizeScores), m_lengthPenalty(lengthPenalty), m_verbosity(verbosity)
+    {
+        if (m_beamWidth == 0)
+            InvalidArgument("BeamSearchDecoder: beamWidth must be at least 1.");
+        if (m_maxLength == 0)
+            InvalidArgument("BeamSearchDecoder: maxLength must be at least 1.");
+    }
+
+    // decode all sequences of the reader and write the best hypothesis of each, one line per sequence
+    // Tokens are written as their index, or as the respective line of the label mapping if one is given.
+    void Decode(IDataReader& dataReader, size_t mbSize, const std::wstring& outputPath, const std::vector<std::string>& labelMapping, size_t numOutputSamples = requestDataSize)
+    {
+        ScopedNetworkOperationMode modeGuard(m_net, NetworkOperationMode::inferring);
+
+        PrepareNetwork();
+        if (!labelMapping.empty() && labelMapping.size() != m_vocabularySize)
+            InvalidArgument("BeamSearchDecoder: The label mapping has %d entries, but the output node %ls has dimension %d.", (int)labelMapping.size(), m_outputNodeName.c_str(), (int)m_vocabularySize);
+
+        StreamMinibatchInputs inputMatrices = DataReaderHelpers::RetrieveInputMatrices(m_sourceInputs);
+        dataReader.StartMinibatchLoop(mbSize, 0, inputMatrices.GetStreamDescriptions(), numOutputSamples);
+        m_net->StartEvaluateMinibatchLoop(m_outputNode);
+
+        File::MakeIntermediateDirs(outputPath);
+        File outputFile(outputPath, fileOptionsWrite | fileOptionsText);
+        FILE* f = outputFile;
+
+        size_t numSequences = 0;
+        size_t numSteps = 0;
+        const size_t numIterationsBeforePrintingProgress = 100;
+        size_t numItersSinceLastPrintOfProgress = 0;
+        size_t actualMBSize;
+        while (DataReaderHelpers::GetMinibatchIntoNetwork<ElemType>(dataReader, m_net, nullptr, false, false, inputMatrices, actualMBSize, nullptr))
+        {
+            size_t numUtterances = ReplicateSourceSequences();
+            std::vector<std::vector<size_t>> results;
+            numSteps += DecodeMinibatch(numUtterances, results);
+
+            for (const auto& tokens : results)
+            {
+                for (size_t i = 0; i < tokens.size(); i++)
+                {
+                    if (labelMapping.empty())
+                        fprintfOrDie(f, "%s%d", i > 0 ? " " : "", (int)tokens[i]);
+                    else
+                        fprintfOrDie(f, "%s%s", i > 0 ? " " : "", labelMapping[tokens[i]].c_str());
+                }
+                fprintfOrDie(f, "\n");
+            }
+            numSequences += numUtterances;
+
+            numItersSinceLastPrintOfProgress = ProgressTracing::TraceFakeProgress(numIterationsBeforePrintingProgress, numItersSinceLastPrintOfProgress);
+            dataReader.DataEnd();
+        }
+        outputFile.Flush();
+
+        fprintf(stderr, "Decoded %d sequences with beam width %d in %d steps. Written to %ls\n", (int)numSequences, (int)m_beamWidth, (int)numSteps, outputPath.c_str());
+    }
+
+private:
+    struct Hypothesis
+    {
+        double m_score;                // sum of the token log probabilities
+        std::vector<size_t> m_tokens;  // emitted tokens, without the start symbol
+        size_t m_slot;                 // parallel sequence on the decoder axis that holds its recurrent state
+    };
+
+    // find the decoder part of the network, its recurrent state and the encoder outputs it reads
+    void PrepareNetwork()
+    {
+        m_outputNode = m_net->GetNodeFromName(m_outputNodeName);
+        m_decoderInput = m_net->GetNodeFromName(m_decoderInputNodeName);
+        if (!dynamic_pointer_cast<InputValueBase<ElemType>>(m_decoderInput))
+            InvalidArgument("BeamSearchDecoder: The decoder input %ls must be an input node, but it is a %ls operation.", m_decoderInputNodeName.c_str(), m_decoderInput->OperationName().c_str());
+        if (!m_decoderInput->HasMBLayout() || m_outputNode->GetMBLayout() != m_decoderInput->GetMBLayout())
+            InvalidArgument("BeamSearchDecoder: The output node %ls must be on the dynamic axis of the decoder input %ls.", m_outputNodeName.c_str(), m_decoderInputNodeName.c_str());
+        if (m_decoderInput->GetSampleLayout().GetNumElements() <= max(m_startSymbol, m_endSymbol))
+            InvalidArgument("BeamSearchDecoder: Start and end symbols must be smaller than the dimension %d of the decoder input.", (int)m_decoderInput->GetSampleLayout().GetNumElements());
+        m_vocabularySize = m_outputNode->GetSampleLayout().GetNumElements();
+        if (m_vocabularySize <= m_endSymbol)
+            InvalidArgument("BeamSearchDecoder: The end symbol must be smaller than the dimension %d of the output node.", (int)m_vocabularySize);
+
+        // everything that depends on the decoder input is computed in each step (iterate, since loops are listed with their delay nodes first)
+        const auto& evalOrder = m_net->GetEvalOrder(m_outputNode);
+        std::set<ComputationNodeBasePtr> decoderNodes{ m_decoderInput };
+        for (bool changed = true; changed;)
+        {
+            changed = false;
+            for (const auto& node : evalOrder)
+            {
+                if (decoderNodes.find(node) != decoderNodes.end())
+                    continue;
+                for (const auto& input : node->GetInputs())
+                {
+                    if (decoderNodes.find(input) != decoderNodes.end())
+                    {
+                        decoderNodes.insert(node);
+                        changed = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        m_delayNodes.clear();
+        std::set<ComputationNodeBasePtr> encoderOutputs;
+        for (const auto& node : evalOrder)
+        {
+            if (decoderNodes.find(node) == decoderNodes.end())
+                continue;
+            if (node->OperationName() == OperationNameOf(FutureValueNode))
+                RuntimeError("%ls %ls operation: Beam search decodes left to right and does not support future values in the decoder.", node->NodeName().c_str(), node->OperationName().c_str());
+            if (node->OperationName() == OperationNameOf(OptimizedRNNStackNode))
+                RuntimeError("%ls %ls operation: Beam search cannot carry the state of an optimized RNN stack from step to step.", node->NodeName().c_str(), node->OperationName().c_str());
+            auto delayNode = dynamic_pointer_cast<PastValueNode<ElemType>>(node);
+            if (delayNode)
+                m_delayNodes.push_back(delayNode);
+            for (const auto& input : node->GetInputs())
+            {
+                if (decoderNodes.find(input) == decoderNodes.end())
+                    encoderOutputs.insert(input);
+            }
+        }
+
+        m_sourceInputs.clear();
+        for (const auto& node : m_net->InputNodesForOutputs({ m_outputNodeName }))
+        {
+            if (node == m_decoderInput)
+                continue;
+            if (node->GetMBLayout() == m_decoderInput->GetMBLayout())
+                InvalidArgument("BeamSearchDecoder: The decoder input %ls must have its own dynamic axis, but it shares it with %ls.", m_decoderInputNodeName.c_str(), node->NodeName().c_str());
+            m_sourceInputs.push_back(node);
+        }
+        if (m_sourceInputs.empty())
+            InvalidArgument("BeamSearchDecoder: The output node %ls does not depend on any input besides the decoder input.", m_outputNodeName.c_str());
+
+        // the encoder outputs are read in every step, so they must not share memory with nodes computed later
+        // (They are marked rather than passed as roots, since the network has no eval order for them.)
+        for (const auto& node : encoderOutputs)
+            node->MarkValueNonSharable();
+        m_net->AllocateAllMatrices({}, { m_outputNode }, nullptr);
+
+        if (m_verbosity > 0)
+            fprintf(stderr, "BeamSearchDecoder: %d of %d nodes are computed per step, %d recurrent state nodes, %d encoder outputs.\n",
+                    (int)decoderNodes.size(), (int)evalOrder.size(), (int)m_delayNodes.size(), (int)encoderOutputs.size());
+    }
+
+    // replace each source sequence by beamWidth copies of it, in parallel sequences u * beamWidth ... (u + 1) * beamWidth - 1
+    // Utterances are ordered by sequence id, which matches the sequences of the different source axes.
+    size_t ReplicateSourceSequences()
+    {
+        std::map<MBLayoutPtr, std::vector<ComputationNodeBasePtr>> layouts;
+        for (const auto& node : m_sourceInputs)
+            layouts[node->GetMBLayout()].push_back(node);
+
+        size_t numUtterances = SIZE_MAX;
+        for (const auto& layout : layouts)
+        {
+            const auto& pMBLayout = layout.first;
+            std::vector<MBLayout::SequenceInfo> sequences;
+            for (const auto& seq : pMBLayout->GetAllSequences())
+            {
+                if (seq.seqId == GAP_SEQUENCE_ID)
+                    continue;
+                if (seq.tBegin < 0 || seq.tEnd > pMBLayout->GetNumTimeSteps())
+                    RuntimeError("BeamSearchDecoder: Beam search needs whole input sequences, but the reader delivered a truncated one. Please do not set 'truncated' for the reader.");
+                sequences.push_back(seq);
+            }
+            std::sort(sequences.begin(), sequences.end(), [](const MBLayout::SequenceInfo& a, const MBLayout::SequenceInfo& b) { return a.seqId < b.seqId; });
+            if (numUtterances != SIZE_MAX && numUtterances != sequences.size())
+                RuntimeError("BeamSearchDecoder: The source inputs have different numbers of sequences in one minibatch.");
+            numUtterances = sequences.size();
+
+            size_t numTimeSteps = 0;
+            for (const auto& seq : sequences)
+                numTimeSteps = max(numTimeSteps, seq.GetNumTimeSteps());
+            let S = numUtterances * m_beamWidth;
+            auto replicated = make_shared<MBLayout>();
+            replicated->Init(S, numTimeSteps);
+            std::vector<ElemType> columnMap(S * numTimeSteps, -1); // negative: gap
+            for (size_t u = 0; u < numUtterances; u++)
+            {
+                let columns = pMBLayout->GetColumnIndices(sequences[u]);
+                for (size_t k = 0; k < m_beamWidth; k++)
+                {
+                    let s = u * m_beamWidth + k;
+                    replicated->AddSequence(s, s, 0, columns.size());
+                    replicated->AddGap(s, columns.size(), numTimeSteps);
+                    for (size_t t = 0; t < columns.size(); t++)
+                        columnMap[t * S + s] = (ElemType)columns[t];
+                }
+            }
+
+            for (const auto& node : layout.second)
+            {
+                auto& matrix = node->As<ComputationNode<ElemType>>()->Value();
+                Matrix<ElemType> idx(1, columnMap.size(), columnMap.data(), matrix.GetDeviceId());
+                Matrix<ElemType> gathered(matrix.GetDeviceId());
+                gathered.SwitchToMatrixType(matrix.GetMatrixType(), matrix.GetFormat(), false);
+                if (matrix.GetMatrixType() == MatrixType::DENSE)
+                {
+                    gathered.Resize(matrix.GetNumRows(), columnMap.size());
+                    gathered.SetValue(0);
+                    gathered.DoGatherColumnsOf(1, idx, matrix, 1);
+                }
+                else
+                    gathered.DoGatherColumnsOf(0, idx, matrix, 1);
+                matrix.SetValue(gathered);
+            }
+            pMBLayout->CopyFrom(replicated);
+            for (const auto& node : layout.second)
+                node->NotifyFunctionValuesMBSizeModified();
+        }
+        ComputationNetwork::BumpEvalTimeStamp(m_sourceInputs);
+        return numUtterances;
+    }
+
+    // set the decoder input of all hypotheses for one step; all parallel sequences continue from the previous step
+    void SetDecoderInput(const std::vector<size_t>& tokens, size_t step)
+    {
+        let S = tokens.size();
+        auto pMBLayout = m_decoderInput->GetMBLayout();
+        pMBLayout->Init(S, 1);
+        for (size_t s = 0; s < S; s++)
+            pMBLayout->AddSequence(s, s, -(ptrdiff_t)step, 1);
+
+        auto& matrix = m_decoderInput->As<ComputationNode<ElemType>>()->Value();
+        let numRows = m_decoderInput->GetSampleLayout().GetNumElements();
+        if (matrix.GetMatrixType() == MatrixType::DENSE)
+        {
+            std::vector<ElemType> oneHot(numRows * S, 0);
+            for (size_t s = 0; s < S; s++)
+                oneHot[s * numRows + tokens[s]] = 1;
+            matrix.SetValue(numRows, S, matrix.GetDeviceId(), oneHot.data(), matrixFlagNormal);
+        }
+        else
+        {
+            std::vector<CPUSPARSE_INDEX_TYPE> colStarts(S + 1), rows(S);
+            std::vector<ElemType> values(S, 1);
+            for (size_t s = 0; s < S; s++)
+            {
+                colStarts[s] = (CPUSPARSE_INDEX_TYPE)s;
+                rows[s] = (CPUSPARSE_INDEX_TYPE)tokens[s];
+            }
+            colStarts[S] = (CPUSPARSE_INDEX_TYPE)S;
+            matrix.SetMatrixFromCSCFormat(colStarts.data(), rows.data(), values.data(), S, numRows, S);
+        }
+        m_decoderInput->NotifyFunctionValuesMBSizeModified();
+        ComputationNetwork::BumpEvalTimeStamp({ m_decoderInput });
+    }
+
+    double FinalScore(const Hypothesis& hyp) const
+    {
+        if (m_lengthPenalty == 0)
+            return hyp.m_score;
+        return hyp.m_score / pow((double)max(hyp.m_tokens.size(), (size_t)1), m_lengthPenalty);
+    }
+
+    // run beam search over the utterances of the current minibatch; returns the number of steps
+    size_t DecodeMinibatch(size_t numUtterances, std::vector<std::vector<size_t>>& results)
+    {
+        let K = m_beamWidth;
+        let S = numUtterances * K;
+        let V = m_vocabularySize;
+
+        // each utterance starts with a single hypothesis; its other slots are idle until the beam has filled
+        std::vector<std::vector<Hypothesis>> live(numUtterances), finished(numUtterances);
+        std::vector<bool> done(numUtterances, false);
+        std::vector<size_t> numFinishedInBeam(numUtterances, 0); // finished hypotheses that were among the best K extensions of their step
+        for (size_t u = 0; u < numUtterances; u++)
+            live[u].push_back(Hypothesis{ 0, {}, u * K });
+
+        std::vector<size_t> tokens(S);
+        std::vector<size_t> sourceSlots(S);
+        std::vector<ElemType> scores;
+        std::vector<std::vector<std::pair<double, size_t>>> candidates(S); // [slot] best (log prob, token) pairs
+        size_t step;
+        for (step = 0; step < m_maxLength; step++)
+        {
+            std::fill(tokens.begin(), tokens.end(), m_endSymbol); // idle slots
+            for (size_t u = 0; u < numUtterances; u++)
+            {
+                for (const auto& hyp : live[u])
+                    tokens[hyp.m_slot] = hyp.m_tokens.empty() ? m_startSymbol : hyp.m_tokens.back();
+            }
+            SetDecoderInput(tokens, step);
+            m_net->ForwardProp(m_outputNode);
+
+            auto& value = m_outputNode->As<ComputationNode<ElemType>>()->Value();
+            if (value.GetNumRows() != V || value.GetNumCols() != S)
+                LogicError("BeamSearchDecoder: Output %ls has dimensions [%d x %d], expected [%d x %d].", m_outputNodeName.c_str(), (int)value.GetNumRows(), (int)value.GetNumCols(), (int)V, (int)S);
+            scores.resize(V * S);
+            ElemType* data = scores.data();
+            size_t size = scores.size();
+            value.CopyToArray(data, size);
+
+            // the best K tokens of every live hypothesis
+#pragma omp parallel for
+            for (long u = 0; u < (long)numUtterances; u++)
+            {
+                for (const auto& hyp : live[u])
+                {
+                    const ElemType* logits = scores.data() + hyp.m_slot * V;
+                    double logZ = 0;
+                    if (m_normalizeScores)
+                    {
+                        double maxLogit = *std::max_element(logits, logits + V);
+                        double sum = 0;
+                        for (size_t v = 0; v < V; v++)
+                            sum += exp((double)logits[v] - maxLogit);
+                        logZ = maxLogit + log(sum);
+                    }
+                    auto& best = candidates[hyp.m_slot];
+                    best.resize(V);
+                    for (size_t v = 0; v < V; v++)
+                        best[v] = std::make_pair((double)logits[v] - logZ, v);
+                    let n = min(K, V);
+                    std::partial_sort(best.begin(), best.begin() + n, best.end(), std::greater<std::pair<double, size_t>>());
+                    best.resize(n);
+                }
+            }
+
+            // prune each utterance's beam to the best K extensions
+            bool anyLive = false;
+            for (size_t u = 0; u < numUtterances; u++)
+            {
+                for (size_t k = 0; k < K; k++)
+                    sourceSlots[u * K + k] = u * K + k;
+                if (done[u])
+                    continue;
+
+                std::vector<std::pair<double, std::pair<size_t, size_t>>> extensions; // (score, (hypothesis, token))
+                for (size_t h = 0; h < live[u].size(); h++)
+                {
+                    for (const auto& candidate : candidates[live[u][h].m_slot])
+                        extensions.push_back(std::make_pair(live[u][h].m_score + candidate.first, std::make_pair(h, candidate.second)));
+                }
+                std::sort(extensions.begin(), extensions.end(), std::greater<std::pair<double, std::pair<size_t, size_t>>>());
+
+                // Extensions that end the hypothesis are kept even if they score below the best K live ones,
+                // since those may still fall below them later; only those within the beam count for stopping early.
+                std::vector<Hypothesis> next;
+                for (const auto& extension : extensions)
+                {
+                    const auto& parent = live[u][extension.second.first];
+                    if (extension.second.second == m_endSymbol)
+                    {
+                        if (next.size() < K)
+                            numFinishedInBeam[u]++;
+                        finished[u].push_back(Hypothesis{ extension.first, parent.m_tokens, SIZE_MAX });
+                        continue;
+                    }
+                    if (next.size() == K)
+                        continue;
+                    Hypothesis hyp{ extension.first, parent.m_tokens, u * K + next.size() };
+                    hyp.m_tokens.push_back(extension.second.second);
+                    sourceSlots[hyp.m_slot] = parent.m_slot;
+                    next.push_back(std::move(hyp));
+                }
+                live[u].swap(next);
+
+                // Scores only decrease, so without length penalty no live hypothesis can beat a finished one that scores better.
+                // With a length penalty, the search ends once K hypotheses have finished within the beam.
+                double bestFinished = -std::numeric_limits<double>::infinity();
+                for (const auto& hyp : finished[u])
+                    bestFinished = max(bestFinished, FinalScore(hyp));
+                done[u] = live[u].empty() || (m_lengthPenalty == 0 ? bestFinished >= live[u].front().m_score : numFinishedInBeam[u] >= K);
+                anyLive |= !done[u];
+            }
+            if (!anyLive)
+            {
+                step++;
+                break;
+            }
+
+            // let each surviving hypothesis continue from the recurrent state of its parent
+            for (const auto& delayNode : m_delayNodes)
+                delayNode->ReorderStreamHistories(sourceSlots);
+        }
+
+        results.assign(numUtterances, std::vector<size_t>());
+        for (size_t u = 0; u < numUtterances; u++)
+        {
+            // if no hypothesis ended within maxLength steps, the best unfinished one is taken
+            if (finished[u].empty())
+                finished[u] = live[u];
+            const Hypothesis* best = nullptr;
+            for (const auto& hyp : finished[u])
+            {
+                if (!best || FinalScore(hyp) > FinalScore(*best))
+                    best = &hyp;
+            }
+            if (best)
+                results[u] = best->m_tokens;
+        }
+        return step;
+    }
+
+    ComputationNetworkPtr m_net;
+    std::wstring m_outputNodeName;
+    std::wstring m_decoderInputNodeName;
+    size_t m_beamWidth;
+    size_t m_maxLength;
+    size_t m_startSymbol;
+    size_t m_endSymbol;
+    bool m_normalizeScores;
+    double m_lengthPenalty;
+    int m_verbosity;
+
+    ComputationNodeBasePtr m_outputNode;
+    ComputationNodeBasePtr m_decoderInput;
+    std::vector<ComputationNodeBasePtr> m_sourceInputs;
+    std::vector<shared_ptr<PastValueNode<ElemType>>> m_delayNodes; // recurrent state of the decoder
+    size_t m_vocabularySize;
+
+    void operator=(const BeamSearchDecoder&); // (not assignable)
+};
+
+}}}
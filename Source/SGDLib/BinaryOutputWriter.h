@@ -0,0 +1,296 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// BinaryOutputWriter.h -- writes node outputs as raw binary files on a background thread
+//
+#pragma once
+
+#include "Basics.h"
+#include "ComputationNode.h"
+#include "fileutil.h"
+#include "Float16.h"
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// BinaryOutputWriter -- writes the values of a set of nodes, one binary file per node
+//
+// File layout (little endian):
+//  - header: BinaryOutputHeader, see below
+//  - data: the samples of all sequences, each sequence contiguous, in the order they were read;
+//    a sample is 'sampleDim' values, either float32 or float16
+//  - index: 'numSequences' entries of BinaryOutputIndexEntry, starting at byte 'indexOffset'
+// The header is rewritten when the file is closed, so a file with numSequences == 0 and indexOffset == 0 is incomplete.
+//
+// Write() copies the node values of a minibatch to the CPU and returns. Reordering the frames into sequences,
+// converting and writing them happens on a background thread. There are two minibatch buffers, so the next
+// ForwardProp() runs while the previous minibatch is written, and Write() only waits if the disk cannot keep up.
+// -----------------------------------------------------------------------
+
+#pragma pack(push, 1)
+struct BinaryOutputHeader
+{
+    char m_magic[8];         // "CNTKBOUT"
+    uint32_t m_version;      // 1
+    uint32_t m_elementType;  // 0 = float32, 1 = float16
+    uint64_t m_sampleDim;    // values per sample
+    uint64_t m_numSequences;
+    uint64_t m_numSamples;
+    uint64_t m_indexOffset;  // byte offset of the sequence index
+};
+
+struct BinaryOutputIndexEntry
+{
+    uint64_t m_firstSample;  // index of the sequence's first sample in the data section
+    uint64_t m_numSamples;
+};
+#pragma pack(pop)
+
+template <class ElemType>
+class BinaryOutputWriter
+{
+public:
+    enum class Precision
+    {
+        Float,
+        Half
+    };
+
+    BinaryOutputWriter(const std::vector<ComputationNodeBasePtr>& nodes, const std::vector<std::wstring>& paths, Precision precision)
+        : m_nodes(nodes), m_precision(precision), m_stop(false), m_buffers(2)
+    {
+        if (paths.size() != nodes.size())
+            LogicError("BinaryOutputWriter: Expected one path per node.");
+        for (size_t i = 0; i < m_nodes.size(); i++)
+        {
+            OutputFile file;
+            file.m_path = paths[i];
+            file.m_sampleDim = m_nodes[i]->GetSampleLayout().GetNumElements();
+            file.m_f = fopenOrDie(file.m_path, L"wb");
+            BinaryOutputHeader header = {};
+            fwriteOrDie(&header, sizeof(header), 1, file.m_f); // placeholder, see Close()
+            m_files.push_back(file);
+        }
+        for (auto& buffer : m_buffers)
+            m_free.push_back(&buffer);
+        m_thread = std::thread([this]() { WriterThread(); });
+    }
+
+    ~BinaryOutputWriter()
+    {
+        StopThread();
+        for (auto& file : m_files)
+        {
+            if (file.m_f)
+                fclose(file.m_f); // (not completed by Close(): incomplete files are recognizable by their header)
+        }
+    }
+
+    // hand the current values of the nodes to the writer thread
+    void Write()
+    {
+        Buffer* buffer;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_changed.wait(lock, [this]() { return !m_free.empty() || m_error; });
+            RethrowWriterError();
+            buffer = m_free.front();
+            m_free.pop_front();
+        }
+
+        buffer->m_values.resize(m_nodes.size());
+        buffer->m_layouts.resize(m_nodes.size());
+        for (size_t i = 0; i < m_nodes.size(); i++)
+        {
+            const auto& value = m_nodes[i]->As<ComputationNode<ElemType>>()->Value();
+            if (value.GetMatrixType() != MatrixType::DENSE)
+                RuntimeError("BinaryOutputWriter: Output %ls is sparse, only dense outputs can be written in binary format.", m_nodes[i]->NodeName().c_str());
+            auto& values = buffer->m_values[i];
+            values.resize(value.GetNumElements());
+            ElemType* data = values.data();
+            size_t size = values.size();
+            value.CopyToArray(data, size);
+
+            // nodes without a dynamic axis are a single sample, which is written as a sequence of length 1
+            if (!buffer->m_layouts[i])
+                buffer->m_layouts[i] = std::make_shared<MBLayout>();
+            if (m_nodes[i]->HasMBLayout())
+                buffer->m_layouts[i]->CopyFrom(m_nodes[i]->GetMBLayout());
+            else
+            {
+                buffer->m_layouts[i]->Init(1, 1);
+                buffer->m_layouts[i]->AddSequence(0, 0, 0, 1);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_full.push_back(buffer);
+        }
+        m_changed.notify_all();
+    }
+
+    // wait for all minibatches to be written, then complete the files
+    void Close()
+    {
+        StopThread();
+        RethrowWriterError();
+        for (auto& file : m_files)
+        {
+            BinaryOutputHeader header;
+            memcpy(header.m_magic, "CNTKBOUT", sizeof(header.m_magic));
+            header.m_version = 1;
+            header.m_elementType = m_precision == Precision::Half ? 1 : 0;
+            header.m_sampleDim = file.m_sampleDim;
+            header.m_numSequences = file.m_index.size();
+            header.m_numSamples = file.m_numSamples;
+            header.m_indexOffset = sizeof(header) + file.m_numSamples * file.m_sampleDim * (m_precision == Precision::Half ? sizeof(uint16_t) : sizeof(float));
+            if (!file.m_index.empty())
+                fwriteOrDie(file.m_index.data(), sizeof(BinaryOutputIndexEntry), file.m_index.size(), file.m_f);
+            fseekOrDie(file.m_f, 0, SEEK_SET);
+            fwriteOrDie(&header, sizeof(header), 1, file.m_f);
+            fcloseOrDie(file.m_f);
+            file.m_f = nullptr;
+        }
+    }
+
+private:
+    struct Buffer
+    {
+        std::vector<std::vector<ElemType>> m_values; // [node] column-major copy of the value
+        std::vector<MBLayoutPtr> m_layouts;          // [node]
+    };
+
+    struct OutputFile
+    {
+        std::wstring m_path;
+        FILE* m_f;
+        size_t m_sampleDim;
+        uint64_t m_numSamples = 0;
+        std::vector<BinaryOutputIndexEntry> m_index;
+    };
+
+    void WriterThread()
+    {
+        std::vector<float> floatValues;
+        std::vector<uint16_t> halfValues;
+        for (;;)
+        {
+            Buffer* buffer;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_changed.wait(lock, [this]() { return !m_full.empty() || m_stop; });
+                if (m_full.empty())
+                    return; // stopped and all written
+                buffer = m_full.front();
+                m_full.pop_front();
+            }
+
+            try
+            {
+                for (size_t i = 0; i < m_files.size(); i++)
+                    WriteMinibatch(m_files[i], buffer->m_values[i], *buffer->m_layouts[i], floatValues, halfValues);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_error = std::current_exception();
+                m_full.clear();
+                m_changed.notify_all();
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_free.push_back(buffer);
+            }
+            m_changed.notify_all();
+        }
+    }
+
+    // write the sequences of one node in the order of the MBLayout; frames outside this minibatch are not written
+    void WriteMinibatch(OutputFile& file, const std::vector<ElemType>& values, const MBLayout& layout, std::vector<float>& floatValues, std::vector<uint16_t>& halfValues)
+    {
+        let D = file.m_sampleDim;
+        let S = layout.GetNumParallelSequences();
+        let T = layout.GetNumTimeSteps();
+        if (values.size() != D * S * T)
+            LogicError("BinaryOutputWriter: Output of %d values does not match the MBLayout.", (int)values.size());
+
+        for (const auto& seq : layout.GetAllSequences())
+        {
+            if (seq.seqId == GAP_SEQUENCE_ID)
+                continue;
+            size_t tBegin = seq.tBegin >= 0 ? (size_t)seq.tBegin : 0;
+            size_t tEnd = std::min(seq.tEnd, T);
+            if (tEnd <= tBegin)
+                continue;
+
+            size_t numSamples = tEnd - tBegin;
+            floatValues.resize(numSamples * D);
+            for (size_t t = tBegin; t < tEnd; t++)
+            {
+                const ElemType* column = values.data() + (t * S + seq.s) * D;
+                for (size_t j = 0; j < D; j++)
+                    floatValues[(t - tBegin) * D + j] = (float)column[j];
+            }
+            if (m_precision == Precision::Half)
+            {
+                halfValues.resize(floatValues.size());
+                for (size_t j = 0; j < floatValues.size(); j++)
+                    halfValues[j] = FloatToHalf(floatValues[j]);
+                fwriteOrDie(halfValues.data(), sizeof(uint16_t), halfValues.size(), file.m_f);
+            }
+            else
+                fwriteOrDie(floatValues.data(), sizeof(float), floatValues.size(), file.m_f);
+
+            BinaryOutputIndexEntry entry = { file.m_numSamples, numSamples };
+            file.m_index.push_back(entry);
+            file.m_numSamples += numSamples;
+        }
+    }
+
+    void StopThread()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_changed.notify_all();
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    // (must be called with m_mutex held or after the writer thread has ended)
+    void RethrowWriterError()
+    {
+        if (m_error)
+            std::rethrow_exception(m_error);
+    }
+
+    std::vector<ComputationNodeBasePtr> m_nodes;
+    Precision m_precision;
+    std::vector<OutputFile> m_files; // [node]; only accessed by the writer thread until it has ended
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    bool m_stop;
+    std::exception_ptr m_error;
+    std::vector<Buffer> m_buffers;
+    std::deque<Buffer*> m_free; // buffers that Write() can fill
+    std::deque<Buffer*> m_full; // buffers that wait to be written
+};
+
+}}}
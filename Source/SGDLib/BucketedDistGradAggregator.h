@@ -0,0 +1,390 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// BucketedDistGradAggregator.h - full-precision gradient aggregation that overlaps with backprop
+//
+// The gradients are grouped into buckets of bounded size, in the order in which backprop completes them
+// (reverse evaluation order). SGD reports each gradient through GradientComputed() as soon as backprop has
+// finished computing it, and a bucket's allreduce is started once all of its gradients are final, so that
+// the communication of the last layers overlaps with the backprop of the first ones. The gradients of a
+// bucket are packed into one contiguous buffer, which replaces the many small allreduce calls (e.g. for
+// bias vectors) by a single one per bucket.
+//
+
+#pragma once
+
+#include "IDistGradAggregator.h"
+#include "CUDAPageLockedMemAllocator.h"
+#include "NcclComm.h"
+#include "GPUDataTransferer.h"
+#include "TimerUtility.h"
+#include <unordered_map>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+class BucketedDistGradAggregator : public IDistGradAggregator<ElemType>
+{
+    UsingIDistGradAggregatorMembers;
+
+public:
+    BucketedDistGradAggregator(const MPIWrapperPtr& mpi, size_t bucketSizeInBytes, int deviceId, int syncStatsTrace)
+        : IDistGradAggregator<ElemType>(mpi), m_bucketSize(std::max<size_t>(bucketSizeInBytes / sizeof(ElemType), 1)), m_initialized(false), m_nextBucket(0), m_syncStatsTrace(syncStatsTrace), m_iterationCount(0), m_nccl(deviceId, mpi)
+    {}
+
+    ~BucketedDistGradAggregator()
+    {
+        for (size_t i = 0; i < m_recvHeaders.size(); ++i)
+            DistGradHeader::Destroy(m_recvHeaders[i]);
+    }
+
+    bool OverlapsWithBackprop() const override { return true; }
+
+    // Bucket assignment, formed by the first AggregateGradients() call (used by the unit tests).
+    size_t NumBuckets() const { return m_buckets.size(); }
+
+    size_t BucketOf(const Matrix<ElemType>* gradient) const
+    {
+        auto iter = m_bucketOfGradient.find(gradient);
+        if (iter == m_bucketOfGradient.end())
+            LogicError("BucketedDistGradAggregator: The matrix is not one of the aggregated gradients.");
+        return iter->second;
+    }
+
+    // Called by SGD when backprop has finished computing the given gradient. Starts the aggregation of all
+    // buckets whose gradients are now complete. Buckets are always started in the same order on all workers,
+    // since the allreduce calls of all workers must match up.
+    void GradientComputed(Matrix<ElemType>* gradient) override
+    {
+        if (!m_initialized) // buckets are formed by the first AggregateGradients() call
+            return;
+
+        auto iter = m_bucketOfGradient.find(gradient);
+        if (iter == m_bucketOfGradient.end())
+            return;
+
+        Bucket& bucket = m_buckets[iter->second];
+        if (bucket.m_numPending > 0) // (a gradient that is reported twice is counted once)
+            bucket.m_numPending--;
+
+        while ((m_nextBucket < m_buckets.size()) && (m_buckets[m_nextBucket].m_numPending == 0))
+            StartBucket(m_nextBucket++);
+
+        // issue the allreduce of buckets whose copy to the CPU has been started before, and give MPI a chance to progress
+        IssueCopiedBuckets(/*all=*/false);
+        ProgressAllReduces();
+    }
+
+    // The gradients must be passed in the order in which backprop completes them, and in the same order in every call.
+    bool AggregateGradients(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, bool /*resetState*/) override
+    {
+        if (!m_initialized)
+            Initialize(gradients, headerCPU->numEvalNode);
+
+        bool showSyncPerfStats = (m_syncStatsTrace > 0) && ((m_iterationCount % m_syncStatsTrace) == 0);
+        m_iterationCount++;
+
+        Timer aggregationTimer;
+        int deviceId = gradients[0]->GetDeviceId();
+        if (showSyncPerfStats)
+        {
+            std::unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(deviceId));
+            mainStreamSyncEvent->SynchronizeEvent();
+            aggregationTimer.Start();
+        }
+
+        size_t numBucketsStartedDuringBackprop = m_nextBucket;
+        if (headerCPU->numSamples == 0)
+        {
+            assert(headerCPU->criterion == 0.0);
+            assert(headerCPU->numSamplesWithLabel == 0);
+
+            // If the current node did not process any samples, the gradients should be zero'd.
+            // No backprop was run in this case, hence no bucket has been started yet.
+            assert(m_nextBucket == 0);
+            for (size_t i = 0; i < gradients.size(); ++i)
+                gradients[i]->SetValue(0);
+        }
+
+        // start all buckets that are not complete yet, e.g. because a gradient was not computed in this minibatch
+        while (m_nextBucket < m_buckets.size())
+            StartBucket(m_nextBucket++);
+        IssueCopiedBuckets(/*all=*/true);
+
+        // the header is aggregated on the main node and sent back to all nodes, as in SimpleDistGradAggregator
+        int headerTag = (int) gradients.size();
+        std::vector<MPI_Request> recvHeaderRequests(NumProc() - 1);
+        if (m_mpi->IsMainNode())
+        {
+            for (size_t j = 0; j < NumProc() - 1; ++j)
+            {
+                int source = (j >= MyRank()) ? (j + 1) : j;
+                MPI_Irecv(m_recvHeaders[j], m_recvHeaders[j]->Size(), MPI_CHAR, source, headerTag, m_mpi->Communicator(), &(recvHeaderRequests[j])) || MpiFail("MPI_Irecv");
+            }
+        }
+
+        MPI_Request sendHeaderRequest;
+        if (!m_mpi->IsMainNode())
+            MPI_Isend(headerCPU, headerCPU->Size(), MPI_CHAR, m_mpi->MainNodeRank(), headerTag, m_mpi->Communicator(), &sendHeaderRequest) || MpiFail("MPI_Isend");
+
+        if (m_mpi->IsMainNode())
+        {
+            size_t numNodesHeadersReceivedFrom = 0;
+            while (numNodesHeadersReceivedFrom < (NumProc() - 1))
+            {
+                int idx = MPI_UNDEFINED;
+                MPI_Waitany(recvHeaderRequests.size(), recvHeaderRequests.data(), &idx, MPI_STATUS_IGNORE) || MpiFail("MPI_Waitany");
+                if (idx == MPI_UNDEFINED)
+                    break;
+
+                numNodesHeadersReceivedFrom++;
+                headerCPU->Aggregate(m_recvHeaders[idx], true);
+            }
+
+            assert(numNodesHeadersReceivedFrom == (NumProc() - 1));
+        }
+
+        MPI_Request recvAggHeaderRequest;
+        if (!m_mpi->IsMainNode())
+            MPI_Irecv(headerCPU, headerCPU->Size(), MPI_CHAR, m_mpi->MainNodeRank(), headerTag + 1, m_mpi->Communicator(), &recvAggHeaderRequest) || MpiFail("MPI_Irecv");
+
+        std::vector<MPI_Request> sendAggHeaderRequests(NumProc() - 1);
+        if (m_mpi->IsMainNode())
+        {
+            for (size_t j = 0; j < NumProc() - 1; ++j)
+            {
+                int dest = (j >= MyRank()) ? (j + 1) : j;
+                MPI_Isend(headerCPU, headerCPU->Size(), MPI_CHAR, dest, headerTag + 1, m_mpi->Communicator(), &(sendAggHeaderRequests[j])) || MpiFail("MPI_Isend");
+            }
+        }
+
+        // wait for the buckets in the order they were started, and unpack them
+        for (auto& bucket : m_buckets)
+            FinishBucket(bucket, deviceId);
+
+        if (!m_mpi->IsMainNode())
+            MPI_Wait(&recvAggHeaderRequest, MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
+
+        if (m_nccl.IsSupported())
+            m_nccl.Sync();
+        else if (deviceId >= 0)
+        {
+            for (auto& bucket : m_buckets)
+                bucket.m_gpuDataTransferer->WaitForCopyCPUToGPUAsync();
+        }
+
+        if (!m_mpi->IsMainNode())
+            MPI_Wait(&sendHeaderRequest, MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
+        else
+            MPI_Waitall(sendAggHeaderRequests.size(), sendAggHeaderRequests.data(), MPI_STATUSES_IGNORE) || MpiFail("MPI_Waitall");
+
+        // get ready for the next minibatch
+        for (auto& bucket : m_buckets)
+            bucket.m_numPending = bucket.m_gradients.size();
+        m_nextBucket = 0;
+
+        if (showSyncPerfStats)
+        {
+            aggregationTimer.Stop();
+            fprintf(stderr, "Exposed gradient aggregation time: %.6g (%d of %d buckets started during backprop)\n",
+                    aggregationTimer.ElapsedSeconds(), (int) numBucketsStartedDuringBackprop, (int) m_buckets.size());
+        }
+
+        return (headerCPU->numSamples != 0);
+    }
+
+private:
+    enum class BucketState
+    {
+        Idle,     // waiting for its gradients to be computed
+        Copying,  // being copied from the GPU into the CPU buffer, allreduce not issued yet
+        Reducing, // allreduce issued
+    };
+
+    struct Bucket
+    {
+        std::vector<Matrix<ElemType>*> m_gradients;
+        std::vector<size_t> m_offsets; // [i] -> offset of m_gradients[i] in m_buffer
+        size_t m_numElements = 0;
+        std::shared_ptr<ElemType> m_buffer; // packed gradients; null for a single CPU gradient, which is reduced in place
+        std::unique_ptr<GPUDataTransferer> m_gpuDataTransferer;
+        size_t m_numPending = 0; // number of gradients not yet computed in the current minibatch
+        BucketState m_state = BucketState::Idle;
+        MPI_Request m_allReduceRequest;
+    };
+
+    void Initialize(const std::vector<Matrix<ElemType>*>& gradients, int numEvalNodes)
+    {
+        m_initialized = true;
+        int deviceId = gradients[0]->GetDeviceId();
+
+        if (!m_nccl.IsSupported() && deviceId != CPUDEVICE)
+            m_allocator.reset(new CUDAPageLockedMemAllocator(deviceId));
+
+        // greedily fill buckets up to m_bucketSize elements; a gradient that is larger than that gets a bucket of its own
+        for (size_t i = 0; i < gradients.size(); i++)
+        {
+            // Make sure none of the gradient matrixes are sparse - we currently do not support aggregation of sparse gradient matrices
+            if (gradients[i]->GetMatrixType() != DENSE)
+                RuntimeError("Gradient aggregation for sparse gradient matrices is currently unsupported!");
+
+            size_t numElements = gradients[i]->GetNumElements();
+            if (m_buckets.empty() || (m_buckets.back().m_numElements > 0 && m_buckets.back().m_numElements + numElements > m_bucketSize))
+                m_buckets.emplace_back();
+
+            Bucket& bucket = m_buckets.back();
+            bucket.m_gradients.push_back(gradients[i]);
+            bucket.m_offsets.push_back(bucket.m_numElements);
+            bucket.m_numElements += numElements;
+            m_bucketOfGradient[gradients[i]] = m_buckets.size() - 1;
+        }
+
+        for (auto& bucket : m_buckets)
+        {
+            bucket.m_numPending = bucket.m_gradients.size();
+            if (m_nccl.IsSupported())
+                continue;
+
+            if (deviceId != CPUDEVICE)
+            {
+                // the copies are issued on the compute stream, so they are ordered after the computation of the gradients
+                bucket.m_gpuDataTransferer = std::make_unique<GPUDataTransferer>(deviceId, /*useConcurrentStreams=*/false);
+                bucket.m_buffer = AllocateIntermediateBuffer(bucket.m_numElements);
+            }
+            else if (bucket.m_gradients.size() > 1)
+                bucket.m_buffer = std::shared_ptr<ElemType>(new ElemType[bucket.m_numElements], [](ElemType* p) { delete[] p; });
+        }
+
+        if (m_mpi->IsMainNode())
+        {
+            for (size_t i = 0; i < NumProc() - 1; ++i)
+                m_recvHeaders.push_back(DistGradHeader::Create(numEvalNodes));
+        }
+
+        fprintf(stderr, "BucketedDistGradAggregator: %d gradient matrices in %d buckets of up to %d elements.\n",
+                (int) gradients.size(), (int) m_buckets.size(), (int) m_bucketSize);
+    }
+
+    std::shared_ptr<ElemType> AllocateIntermediateBuffer(size_t numElements)
+    {
+        // Use pinned memory for GPU devices for better copy performance
+        size_t totalSize = sizeof(ElemType) * numElements;
+        return std::shared_ptr<ElemType>((ElemType*) m_allocator->Malloc(totalSize), [this](ElemType* p)
+                                         {
+                                             m_allocator->Free(p);
+                                         });
+    }
+
+    void StartBucket(size_t bucketIndex)
+    {
+        Bucket& bucket = m_buckets[bucketIndex];
+        assert(bucket.m_state == BucketState::Idle);
+
+        if (m_nccl.IsSupported())
+        {
+            m_nccl.AllReduce(bucket.m_gradients);
+            bucket.m_state = BucketState::Reducing;
+        }
+        else if (bucket.m_gpuDataTransferer)
+        {
+            // pack the gradients into the pinned CPU buffer; the allreduce is issued once the copy has completed
+            for (size_t i = 0; i < bucket.m_gradients.size(); i++)
+                bucket.m_gpuDataTransferer->CopyGPUToCPUAsync(bucket.m_gradients[i]->Data(), bucket.m_gradients[i]->GetNumElements(), bucket.m_buffer.get() + bucket.m_offsets[i]);
+            bucket.m_state = BucketState::Copying;
+            m_copyingBuckets.push_back(bucketIndex);
+        }
+        else
+        {
+            if (bucket.m_buffer)
+            {
+                for (size_t i = 0; i < bucket.m_gradients.size(); i++)
+                    memcpy(bucket.m_buffer.get() + bucket.m_offsets[i], bucket.m_gradients[i]->Data(), sizeof(ElemType) * bucket.m_gradients[i]->GetNumElements());
+            }
+            IssueAllReduce(bucket);
+        }
+    }
+
+    // Issue the allreduce of buckets whose GPU-to-CPU copy has been started. Unless 'all' is set, the most recently
+    // started bucket is left alone, so that we do not stall the host on a copy that is queued behind the backprop
+    // computation that was just launched.
+    void IssueCopiedBuckets(bool all)
+    {
+        size_t numToIssue = all ? m_copyingBuckets.size() : (m_copyingBuckets.empty() ? 0 : m_copyingBuckets.size() - 1);
+        for (size_t i = 0; i < numToIssue; i++)
+        {
+            Bucket& bucket = m_buckets[m_copyingBuckets[i]];
+            bucket.m_gpuDataTransferer->WaitForCopyGPUToCPUAsync();
+            IssueAllReduce(bucket);
+        }
+        m_copyingBuckets.erase(m_copyingBuckets.begin(), m_copyingBuckets.begin() + numToIssue);
+    }
+
+    void IssueAllReduce(Bucket& bucket)
+    {
+        ElemType* reductionBuffer = bucket.m_buffer ? bucket.m_buffer.get() : bucket.m_gradients[0]->Data();
+
+        // On Windows this async MPI_Iallreduce call requires MS MPI v7 or higher to be installed
+        MPI_Iallreduce(MPI_IN_PLACE, reductionBuffer, bucket.m_numElements,
+                       MPIWrapper::GetDataType(reductionBuffer), MPI_SUM,
+                       m_mpi->Communicator(), &bucket.m_allReduceRequest) || MpiFail("MPI_Iallreduce");
+        bucket.m_state = BucketState::Reducing;
+    }
+
+    // MPI implementations typically only progress non-blocking collectives from within MPI calls
+    void ProgressAllReduces()
+    {
+        for (size_t i = 0; i < m_nextBucket; i++)
+        {
+            Bucket& bucket = m_buckets[i];
+            if (bucket.m_state == BucketState::Reducing && !m_nccl.IsSupported())
+            {
+                int completed = 0;
+                MPI_Test(&bucket.m_allReduceRequest, &completed, MPI_STATUS_IGNORE) || MpiFail("MPI_Test");
+                if (!completed) // later buckets were started after this one and are unlikely to have completed
+                    break;
+            }
+        }
+    }
+
+    void FinishBucket(Bucket& bucket, int deviceId)
+    {
+        assert(bucket.m_state == BucketState::Reducing);
+        bucket.m_state = BucketState::Idle;
+        if (m_nccl.IsSupported())
+            return;
+
+        // (MPI_Wait on a request that has completed in MPI_Test() returns immediately)
+        MPI_Wait(&bucket.m_allReduceRequest, MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
+        if (deviceId >= 0)
+        {
+            for (size_t i = 0; i < bucket.m_gradients.size(); i++)
+                bucket.m_gpuDataTransferer->CopyCPUToGPUAsync(bucket.m_buffer.get() + bucket.m_offsets[i], bucket.m_gradients[i]->GetNumElements(), bucket.m_gradients[i]->Data());
+        }
+        else if (bucket.m_buffer)
+        {
+            for (size_t i = 0; i < bucket.m_gradients.size(); i++)
+                memcpy(bucket.m_gradients[i]->Data(), bucket.m_buffer.get() + bucket.m_offsets[i], sizeof(ElemType) * bucket.m_gradients[i]->GetNumElements());
+        }
+    }
+
+private:
+    size_t m_bucketSize; // upper bound of the number of elements in a bucket, unless a single gradient is larger
+    bool m_initialized;
+
+    std::vector<Bucket> m_buckets; // in the order in which they are started
+    std::unordered_map<const Matrix<ElemType>*, size_t> m_bucketOfGradient;
+    size_t m_nextBucket;                 // index of the next bucket to start in the current minibatch
+    std::vector<size_t> m_copyingBuckets; // buckets in state Copying, in the order they were started
+
+    std::unique_ptr<CUDAPageLockedMemAllocator> m_allocator;
+    std::vector<DistGradHeader*> m_recvHeaders;
+
+    int m_syncStatsTrace;
+
+    // Only used for controlling frequency of measuring/showing gradient aggregation perf stats
+    size_t m_iterationCount;
+
+    NcclComm m_nccl;
+};
+} } }
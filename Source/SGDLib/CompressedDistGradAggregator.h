@@ -0,0 +1,73 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CompressedDistGradAggregator.h - gradient aggregation with compression and error feedback (see GradientCompression.h)
+//
+
+#pragma once
+
+#include "IDistGradAggregator.h"
+#include "GradientCompression.h"
+#include "TimerUtility.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+class CompressedDistGradAggregator : public IDistGradAggregator<ElemType>
+{
+    UsingIDistGradAggregatorMembers;
+
+public:
+    CompressedDistGradAggregator(const MPIWrapperPtr& mpi, const GradientCompressionOptions& options, int syncStatsTrace)
+        : IDistGradAggregator<ElemType>(mpi), m_allReducer(mpi, options), m_syncStatsTrace(syncStatsTrace), m_iterationCount(0)
+    {}
+
+    bool AggregateGradients(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, bool resetState) override
+    {
+        if (resetState)
+            m_allReducer.ResetResiduals();
+
+        bool showSyncPerfStats = (m_syncStatsTrace > 0) && ((m_iterationCount % m_syncStatsTrace) == 0);
+        m_iterationCount++;
+
+        Timer aggregationTimer;
+        if (showSyncPerfStats)
+            aggregationTimer.Start();
+
+        if (headerCPU->numSamples == 0)
+        {
+            // If the current node did not process any samples, the gradients should be zero'd
+            for (size_t i = 0; i < gradients.size(); ++i)
+                gradients[i]->SetValue(0);
+        }
+
+        m_allReducer.AllReduce(gradients);
+
+        // aggregate the headers: every node gathers all headers and sums them up
+        size_t headerSize = headerCPU->Size();
+        m_headerBuffer.resize(headerSize * NumProc());
+        MPI_Allgather(headerCPU, (int) headerSize, MPI_CHAR, m_headerBuffer.data(), (int) headerSize, MPI_CHAR, m_mpi->Communicator()) || MpiFail("MPI_Allgather");
+        headerCPU->Aggregate(reinterpret_cast<DistGradHeader*>(m_headerBuffer.data()), /*add=*/false);
+        for (size_t j = 1; j < NumProc(); j++)
+            headerCPU->Aggregate(reinterpret_cast<DistGradHeader*>(m_headerBuffer.data() + j * headerSize), /*add=*/true);
+
+        if (showSyncPerfStats)
+        {
+            aggregationTimer.Stop();
+            fprintf(stderr, "Compressed gradient aggregation time: %.6g\n", aggregationTimer.ElapsedSeconds());
+        }
+
+        return (headerCPU->numSamples != 0);
+    }
+
+private:
+    CompressedAllReducer<ElemType> m_allReducer;
+    std::vector<char> m_headerBuffer;
+
+    int m_syncStatsTrace;
+
+    // Only used for controlling frequency of measuring/showing gradient aggregation perf stats
+    size_t m_iterationCount;
+};
+} } }
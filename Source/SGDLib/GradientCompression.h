@@ -0,0 +1,552 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// GradientCompression.h - compressed allreduce of gradients with error feedback
+//
+// A GradientCompressor encodes a gradient into a compact message. What the message cannot represent is kept
+// by the sender as a residual, which is added to the next gradient before it is encoded (error feedback),
+// so that no part of the gradient is lost, only delayed.
+//
+// CompressedAllReducer sums a set of gradient matrices over all MPI workers using such a compressor. Each
+// matrix is split into column stripes, one per worker. In the first phase, every worker sends the compressed
+// stripe w of its gradients to worker w, which decompresses and sums what it receives. In the second phase,
+// every worker compresses its aggregated stripe (with a second residual) and sends it to all workers.
+// Each worker thus sends and receives about twice the compressed size of the gradients, independent of
+// the number of workers.
+//
+
+#pragma once
+
+#include "Matrix.h"
+#include "MatrixQuantizerImpl.h"
+#include "MPIWrapper.h"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+enum class GradientCompressionType : int
+{
+    None,
+    Quantization,       // column-wise quantization to a few bits per value (1-bit SGD)
+    TopK,               // only the values of largest magnitude are sent, as (index, value) pairs
+    StochasticRounding  // column-wise 8-bit quantization with stochastic rounding
+};
+
+static inline GradientCompressionType ParseGradientCompressionType(const std::wstring& s)
+{
+    if      (EqualCI(s, L"") || EqualCI(s, L"none"))                 return GradientCompressionType::None;
+    else if (EqualCI(s, L"1bit") || EqualCI(s, L"quantization"))     return GradientCompressionType::Quantization;
+    else if (EqualCI(s, L"topK"))                                    return GradientCompressionType::TopK;
+    else if (EqualCI(s, L"8bit") || EqualCI(s, L"stochasticRounding")) return GradientCompressionType::StochasticRounding;
+    else InvalidArgument("ParseGradientCompressionType: Invalid gradient compression '%ls'. Valid values are (none | 1bit | topK | 8bit)", s.c_str());
+}
+
+struct GradientCompressionOptions
+{
+    GradientCompressionType m_type = GradientCompressionType::None;
+    size_t m_numQuantizationBits = 1;   // for Quantization
+    bool m_zeroThresholdFor1Bit = true; // for Quantization
+    double m_topKFraction = 0.01;       // for TopK: fraction of the values of a stripe that are sent
+};
+
+// ---------------------------------------------------------------------------
+// GradientCompressor -- encodes CPU matrices with error feedback
+// ---------------------------------------------------------------------------
+
+template <class ElemType>
+class GradientCompressor
+{
+public:
+    virtual ~GradientCompressor()
+    {}
+
+    // size in bytes of the message that encodes a [numRows x numCols] matrix
+    virtual size_t MessageSize(size_t numRows, size_t numCols) const = 0;
+
+    // Encodes 'values' + 'residual' into 'message' and updates 'residual' to the part that the message does not represent.
+    virtual void Compress(const Matrix<ElemType>& values, Matrix<ElemType>& residual, char* message) = 0;
+
+    // Decodes 'message' into 'values', or adds it to 'values' if 'add' is set.
+    virtual void Decompress(const char* message, Matrix<ElemType>& values, bool add) = 0;
+
+    static std::unique_ptr<GradientCompressor<ElemType>> Create(const GradientCompressionOptions& options, unsigned long randomSeed);
+};
+
+// Quantization of each column to numBits bits between the column's range, using MatrixQuantizerImpl and the
+// QuantizedMatrix format. With 1 bit, this is the 1-bit SGD compression.
+template <class ElemType>
+class QuantizingGradientCompressor : public GradientCompressor<ElemType>
+{
+public:
+    QuantizingGradientCompressor(size_t numBits, bool zeroThresholdFor1Bit)
+        : m_numBits(numBits), m_zeroThresholdFor1Bit(zeroThresholdFor1Bit), m_quantizer(MatrixQuantizerImpl<ElemType>::Create(CPUDEVICE, /*useAsync=*/false))
+    {
+        if (numBits < 1 || numBits > 8 * sizeof(ElemType))
+            InvalidArgument("QuantizingGradientCompressor: numQuantizationBits must be in the range [1, %d].", (int) (8 * sizeof(ElemType)));
+    }
+
+    size_t MessageSize(size_t numRows, size_t numCols) const override
+    {
+        return numCols * QuantizedColumn<ElemType>::QuantizedColumnSize(m_numBits, numRows);
+    }
+
+    void Compress(const Matrix<ElemType>& values, Matrix<ElemType>& residual, char* message) override
+    {
+        auto& quantizedMatrix = GetQuantizedMatrix(values.GetNumRows(), values.GetNumCols());
+        m_quantizer->QuantizeAsync(values, residual, quantizedMatrix, residual, m_zeroThresholdFor1Bit);
+        m_quantizer->WaitQuantizeAsyncDone();
+        memcpy(message, quantizedMatrix.Buffer(), quantizedMatrix.GetSize());
+    }
+
+    void Decompress(const char* message, Matrix<ElemType>& values, bool add) override
+    {
+        auto& quantizedMatrix = GetQuantizedMatrix(values.GetNumRows(), values.GetNumCols());
+        memcpy(quantizedMatrix.Buffer(), message, quantizedMatrix.GetSize());
+        m_quantizer->UnquantizeAsync(quantizedMatrix, values, add);
+        m_quantizer->WaitUnquantizeAsyncDone();
+    }
+
+private:
+    QuantizedMatrix<ElemType>& GetQuantizedMatrix(size_t numRows, size_t numCols)
+    {
+        auto& quantizedMatrix = m_quantizedMatrices[std::make_pair(numRows, numCols)];
+        if (!quantizedMatrix)
+            quantizedMatrix.reset(new QuantizedMatrix<ElemType>(numRows, numCols, m_numBits, CPUDEVICE));
+        return *quantizedMatrix;
+    }
+
+    size_t m_numBits;
+    bool m_zeroThresholdFor1Bit;
+    std::unique_ptr<MatrixQuantizerImpl<ElemType>> m_quantizer;
+    std::map<std::pair<size_t, size_t>, std::unique_ptr<QuantizedMatrix<ElemType>>> m_quantizedMatrices; // scratch, per shape
+};
+
+// Top-k sparsification: only the k = ceil(fraction * n) values of largest magnitude are sent, as an array of
+// k values followed by an array of k 32-bit indices.
+template <class ElemType>
+class TopKGradientCompressor : public GradientCompressor<ElemType>
+{
+public:
+    TopKGradientCompressor(double fraction)
+        : m_fraction(fraction)
+    {
+        if (fraction <= 0 || fraction > 1)
+            InvalidArgument("TopKGradientCompressor: topKFraction must be in the range (0, 1].");
+    }
+
+    size_t MessageSize(size_t numRows, size_t numCols) const override
+    {
+        // (padded so that the next message is aligned as well)
+        size_t size = NumSelected(numRows * numCols) * (sizeof(uint32_t) + sizeof(ElemType));
+        return (size + sizeof(ElemType) - 1) / sizeof(ElemType) * sizeof(ElemType);
+    }
+
+    void Compress(const Matrix<ElemType>& values, Matrix<ElemType>& residual, char* message) override
+    {
+        size_t n = values.GetNumElements();
+        if (n > UINT32_MAX)
+            InvalidArgument("TopKGradientCompressor: Gradients with more than 2^32 elements are not supported.");
+        size_t k = NumSelected(n);
+        if (k == 0)
+            return;
+
+        // the residual accumulates everything that has not been sent yet
+        const ElemType* in = values.Data();
+        ElemType* res = residual.Data();
+        for (size_t i = 0; i < n; i++)
+            res[i] += in[i];
+
+        m_indices.resize(n);
+        for (size_t i = 0; i < n; i++)
+            m_indices[i] = (uint32_t) i;
+        std::nth_element(m_indices.begin(), m_indices.begin() + (k - 1), m_indices.end(), [res](uint32_t a, uint32_t b)
+                         {
+                             return fabs(res[a]) > fabs(res[b]);
+                         });
+        std::sort(m_indices.begin(), m_indices.begin() + k); // (for memory locality when decompressing)
+
+        ElemType* outValues = reinterpret_cast<ElemType*>(message);
+        uint32_t* outIndices = reinterpret_cast<uint32_t*>(message + k * sizeof(ElemType));
+        for (size_t j = 0; j < k; j++)
+        {
+            outIndices[j] = m_indices[j];
+            outValues[j] = res[m_indices[j]];
+            res[m_indices[j]] = 0;
+        }
+    }
+
+    void Decompress(const char* message, Matrix<ElemType>& values, bool add) override
+    {
+        if (!add)
+            values.SetValue(0);
+
+        size_t k = NumSelected(values.GetNumElements());
+        const ElemType* inValues = reinterpret_cast<const ElemType*>(message);
+        const uint32_t* inIndices = reinterpret_cast<const uint32_t*>(message + k * sizeof(ElemType));
+        ElemType* out = values.Data();
+        for (size_t j = 0; j < k; j++)
+            out[inIndices[j]] += inValues[j];
+    }
+
+private:
+    size_t NumSelected(size_t n) const
+    {
+        return std::min(n, (size_t) ceil(m_fraction * n));
+    }
+
+    double m_fraction;
+    std::vector<uint32_t> m_indices; // scratch
+};
+
+// 8-bit quantization of each column between its minimum and maximum, with stochastic rounding. Each column
+// is encoded as its lower bound and step size followed by one byte per value, padded to a multiple of sizeof(ElemType).
+template <class ElemType>
+class StochasticRoundingGradientCompressor : public GradientCompressor<ElemType>
+{
+public:
+    StochasticRoundingGradientCompressor(unsigned long randomSeed)
+        : m_randomEngine(randomSeed), m_uniform(0, 1)
+    {}
+
+    size_t MessageSize(size_t numRows, size_t numCols) const override
+    {
+        return numCols * ColumnSize(numRows);
+    }
+
+    void Compress(const Matrix<ElemType>& values, Matrix<ElemType>& residual, char* message) override
+    {
+        size_t numRows = values.GetNumRows();
+        for (size_t j = 0; j < values.GetNumCols(); j++)
+        {
+            const ElemType* in = values.Data() + j * numRows;
+            ElemType* res = residual.Data() + j * numRows;
+            char* column = message + j * ColumnSize(numRows);
+            ElemType* header = reinterpret_cast<ElemType*>(column);
+            unsigned char* codes = reinterpret_cast<unsigned char*>(column + 2 * sizeof(ElemType));
+
+            ElemType lower = std::numeric_limits<ElemType>::max();
+            ElemType upper = std::numeric_limits<ElemType>::lowest();
+            for (size_t i = 0; i < numRows; i++)
+            {
+                res[i] += in[i];
+                lower = std::min(lower, res[i]);
+                upper = std::max(upper, res[i]);
+            }
+            ElemType step = (upper - lower) / NumLevels;
+            header[0] = lower;
+            header[1] = step;
+
+            for (size_t i = 0; i < numRows; i++)
+            {
+                unsigned char code = 0;
+                if (step > 0)
+                {
+                    // round up with a probability equal to the fractional part, so that the code is unbiased
+                    ElemType scaled = (res[i] - lower) / step;
+                    ElemType rounded = floor(scaled + (ElemType) m_uniform(m_randomEngine));
+                    code = (unsigned char) std::max((ElemType) 0, std::min((ElemType) NumLevels, rounded));
+                }
+                codes[i] = code;
+                res[i] -= lower + code * step;
+            }
+        }
+    }
+
+    void Decompress(const char* message, Matrix<ElemType>& values, bool add) override
+    {
+        size_t numRows = values.GetNumRows();
+        for (size_t j = 0; j < values.GetNumCols(); j++)
+        {
+            ElemType* out = values.Data() + j * numRows;
+            const char* column = message + j * ColumnSize(numRows);
+            const ElemType* header = reinterpret_cast<const ElemType*>(column);
+            const unsigned char* codes = reinterpret_cast<const unsigned char*>(column + 2 * sizeof(ElemType));
+            ElemType lower = header[0];
+            ElemType step = header[1];
+            for (size_t i = 0; i < numRows; i++)
+                out[i] = (add ? out[i] : 0) + lower + codes[i] * step;
+        }
+    }
+
+private:
+    static const int NumLevels = 255;
+
+    static size_t ColumnSize(size_t numRows)
+    {
+        return 2 * sizeof(ElemType) + (numRows + sizeof(ElemType) - 1) / sizeof(ElemType) * sizeof(ElemType);
+    }
+
+    std::mt19937 m_randomEngine;
+    std::uniform_real_distribution<double> m_uniform;
+};
+
+template <class ElemType>
+/*static*/ std::unique_ptr<GradientCompressor<ElemType>> GradientCompressor<ElemType>::Create(const GradientCompressionOptions& options, unsigned long randomSeed)
+{
+    switch (options.m_type)
+    {
+    case GradientCompressionType::Quantization:
+        return std::unique_ptr<GradientCompressor<ElemType>>(new QuantizingGradientCompressor<ElemType>(options.m_numQuantizationBits, options.m_zeroThresholdFor1Bit));
+    case GradientCompressionType::TopK:
+        return std::unique_ptr<GradientCompressor<ElemType>>(new TopKGradientCompressor<ElemType>(options.m_topKFraction));
+    case GradientCompressionType::StochasticRounding:
+        return std::unique_ptr<GradientCompressor<ElemType>>(new StochasticRoundingGradientCompressor<ElemType>(randomSeed));
+    default:
+        LogicError("GradientCompressor::Create: No compressor for this compression type.");
+    }
+}
+
+// ---------------------------------------------------------------------------
+// CompressedAllReducer -- sums gradients over all workers, sending compressed stripes
+// ---------------------------------------------------------------------------
+
+template <class ElemType>
+class CompressedAllReducer
+{
+public:
+    CompressedAllReducer(const MPIWrapperPtr& mpi, const GradientCompressionOptions& options)
+        : m_mpi(mpi), m_options(options), m_initialized(false)
+    {
+        // every worker uses its own random sequence for stochastic rounding
+        unsigned long randomSeed = (unsigned long) (m_mpi->CurrentNodeRank() + 1);
+        m_compressor = GradientCompressor<ElemType>::Create(options, randomSeed);
+        m_stripeCompressor = GradientCompressor<ElemType>::Create(options, randomSeed + 0x10000);
+    }
+
+    // Replaces each matrix by its sum over all workers. The matrices are identified by their position in 'values',
+    // which must be the same in every call, as the error-feedback residuals are kept per matrix.
+    void AllReduce(const std::vector<Matrix<ElemType>*>& values)
+    {
+        if (!m_initialized)
+            Initialize(values);
+        else if (values.size() != m_entries.size())
+            LogicError("CompressedAllReducer: The number of matrices changed between calls.");
+
+        size_t numWorkers = m_mpi->NumNodesInUse();
+        size_t myRank = m_mpi->CurrentNodeRank();
+
+        // the CPU copies of the values (on CPU, the values themselves)
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            auto& entry = m_entries[i];
+            if (values[i]->GetNumRows() != entry.m_numRows || values[i]->GetNumCols() != entry.m_numCols)
+                LogicError("CompressedAllReducer: The dimensions of a matrix changed between calls.");
+            if (values[i]->GetDeviceId() != CPUDEVICE)
+                entry.m_cpuValues->AssignValuesOf(*values[i]);
+        }
+
+        // small matrices are summed without compression, in a single fused allreduce that overlaps with the exchange below
+        MPI_Request uncompressedRequest = MPI_REQUEST_NULL;
+        if (!m_uncompressedBuffer.empty())
+        {
+            for (size_t i = 0; i < values.size(); i++)
+            {
+                auto& entry = m_entries[i];
+                if (!entry.m_compressed)
+                    memcpy(m_uncompressedBuffer.data() + entry.m_uncompressedOffset, CPUValues(values, i).Data(), sizeof(ElemType) * entry.m_numRows * entry.m_numCols);
+            }
+            MPI_Iallreduce(MPI_IN_PLACE, m_uncompressedBuffer.data(), (int) m_uncompressedBuffer.size(), MPIWrapper::GetDataType(m_uncompressedBuffer.data()),
+                           MPI_SUM, m_mpi->Communicator(), &uncompressedRequest) || MpiFail("MPI_Iallreduce");
+        }
+
+        // phase 1: send stripe w of every gradient to worker w, and sum the stripes we receive
+        for (size_t w = 0; w < numWorkers; w++)
+        {
+            char* message = m_sendBuffer.data() + m_sendOffsets[w];
+            for (size_t i = 0; i < values.size(); i++)
+            {
+                auto& entry = m_entries[i];
+                if (!entry.m_compressed || entry.StripeNumCols(w) == 0)
+                    continue;
+                Matrix<ElemType> stripe = CPUValues(values, i).ColumnSlice(entry.StripeBegin(w), entry.StripeNumCols(w));
+                Matrix<ElemType> residual = entry.m_residual->ColumnSlice(entry.StripeBegin(w), entry.StripeNumCols(w));
+                m_compressor->Compress(stripe, residual, message);
+                message += m_compressor->MessageSize(entry.m_numRows, entry.StripeNumCols(w));
+            }
+        }
+        MPI_Alltoallv(m_sendBuffer.data(), m_sendCounts.data(), m_sendOffsets.data(), MPI_CHAR,
+                      m_recvBuffer.data(), m_recvCounts.data(), m_recvOffsets.data(), MPI_CHAR, m_mpi->Communicator()) || MpiFail("MPI_Alltoallv");
+
+        for (size_t w = 0; w < numWorkers; w++)
+        {
+            const char* message = m_recvBuffer.data() + m_recvOffsets[w];
+            for (auto& entry : m_entries)
+            {
+                if (!entry.m_compressed || entry.StripeNumCols(myRank) == 0)
+                    continue;
+                m_compressor->Decompress(message, *entry.m_aggregatedStripe, /*add=*/w > 0);
+                message += m_compressor->MessageSize(entry.m_numRows, entry.StripeNumCols(myRank));
+            }
+        }
+
+        // phase 2: send our aggregated stripes to all workers
+        char* myMessage = m_gatherSendBuffer.data();
+        for (auto& entry : m_entries)
+        {
+            if (!entry.m_compressed || entry.StripeNumCols(myRank) == 0)
+                continue;
+            m_stripeCompressor->Compress(*entry.m_aggregatedStripe, *entry.m_stripeResidual, myMessage);
+            myMessage += m_stripeCompressor->MessageSize(entry.m_numRows, entry.StripeNumCols(myRank));
+        }
+        MPI_Allgatherv(m_gatherSendBuffer.data(), (int) m_gatherSendBuffer.size(), MPI_CHAR,
+                       m_gatherRecvBuffer.data(), m_gatherCounts.data(), m_gatherOffsets.data(), MPI_CHAR, m_mpi->Communicator()) || MpiFail("MPI_Allgatherv");
+
+        for (size_t w = 0; w < numWorkers; w++)
+        {
+            const char* message = m_gatherRecvBuffer.data() + m_gatherOffsets[w];
+            for (size_t i = 0; i < values.size(); i++)
+            {
+                auto& entry = m_entries[i];
+                if (!entry.m_compressed || entry.StripeNumCols(w) == 0)
+                    continue;
+                Matrix<ElemType> stripe = CPUValues(values, i).ColumnSlice(entry.StripeBegin(w), entry.StripeNumCols(w));
+                m_stripeCompressor->Decompress(message, stripe, /*add=*/false);
+                message += m_stripeCompressor->MessageSize(entry.m_numRows, entry.StripeNumCols(w));
+            }
+        }
+
+        if (uncompressedRequest != MPI_REQUEST_NULL)
+        {
+            MPI_Wait(&uncompressedRequest, MPI_STATUS_IGNORE) || MpiFail("MPI_Wait");
+            for (size_t i = 0; i < values.size(); i++)
+            {
+                auto& entry = m_entries[i];
+                if (!entry.m_compressed)
+                    memcpy(CPUValues(values, i).Data(), m_uncompressedBuffer.data() + entry.m_uncompressedOffset, sizeof(ElemType) * entry.m_numRows * entry.m_numCols);
+            }
+        }
+
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            if (values[i]->GetDeviceId() != CPUDEVICE)
+                values[i]->AssignValuesOf(*m_entries[i].m_cpuValues);
+        }
+    }
+
+    // Clears the error-feedback residuals, e.g. when restarting from a checkpoint.
+    void ResetResiduals()
+    {
+        for (auto& entry : m_entries)
+        {
+            if (entry.m_residual)
+                entry.m_residual->SetValue(0);
+            if (entry.m_stripeResidual)
+                entry.m_stripeResidual->SetValue(0);
+        }
+    }
+
+private:
+    // matrices with fewer elements than this are not worth compressing (e.g. bias vectors)
+    static const size_t MinNumElementsToCompress = 4096;
+
+    struct Entry
+    {
+        size_t m_numRows, m_numCols, m_numWorkers;
+        bool m_compressed;
+        size_t m_uncompressedOffset;                        // position in m_uncompressedBuffer, if not compressed
+        std::unique_ptr<Matrix<ElemType>> m_cpuValues;        // for matrices that do not live on the CPU
+        std::unique_ptr<Matrix<ElemType>> m_residual;         // error feedback of our gradient, [m_numRows x m_numCols]
+        std::unique_ptr<Matrix<ElemType>> m_aggregatedStripe; // sum of our stripe over all workers
+        std::unique_ptr<Matrix<ElemType>> m_stripeResidual;   // error feedback of the aggregated stripe
+
+        size_t StripeBegin(size_t w) const { return w * m_numCols / m_numWorkers; }
+        size_t StripeNumCols(size_t w) const { return StripeBegin(w + 1) - StripeBegin(w); }
+    };
+
+    Matrix<ElemType>& CPUValues(const std::vector<Matrix<ElemType>*>& values, size_t i)
+    {
+        return m_entries[i].m_cpuValues ? *m_entries[i].m_cpuValues : *values[i];
+    }
+
+    void Initialize(const std::vector<Matrix<ElemType>*>& values)
+    {
+        m_initialized = true;
+        size_t numWorkers = m_mpi->NumNodesInUse();
+        size_t myRank = m_mpi->CurrentNodeRank();
+
+        m_entries.resize(values.size());
+        size_t uncompressedSize = 0;
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            if (values[i]->GetMatrixType() != DENSE)
+                RuntimeError("Gradient aggregation for sparse gradient matrices is currently unsupported!");
+
+            auto& entry = m_entries[i];
+            entry.m_numRows = values[i]->GetNumRows();
+            entry.m_numCols = values[i]->GetNumCols();
+            entry.m_numWorkers = numWorkers;
+            entry.m_compressed = entry.m_numRows * entry.m_numCols >= MinNumElementsToCompress;
+            entry.m_uncompressedOffset = uncompressedSize;
+            if (!entry.m_compressed)
+                uncompressedSize += entry.m_numRows * entry.m_numCols;
+
+            if (values[i]->GetDeviceId() != CPUDEVICE)
+                entry.m_cpuValues.reset(new Matrix<ElemType>(entry.m_numRows, entry.m_numCols, CPUDEVICE));
+            if (entry.m_compressed)
+            {
+                entry.m_residual.reset(new Matrix<ElemType>(Matrix<ElemType>::Zeros(entry.m_numRows, entry.m_numCols, CPUDEVICE)));
+                entry.m_aggregatedStripe.reset(new Matrix<ElemType>(entry.m_numRows, entry.StripeNumCols(myRank), CPUDEVICE));
+                entry.m_stripeResidual.reset(new Matrix<ElemType>(Matrix<ElemType>::Zeros(entry.m_numRows, entry.StripeNumCols(myRank), CPUDEVICE)));
+            }
+        }
+        m_uncompressedBuffer.resize(uncompressedSize);
+
+        // message sizes are a function of the matrix dimensions only, so all workers can compute them up front
+        m_sendCounts.assign(numWorkers, 0);
+        m_recvCounts.assign(numWorkers, 0);
+        m_gatherCounts.assign(numWorkers, 0);
+        for (size_t w = 0; w < numWorkers; w++)
+        {
+            size_t sendCount = 0, gatherCount = 0;
+            for (auto& entry : m_entries)
+            {
+                if (!entry.m_compressed)
+                    continue;
+                sendCount += m_compressor->MessageSize(entry.m_numRows, entry.StripeNumCols(w));
+                gatherCount += m_stripeCompressor->MessageSize(entry.m_numRows, entry.StripeNumCols(w));
+            }
+            if (sendCount > INT_MAX || gatherCount * numWorkers > INT_MAX)
+                RuntimeError("CompressedAllReducer: The compressed gradients exceed the MPI message size limit.");
+            m_sendCounts[w] = (int) sendCount;
+            m_gatherCounts[w] = (int) gatherCount;
+        }
+        // we receive our own stripe from every worker
+        m_recvCounts.assign(numWorkers, m_sendCounts[myRank]);
+
+        auto exclusiveScan = [](const std::vector<int>& counts, std::vector<int>& offsets)
+        {
+            offsets.assign(counts.size(), 0);
+            for (size_t w = 1; w < counts.size(); w++)
+                offsets[w] = offsets[w - 1] + counts[w - 1];
+            return (size_t) (counts.empty() ? 0 : offsets.back() + counts.back());
+        };
+        m_sendBuffer.resize(exclusiveScan(m_sendCounts, m_sendOffsets));
+        m_recvBuffer.resize(exclusiveScan(m_recvCounts, m_recvOffsets));
+        m_gatherRecvBuffer.resize(exclusiveScan(m_gatherCounts, m_gatherOffsets));
+        m_gatherSendBuffer.resize(m_gatherCounts[myRank]);
+    }
+
+    MPIWrapperPtr m_mpi;
+    GradientCompressionOptions m_options;
+    bool m_initialized;
+    std::unique_ptr<GradientCompressor<ElemType>> m_compressor;       // for our gradients
+    std::unique_ptr<GradientCompressor<ElemType>> m_stripeCompressor; // for the aggregated stripes
+
+    std::vector<Entry> m_entries;
+    std::vector<ElemType> m_uncompressedBuffer;
+    std::vector<char> m_sendBuffer, m_recvBuffer, m_gatherSendBuffer, m_gatherRecvBuffer;
+    std::vector<int> m_sendCounts, m_sendOffsets, m_recvCounts, m_recvOffsets, m_gatherCounts, m_gatherOffsets;
+};
+
+}}}
@@ -19,6 +19,17 @@ public:
     // Returns a boolean indicating if any samples were processed
     virtual bool AggregateGradients(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, bool resetState) = 0;
 
+    // Aggregators that overlap the aggregation with backprop return true here. SGD then passes the gradients to
+    // AggregateGradients() in reverse evaluation order, and reports each of them through GradientComputed()
+    // as soon as backprop has finished computing it.
+    virtual bool OverlapsWithBackprop() const
+    {
+        return false;
+    }
+
+    virtual void GradientComputed(Matrix<ElemType>* /*gradient*/)
+    {}
+
     size_t NumProc()
     {
         return m_mpi->NumNodesInUse();
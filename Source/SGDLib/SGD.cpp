@@ -31,6 +31,8 @@
 #include "ASGDHelper.h"
 
 #include "SimpleDistGradAggregator.h"
+#include "BucketedDistGradAggregator.h"
+#include "CompressedDistGradAggregator.h"
 #include "V2SimpleDistGradAggregator.h"
 #include "ProgressTracing.h"
 #include "PerformanceProfiler.h"
@@ -898,6 +900,7 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
     }
 
     std::vector<Matrix<ElemType>*> learnParamsGradients;
+    std::unordered_map<const ComputationNodeBase*, Matrix<ElemType>*> gradientOfNode; // for aggregators that overlap with backprop
     Profiler profiler(m_numMBsToCUDAProfile);
 
     // resetting this, so profiling is performed for one epoch only
@@ -951,6 +954,8 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
 
             if (m_bufferedAsyncGradientAggregation)
                 fprintf(stderr, ", BufferedAsyncGradientAggregation is ENABLED");
+            if (m_bucketedGradientAggregation)
+                fprintf(stderr, ", BucketedGradientAggregation is ENABLED");
         }
 
         if (useAsyncGradientAggregation)
@@ -994,6 +999,10 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
     EpochCriterion         epochCriterionLastLogged  = epochCriterion;
     vector<EpochCriterion> epochEvalErrorsLastLogged = epochEvalErrors;
 
+    // gap frames and columns of the minibatch layouts since last logged, to report the padding efficiency
+    size_t numGapFramesSinceLastLogged = 0;
+    size_t numColsSinceLastLogged = 0;
+
     // NOTE: For ResNet, the regularization in BatchNormalization should be disabled.
     if (m_disableRegInBatchNormalization) {
         let bnNodes = net->GetNodesWithType(L"BatchNormalization");
@@ -1047,6 +1056,20 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
             actualMBSize = 0; // (undefined if !wasDataRead)
             ProfilerEnable(false); // Profiler will be enabled at the beginning of the next epoch.
         }
+        else
+        {
+            // account for the padding of each distinct layout (inputs often share one)
+            std::set<MBLayoutPtr> layouts;
+            for (const auto& input : *inputMatrices)
+            {
+                const auto& pMBLayout = input.second.pMBLayout;
+                if (pMBLayout && layouts.insert(pMBLayout).second)
+                {
+                    numGapFramesSinceLastLogged += pMBLayout->GetNumGapFrames();
+                    numColsSinceLastLogged += pMBLayout->GetNumCols();
+                }
+            }
+        }
 
         ProfilerTimeEnd(profGetMinibatch, profilerEvtMainGetMinibatch);
         auto profForwardBackward = ProfilerTimeBegin();
@@ -1116,7 +1139,21 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
                 // ===========================================================
 
                 if (learnRatePerSample > 0.01 * m_minLearnRate) // only compute gradient when learning rate is large enough
-                    net->Backprop(criterionNodes[0]);
+                {
+                    // If the aggregator overlaps with backprop, report each parameter gradient as soon as it is final,
+                    // which is only the case in the last sub-minibatch.
+                    if (!gradientOfNode.empty() && ismb + 1 == actualNumSubminibatches)
+                    {
+                        net->Backprop(criterionNodes[0], [&](const ComputationNodeBasePtr& node)
+                        {
+                            auto iter = gradientOfNode.find(node.get());
+                            if (iter != gradientOfNode.end())
+                                m_distGradAgg->GradientComputed(iter->second);
+                        });
+                    }
+                    else
+                        net->Backprop(criterionNodes[0]);
+                }
 
                 // house-keeping for sub-minibatching
                 if (actualNumSubminibatches > 1)
@@ -1165,8 +1202,23 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
             if (learnParamsGradients.size() == 0)
             {
                 // lazily form the list of smoothedGradients to exchange
+                // An aggregator that overlaps with backprop expects them in the order in which backprop completes them.
+                std::list<ComputationNodeBasePtr> aggregatedNodes;
+                if (m_distGradAgg->OverlapsWithBackprop())
+                {
+                    std::set<ComputationNodeBasePtr> learnableNodeSet(learnableNodes.begin(), learnableNodes.end());
+                    const auto& evalOrder = net->GetEvalOrder(criterionNodes[0]);
+                    for (auto nodeIter = evalOrder.rbegin(); nodeIter != evalOrder.rend(); nodeIter++)
+                    {
+                        if (learnableNodeSet.find(*nodeIter) != learnableNodeSet.end())
+                            aggregatedNodes.push_back(*nodeIter);
+                    }
+                }
+                else
+                    aggregatedNodes = learnableNodes;
+
                 learnParamsGradients.reserve(learnableNodes.size());
-                for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++)
+                for (auto nodeIter = aggregatedNodes.begin(); nodeIter != aggregatedNodes.end(); nodeIter++)
                 {
                     ComputationNodePtr node = dynamic_pointer_cast<ComputationNode<ElemType>>(*nodeIter);
                     if (node->IsParameterUpdateRequired())
@@ -1182,6 +1234,8 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
                         }
 
                         learnParamsGradients.push_back(currParamsGradient);
+                        if (m_distGradAgg->OverlapsWithBackprop())
+                            gradientOfNode[node.get()] = currParamsGradient;
                     }
                 }
             }
@@ -1388,6 +1442,10 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
                     }
                 }
 
+                // only sequence minibatches have gaps; their fraction of actual frames is the padding efficiency
+                if (numGapFramesSinceLastLogged > 0)
+                    fprintf(stderr, "paddingEfficiency = %.1f%%; ", 100.0 * (numColsSinceLastLogged - numGapFramesSinceLastLogged) / numColsSinceLastLogged);
+
                 fprintf(stderr, ("time = " + GeneratePaddedFloatOrExpFormat(0, 4, totalTimeInMBs) + "s; samplesPerSecond = %.1f\n").c_str(),
                         totalTimeInMBs, trainSamplesSinceLastLogged / totalTimeInMBs);
             }
@@ -1406,6 +1464,8 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
             epochCriterionLastLogged  = epochCriterion;
             epochEvalErrorsLastLogged = epochEvalErrors;
             numMBsRunSinceLastLogged = numMBsRun;
+            numGapFramesSinceLastLogged = 0;
+            numColsSinceLastLogged = 0;
             for (size_t i = 0; i < epochEvalErrors.size(); i++)
             {
                 if (ContainsAccumulatedResult(evaluationNodes[i]))
@@ -2077,7 +2137,17 @@ void SGD<ElemType>::InitDistGradAgg(int numEvalNodes, int numGradientBits, int d
 {
     assert(GetParallelizationMethod() == ParallelizationMethod::dataParallelSGD);
 
-    if (numGradientBits != (8 * sizeof(ElemType)))
+    if (m_gradientCompression.m_type != GradientCompressionType::None)
+    {
+        // gradientBits selects the number of bits of the quantization compressor
+        GradientCompressionOptions options = m_gradientCompression;
+        if (numGradientBits != (8 * sizeof(ElemType)))
+            options.m_numQuantizationBits = numGradientBits;
+        if (traceLevel > 0)
+            fprintf(stderr, "Initializing dataParallelSGD with compressed gradient aggregation.\n");
+        m_distGradAgg = std::make_shared<CompressedDistGradAggregator<ElemType>>(m_mpi, options, m_syncStatsTrace);
+    }
+    else if (numGradientBits != (8 * sizeof(ElemType)))
     {
         if (traceLevel > 0)
             fprintf(stderr, "Initializing dataParallelSGD for %d-bit quantization.\n", numGradientBits);
@@ -2097,10 +2167,22 @@ void SGD<ElemType>::InitDistGradAgg(int numEvalNodes, int numGradientBits, int d
     {
         if (traceLevel > 0)
             fprintf(stderr, "Initializing dataParallelSGD with FP%d aggregation.\n", numGradientBits);
-        if (Globals::UseV2Aggregator()) // Currently used to check V2 against baselines.
-            m_distGradAgg = std::make_shared<V2SimpleDistGradAggregator<ElemType>>(m_mpi, m_bufferedAsyncGradientAggregation, deviceId, m_syncStatsTrace, ::CNTK::MPICommunicator());
+        if (m_hierarchicalGradientAggregation && traceLevel > 0)
+            fprintf(stderr, "Using hierarchical gradient aggregation.\n");
+        if (m_bucketedGradientAggregation)
+        {
+            if (traceLevel > 0)
+                fprintf(stderr, "Using bucketed gradient aggregation with a bucket size of %d bytes.\n", (int) m_gradientAggregationBucketSize);
+            m_distGradAgg = std::make_shared<BucketedDistGradAggregator<ElemType>>(m_mpi, m_gradientAggregationBucketSize, deviceId, m_syncStatsTrace);
+        }
+        else if (Globals::UseV2Aggregator()) // Currently used to check V2 against baselines.
+        {
+            auto communicator = m_hierarchicalGradientAggregation ? ::CNTK::HierarchicalMPICommunicator(m_hierarchicalAggregationRanksPerHost) : ::CNTK::MPICommunicator();
+            m_distGradAgg = std::make_shared<V2SimpleDistGradAggregator<ElemType>>(m_mpi, m_bufferedAsyncGradientAggregation, deviceId, m_syncStatsTrace, communicator);
+        }
         else
-            m_distGradAgg = std::make_shared<SimpleDistGradAggregator<ElemType>>(m_mpi, m_bufferedAsyncGradientAggregation, deviceId, m_syncStatsTrace);
+            m_distGradAgg = std::make_shared<SimpleDistGradAggregator<ElemType>>(m_mpi, m_bufferedAsyncGradientAggregation, deviceId, m_syncStatsTrace,
+                                                                                 m_hierarchicalGradientAggregation, m_hierarchicalAggregationRanksPerHost);
     }
 
     m_gradHeader.reset(DistGradHeader::Create(numEvalNodes), [](DistGradHeader* ptr) { DistGradHeader::Destroy(ptr); });
@@ -2893,6 +2975,10 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     m_numGradientBits = vector<int>{8 * (int)sizeofElemType}; // means no quantization
     m_zeroThresholdFor1Bit = true;
     m_bufferedAsyncGradientAggregation = false;
+    m_bucketedGradientAggregation = false;
+    m_gradientAggregationBucketSize = 0;
+    m_hierarchicalGradientAggregation = false;
+    m_hierarchicalAggregationRanksPerHost = 0;
     m_enableDistributedMBReading = false;
     m_parallelizationStartEpochNum = 0;
     m_modelAggregationBlockSize = 0; 
@@ -2926,11 +3012,31 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
             m_numGradientBits = configDataParallelSGD(L"gradientBits", ConfigRecordType::Array(intargvector(vector<int>{defaultGradientBits})));
             m_zeroThresholdFor1Bit = configDataParallelSGD(L"useZeroThresholdFor1BitQuantization", true);
             m_bufferedAsyncGradientAggregation = configDataParallelSGD(L"useBufferedAsyncGradientAggregation", false);
+            m_bucketedGradientAggregation = configDataParallelSGD(L"useBucketedGradientAggregation", false);
+            double gradientBucketSizeInMB = configDataParallelSGD(L"gradientBucketSizeInMB", 16.0);
+            m_gradientAggregationBucketSize = (size_t) (gradientBucketSizeInMB * 1024 * 1024);
+            m_hierarchicalGradientAggregation = configDataParallelSGD(L"useHierarchicalAggregation", false);
+            m_hierarchicalAggregationRanksPerHost = configDataParallelSGD(L"hierarchicalAggregationRanksPerHost", (size_t) 0);
             for (size_t i = 0; i < m_numGradientBits.size(); i++)
             {
                 if (m_numGradientBits[i] < 1 || m_numGradientBits[i] > defaultGradientBits)
                     InvalidArgument("gradientBits values must be in the range [1, 32] when using precision=float and in range [1, 64] when using precision=double.");
+                if (m_bucketedGradientAggregation && m_numGradientBits[i] != defaultGradientBits)
+                    InvalidArgument("useBucketedGradientAggregation is only supported without gradient quantization (gradientBits = %d).", defaultGradientBits);
+                if (m_hierarchicalGradientAggregation && m_numGradientBits[i] != defaultGradientBits)
+                    InvalidArgument("useHierarchicalAggregation is only supported without gradient quantization (gradientBits = %d).", defaultGradientBits);
             }
+            m_gradientCompression.m_type = ParseGradientCompressionType(configDataParallelSGD(L"gradientCompression", L"none"));
+            m_gradientCompression.m_zeroThresholdFor1Bit = m_zeroThresholdFor1Bit;
+            m_gradientCompression.m_topKFraction = configDataParallelSGD(L"gradientCompressionTopKFraction", 0.01);
+            if (m_gradientCompression.m_type != GradientCompressionType::None && (m_bucketedGradientAggregation || m_bufferedAsyncGradientAggregation))
+                InvalidArgument("gradientCompression cannot be combined with useBucketedGradientAggregation or useBufferedAsyncGradientAggregation.");
+            if (m_bucketedGradientAggregation && m_bufferedAsyncGradientAggregation)
+                InvalidArgument("useBucketedGradientAggregation and useBufferedAsyncGradientAggregation cannot be combined.");
+            if (m_bucketedGradientAggregation && m_gradientAggregationBucketSize == 0)
+                InvalidArgument("gradientBucketSizeInMB must be greater than 0.");
+            if (m_hierarchicalGradientAggregation && (m_gradientCompression.m_type != GradientCompressionType::None || m_bucketedGradientAggregation))
+                InvalidArgument("useHierarchicalAggregation cannot be combined with gradientCompression or useBucketedGradientAggregation.");
         }
         if (configParallelTrain.Exists(L"ModelAveragingSGD"))
         {
@@ -20,6 +20,7 @@
 #include "Profiler.h"
 #include "MASGD.h"
 #include "ASGDHelper.h"
+#include "GradientCompression.h"
 using namespace std; // ugh! TODO: get rid of this from .h files!!!
 
 #define CNTK_CHECKPOINT_VERSION_1 1     // 1 -> no version number 
@@ -272,6 +273,11 @@ protected:
     // Data parallel SGD training parameters
     intargvector m_numGradientBits;
     bool m_bufferedAsyncGradientAggregation;
+    bool m_bucketedGradientAggregation;       // aggregate in buckets of gradients, overlapped with backprop
+    size_t m_gradientAggregationBucketSize;   // in bytes
+    GradientCompressionOptions m_gradientCompression; // compressed aggregation with error feedback, if m_type != None
+    bool m_hierarchicalGradientAggregation;   // aggregate through shared memory within a host, then across hosts
+    size_t m_hierarchicalAggregationRanksPerHost; // 0: group ranks by physical host; > 0: pseudo-hosts of this many ranks (for testing)
     bool m_zeroThresholdFor1Bit;
 
     // Parallel training related with MA / BM
@@ -13,6 +13,7 @@
 #include "GPUDataTransferer.h"
 #include "TimerUtility.h"
 #include "MatrixQuantizerImpl.h"
+#include "HierarchicalAllReducer.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -22,9 +23,14 @@ class SimpleDistGradAggregator : public IDistGradAggregator<ElemType>
     UsingIDistGradAggregatorMembers;
 
 public:
-    SimpleDistGradAggregator(const MPIWrapperPtr& mpi, bool useAsyncAggregation, int deviceId, int syncStatsTrace)
+    SimpleDistGradAggregator(const MPIWrapperPtr& mpi, bool useAsyncAggregation, int deviceId, int syncStatsTrace, bool useHierarchicalAggregation = false, size_t ranksPerHost = 0,
+                             size_t hierarchicalSegmentSizeInBytes = HierarchicalAllReducer::DefaultMaxSegmentSizeInBytes)
         : IDistGradAggregator<ElemType>(mpi), m_useAsyncAggregation(useAsyncAggregation), m_initialized(false), m_bufferedGradHeader(nullptr), m_syncStatsTrace(syncStatsTrace), m_iterationCount(0), m_nccl(deviceId, mpi)
-    {}
+    {
+        // NCCL already takes the fastest path within a host
+        if (useHierarchicalAggregation && !m_nccl.IsSupported())
+            m_hierarchicalAllReducer = std::make_unique<HierarchicalAllReducer>(mpi, ranksPerHost, hierarchicalSegmentSizeInBytes);
+    }
 
     ~SimpleDistGradAggregator()
     {
@@ -249,7 +255,32 @@ private:
 
         // Perform async allreduce on the gradient data
         std::vector<MPI_Request> allReduceRequests(numGradMatrices);
-        if (!m_nccl.IsSupported())
+        if (m_hierarchicalAllReducer)
+        {
+            // The hierarchical allreduce is blocking; the header exchange proceeds meanwhile
+            std::vector<std::pair<ElemType*, size_t>> reductionBuffers(numGradMatrices);
+            for (size_t i = 0; i < numGradMatrices; ++i)
+            {
+                ElemType* reductionBuffer = gradients[i]->Data();
+                if (deviceId >= 0)
+                {
+                    m_gpuDataTransferers[i]->WaitForCopyGPUToCPUAsync();
+                    reductionBuffer = m_intermediateCPUBuffers[i].get();
+                }
+                reductionBuffers[i] = std::make_pair(reductionBuffer, gradients[i]->GetNumElements());
+            }
+
+            m_hierarchicalAllReducer->AllReduce(reductionBuffers);
+            if (showSyncPerfStats)
+                m_hierarchicalAllReducer->PrintPhaseTimes(stderr);
+
+            if (deviceId >= 0)
+            {
+                for (size_t i = 0; i < numGradMatrices; ++i)
+                    m_gpuDataTransferers[i]->CopyCPUToGPUAsync(m_intermediateCPUBuffers[i].get(), gradients[i]->GetNumElements(), gradients[i]->Data());
+            }
+        }
+        else if (!m_nccl.IsSupported())
         {
             for (size_t i = 0; i < numGradMatrices; ++i)
             {
@@ -308,7 +339,7 @@ private:
         }
 
         // Wait for the allreduce operations to finish and initiate transfer back to the GPU if needed
-        if (!m_nccl.IsSupported())
+        if (!m_nccl.IsSupported() && !m_hierarchicalAllReducer)
         {
             for (size_t i = 0; i < numGradMatrices; ++i)
             {
@@ -371,5 +402,8 @@ private:
     bool m_initialized;
 
     NcclComm m_nccl;
+
+    // Two-level aggregation through shared memory within a host, if enabled
+    std::unique_ptr<HierarchicalAllReducer> m_hierarchicalAllReducer;
 };
 } } }
@@ -18,6 +18,7 @@
 #include <cstdio>
 #include "ProgressTracing.h"
 #include "ComputationNetworkBuilder.h"
+#include "BinaryOutputWriter.h"
 
 using namespace std;
 
@@ -288,6 +289,57 @@ public:
             iter.second->Flush();
     }
 
+    // Write the outputs as binary files outputPath.nodeName (see BinaryOutputWriter.h for the format).
+    // Unlike the text output, formatting and writing run on a background thread while the next minibatch is evaluated.
+    void WriteBinaryOutput(IDataReader& dataReader, size_t mbSize, std::wstring outputPath, const std::vector<std::wstring>& outputNodeNames, bool halfPrecision, size_t numOutputSamples = requestDataSize)
+    {
+        ScopedNetworkOperationMode modeGuard(m_net, NetworkOperationMode::inferring);
+
+        if (outputPath == L"-")
+            InvalidArgument("WriteBinaryOutput: Binary output cannot be written to stdout.");
+
+        std::vector<ComputationNodeBasePtr> outputNodes = m_net->OutputNodesByName(outputNodeNames);
+        std::vector<ComputationNodeBasePtr> inputNodes = m_net->InputNodesForOutputs(outputNodeNames);
+
+        m_net->AllocateAllMatrices({}, outputNodes, nullptr);
+
+        StreamMinibatchInputs inputMatrices = DataReaderHelpers::RetrieveInputMatrices(inputNodes);
+
+        File::MakeIntermediateDirs(outputPath);
+        std::vector<std::wstring> outputPaths;
+        for (auto& onode : outputNodes)
+            outputPaths.push_back(outputPath + L"." + onode->NodeName());
+        BinaryOutputWriter<ElemType> binaryWriter(outputNodes, outputPaths, halfPrecision ? BinaryOutputWriter<ElemType>::Precision::Half : BinaryOutputWriter<ElemType>::Precision::Float);
+
+        dataReader.StartMinibatchLoop(mbSize, 0, inputMatrices.GetStreamDescriptions(), numOutputSamples);
+        m_net->StartEvaluateMinibatchLoop(outputNodes);
+
+        size_t totalEpochSamples = 0;
+        size_t actualMBSize;
+        const size_t numIterationsBeforePrintingProgress = 100;
+        size_t numItersSinceLastPrintOfProgress = 0;
+        for (size_t numMBsRun = 0; DataReaderHelpers::GetMinibatchIntoNetwork<ElemType>(dataReader, m_net, nullptr, false, false, inputMatrices, actualMBSize, nullptr); numMBsRun++)
+        {
+            ComputationNetwork::BumpEvalTimeStamp(inputNodes);
+            m_net->ForwardProp(outputNodes);
+
+            binaryWriter.Write(); // copies the values; writing overlaps with the next minibatch
+            totalEpochSamples += actualMBSize;
+
+            if (m_verbosity > 1)
+                fprintf(stderr, "Minibatch[%lu]: ActualMBSize = %lu\n", (unsigned long)numMBsRun, (unsigned long)actualMBSize);
+
+            numItersSinceLastPrintOfProgress = ProgressTracing::TraceFakeProgress(numIterationsBeforePrintingProgress, numItersSinceLastPrintOfProgress);
+
+            // call DataEnd function in dataReader to do
+            // reader specific process if sentence ending is reached
+            dataReader.DataEnd();
+        }
+        binaryWriter.Close();
+
+        fprintf(stderr, "Written to %ls*\nTotal Samples Evaluated = %lu\n", outputPath.c_str(), (unsigned long)totalEpochSamples);
+    }
+
 private:
     ComputationNetworkPtr m_net;
     int m_verbosity;
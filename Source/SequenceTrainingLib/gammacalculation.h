@@ -10,6 +10,7 @@
 
 #include <memory>
 #include <vector>
+#include <exception>
 
 #pragma warning(disable : 4127) // conditional expression is constant
 
@@ -100,7 +101,6 @@ public:
     {
         // check total frame number to be added ?
         // int deviceid = loglikelihood.GetDeviceId();
-        size_t boundaryframenum;
         std::vector<size_t> validframes; // [s] cursor pointing to next utterance begin within a single parallel sequence [s]
         validframes.assign(samplesInRecurrentStep, 0);
         ElemType objectValue = 0.0;
@@ -126,31 +126,19 @@ public:
             assert(T == pMBLayout->GetNumTimeSteps());
         }
 
-        size_t mapi = 0; // parallel-sequence index for utterance [i]
-        // cal gamma for each utterance
+        // determine where each utterance lives in the minibatch
+        std::vector<utterancespan> spans(lattices.size());
         size_t ts = 0;
         for (size_t i = 0; i < lattices.size(); i++)
         {
             const size_t numframes = lattices[i]->getnumframes();
+            spans[i].ts = ts;
+            spans[i].numframes = numframes;
 
-            msra::dbn::matrixstripe predstripe(pred, ts, numframes);           // logLLs for this utterance
-            msra::dbn::matrixstripe dengammasstripe(dengammas, ts, numframes); // denominator gammas
-
-            if (samplesInRecurrentStep == 1) // no sequence parallelism
-            {
-                tempmatrix = loglikelihood.ColumnSlice(ts, numframes);
-                // if (m_deviceid == CPUDEVICE)
-                {
-                    CopyFromCNTKMatrixToSSEMatrix(tempmatrix, numframes, predstripe);
-                }
-
-                if (m_deviceid != CPUDEVICE)
-                    parallellattice.setloglls(tempmatrix);
-            }
-            else // multiple parallel sequences
+            if (samplesInRecurrentStep > 1) // multiple parallel sequences
             {
                 // get number of frames for the utterance
-                mapi = extrauttmap[i]; // parallel-sequence index; in case of >1 utterance within this parallel sequence, this is in order of concatenation
+                size_t mapi = extrauttmap[i]; // parallel-sequence index; in case of >1 utterance within this parallel sequence, this is in order of concatenation
 
                 // scan MBLayout for end of utterance
                 size_t mapframenum = SIZE_MAX; // duration of utterance [i] as determined from MBLayout
@@ -169,88 +157,170 @@ public:
                     LogicError("gammacalculation: IsEnd() not working, numframes (%d) vs. mapframenum (%d)", (int) numframes, (int) mapframenum);
                 assert(numframes == mapframenum);
 
-                if (numframes > tempmatrix.GetNumCols())
-                    tempmatrix.Resize(numrows, numframes);
-
-                Microsoft::MSR::CNTK::Matrix<ElemType> loglikelihoodForCurrentParallelUtterance = loglikelihood.ColumnSlice(mapi + (validframes[mapi] * samplesInRecurrentStep), ((numframes - 1) * samplesInRecurrentStep) + 1);
-                tempmatrix.CopyColumnsStrided(loglikelihoodForCurrentParallelUtterance, numframes, samplesInRecurrentStep, 1);
+                spans[i].mapi = mapi;
+                spans[i].firstframe = validframes[mapi];
+                validframes[mapi] += numframes; // advance the cursor within the parallel sequence
+            }
+            ts += numframes;
+        }
 
-                // if (doreferencealign || m_deviceid == CPUDEVICE)
+        if (m_deviceid == CPUDEVICE)
+        {
+            // On the CPU, the utterances of the minibatch are independent of each other and are processed concurrently.
+            // Only the lattice forward-backward runs in parallel; the copies in and out share buffers and are done serially.
+            // With a single utterance, the edges of its lattice are processed in parallel instead (see lattice::forwardbackwardalign()).
+            for (size_t i = 0; i < lattices.size(); i++)
+                getloglls(spans[i], loglikelihood, samplesInRecurrentStep, tempmatrix);
+
+            std::vector<std::exception_ptr> errors(lattices.size());
+#pragma omp parallel for schedule(dynamic) if (lattices.size() > 1)
+            for (int i = 0; i < (int) lattices.size(); i++)
+            {
+                try
                 {
-                    CopyFromCNTKMatrixToSSEMatrix(tempmatrix, numframes, predstripe);
+                    forwardbackwardutterance(*lattices[i], spans[i], uids, boundaries, doreferencealign);
                 }
-
-                if (m_deviceid != CPUDEVICE)
+                catch (...)
                 {
-                    parallellattice.setloglls(tempmatrix);
+                    errors[i] = std::current_exception();
                 }
             }
-
-            array_ref<size_t> uidsstripe(&uids[ts], numframes);
-
-            if (doreferencealign)
+            for (const auto& error : errors)
             {
-                boundaryframenum = numframes;
+                if (error)
+                    std::rethrow_exception(error);
             }
-            else
-                boundaryframenum = 0;
-            array_ref<size_t> boundariesstripe(&boundaries[ts], boundaryframenum);
 
-            double numavlogp = 0;
-            foreach_column (t, dengammasstripe) // we do not allocate memory for numgamma now, should be the same as numgammasstripe
+            for (size_t i = 0; i < lattices.size(); i++)
             {
-                const size_t s = uidsstripe[t];
-                numavlogp += predstripe(s, t) / amf;
+                putgammas(spans[i], gammafromlattice, labels, uids, samplesInRecurrentStep, doreferencealign, tempmatrix);
+                objectValue += (ElemType)((spans[i].numavlogp - spans[i].denavlogp) * spans[i].numframes);
             }
-            numavlogp /= numframes;
-
-            // auto_timer dengammatimer;
-            double denavlogp = lattices[i]->second.forwardbackward(parallellattice,
-                                                                   (const msra::math::ssematrixbase&) predstripe, (const msra::asr::simplesenonehmm&) m_hset,
-                                                                   (msra::math::ssematrixbase&) dengammasstripe, (msra::math::ssematrixbase&) gammasbuffer /*empty, not used*/,
-                                                                   lmf, wp, amf, boostmmifactor, seqsMBRmode, uidsstripe, boundariesstripe);
-            objectValue += (ElemType)((numavlogp - denavlogp) * numframes);
-
-            if (samplesInRecurrentStep == 1)
+        }
+        else // GPU: the lattices share the device state in 'parallellattice' and must be processed one at a time
+        {
+            for (size_t i = 0; i < lattices.size(); i++)
             {
-                tempmatrix = gammafromlattice.ColumnSlice(ts, numframes);
+                getloglls(spans[i], loglikelihood, samplesInRecurrentStep, tempmatrix);
+                forwardbackwardutterance(*lattices[i], spans[i], uids, boundaries, doreferencealign);
+                putgammas(spans[i], gammafromlattice, labels, uids, samplesInRecurrentStep, doreferencealign, tempmatrix);
+                objectValue += (ElemType)((spans[i].numavlogp - spans[i].denavlogp) * spans[i].numframes);
             }
+        }
+        functionValues.SetValue(objectValue);
+    }
 
-            // copy gamma to tempmatrix
-            if (m_deviceid == CPUDEVICE)
-            {
-                CopyFromSSEMatrixToCNTKMatrix(dengammas, numrows, numframes, tempmatrix, gammafromlattice.GetDeviceId());
-            }
-            else
-                parallellattice.getgamma(tempmatrix);
+private:
+    // location of one utterance within the minibatch, and its results
+    struct utterancespan
+    {
+        size_t ts;         // first column in pred/dengammas (utterances are stored consecutively there)
+        size_t numframes;  // number of frames of the utterance
+        size_t mapi;       // parallel-sequence index (if multiple parallel sequences)
+        size_t firstframe; // first time step within the parallel sequence (if multiple parallel sequences)
+        double numavlogp;  // numerator (reference) average log likelihood
+        double denavlogp;  // result of lattice forward-backward
+        utterancespan()
+            : ts(0), numframes(0), mapi(0), firstframe(0), numavlogp(0), denavlogp(0)
+        {
+        }
+    };
 
-            // set gamma for multi channel
-            if (samplesInRecurrentStep > 1)
-            {
-                Microsoft::MSR::CNTK::Matrix<ElemType> gammaFromLatticeForCurrentParallelUtterance = gammafromlattice.ColumnSlice(mapi + (validframes[mapi] * samplesInRecurrentStep), ((numframes - 1) * samplesInRecurrentStep) + 1);
-                gammaFromLatticeForCurrentParallelUtterance.CopyColumnsStrided(tempmatrix, numframes, 1, samplesInRecurrentStep);
-            }
+    // copy the log likelihoods of one utterance into 'pred' (and to the GPU if in GPU mode)
+    void getloglls(const utterancespan& span, const Microsoft::MSR::CNTK::Matrix<ElemType>& loglikelihood, size_t samplesInRecurrentStep,
+                   Microsoft::MSR::CNTK::Matrix<ElemType>& tempmatrix)
+    {
+        const size_t numframes = span.numframes;
+        msra::dbn::matrixstripe predstripe(pred, span.ts, numframes); // logLLs for this utterance
+
+        if (samplesInRecurrentStep == 1) // no sequence parallelism
+        {
+            tempmatrix = loglikelihood.ColumnSlice(span.ts, numframes);
+        }
+        else // multiple parallel sequences
+        {
+            if (numframes > tempmatrix.GetNumCols())
+                tempmatrix.Resize(loglikelihood.GetNumRows(), numframes);
+
+            Microsoft::MSR::CNTK::Matrix<ElemType> loglikelihoodForCurrentParallelUtterance = loglikelihood.ColumnSlice(span.mapi + (span.firstframe * samplesInRecurrentStep), ((numframes - 1) * samplesInRecurrentStep) + 1);
+            tempmatrix.CopyColumnsStrided(loglikelihoodForCurrentParallelUtterance, numframes, samplesInRecurrentStep, 1);
+        }
+
+        CopyFromCNTKMatrixToSSEMatrix(tempmatrix, numframes, predstripe);
+
+        if (m_deviceid != CPUDEVICE)
+            parallellattice.setloglls(tempmatrix);
+    }
+
+    // run the lattice forward-backward for one utterance, writing its gammas into 'dengammas'
+    // This only touches the columns of this utterance and is safe to call for several utterances concurrently in CPU mode.
+    void forwardbackwardutterance(const msra::dbn::latticepair& lattice, utterancespan& span,
+                                  std::vector<size_t>& uids, std::vector<size_t>& boundaries, bool doreferencealign)
+    {
+        const size_t numframes = span.numframes;
+        msra::dbn::matrixstripe predstripe(pred, span.ts, numframes);           // logLLs for this utterance
+        msra::dbn::matrixstripe dengammasstripe(dengammas, span.ts, numframes); // denominator gammas
+
+        array_ref<size_t> uidsstripe(&uids[span.ts], numframes);
+        array_ref<size_t> boundariesstripe(&boundaries[span.ts], doreferencealign ? numframes : 0);
 
-            if (doreferencealign)
+        double numavlogp = 0;
+        foreach_column (t, dengammasstripe) // we do not allocate memory for numgamma now, should be the same as numgammasstripe
+        {
+            const size_t s = uidsstripe[t];
+            numavlogp += predstripe(s, t) / amf;
+        }
+        span.numavlogp = numavlogp / numframes;
+
+        // auto_timer dengammatimer;
+        span.denavlogp = lattice.second.forwardbackward(parallellattice,
+                                                        (const msra::math::ssematrixbase&) predstripe, (const msra::asr::simplesenonehmm&) m_hset,
+                                                        (msra::math::ssematrixbase&) dengammasstripe, (msra::math::ssematrixbase&) gammasbuffer /*empty, not used*/,
+                                                        lmf, wp, amf, boostmmifactor, seqsMBRmode, uidsstripe, boundariesstripe);
+    }
+
+    // copy the gammas of one utterance into the CNTK matrix, and set the reference labels if requested
+    void putgammas(const utterancespan& span, Microsoft::MSR::CNTK::Matrix<ElemType>& gammafromlattice, Microsoft::MSR::CNTK::Matrix<ElemType>& labels,
+                   const std::vector<size_t>& uids, size_t samplesInRecurrentStep, bool doreferencealign,
+                   Microsoft::MSR::CNTK::Matrix<ElemType>& tempmatrix)
+    {
+        const size_t numframes = span.numframes;
+        msra::dbn::matrixstripe dengammasstripe(dengammas, span.ts, numframes); // denominator gammas
+
+        if (samplesInRecurrentStep == 1)
+        {
+            tempmatrix = gammafromlattice.ColumnSlice(span.ts, numframes);
+        }
+
+        // copy gamma to tempmatrix
+        if (m_deviceid == CPUDEVICE)
+        {
+            CopyFromSSEMatrixToCNTKMatrix(dengammasstripe, dengammas.rows(), numframes, tempmatrix, gammafromlattice.GetDeviceId());
+        }
+        else
+            parallellattice.getgamma(tempmatrix);
+
+        // set gamma for multi channel
+        if (samplesInRecurrentStep > 1)
+        {
+            Microsoft::MSR::CNTK::Matrix<ElemType> gammaFromLatticeForCurrentParallelUtterance = gammafromlattice.ColumnSlice(span.mapi + (span.firstframe * samplesInRecurrentStep), ((numframes - 1) * samplesInRecurrentStep) + 1);
+            gammaFromLatticeForCurrentParallelUtterance.CopyColumnsStrided(tempmatrix, numframes, 1, samplesInRecurrentStep);
+        }
+
+        if (doreferencealign)
+        {
+            for (size_t nframe = 0; nframe < numframes; nframe++)
             {
-                for (size_t nframe = 0; nframe < numframes; nframe++)
-                {
-                    size_t uid = uidsstripe[nframe];
-                    if (samplesInRecurrentStep > 1)
-                        labels(uid, (nframe + validframes[mapi]) * samplesInRecurrentStep + mapi) = 1.0;
-                    else
-                        labels(uid, ts + nframe) = 1.0;
-                }
+                size_t uid = uids[span.ts + nframe];
+                if (samplesInRecurrentStep > 1)
+                    labels(uid, (nframe + span.firstframe) * samplesInRecurrentStep + span.mapi) = 1.0;
+                else
+                    labels(uid, span.ts + nframe) = 1.0;
             }
-            if (samplesInRecurrentStep > 1)
-                validframes[mapi] += numframes; // advance the cursor within the parallel sequence
-            fprintf(stderr, "dengamma value %f\n", denavlogp);
-            ts += numframes;
         }
-        functionValues.SetValue(objectValue);
+        fprintf(stderr, "dengamma value %f\n", span.denavlogp);
     }
 
-private:
     // Helper methods for copying between ssematrix objects and CNTK matrices
     void CopyFromCNTKMatrixToSSEMatrix(const Microsoft::MSR::CNTK::Matrix<ElemType>& src, size_t numCols, msra::math::ssematrixbase& dest)
     {
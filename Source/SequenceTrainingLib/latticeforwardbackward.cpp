@@ -15,6 +15,7 @@
 #include <unordered_map>
 #include <list>
 #include <stdexcept>
+#include <exception>
 
 using namespace std;
 
@@ -952,49 +953,72 @@ void lattice::forwardbackwardalign(parallelstate &parallelstate,
             parallelstate.getedgeacscores(edgeacscoresgpu);
             parallelstate.copyalignments(thisedgealignmentsgpu);
         }
-        foreach_index (j, edges)
+        // edges are independent here, so they are processed in parallel, longest first for load balancing
+        // (When called for several utterances in parallel, nested regions are serialized by OpenMP.)
+        std::vector<edgespan> edgespansbuf;
+        std::vector<unsigned int> edgeorderbuf;
+        if (edgespans.size() != edges.size()) // not read from an archive: compute on the fly
+            computeedgespans(edgespansbuf, edgeorderbuf);
+        const auto &spans = edgespansbuf.empty() ? edgespans : edgespansbuf;
+        const auto &order = edgeorderbuf.empty() ? edgeorder : edgeorderbuf;
+        thisedgealignments.allocate();
+        std::vector<std::exception_ptr> errors(order.size());
+#pragma omp parallel for schedule(dynamic) if (!cpuverification)
+        for (int jj = 0; jj < (int) order.size(); jj++)
         {
-            const edgeinfowithscores &e = edges[j];
-            const size_t ts = nodes[e.S].t;
-            const size_t te = nodes[e.E].t;
-            if (ts == te) // dummy !NULL edge at end
-                edgeacscores[j] = 0.0f;
-            else
+            try
             {
-                const auto &aligntokens = getaligninfo(j); // get alignment tokens
-                const auto edgeLLs = msra::math::ssematrixstriperef<msra::math::ssematrixbase>(const_cast<msra::math::ssematrixbase &>(logLLs), ts, te - ts);
-                if (minlogpp > LOGZERO && origlogpps[j] < minlogpp)
-                    edgeacscores[j] = LOGZERO; // will kill word level forwardbackward hypothesis
-                else if (softalignstates)
-                    edgeacscores[j] = forwardbackwardedge(aligntokens, hset, edgeLLs, *abcs[j], j);
+                const int j = (int) order[jj];
+                const size_t ts = spans[j].ts;
+                const size_t te = spans[j].te;
+                if (ts == te) // dummy !NULL edge at end
+                    edgeacscores[j] = 0.0f;
                 else
-                    edgeacscores[j] = alignedge(aligntokens, hset, edgeLLs, *abcs[j], j, returnsenoneids, thisedgealignments[j]);
-            }
-            if (cpuverification)
-            {
-                const auto &aligntokens = getaligninfo(j); // get alignment tokens
-                bool edgehassil = false;
-                foreach_index (i, aligntokens)
                 {
-                    if (aligntokens[i].unit == silunitid)
-                        edgehassil = true;
+                    const auto &aligntokens = getaligninfo(j); // get alignment tokens
+                    const auto edgeLLs = msra::math::ssematrixstriperef<msra::math::ssematrixbase>(const_cast<msra::math::ssematrixbase &>(logLLs), ts, te - ts);
+                    if (minlogpp > LOGZERO && origlogpps[j] < minlogpp)
+                        edgeacscores[j] = LOGZERO; // will kill word level forwardbackward hypothesis
+                    else if (softalignstates)
+                        edgeacscores[j] = forwardbackwardedge(aligntokens, hset, edgeLLs, *abcs[j], j);
+                    else
+                        edgeacscores[j] = alignedge(aligntokens, hset, edgeLLs, *abcs[j], j, returnsenoneids, thisedgealignments[j]);
                 }
-                if (fabs(edgeacscores[j] - edgeacscoresgpu[j]) > 1e-3)
+                if (cpuverification)
                 {
-                    fprintf(stderr, "edge %d, sil ? %d, edgeacscores / edgeacscoresgpu MISMATCH %f v.s. %f, diff %e\n",
-                            j, edgehassil ? 1 : 0, (float) edgeacscores[j], (float) edgeacscoresgpu[j],
-                            (float) (edgeacscores[j] - edgeacscoresgpu[j]));
-                    fprintf(stderr, "aligntokens: ");
+                    const auto &aligntokens = getaligninfo(j); // get alignment tokens
+                    bool edgehassil = false;
                     foreach_index (i, aligntokens)
-                        fprintf(stderr, "%d %d; ", i, aligntokens[i].unit);
-                    fprintf(stderr, "\n");
-                }
-                for (size_t t = ts; t < te; t++)
-                {
-                    if (thisedgealignments[j][t - ts] != thisedgealignmentsgpu[j][t - ts])
-                        fprintf(stderr, "edge %d, sil ? %d, time %d, alignment / alignmentgpu MISMATCH %d v.s. %d\n", j, edgehassil ? 1 : 0, (int) (t - ts), thisedgealignments[j][t - ts], thisedgealignmentsgpu[j][t - ts]);
+                    {
+                        if (aligntokens[i].unit == silunitid)
+                            edgehassil = true;
+                    }
+                    if (fabs(edgeacscores[j] - edgeacscoresgpu[j]) > 1e-3)
+                    {
+                        fprintf(stderr, "edge %d, sil ? %d, edgeacscores / edgeacscoresgpu MISMATCH %f v.s. %f, diff %e\n",
+                                j, edgehassil ? 1 : 0, (float) edgeacscores[j], (float) edgeacscoresgpu[j],
+                                (float) (edgeacscores[j] - edgeacscoresgpu[j]));
+                        fprintf(stderr, "aligntokens: ");
+                        foreach_index (i, aligntokens)
+                            fprintf(stderr, "%d %d; ", i, aligntokens[i].unit);
+                        fprintf(stderr, "\n");
+                    }
+                    for (size_t t = ts; t < te; t++)
+                    {
+                        if (thisedgealignments[j][t - ts] != thisedgealignmentsgpu[j][t - ts])
+                            fprintf(stderr, "edge %d, sil ? %d, time %d, alignment / alignmentgpu MISMATCH %d v.s. %d\n", j, edgehassil ? 1 : 0, (int) (t - ts), thisedgealignments[j][t - ts], thisedgealignmentsgpu[j][t - ts]);
+                    }
                 }
             }
+            catch (...)
+            {
+                errors[jj] = std::current_exception();
+            }
+        }
+        for (const auto &error : errors)
+        {
+            if (error)
+                std::rethrow_exception(error);
         }
     }
 }
@@ -105,6 +105,11 @@ void TestFrameMode()
     // Create a set of trainers.
     std::map<std::wstring, std::function<DistributedLearnerPtr(LearnerPtr)>> learners;
     learners[L"simple"] = [](LearnerPtr l) { return CreateDataParallelDistributedLearner(MPICommunicator(), l, 0); };
+    learners[L"compressed1bit"] = [](LearnerPtr l) { return CreateCompressedDataParallelDistributedLearner(MPICommunicator(), l, 0, L"1bit"); };
+    learners[L"compressedTopK"] = [](LearnerPtr l) { return CreateCompressedDataParallelDistributedLearner(MPICommunicator(), l, 0, L"topK", 1, 0.1); };
+    learners[L"compressed8bit"] = [](LearnerPtr l) { return CreateCompressedDataParallelDistributedLearner(MPICommunicator(), l, 0, L"8bit"); };
+    learners[L"hierarchical"] = [](LearnerPtr l) { return CreateDataParallelDistributedLearner(HierarchicalMPICommunicator(), l, 0); };
+    learners[L"hierarchicalPseudoHosts"] = [](LearnerPtr l) { return CreateDataParallelDistributedLearner(HierarchicalMPICommunicator(1), l, 0); };
 
     if (Is1bitSGDAvailable())
     {
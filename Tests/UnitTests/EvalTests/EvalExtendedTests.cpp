@@ -7,6 +7,9 @@
 #include "ComputationNode.h"
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
+#include <thread>
+#include <random>
+#include <chrono>
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -415,5 +418,347 @@ BOOST_AUTO_TEST_CASE(EvalRNNTest)
     eval->Destroy();
 }
 
+BOOST_AUTO_TEST_CASE(EvalConcurrentDenseTimesTest)
+{
+    std::string modelDefinition =
+        "deviceId = -1 \n"
+        "precision = \"float\" \n"
+        "traceLevel = 1 \n"
+        "numWorkers = 3 \n"
+        "run=NDLNetworkBuilder \n"
+        "NDLNetworkBuilder=[ \n"
+        "i1 = Input(4) \n"
+        "o1 = Times(Constant(2, rows=1, cols=4), i1, tag=\"output\") \n"
+        "FeatureNodes = (i1) \n"
+        "] \n";
+
+    IEvaluateModelExtended<float> *eval;
+    GetEvalConcurrentF(&eval);
+    eval->CreateNetwork(modelDefinition);
+    eval->StartForwardEvaluation({ eval->GetOutputSchema()[0].m_name });
+    VariableSchema outputLayouts = eval->GetOutputSchema();
+
+    // Carrying over recurrent state is not possible when calls can be served by different workers.
+    Values<float> inputBuffer(1);
+    inputBuffer[0].m_buffer = { 1, 2, 3, 4 };
+    Values<float> outputBuffer = outputLayouts.CreateBuffers<float>({ 1 });
+    BOOST_REQUIRE_THROW(eval->ForwardPass(inputBuffer, outputBuffer, false), std::exception);
+
+    // More threads than workers, so that some of them have to wait for a free worker.
+    // Results are collected and checked on the main thread since Boost.Test assertions are not thread-safe.
+    const size_t numThreads = 8;
+    const size_t numIterations = 50;
+    std::vector<std::vector<float>> results(numThreads);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < numThreads; t++)
+    {
+        threads.push_back(std::thread([&, t]()
+        {
+            Values<float> input(1);
+            Values<float> output = outputLayouts.CreateBuffers<float>({ 1 });
+            for (size_t i = 0; i < numIterations; i++)
+            {
+                input[0].m_buffer = { (float)t, (float)i, 1, 0 };
+                eval->ForwardPass(input, output);
+                results[t].push_back(output[0].m_buffer[0]);
+            }
+        }));
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    for (size_t t = 0; t < numThreads; t++)
+    {
+        std::vector<float> expected;
+        for (size_t i = 0; i < numIterations; i++)
+            expected.push_back(2 * (t + i + 1));
+        BOOST_CHECK_EQUAL_COLLECTIONS(results[t].begin(), results[t].end(), expected.begin(), expected.end());
+    }
+
+    eval->Destroy();
+}
+
+// Load generator for the batching evaluator: many client threads send sequences of random length with random
+// pauses in between, and each checks that it gets back exactly the outputs of its own sequence.
+BOOST_AUTO_TEST_CASE(EvalBatchingLoadTest)
+{
+    std::string modelDefinition =
+        "deviceId = -1 \n"
+        "precision = \"float\" \n"
+        "traceLevel = 1 \n"
+        "maxBatchSize = 16 \n"
+        "maxWaitTimeMs = 1 \n"
+        "run=NDLNetworkBuilder \n"
+        "NDLNetworkBuilder=[ \n"
+        "i1 = Input(2) \n"
+        "o1 = Times(Constant(3, rows=1, cols=2), i1, tag=\"output\") \n"
+        "FeatureNodes = (i1) \n"
+        "] \n";
+
+    IEvaluateModelExtended<float> *eval;
+    GetEvalBatchingF(&eval);
+    eval->CreateNetwork(modelDefinition);
+    eval->StartForwardEvaluation({ eval->GetOutputSchema()[0].m_name });
+    VariableSchema outputLayouts = eval->GetOutputSchema();
+
+    const size_t numClients = 32;
+    const size_t numRequests = 100;
+    const size_t maxSequenceLength = 5;
+    std::vector<size_t> numMismatches(numClients, 0);
+    std::vector<size_t> numErrors(numClients, 0);
+    std::vector<std::thread> clients;
+    for (size_t c = 0; c < numClients; c++)
+    {
+        clients.push_back(std::thread([&, c]()
+        {
+            std::mt19937 rng((unsigned int)c);
+            Values<float> input(1);
+            Values<float> output = outputLayouts.CreateBuffers<float>({ maxSequenceLength });
+            for (size_t r = 0; r < numRequests; r++)
+            {
+                size_t length = 1 + rng() % maxSequenceLength;
+                input[0].m_buffer.clear();
+                for (size_t t = 0; t < length; t++)
+                {
+                    input[0].m_buffer.push_back((float)c);
+                    input[0].m_buffer.push_back((float)(r + t));
+                }
+                try
+                {
+                    eval->ForwardPass(input, output);
+                }
+                catch (const std::exception&)
+                {
+                    numErrors[c]++;
+                    continue;
+                }
+                if (output[0].m_buffer.size() != length)
+                    numMismatches[c]++;
+                else
+                {
+                    for (size_t t = 0; t < length; t++)
+                    {
+                        if (output[0].m_buffer[t] != 3 * (c + r + t))
+                        {
+                            numMismatches[c]++;
+                            break;
+                        }
+                    }
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(rng() % 500));
+            }
+        }));
+    }
+    for (auto& client : clients)
+        client.join();
+
+    std::vector<size_t> expected(numClients, 0);
+    BOOST_CHECK_EQUAL_COLLECTIONS(numErrors.begin(), numErrors.end(), expected.begin(), expected.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(numMismatches.begin(), numMismatches.end(), expected.begin(), expected.end());
+
+    // With 32 concurrent clients, requests must have been merged into larger minibatches.
+    EvalBatchingCounters counters;
+    GetEvalBatchingCountersF(eval, &counters);
+    BOOST_CHECK_EQUAL(counters.m_numRequests, numClients * numRequests);
+    BOOST_CHECK_LT(counters.m_numForwardPasses, counters.m_numRequests);
+    BOOST_CHECK_GT(counters.m_largestBatch, 1);
+    BOOST_CHECK_LE(counters.m_largestBatch, 16);
+
+    // Requests that cannot be batched are rejected on their own.
+    Values<float> badInput(1);
+    badInput[0].m_buffer = { 1, 2, 3 };
+    Values<float> output = outputLayouts.CreateBuffers<float>({ 2 });
+    BOOST_REQUIRE_THROW(eval->ForwardPass(badInput, output), std::exception);
+    BOOST_REQUIRE_THROW(eval->ForwardPass(badInput, output, false), std::exception);
+
+    eval->Destroy(); // prints the latency and batch size statistics since traceLevel > 0
+}
+
+// Inputs on the same dynamic axis share one MBLayout, which is set up once per minibatch; their sequences must
+// have the same lengths.
+BOOST_AUTO_TEST_CASE(EvalBatchingSharedLayoutTest)
+{
+    std::string modelDefinition =
+        "deviceId = -1 \n"
+        "precision = \"float\" \n"
+        "traceLevel = 0 \n"
+        "run=NDLNetworkBuilder \n"
+        "NDLNetworkBuilder=[ \n"
+        "i1 = Input(1) \n"
+        "i2 = Input(1) \n"
+        "o1 = Plus(i1, i2, tag=\"output\") \n"
+        "FeatureNodes = (i1:i2) \n"
+        "] \n";
+
+    IEvaluateModelExtended<float> *eval;
+    GetEvalBatchingF(&eval);
+    eval->CreateNetwork(modelDefinition);
+    eval->StartForwardEvaluation({ eval->GetOutputSchema()[0].m_name });
+    VariableSchema inputLayouts = eval->GetInputSchema();
+    BOOST_REQUIRE_EQUAL(inputLayouts.size(), 2);
+
+    Values<float> input = inputLayouts.CreateBuffers<float>({ 3, 3 });
+    Values<float> output = eval->GetOutputSchema().CreateBuffers<float>({ 3 });
+    input[0].m_buffer = { 1, 2, 3 };
+    input[1].m_buffer = { 10, 20 };
+    BOOST_REQUIRE_THROW(eval->ForwardPass(input, output), std::exception);
+
+    input[1].m_buffer = { 10, 20, 30 };
+    eval->ForwardPass(input, output);
+    std::vector<float> expected{ 11, 22, 33 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(output[0].m_buffer.begin(), output[0].m_buffer.end(), expected.begin(), expected.end());
+
+    eval->Destroy();
+}
+
+BOOST_AUTO_TEST_CASE(EvalStreamingSessionsTest)
+{
+    // acc(t) = x(t) + acc(t-1); o(t) = acc(t) + x(t-2)
+    std::string modelDefinition =
+        "deviceId = -1 \n"
+        "precision = \"float\" \n"
+        "traceLevel = 1 \n"
+        "run=NDLNetworkBuilder \n"
+        "NDLNetworkBuilder=[ \n"
+        "i1 = Input(1) \n"
+        "acc = Plus(i1, PastValue(1, acc, timeStep=1, defaultHiddenActivity=0.5)) \n"
+        "o1 = Plus(acc, PastValue(1, i1, timeStep=2, defaultHiddenActivity=0.25), tag=\"output\") \n"
+        "FeatureNodes = (i1) \n"
+        "] \n";
+
+    // reference: every stream evaluated as a whole
+    const std::vector<size_t> streamLengths = { 7, 5, 9, 4 };
+    std::vector<std::vector<float>> streams(streamLengths.size());
+    std::vector<std::vector<float>> expected(streamLengths.size());
+    IEvaluateModelExtended<float>* reference;
+    GetEvalExtendedF(&reference);
+    reference->CreateNetwork(modelDefinition);
+    reference->StartForwardEvaluation({ reference->GetOutputSchema()[0].m_name });
+    for (size_t k = 0; k < streams.size(); k++)
+    {
+        for (size_t t = 0; t < streamLengths[k]; t++)
+            streams[k].push_back((float)(10 * k + t + 1));
+        Values<float> input(1);
+        input[0].m_buffer = streams[k];
+        Values<float> output = reference->GetOutputSchema().CreateBuffers<float>({ streamLengths[k] });
+        reference->ForwardPass(input, output);
+        expected[k] = output[0].m_buffer;
+        BOOST_REQUIRE_EQUAL(expected[k].size(), streamLengths[k]);
+    }
+    reference->Destroy();
+
+    IEvaluateModelStreaming<float>* eval;
+    GetEvalStreamingF(&eval);
+    eval->CreateNetwork(modelDefinition);
+    eval->StartForwardEvaluation({ eval->GetOutputSchema()[0].m_name });
+
+    // Feed the streams in chunks of varying length; not every stream takes part in every call, and stream 3
+    // only starts after the others have begun. Session ids are arbitrary.
+    const std::vector<uint64_t> sessionIds = { 1001, 7, 123456789012ULL, 42 };
+    const std::vector<std::vector<size_t>> chunkLengths = { { 1, 3, 0, 2, 1 }, { 2, 0, 1, 2, 0 }, { 3, 1, 3, 1, 1 }, { 0, 0, 2, 1, 1 } };
+    std::vector<size_t> position(streams.size(), 0);
+    std::vector<std::vector<float>> results(streams.size());
+    for (size_t step = 0; step < chunkLengths[0].size(); step++)
+    {
+        std::vector<uint64_t> ids;
+        std::vector<Values<float>> inputs;
+        std::vector<size_t> streamIndices;
+        for (size_t k = 0; k < streams.size(); k++)
+        {
+            size_t length = chunkLengths[k][step];
+            if (length == 0)
+                continue;
+            Values<float> input(1);
+            input[0].m_buffer.assign(streams[k].begin() + position[k], streams[k].begin() + position[k] + length);
+            position[k] += length;
+            ids.push_back(sessionIds[k]);
+            inputs.push_back(input);
+            streamIndices.push_back(k);
+        }
+        std::vector<Values<float>> outputs;
+        eval->ForwardPass(ids, inputs, outputs);
+        BOOST_REQUIRE_EQUAL(outputs.size(), ids.size());
+        for (size_t j = 0; j < ids.size(); j++)
+        {
+            BOOST_REQUIRE_EQUAL(outputs[j][0].m_buffer.size(), inputs[j][0].m_buffer.size());
+            auto& result = results[streamIndices[j]];
+            result.insert(result.end(), outputs[j][0].m_buffer.begin(), outputs[j][0].m_buffer.end());
+        }
+    }
+    BOOST_CHECK_EQUAL(eval->GetNumSessions(), streams.size());
+    for (size_t k = 0; k < streams.size(); k++)
+        BOOST_CHECK_EQUAL_COLLECTIONS(results[k].begin(), results[k].end(), expected[k].begin(), expected[k].end());
+
+    // An ended session starts over.
+    eval->EndSession(sessionIds[1]);
+    BOOST_CHECK_EQUAL(eval->GetNumSessions(), streams.size() - 1);
+    std::vector<Values<float>> inputs(1, Values<float>(1));
+    inputs[0][0].m_buffer = streams[1];
+    std::vector<Values<float>> outputs;
+    eval->ForwardPass({ sessionIds[1] }, inputs, outputs);
+    BOOST_CHECK_EQUAL_COLLECTIONS(outputs[0][0].m_buffer.begin(), outputs[0][0].m_buffer.end(), expected[1].begin(), expected[1].end());
+
+    // A session may only appear once per call.
+    inputs.push_back(inputs[0]);
+    BOOST_REQUIRE_THROW(eval->ForwardPass({ sessionIds[0], sessionIds[0] }, inputs, outputs), std::exception);
+
+    eval->Destroy();
+}
+
+// Calls that are rejected leave no sessions behind.
+BOOST_AUTO_TEST_CASE(EvalStreamingInvalidCallsTest)
+{
+    std::string modelDefinition =
+        "deviceId = -1 \n"
+        "precision = \"float\" \n"
+        "traceLevel = 0 \n"
+        "run=NDLNetworkBuilder \n"
+        "NDLNetworkBuilder=[ \n"
+        "i1 = Input(1) \n"
+        "i2 = Input(2) \n"
+        "o1 = Plus(PastValue(1, i1, timeStep=1, defaultHiddenActivity=0), Times(Constant(1, rows=1, cols=2), i2), tag=\"output\") \n"
+        "FeatureNodes = (i1:i2) \n"
+        "] \n";
+
+    IEvaluateModelStreaming<float>* eval;
+    GetEvalStreamingF(&eval);
+    eval->CreateNetwork(modelDefinition);
+    eval->StartForwardEvaluation({ eval->GetOutputSchema()[0].m_name });
+    VariableSchema inputLayouts = eval->GetInputSchema();
+    BOOST_REQUIRE_EQUAL(inputLayouts.size(), 2);
+
+    std::vector<Values<float>> inputs(2, inputLayouts.CreateBuffers<float>({ 3, 3 }));
+    for (auto& input : inputs)
+    {
+        input[0].m_buffer = { 1, 2, 3 };
+        input[1].m_buffer = { 10, 20, 30, 40, 50, 60 };
+    }
+    std::vector<Values<float>> outputs;
+
+    // a new session that appears twice
+    BOOST_REQUIRE_THROW(eval->ForwardPass({ 5, 5 }, inputs, outputs), std::exception);
+    BOOST_CHECK_EQUAL(eval->GetNumSessions(), 0);
+
+    // inputs with different numbers of frames
+    inputs[1][1].m_buffer = { 10, 20, 30, 40 };
+    BOOST_REQUIRE_THROW(eval->ForwardPass({ 5, 6 }, inputs, outputs), std::exception);
+    BOOST_CHECK_EQUAL(eval->GetNumSessions(), 0);
+
+    // an input that is not a whole number of frames
+    inputs[1][1].m_buffer = { 10, 20, 30, 40, 50 };
+    BOOST_REQUIRE_THROW(eval->ForwardPass({ 5, 6 }, inputs, outputs), std::exception);
+    BOOST_CHECK_EQUAL(eval->GetNumSessions(), 0);
+
+    inputs[1][1].m_buffer = { 10, 20, 30, 40, 50, 60 };
+    eval->ForwardPass({ 5, 6 }, inputs, outputs);
+    BOOST_CHECK_EQUAL(eval->GetNumSessions(), 2);
+    BOOST_REQUIRE_EQUAL(outputs.size(), 2);
+    std::vector<float> expected{ 30, 71, 112 };
+    for (const auto& output : outputs)
+        BOOST_CHECK_EQUAL_COLLECTIONS(output[0].m_buffer.begin(), output[0].m_buffer.end(), expected.begin(), expected.end());
+
+    eval->Destroy();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }}}}
@@ -9,6 +9,8 @@
 //#include "Windows.h"
 #include "Matrix.h"
 #include "CPUMatrix.h"
+#include "CPUSparseMatrix.h"
+#include "ConvolutionEngine.h"
 #include "TensorView.h"
 #include "Sequences.h"
 #include <chrono>
@@ -336,10 +338,143 @@ void MandSTest(int count, int devId)
     delete[] data3;
 }
 
+// Sparse * dense products with the sparsity of NLP inputs: 'numSamples' one-hot or bag-of-words columns over a vocabulary of
+// 'vocabSize' words with 'nonzerosPerColumn' nonzero elements each, multiplied with an embedding matrix of 'hiddenDim' rows.
+// Times the forward product W * X and the gradient product dY * X^T for a CSC and a CSR input matrix (wall clock time).
+template <class ElemType>
+void SparseMultiplyAndWeightedAddTest(size_t vocabSize, size_t hiddenDim, size_t numSamples, size_t nonzerosPerColumn, int count)
+{
+    cout << "Testing CPUSparseMatrix" << endl;
+    cout << "W(" << hiddenDim << "x" << vocabSize << ") and X(" << vocabSize << "x" << numSamples << "), " << nonzerosPerColumn << " nonzeros per column" << endl;
+
+    // row indices of the nonzero elements of each column, sorted (rows may repeat, in which case the values are summed up)
+    vector<vector<size_t>> rows(numSamples);
+    for (auto& columnRows : rows)
+    {
+        for (size_t i = 0; i < nonzerosPerColumn; i++)
+            columnRows.push_back(((size_t) rand() * (RAND_MAX + (size_t) 1) + rand()) % vocabSize);
+        sort(columnRows.begin(), columnRows.end());
+        columnRows.erase(unique(columnRows.begin(), columnRows.end()), columnRows.end());
+    }
+
+    CPUSparseMatrix<ElemType> XCSC(matrixFormatSparseCSC, vocabSize, numSamples, numSamples * nonzerosPerColumn);
+    for (size_t j = 0; j < numSamples; j++)
+        for (size_t i : rows[j])
+            XCSC.SetValue(i, j, 1);
+
+    // CSR elements must be added row by row
+    vector<pair<size_t, size_t>> coordinates;
+    for (size_t j = 0; j < numSamples; j++)
+        for (size_t i : rows[j])
+            coordinates.push_back(make_pair(i, j));
+    sort(coordinates.begin(), coordinates.end());
+    CPUSparseMatrix<ElemType> XCSR(matrixFormatSparseCSR, vocabSize, numSamples, numSamples * nonzerosPerColumn);
+    for (const auto& coordinate : coordinates)
+        XCSR.SetValue(coordinate.first, coordinate.second, 1);
+
+    CPUMatrix<ElemType> W(hiddenDim, vocabSize);
+    randomInitializeCPUMatrix<ElemType>(W);
+    CPUMatrix<ElemType> dY(hiddenDim, numSamples);
+    randomInitializeCPUMatrix<ElemType>(dY);
+    CPUMatrix<ElemType> Y(hiddenDim, numSamples);
+    CPUMatrix<ElemType> dW(hiddenDim, vocabSize);
+    dW.SetValue(0);
+
+    for (const auto* X : { &XCSC, &XCSR })
+    {
+        const char* format = X == &XCSC ? "CSC" : "CSR";
+
+        auto t_start = chrono::steady_clock::now();
+        for (int i = 0; i < count; ++i)
+            CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(1, W, false, *X, false, 0, Y);
+        auto t_end = chrono::steady_clock::now();
+        cout << format << " Y=W*X in: " << chrono::duration<double>(t_end - t_start).count() / count << " seconds" << endl;
+
+        t_start = chrono::steady_clock::now();
+        for (int i = 0; i < count; ++i)
+            CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(1, dY, false, *X, true, 1, dW);
+        t_end = chrono::steady_clock::now();
+        cout << format << " dW+=dY*X^T in: " << chrono::duration<double>(t_end - t_start).count() / count << " seconds" << endl;
+
+        t_start = chrono::steady_clock::now();
+        for (int i = 0; i < count; ++i)
+            CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(1, *X, true, W, true, 0, Y);
+        t_end = chrono::steady_clock::now();
+        cout << format << " Y^T=X^T*W^T in: " << chrono::duration<double>(t_end - t_start).count() / count << " seconds" << endl;
+    }
+}
+
+// Forward convolution with the direct and the GEMM engine on typical ResNet and VGG layers (wall clock time).
+template <class ElemType>
+void ConvolutionForwardDirectTest(size_t batchSize, int count)
+{
+    struct Layer
+    {
+        const char* name;
+        size_t size;
+        size_t inC;
+        size_t outC;
+        size_t kernel;
+        size_t stride;
+    };
+    const Layer layers[] = {
+        { "ResNet 3x3, 56x56x64",    56,  64,  64, 3, 1 },
+        { "ResNet 1x1, 56x56x64",    56,  64, 256, 1, 1 },
+        { "ResNet 1x1, 56x56x256",   56, 256,  64, 1, 1 },
+        { "ResNet 1x1/2, 56x56x256", 56, 256, 512, 1, 2 },
+        { "ResNet 3x3, 28x28x128",   28, 128, 128, 3, 1 },
+        { "ResNet 3x3, 14x14x256",   14, 256, 256, 3, 1 },
+        { "ResNet 3x3, 7x7x512",      7, 512, 512, 3, 1 },
+        { "VGG conv2, 112x112x128", 112, 128, 128, 3, 1 },
+        { "VGG conv3, 56x56x256",    56, 256, 256, 3, 1 },
+        { "VGG conv4, 28x28x512",    28, 512, 512, 3, 1 },
+        { "VGG conv5, 14x14x512",    14, 512, 512, 3, 1 },
+    };
+
+    int deviceId = CPUDEVICE;
+    for (const auto& l : layers)
+    {
+        auto g = make_shared<ConvolveGeometry>(TensorShape(l.size, l.size, l.inC),
+            TensorShape(l.kernel, l.kernel, l.inC), TensorShape(l.outC), TensorShape(l.stride, l.stride, l.inC),
+            ConvolveGeometry::BoolVec{true}, ConvolveGeometry::BoolVec{true, true, false},
+            TensorShape(0), TensorShape(0));
+
+        Matrix<ElemType> in(g->InputShape().GetNumElements(), batchSize, deviceId);
+        in.SetUniformRandomValue(-1, 1, 1);
+        Matrix<ElemType> kernel(l.outC, g->KernelShape().GetNumElements(), deviceId);
+        kernel.SetUniformRandomValue(-0.1f, 0.1f, 2);
+
+        double seconds[2];
+        ConvolutionEngineKind kinds[2] = { ConvolutionEngineKind::Gemm, ConvolutionEngineKind::Direct };
+        for (int i = 0; i < 2; i++)
+        {
+            auto eng = ConvolutionEngine<ElemType>::Create(g, deviceId, ImageLayoutKind::CHW, 0, PoolKind::None, kinds[i]);
+            Matrix<ElemType> out(g->OutputShape().GetNumElements(), batchSize, deviceId);
+            Matrix<ElemType> workspace(deviceId);
+            // warm up: allocate the workspace
+            eng->Forward(in, kernel, out, workspace);
+            auto t_start = chrono::steady_clock::now();
+            for (int iter = 0; iter < count; iter++)
+                eng->Forward(in, kernel, out, workspace);
+            auto t_end = chrono::steady_clock::now();
+            seconds[i] = chrono::duration<double>(t_end - t_start).count() / count;
+        }
+        cout << l.name << " GEMM: " << seconds[0] << " seconds, direct: " << seconds[1] << " seconds, speedup: " << seconds[0] / seconds[1] << endl;
+    }
+}
+
 int wmain()
 {
     // MandSTest<float>(100, 2);
 
+    cout << endl << "********************CPUSparseMatrix MultiplyAndWeightedAdd TEST********************" << endl;
+    SparseMultiplyAndWeightedAddTest<float>(50000, 256, 512, 1, 10);   // one-hot word input
+    SparseMultiplyAndWeightedAddTest<float>(50000, 256, 512, 30, 10);  // bag of words
+    SparseMultiplyAndWeightedAddTest<float>(100000, 512, 64, 100, 10); // few long documents
+
+    cout << endl << "********************ConvolutionEngine direct Forward TEST********************" << endl;
+    ConvolutionForwardDirectTest<float>(2, 3);
+
     /*cout<<endl<<"********************Matrix SquareMultiplyAndWeightedAdd10TimesAvg TEST********************"<<endl;
     SquareMultiplyAndAdd10TimesAvgTest<float>(4096,10);
 
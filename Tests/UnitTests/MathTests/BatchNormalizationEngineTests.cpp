@@ -7,6 +7,7 @@
 #include <array>
 #include <random>
 #include <numeric>
+#include <functional>
 #include <boost/random/normal_distribution.hpp>
 #include "../../../Source/Math/Matrix.h"
 #include "../../../Source/Math/CPUMatrix.h"
@@ -327,6 +328,316 @@ BOOST_AUTO_TEST_CASE(BatchNormalizationBackward)
     }
 }
 
+// The CNTK engine on the CPU must produce the same results as on the GPU, in training as well as in inference.
+BOOST_AUTO_TEST_CASE(BatchNormalizationForwardCpu)
+{
+    std::mt19937 rng(0);
+    boost::random::normal_distribution<float> nd;
+
+    int baseDeviceId = 0;
+    int deviceId = CPUDEVICE;
+    for (const auto& cfg : GenerateBNTestConfigs())
+    {
+        const auto& inOutT = std::get<0>(cfg);
+        size_t batchSize = std::get<1>(cfg);
+        bool spatial = std::get<2>(cfg);
+        double expAvg = std::get<3>(cfg);
+        double blendFactor = std::get<4>(cfg);
+        double eps = 1e-5;
+        for (bool inferenceOnly : {false, true})
+        {
+            if (inferenceOnly)
+            {
+                expAvg = 0;
+                blendFactor = 1;
+            }
+
+            auto engCpu = BNEng::Create(deviceId, inOutT, spatial, ImageLayoutKind::CHW, BatchNormEngineKind::Cntk);
+            auto engGpu = BNEng::Create(baseDeviceId, inOutT, spatial, ImageLayoutKind::CHW, BatchNormEngineKind::Cntk);
+
+            size_t crow = inOutT.GetNumElements();
+            size_t ccol = batchSize;
+            size_t crowScaleBias = spatial ? inOutT[2] : inOutT.GetNumElements();
+
+            auto createMats = [&](size_t r, size_t c, std::function<float()> gen) -> std::pair<SingleMatrix, SingleMatrix>
+            {
+                vec buf(r * c);
+                std::generate(begin(buf), end(buf), gen);
+                return std::make_pair(SingleMatrix(r, c, buf.data(), deviceId, matrixFlagNormal), SingleMatrix(r, c, buf.data(), baseDeviceId, matrixFlagNormal));
+            };
+            // offset the data to exercise the numerical stability of the statistics
+            auto in = createMats(crow, ccol, [&] { return 100 + nd(rng); });
+            auto scale = createMats(crowScaleBias, 1, [&] { return nd(rng); });
+            auto bias = createMats(crowScaleBias, 1, [&] { return nd(rng); });
+            auto runMean = createMats(crowScaleBias, 1, [&] { return 100 + nd(rng); });
+            auto runVariance = createMats(crowScaleBias, 1, [&] { return 1 + std::abs(nd(rng)); });
+            SingleMatrix out(crow, ccol, deviceId), outB(crow, ccol, baseDeviceId);
+            SingleMatrix saveMean(deviceId), saveMeanB(baseDeviceId);
+            SingleMatrix saveInvStdDev(deviceId), saveInvStdDevB(baseDeviceId);
+
+            engCpu->Forward(in.first, scale.first, bias.first, inferenceOnly, expAvg, blendFactor, runMean.first, runVariance.first, out, eps, saveMean, saveInvStdDev);
+            engGpu->Forward(in.second, scale.second, bias.second, inferenceOnly, expAvg, blendFactor, runMean.second, runVariance.second, outB, eps, saveMeanB, saveInvStdDevB);
+
+            std::stringstream tmsg;
+            tmsg << "inOut tensor: " << (std::string)inOutT
+                 << ", spatial = " << (spatial ? "true" : "false")
+                 << ", expAvg = " << expAvg << ", blendFactor = " << blendFactor
+                 << ", inferenceOnly = " << (inferenceOnly ? "true" : "false");
+            std::string msg = " are not equal, " + tmsg.str();
+
+            float relErr = Err<float>::Rel;
+            float absErr = Err<float>::Abs;
+            std::string emsg;
+
+            BOOST_REQUIRE_MESSAGE(CheckEqual(out, outB, emsg, relErr * 16, absErr * 20), "out" << msg << ". " << emsg);
+            BOOST_REQUIRE_MESSAGE(CheckEqual(runMean.first, runMean.second, emsg, relErr, absErr), "runMean" << msg << ". " << emsg);
+            BOOST_REQUIRE_MESSAGE(CheckEqual(runVariance.first, runVariance.second, emsg, relErr * 16, absErr * 16), "runVariance" << msg << ". " << emsg);
+            if (!inferenceOnly)
+            {
+                BOOST_REQUIRE_MESSAGE(CheckEqual(saveMean, saveMeanB, emsg, relErr, absErr), "saveMean" << msg << ". " << emsg);
+                BOOST_REQUIRE_MESSAGE(CheckEqual(saveInvStdDev, saveInvStdDevB, emsg, relErr * 16, absErr * 16), "saveInvStdDev" << msg << ". " << emsg);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(BatchNormalizationBackwardCpu)
+{
+    std::mt19937 rng(0);
+    boost::random::normal_distribution<float> nd;
+
+    int baseDeviceId = 0;
+    int deviceId = CPUDEVICE;
+    for (const auto& cfg : GenerateBNTestConfigs())
+    {
+        const auto& inOutT = std::get<0>(cfg);
+        size_t batchSize = std::get<1>(cfg);
+        bool spatial = std::get<2>(cfg);
+        double blendFactor = std::get<4>(cfg);
+
+        auto engCpu = BNEng::Create(deviceId, inOutT, spatial, ImageLayoutKind::CHW, BatchNormEngineKind::Cntk);
+        auto engGpu = BNEng::Create(baseDeviceId, inOutT, spatial, ImageLayoutKind::CHW, BatchNormEngineKind::Cntk);
+
+        size_t crow = inOutT.GetNumElements();
+        size_t ccol = batchSize;
+        size_t crowScaleBias = spatial ? inOutT[2] : inOutT.GetNumElements();
+
+        auto createMats = [&](size_t r, size_t c, std::function<float()> gen) -> std::pair<SingleMatrix, SingleMatrix>
+        {
+            vec buf(r * c);
+            std::generate(begin(buf), end(buf), gen);
+            return std::make_pair(SingleMatrix(r, c, buf.data(), deviceId, matrixFlagNormal), SingleMatrix(r, c, buf.data(), baseDeviceId, matrixFlagNormal));
+        };
+        auto x = createMats(crow, ccol, [&] { return nd(rng); });
+        auto dy = createMats(crow, ccol, [&] { return nd(rng); });
+        auto scale = createMats(crowScaleBias, 1, [&] { return nd(rng); });
+        auto saveMean = createMats(crowScaleBias, 1, [&] { return nd(rng); });
+        auto saveInvStdDev = createMats(crowScaleBias, 1, [&] { return 1 + std::abs(nd(rng)); });
+        auto dx = createMats(crow, ccol, [&] { return nd(rng); }); // (gradients are accumulated into dx)
+        SingleMatrix dScale(deviceId), dScaleB(baseDeviceId);
+        SingleMatrix dBias(deviceId), dBiasB(baseDeviceId);
+
+        engCpu->Backward(x.first, dy.first, dx.first, scale.first, blendFactor, saveMean.first, saveInvStdDev.first, dScale, dBias);
+        engGpu->Backward(x.second, dy.second, dx.second, scale.second, blendFactor, saveMean.second, saveInvStdDev.second, dScaleB, dBiasB);
+
+        std::stringstream tmsg;
+        tmsg << "inOut tensor: " << (std::string)inOutT
+             << ", spatial = " << (spatial ? "true" : "false")
+             << ", blendFactor = " << blendFactor;
+        std::string msg = " are not equal, " + tmsg.str();
+
+        float relErr = Err<float>::Rel;
+        float absErr = Err<float>::Abs;
+        std::string emsg;
+
+        BOOST_REQUIRE_MESSAGE(CheckEqual(dx.first, dx.second, emsg, relErr * 16, absErr * 16), "dx" << msg << ". " << emsg);
+        BOOST_REQUIRE_MESSAGE(CheckEqual(dScale, dScaleB, emsg, relErr * 88, absErr * 16), "dScale" << msg << ". " << emsg);
+        BOOST_REQUIRE_MESSAGE(CheckEqual(dBias, dBiasB, emsg, relErr * 50, absErr * 16), "dBias" << msg << ". " << emsg);
+    }
+}
+
+// Straightforward double-precision batch normalization of a [numChannels * spatialSize x batchSize] CHW matrix,
+// with the semantics of the CNTK engine, to check the CPU engine without a GPU.
+struct BatchNormReference
+{
+    size_t numChannels;
+    size_t spatialSize;
+    size_t batchSize;
+
+    size_t Index(size_t c, size_t i, size_t j) const
+    {
+        return (j * numChannels + c) * spatialSize + i;
+    }
+
+    void Forward(const vec& x, const vec& scale, const vec& bias, bool inferenceOnly, double expAvg, double blendFactor,
+                 vec& runMean, vec& runVariance, vec& out, double eps, vec& saveMean, vec& saveInvStdDev) const
+    {
+        const double m = (double) spatialSize * batchSize;
+        out.resize(x.size());
+        saveMean.resize(numChannels);
+        saveInvStdDev.resize(numChannels);
+        for (size_t c = 0; c < numChannels; c++)
+        {
+            double mean, invStdDev;
+            if (inferenceOnly)
+            {
+                mean = runMean[c];
+                invStdDev = 1 / sqrt(runVariance[c] + eps);
+            }
+            else
+            {
+                double sum = 0;
+                for (size_t j = 0; j < batchSize; j++)
+                    for (size_t i = 0; i < spatialSize; i++)
+                        sum += x[Index(c, i, j)];
+                double batchMean = sum / m;
+                double sqSum = 0;
+                for (size_t j = 0; j < batchSize; j++)
+                    for (size_t i = 0; i < spatialSize; i++)
+                        sqSum += (x[Index(c, i, j)] - batchMean) * (x[Index(c, i, j)] - batchMean);
+
+                double newRunMean = expAvg * batchMean + (1 - expAvg) * runMean[c];
+                double newRunVariance = expAvg * (m > 1 ? sqSum / (m - 1) : 0) + (1 - expAvg) * runVariance[c];
+                mean = blendFactor * newRunMean + (1 - blendFactor) * batchMean;
+                invStdDev = blendFactor / sqrt(newRunVariance + eps) + (1 - blendFactor) / sqrt(sqSum / m + eps);
+                runMean[c] = (float) newRunMean;
+                runVariance[c] = (float) newRunVariance;
+            }
+            saveMean[c] = (float) mean;
+            saveInvStdDev[c] = (float) invStdDev;
+            for (size_t j = 0; j < batchSize; j++)
+                for (size_t i = 0; i < spatialSize; i++)
+                    out[Index(c, i, j)] = (float) (scale[c] * (x[Index(c, i, j)] - mean) * invStdDev + bias[c]);
+        }
+    }
+
+    // dx is accumulated into
+    void Backward(const vec& x, const vec& dy, vec& dx, const vec& scale, double blendFactor, const vec& saveMean, const vec& saveInvStdDev,
+                  vec& dScale, vec& dBias) const
+    {
+        const double m = (double) spatialSize * batchSize;
+        dScale.resize(numChannels);
+        dBias.resize(numChannels);
+        for (size_t c = 0; c < numChannels; c++)
+        {
+            double ds = 0, db = 0;
+            for (size_t j = 0; j < batchSize; j++)
+                for (size_t i = 0; i < spatialSize; i++)
+                {
+                    ds += dy[Index(c, i, j)] * (x[Index(c, i, j)] - saveMean[c]) * saveInvStdDev[c];
+                    db += dy[Index(c, i, j)];
+                }
+            dScale[c] = (float) ds;
+            dBias[c] = (float) db;
+            for (size_t j = 0; j < batchSize; j++)
+                for (size_t i = 0; i < spatialSize; i++)
+                {
+                    double xHat = (x[Index(c, i, j)] - saveMean[c]) * saveInvStdDev[c];
+                    double g = dy[Index(c, i, j)] - (1 - blendFactor) * (xHat * ds + db) / m;
+                    dx[Index(c, i, j)] += (float) (scale[c] * saveInvStdDev[c] * g);
+                }
+        }
+    }
+};
+
+// The CNTK engine on the CPU against the reference implementation above, so that it is also tested on machines without a GPU.
+BOOST_AUTO_TEST_CASE(BatchNormalizationCpuMatchesReference)
+{
+    std::mt19937 rng(0);
+    boost::random::normal_distribution<float> nd;
+    auto randomVector = [&](size_t n, float offset, bool positive)
+    {
+        vec v(n);
+        for (auto& e : v)
+            e = offset + (positive ? std::abs(nd(rng)) : nd(rng));
+        return v;
+    };
+
+    int deviceId = CPUDEVICE;
+    float relErr = Err<float>::Rel;
+    float absErr = Err<float>::Abs;
+    // (shape, batch size, spatial)
+    std::vector<std::tuple<TensorShape, size_t, bool>> shapes = {
+        std::make_tuple(TensorShape(6), 13, false),
+        std::make_tuple(TensorShape(3, 2, 4), 7, false),
+        std::make_tuple(TensorShape(3, 2, 4), 5, true),
+        std::make_tuple(TensorShape(1, 1, 3), 9, true),
+        std::make_tuple(TensorShape(5, 5, 2), 1, true),
+    };
+    for (const auto& shape : shapes)
+    {
+        const auto& inOutT = std::get<0>(shape);
+        size_t batchSize = std::get<1>(shape);
+        bool spatial = std::get<2>(shape);
+        size_t crow = inOutT.GetNumElements();
+        size_t crowScaleBias = spatial ? inOutT[2] : crow;
+        BatchNormReference ref = { crowScaleBias, crow / crowScaleBias, batchSize };
+        auto eng = BNEng::Create(deviceId, inOutT, spatial, ImageLayoutKind::CHW, BatchNormEngineKind::Cntk);
+
+        // (expAvg, blendFactor, inferenceOnly)
+        for (const auto& mode : { std::make_tuple(1.0, 0.0, false), std::make_tuple(0.1, 0.0, false), std::make_tuple(0.1, 0.5, false),
+                                  std::make_tuple(0.0, 1.0, false), std::make_tuple(0.0, 1.0, true) })
+        {
+            double expAvg = std::get<0>(mode);
+            double blendFactor = std::get<1>(mode);
+            bool inferenceOnly = std::get<2>(mode);
+            double eps = 1e-5;
+
+            vec x = randomVector(crow * batchSize, 10, false);
+            vec scale = randomVector(crowScaleBias, 0, false);
+            vec bias = randomVector(crowScaleBias, 0, false);
+            vec runMean = randomVector(crowScaleBias, 10, false);
+            vec runVariance = randomVector(crowScaleBias, 0.5f, true);
+            vec dy = randomVector(crow * batchSize, 0, false);
+            vec dx = randomVector(crow * batchSize, 0, false);
+
+            SingleMatrix xM(crow, batchSize, x.data(), deviceId, matrixFlagNormal);
+            SingleMatrix scaleM(crowScaleBias, 1, scale.data(), deviceId, matrixFlagNormal);
+            SingleMatrix biasM(crowScaleBias, 1, bias.data(), deviceId, matrixFlagNormal);
+            SingleMatrix runMeanM(crowScaleBias, 1, runMean.data(), deviceId, matrixFlagNormal);
+            SingleMatrix runVarianceM(crowScaleBias, 1, runVariance.data(), deviceId, matrixFlagNormal);
+            SingleMatrix outM(crow, batchSize, deviceId);
+            SingleMatrix saveMeanM(deviceId), saveInvStdDevM(deviceId);
+            eng->Forward(xM, scaleM, biasM, inferenceOnly, expAvg, blendFactor, runMeanM, runVarianceM, outM, eps, saveMeanM, saveInvStdDevM);
+
+            vec out, saveMean, saveInvStdDev;
+            ref.Forward(x, scale, bias, inferenceOnly, expAvg, blendFactor, runMean, runVariance, out, eps, saveMean, saveInvStdDev);
+
+            std::stringstream tmsg;
+            tmsg << "inOut tensor: " << (std::string)inOutT << ", batchSize = " << batchSize
+                 << ", spatial = " << (spatial ? "true" : "false")
+                 << ", expAvg = " << expAvg << ", blendFactor = " << blendFactor
+                 << ", inferenceOnly = " << (inferenceOnly ? "true" : "false");
+            std::string msg = " are not equal, " + tmsg.str();
+            std::string emsg;
+
+            auto asMatrix = [&](vec& v, size_t r, size_t c) { return SingleMatrix(r, c, v.data(), deviceId, matrixFlagNormal); };
+            BOOST_REQUIRE_MESSAGE(CheckEqual(outM, asMatrix(out, crow, batchSize), emsg, relErr * 16, absErr * 16), "out" << msg << ". " << emsg);
+            BOOST_REQUIRE_MESSAGE(CheckEqual(runMeanM, asMatrix(runMean, crowScaleBias, 1), emsg, relErr, absErr), "runMean" << msg << ". " << emsg);
+            BOOST_REQUIRE_MESSAGE(CheckEqual(runVarianceM, asMatrix(runVariance, crowScaleBias, 1), emsg, relErr * 16, absErr * 16), "runVariance" << msg << ". " << emsg);
+            if (inferenceOnly)
+            {
+                BOOST_CHECK(saveMeanM.IsEmpty() && saveInvStdDevM.IsEmpty());
+                continue;
+            }
+            BOOST_REQUIRE_MESSAGE(CheckEqual(saveMeanM, asMatrix(saveMean, crowScaleBias, 1), emsg, relErr, absErr), "saveMean" << msg << ". " << emsg);
+            BOOST_REQUIRE_MESSAGE(CheckEqual(saveInvStdDevM, asMatrix(saveInvStdDev, crowScaleBias, 1), emsg, relErr * 16, absErr * 16), "saveInvStdDev" << msg << ". " << emsg);
+
+            SingleMatrix dyM(crow, batchSize, dy.data(), deviceId, matrixFlagNormal);
+            SingleMatrix dxM(crow, batchSize, dx.data(), deviceId, matrixFlagNormal);
+            SingleMatrix dScaleM(deviceId), dBiasM(deviceId);
+            eng->Backward(xM, dyM, dxM, scaleM, blendFactor, saveMeanM, saveInvStdDevM, dScaleM, dBiasM);
+
+            vec dScale, dBias;
+            ref.Backward(x, dy, dx, scale, blendFactor, saveMean, saveInvStdDev, dScale, dBias);
+
+            BOOST_REQUIRE_MESSAGE(CheckEqual(dxM, asMatrix(dx, crow, batchSize), emsg, relErr * 16, absErr * 16), "dx" << msg << ". " << emsg);
+            BOOST_REQUIRE_MESSAGE(CheckEqual(dScaleM, asMatrix(dScale, crowScaleBias, 1), emsg, relErr * 16, absErr * 16), "dScale" << msg << ". " << emsg);
+            BOOST_REQUIRE_MESSAGE(CheckEqual(dBiasM, asMatrix(dBias, crowScaleBias, 1), emsg, relErr * 16, absErr * 16), "dBias" << msg << ". " << emsg);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 } } } }
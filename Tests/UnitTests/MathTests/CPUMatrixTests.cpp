@@ -4,6 +4,7 @@
 //
 #include "stdafx.h"
 #include "../../../Source/Math/CPUMatrix.h"
+#include "../../../Source/Math/RNNCommon.h"
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -928,6 +929,94 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrixAdam, RandomSeedFixture)
     BOOST_CHECK(adamMatrix.IsEqualTo(expectedStates, 1e-6));
 }
 
+BOOST_FIXTURE_TEST_CASE(CPUMatrixRNNForwardLayout, RandomSeedFixture)
+{
+    // one tanh cell with one input: the parameters are [W, R, bW, bR] as in cuDNN
+    RnnAttributes attributes(false, 1, 1, L"rnnTanh", -1);
+    BOOST_CHECK_EQUAL(attributes.GetNumParameters(1).second, 4);
+    double paramValues[] = { 0.5, -0.7, 0.1, 0.2 };
+    DMatrix paramW(1, 4, paramValues, matrixFlagNormal);
+
+    // two sequences of lengths 2 and 1, packed frame by frame
+    double inputValues[] = { 1.0, -2.0, 3.0 };
+    DMatrix inputX(1, 3, inputValues, matrixFlagNormal);
+    vector<size_t> numSequencesForFrame = { 2, 1 };
+
+    DMatrix outputY(1, 3);
+    DMatrix reserve;
+    DMatrix workspace;
+    outputY.RNNForward(inputX, paramW, 1, 1, numSequencesForFrame, attributes, reserve, workspace);
+
+    double y0 = tanh(0.5 * 1.0 + 0.3);
+    double y1 = tanh(0.5 * -2.0 + 0.3);
+    double y2 = tanh(0.5 * 3.0 - 0.7 * y0 + 0.3);
+    BOOST_CHECK_CLOSE(outputY(0, 0), y0, 1e-8);
+    BOOST_CHECK_CLOSE(outputY(0, 1), y1, 1e-8);
+    BOOST_CHECK_CLOSE(outputY(0, 2), y2, 1e-8);
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixRNNGradients, RandomSeedFixture)
+{
+    const size_t inputDim = 3;
+    const size_t hiddenSize = 4;
+    const size_t numFrames = 9;
+    vector<size_t> numSequencesForFrame = { 3, 3, 2, 1 }; // three sequences of lengths 4, 3 and 2
+
+    for (auto recurrentOp : { L"lstm", L"gru" })
+    {
+        RnnAttributes attributes(true, 2, hiddenSize, recurrentOp, -1);
+        auto numParameters = attributes.GetNumParameters(inputDim);
+        const size_t outputDim = 2 * hiddenSize;
+
+        DMatrix paramW(numParameters.first, numParameters.second);
+        paramW.SetUniformRandomValue(-0.5, 0.5, IncrementCounter());
+        DMatrix inputX(inputDim, numFrames);
+        inputX.SetUniformRandomValue(-1, 1, IncrementCounter());
+        // the loss is the inner product of the output with 'lossWeights', so lossWeights is its gradient
+        DMatrix lossWeights(outputDim, numFrames);
+        lossWeights.SetUniformRandomValue(-1, 1, IncrementCounter());
+
+        DMatrix outputY(outputDim, numFrames);
+        DMatrix reserve;
+        DMatrix workspace;
+        outputY.RNNForward(inputX, paramW, inputDim, outputDim, numSequencesForFrame, attributes, reserve, workspace);
+
+        DMatrix gradientX(inputDim, numFrames);
+        DMatrix gradientW(numParameters.first, numParameters.second);
+        gradientW.SetValue(0);
+        outputY.RNNBackwardData(lossWeights, paramW, gradientX, attributes, reserve, workspace);
+        outputY.RNNBackwardWeights(inputX, outputY, gradientW, attributes, reserve, workspace);
+
+        auto loss = [&](const DMatrix& x, const DMatrix& w)
+        {
+            DMatrix y(outputDim, numFrames);
+            DMatrix r;
+            DMatrix ws;
+            y.RNNForward(x, w, inputDim, outputDim, numSequencesForFrame, attributes, r, ws);
+            return y.ElementMultiplyWith(lossWeights).SumOfElements();
+        };
+
+        // compare with central differences
+        const double epsilon = 1e-6;
+        for (size_t i = 0; i < inputX.GetNumElements(); i++)
+        {
+            DMatrix xPlus(inputX), xMinus(inputX);
+            xPlus.Data()[i] += epsilon;
+            xMinus.Data()[i] -= epsilon;
+            double expected = (loss(xPlus, paramW) - loss(xMinus, paramW)) / (2 * epsilon);
+            BOOST_CHECK_SMALL(gradientX.Data()[i] - expected, 1e-6);
+        }
+        for (size_t i = 0; i < paramW.GetNumElements(); i++)
+        {
+            DMatrix wPlus(paramW), wMinus(paramW);
+            wPlus.Data()[i] += epsilon;
+            wMinus.Data()[i] -= epsilon;
+            double expected = (loss(inputX, wPlus) - loss(inputX, wMinus)) / (2 * epsilon);
+            BOOST_CHECK_SMALL(gradientW.Data()[i] - expected, 1e-6);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
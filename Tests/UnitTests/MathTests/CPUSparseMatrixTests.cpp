@@ -116,6 +116,74 @@ BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixMultiplyAndAdd, RandomSeedFixture)
     }
 }
 
+// Compares sparse * dense and dense * sparse products with a CSC and a CSR sparse operand against the dense product, for all transpositions.
+BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixMultiplyAndWeightedAddCSCAndCSR, RandomSeedFixture)
+{
+    const size_t m = 300; // rows of the sparse matrix
+    const size_t n = 40;  // columns of the sparse matrix
+    const size_t k = 70;  // outer dimension of the dense matrix
+    const double alpha = 0.5;
+    const double beta = 2.0;
+
+    DenseMatrix dmSparse(m, n);
+    dmSparse.SetUniformRandomValue(-30, 1, IncrementCounter());
+    dmSparse.InplaceTruncateBottom(0);
+
+    // CSC elements are added column by column, CSR elements row by row
+    SparseMatrix smCSC(MatrixFormat::matrixFormatSparseCSC, m, n, 0);
+    foreach_coord (row, col, dmSparse)
+    {
+        if (dmSparse(row, col) != 0)
+            smCSC.SetValue(row, col, dmSparse(row, col));
+    }
+    SparseMatrix smCSR(MatrixFormat::matrixFormatSparseCSR, m, n, 0);
+    for (size_t row = 0; row < m; row++)
+    {
+        for (size_t col = 0; col < n; col++)
+        {
+            if (dmSparse(row, col) != 0)
+                smCSR.SetValue(row, col, dmSparse(row, col));
+        }
+    }
+
+    for (int transposeSparse = 0; transposeSparse < 2; transposeSparse++)
+    {
+        for (int transposeDense = 0; transposeDense < 2; transposeDense++)
+        {
+            size_t sparseRows = transposeSparse ? n : m;
+            size_t sparseCols = transposeSparse ? m : n;
+
+            // dense * sparse
+            DenseMatrix dmLeft = transposeDense ? DenseMatrix(sparseRows, k) : DenseMatrix(k, sparseRows);
+            dmLeft.SetUniformRandomValue(-1, 1, IncrementCounter());
+            DenseMatrix dmExpected(k, sparseCols);
+            dmExpected.SetUniformRandomValue(-1, 1, IncrementCounter());
+            DenseMatrix dmCSC(dmExpected);
+            DenseMatrix dmCSR(dmExpected);
+
+            DenseMatrix::MultiplyAndWeightedAdd(alpha, dmLeft, transposeDense != 0, dmSparse, transposeSparse != 0, beta, dmExpected);
+            SparseMatrix::MultiplyAndWeightedAdd(alpha, dmLeft, transposeDense != 0, smCSC, transposeSparse != 0, beta, dmCSC);
+            SparseMatrix::MultiplyAndWeightedAdd(alpha, dmLeft, transposeDense != 0, smCSR, transposeSparse != 0, beta, dmCSR);
+            BOOST_CHECK(dmCSC.IsEqualTo(dmExpected, c_epsilonFloatE4));
+            BOOST_CHECK(dmCSR.IsEqualTo(dmExpected, c_epsilonFloatE4));
+
+            // sparse * dense
+            DenseMatrix dmRight = transposeDense ? DenseMatrix(k, sparseCols) : DenseMatrix(sparseCols, k);
+            dmRight.SetUniformRandomValue(-1, 1, IncrementCounter());
+            dmExpected.Resize(sparseRows, k);
+            dmExpected.SetUniformRandomValue(-1, 1, IncrementCounter());
+            dmCSC.SetValue(dmExpected);
+            dmCSR.SetValue(dmExpected);
+
+            DenseMatrix::MultiplyAndWeightedAdd(alpha, dmSparse, transposeSparse != 0, dmRight, transposeDense != 0, beta, dmExpected);
+            SparseMatrix::MultiplyAndWeightedAdd(alpha, smCSC, transposeSparse != 0, dmRight, transposeDense != 0, beta, dmCSC);
+            SparseMatrix::MultiplyAndWeightedAdd(alpha, smCSR, transposeSparse != 0, dmRight, transposeDense != 0, beta, dmCSR);
+            BOOST_CHECK(dmCSC.IsEqualTo(dmExpected, c_epsilonFloatE4));
+            BOOST_CHECK(dmCSR.IsEqualTo(dmExpected, c_epsilonFloatE4));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
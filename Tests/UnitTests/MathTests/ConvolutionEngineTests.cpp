@@ -5,6 +5,7 @@
 #include "stdafx.h"
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <random>
 #include <numeric>
 #include <boost/random/normal_distribution.hpp>
@@ -124,6 +125,36 @@ std::vector<ConvolveGeometryPtr> GenerateConvTestConfigs()
     return res;
 }
 
+// Configurations that exercise all algorithms of direct engine: Winograd F(2x2, 3x3) and F(4x4, 3x3),
+// direct convolution on blocked layout and 1x1 convolution, including partial tiles and channel blocks.
+std::vector<ConvolveGeometryPtr> GenerateDirectConvTestConfigs()
+{
+    std::vector<ConvolveGeometryPtr> res;
+    for (size_t inW : {9, 19})
+    {
+        for (size_t mapCount : {5, 12})
+        {
+            for (size_t kW : {1, 3})
+            {
+                for (size_t stride : {1, 2})
+                {
+                    res.push_back(std::make_shared<ConvolveGeometry>(TensorShape(inW, inW + 2, 11),
+                        TensorShape(kW, kW, 11), TensorShape(mapCount), TensorShape(stride, stride, 11),
+                        ConvolveGeometry::BoolVec{true},
+                        ConvolveGeometry::BoolVec{true, true, false},
+                        TensorShape(0), TensorShape(0)));
+                }
+            }
+        }
+    }
+    // Explicit padding.
+    res.push_back(std::make_shared<ConvolveGeometry>(TensorShape(10, 12, 16),
+        TensorShape(3, 3, 16), TensorShape(16), TensorShape(1, 1, 16),
+        ConvolveGeometry::BoolVec{true}, ConvolveGeometry::BoolVec{false},
+        TensorShape(1, 1, 0), TensorShape(1, 1, 0)));
+    return res;
+}
+
 std::vector<ConvolveGeometryPtr> GeneratePoolTestConfigs()
 {
     std::vector<ConvolveGeometryPtr> res;
@@ -371,6 +402,76 @@ BOOST_AUTO_TEST_CASE(ConvolutionBackwardKernel)
     }
 }
 
+BOOST_AUTO_TEST_CASE(ConvolutionForwardDirect)
+{
+    std::mt19937 rng(0);
+    boost::random::uniform_int_distribution<> batchSizeG(1, 8);
+    boost::random::normal_distribution<float> nd;
+
+    auto initMat = [&](SingleMatrix& buf, size_t r, size_t c, vec& data) -> SingleMatrix
+    {
+        data.resize(r * 3 * c);
+        std::fill(begin(data), end(data), std::numeric_limits<float>::quiet_NaN());
+        std::generate(begin(data) + r * c, begin(data) + 2 * r * c, [&] { return nd(rng); });
+        buf.SetValue(r, 3 * c, buf.GetDeviceId(), data.data());
+        // Get center slice.
+        return buf.ColumnSlice(c, c);
+    };
+
+    // Direct engine is CPU-only so it is compared with CPU reference engine. Configurations that
+    // direct engine does not support are created as reference engine.
+    int deviceId = -1;
+    auto engKind = (ConvolutionEngineKind)((int)ConvolutionEngineKind::Direct | (int)ConvolutionEngineKind::Reference);
+    auto configs = GenerateConvTestConfigs();
+    auto directConfigs = GenerateDirectConvTestConfigs();
+    configs.insert(end(configs), begin(directConfigs), end(directConfigs));
+    for (size_t maxTempMem : {0, 2})
+    {
+        for (const auto& g : configs)
+        {
+            auto baseEng = ConvEng::Create(g, deviceId, ImageLayoutKind::CHW, 0, PoolKind::None, ConvolutionEngineKind::Reference);
+            auto testEng = ConvEng::Create(g, deviceId, ImageLayoutKind::CHW, maxTempMem, PoolKind::None, engKind);
+
+            size_t n = batchSizeG(rng);
+            vec buf;
+            buf.resize(g->InputShape().GetNumElements() * n);
+            std::generate(begin(buf), end(buf), [&] { return nd(rng); });
+            SingleMatrix in(g->InputShape().GetNumElements(), n, buf.data(), deviceId, matrixFlagNormal);
+
+            size_t mapCount = g->GetMapCount(g->InputShape().GetRank() - 1);
+            buf.resize(g->KernelShape().GetNumElements() * mapCount);
+            std::generate(begin(buf), end(buf), [&] { return nd(rng); });
+            SingleMatrix kernel(mapCount, g->KernelShape().GetNumElements(), buf.data(), deviceId, matrixFlagNormal);
+
+            size_t crowOut = g->OutputShape().GetNumElements();
+            SingleMatrix outBuf(deviceId);
+            SingleMatrix out = initMat(outBuf, crowOut, n, buf);
+            SingleMatrix outB(out.DeepClone(), deviceId);
+
+            SingleMatrix workspace(deviceId);
+            SingleMatrix workspaceB(deviceId);
+
+            testEng->Forward(in, kernel, out, workspace);
+            baseEng->Forward(in, kernel, outB, workspaceB);
+
+            std::stringstream tmsg;
+            tmsg << "Geometry: " << (std::string)(*g) << ", Batch: " << n << ", MaxTempMem: " << maxTempMem;
+            std::string msg = " are not equal, " + tmsg.str();
+            std::string msgNan = " has NaNs, " + tmsg.str();
+            std::string msgNotNan = " has buffer overflow/underflow, " + tmsg.str();
+
+            float relErr = Err<float>::Rel;
+            float absErr = Err<float>::Abs;
+            std::string emsg;
+
+            BOOST_REQUIRE_MESSAGE(!out.HasNan("out"), "out" << msgNan);
+            // Rounding error of Winograd transforms is larger and depends on the magnitude of inputs rather than of outputs.
+            BOOST_REQUIRE_MESSAGE(CheckEqual(out, outB, emsg, relErr * 64, absErr * 4096), "out" << msg << ". " << emsg);
+            BOOST_REQUIRE_MESSAGE(CountNans(outBuf) == crowOut * 2 * n, "out" << msgNotNan);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(PoolingForward)
 {
     std::mt19937 rng(0);
@@ -584,6 +685,91 @@ BOOST_AUTO_TEST_CASE(MaxUnpooling)
     }
 }
 
+BOOST_AUTO_TEST_CASE(PoolingDirect)
+{
+    std::mt19937 rng(0);
+    boost::random::uniform_int_distribution<> batchSizeG(1, 8);
+    boost::random::normal_distribution<float> nd;
+    // Quantized values produce ties within pooling windows, which must be resolved the same way as in reference engine.
+    auto gen = [&] { return std::round(nd(rng) * 4) / 4; };
+
+    auto initMat = [&](SingleMatrix& buf, size_t r, size_t c, vec& data) -> SingleMatrix
+    {
+        data.resize(r * 3 * c);
+        std::fill(begin(data), end(data), std::numeric_limits<float>::quiet_NaN());
+        std::generate(begin(data) + r * c, begin(data) + 2 * r * c, [&] { return nd(rng); });
+        buf.SetValue(r, 3 * c, buf.GetDeviceId(), data.data());
+        // Get center slice.
+        return buf.ColumnSlice(c, c);
+    };
+
+    // Direct engine is CPU-only so it is compared with CPU reference engine.
+    int deviceId = -1;
+    for (auto kind : {PoolKind::Max, PoolKind::Average})
+    {
+        for (const auto& g : GeneratePoolTestConfigs())
+        {
+            auto baseEng = ConvEng::Create(g, deviceId, ImageLayoutKind::CHW, 0, kind, ConvolutionEngineKind::Reference);
+            auto testEng = ConvEng::Create(g, deviceId, ImageLayoutKind::CHW, 0, kind, ConvolutionEngineKind::Direct);
+
+            size_t n = batchSizeG(rng);
+            vec buf;
+            size_t crowIn = g->InputShape().GetNumElements();
+            buf.resize(crowIn * n);
+            std::generate(begin(buf), end(buf), gen);
+            SingleMatrix in(crowIn, n, buf.data(), deviceId, matrixFlagNormal);
+
+            size_t crowOut = g->OutputShape().GetNumElements();
+            SingleMatrix outBuf(deviceId);
+            SingleMatrix out = initMat(outBuf, crowOut, n, buf);
+            SingleMatrix outB(out.DeepClone(), deviceId);
+
+            testEng->ForwardPooling(in, out);
+            baseEng->ForwardPooling(in, outB);
+
+            buf.resize(crowOut * n);
+            std::generate(begin(buf), end(buf), [&] { return nd(rng); });
+            SingleMatrix srcGrad(crowOut, n, buf.data(), deviceId, matrixFlagNormal);
+
+            SingleMatrix gradBuf(deviceId);
+            SingleMatrix grad = initMat(gradBuf, crowIn, n, buf);
+            SingleMatrix gradB(grad.DeepClone(), deviceId);
+
+            testEng->BackwardPooling(outB, srcGrad, in, grad);
+            baseEng->BackwardPooling(outB, srcGrad, in, gradB);
+
+            std::stringstream tmsg;
+            tmsg << "Geometry: " << (std::string)(*g) << ", Pool: " << (int)kind << ", Batch: " << n;
+            std::string msg = " are not equal, " + tmsg.str();
+            std::string msgNan = " has NaNs, " + tmsg.str();
+            std::string msgNotNan = " has buffer overflow/underflow, " + tmsg.str();
+
+            float relErr = Err<float>::Rel;
+            float absErr = Err<float>::Abs;
+            std::string emsg;
+
+            BOOST_REQUIRE_MESSAGE(!out.HasNan("out"), "out" << msgNan);
+            BOOST_REQUIRE_MESSAGE(CheckEqual(out, outB, emsg, relErr, absErr * 8), "out" << msg << ". " << emsg);
+            BOOST_REQUIRE_MESSAGE(CountNans(outBuf) == crowOut * 2 * n, "out" << msgNotNan);
+
+            BOOST_REQUIRE_MESSAGE(!grad.HasNan("grad"), "grad" << msgNan);
+            BOOST_REQUIRE_MESSAGE(CheckEqual(grad, gradB, emsg, relErr, absErr * 8), "grad" << msg << ". " << emsg);
+            BOOST_REQUIRE_MESSAGE(CountNans(gradBuf) == crowIn * 2 * n, "grad" << msgNotNan);
+
+            if (kind == PoolKind::Max)
+            {
+                SingleMatrix inU(crowIn, n, deviceId);
+                SingleMatrix inUB(crowIn, n, deviceId);
+                inU.SetValue(0);
+                inUB.SetValue(0);
+                testEng->MaxUnpooling(outB, in, inU);
+                baseEng->MaxUnpooling(outB, in, inUB);
+                BOOST_REQUIRE_MESSAGE(CheckEqual(inU, inUB, emsg, 0.0f, 0.0f), "inU" << msg << ". " << emsg);
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 } } } }
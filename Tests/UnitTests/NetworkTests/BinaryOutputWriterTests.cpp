@@ -0,0 +1,399 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Tests of the binary output of the write action and of the float16 conversion it uses.
+//
+#include "stdafx.h"
+
+#include "../../../Source/ComputationNetworkLib/ComputationNetwork.h"
+#include "../../../Source/ComputationNetworkLib/ComputationNetworkBuilder.h"
+#include "../../../Source/ComputationNetworkLib/InputAndParamNodes.h"
+#include "DataWriter.h"
+#include "BinaryOutputWriter.h"
+#include "SimpleOutputWriter.h"
+#include "Float16.h"
+#include "fileutil.h"
+
+using namespace Microsoft::MSR::CNTK;
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// We perform test on CPU.
+static const DEVICEID_TYPE c_deviceId = CPUDEVICE;
+
+static float Bits(uint32_t x)
+{
+    float value;
+    memcpy(&value, &x, sizeof(value));
+    return value;
+}
+
+// the content of a file written by BinaryOutputWriter, with float16 values converted to float
+struct BinaryOutput
+{
+    BinaryOutputHeader m_header;
+    vector<float> m_values;
+    vector<BinaryOutputIndexEntry> m_index;
+};
+
+static BinaryOutputHeader ReadBinaryOutputHeader(const wstring& path)
+{
+    BinaryOutputHeader header;
+    FILE* f = fopenOrDie(path, L"rb");
+    freadOrDie(&header, sizeof(header), 1, f);
+    fclose(f);
+    return header;
+}
+
+static BinaryOutput ReadBinaryOutput(const wstring& path)
+{
+    BinaryOutput output;
+    FILE* f = fopenOrDie(path, L"rb");
+    freadOrDie(&output.m_header, sizeof(output.m_header), 1, f);
+    const auto& header = output.m_header;
+    BOOST_REQUIRE(memcmp(header.m_magic, "CNTKBOUT", sizeof(header.m_magic)) == 0);
+    BOOST_REQUIRE_EQUAL(header.m_version, 1);
+
+    output.m_values.resize(header.m_numSamples * header.m_sampleDim);
+    if (header.m_elementType == 1)
+    {
+        vector<uint16_t> halfValues(output.m_values.size());
+        if (!halfValues.empty())
+            freadOrDie(halfValues.data(), sizeof(uint16_t), halfValues.size(), f);
+        for (size_t i = 0; i < halfValues.size(); i++)
+            output.m_values[i] = HalfToFloat(halfValues[i]);
+    }
+    else if (!output.m_values.empty())
+        freadOrDie(output.m_values.data(), sizeof(float), output.m_values.size(), f);
+
+    BOOST_CHECK_EQUAL(fgetpos(f), header.m_indexOffset);
+    output.m_index.resize(header.m_numSequences);
+    if (!output.m_index.empty())
+        freadOrDie(output.m_index.data(), sizeof(BinaryOutputIndexEntry), output.m_index.size(), f);
+    BOOST_CHECK(fgetc(f) == EOF);
+    fclose(f);
+    return output;
+}
+
+// a sequence of samples of dimension 'dim', with values that differ between sequences and samples
+static vector<float> CreateSequence(size_t id, size_t length, size_t dim)
+{
+    vector<float> values;
+    for (size_t t = 0; t < length; t++)
+        for (size_t j = 0; j < dim; j++)
+            values.push_back(id * 100.0f + t + j / 8.0f + 1 / 3.0f);
+    return values;
+}
+
+// sets the value of a minibatch of sequences that all start in it, placing each one after another in the given parallel sequence
+static void SetSequences(const ComputationNodeBasePtr& node, size_t numParallelSequences, size_t numTimeSteps,
+                         const vector<pair<size_t, vector<float>>>& sequences)
+{
+    let dim = node->GetSampleLayout().GetNumElements();
+    auto pMBLayout = node->GetMBLayout();
+    pMBLayout->Init(numParallelSequences, numTimeSteps);
+    vector<float> values(dim * numParallelSequences * numTimeSteps, 0);
+    vector<size_t> t0(numParallelSequences, 0);
+    for (size_t i = 0; i < sequences.size(); i++)
+    {
+        let s = sequences[i].first;
+        let length = sequences[i].second.size() / dim;
+        pMBLayout->AddSequence(i, s, t0[s], t0[s] + length);
+        for (size_t t = 0; t < length; t++)
+            copy_n(sequences[i].second.begin() + t * dim, dim, values.begin() + ((t0[s] + t) * numParallelSequences + s) * dim);
+        t0[s] += length;
+    }
+    for (size_t s = 0; s < numParallelSequences; s++)
+    {
+        if (t0[s] < numTimeSteps)
+            pMBLayout->AddGap(s, t0[s], numTimeSteps);
+    }
+    node->As<ComputationNode<float>>()->Value().SetValue(dim, numParallelSequences * numTimeSteps, c_deviceId, values.data());
+}
+
+static ComputationNetworkPtr CreateNetwork(size_t dim)
+{
+    auto net = make_shared<ComputationNetwork>(c_deviceId);
+    ComputationNetworkBuilder<float> builder(*net);
+    auto x = builder.CreateInputNode(L"x", dim);
+    auto z = builder.Plus(x, x, L"z");
+    auto w = builder.CreateLearnableParameter(L"W", dim, 3);
+    net->AddToNodeGroup(L"feature", x);
+    net->AddToNodeGroup(L"output", z);
+    net->AddToNodeGroup(L"output", w);
+    net->CompileNetwork();
+    vector<float> values = CreateSequence(9, 3, dim);
+    dynamic_pointer_cast<ComputationNode<float>>(w)->Value().SetValue(dim, 3, c_deviceId, values.data());
+    return net;
+}
+
+BOOST_AUTO_TEST_SUITE(BinaryOutputWriterTests)
+
+BOOST_AUTO_TEST_CASE(FloatToHalfRounding)
+{
+    BOOST_CHECK_EQUAL(FloatToHalf(1.0f), 0x3c00);
+    BOOST_CHECK_EQUAL(FloatToHalf(-2.0f), 0xc000);
+    BOOST_CHECK_EQUAL(FloatToHalf(0.0f), 0x0000);
+    BOOST_CHECK_EQUAL(FloatToHalf(-0.0f), 0x8000);
+    BOOST_CHECK_EQUAL(FloatToHalf(65504.0f), 0x7bff); // largest finite value
+
+    // to nearest, ties to even
+    BOOST_CHECK_EQUAL(FloatToHalf(1.0f + 1.0f / 2048), 0x3c00);     // halfway between 0x3c00 and 0x3c01
+    BOOST_CHECK_EQUAL(FloatToHalf(1.0f + 3.0f / 2048), 0x3c02);     // halfway between 0x3c01 and 0x3c02
+    BOOST_CHECK_EQUAL(FloatToHalf(1.0f + 1.0f / 2000), 0x3c01);     // above halfway
+    BOOST_CHECK_EQUAL(FloatToHalf(2.0f - 1.0f / 4096), 0x4000);     // the carry goes into the exponent
+    BOOST_CHECK_EQUAL(FloatToHalf(65519.0f), 0x7bff);               // below halfway to 65536
+    BOOST_CHECK_EQUAL(FloatToHalf(65520.0f), 0x7c00);               // halfway rounds to Inf
+    BOOST_CHECK_EQUAL(FloatToHalf(1e10f), 0x7c00);
+    BOOST_CHECK_EQUAL(FloatToHalf(-1e10f), 0xfc00);
+
+    // subnormals
+    const float minSubnormal = ldexp(1.0f, -24);
+    BOOST_CHECK_EQUAL(FloatToHalf(minSubnormal), 0x0001);
+    BOOST_CHECK_EQUAL(FloatToHalf(1023 * minSubnormal), 0x03ff);         // largest subnormal
+    BOOST_CHECK_EQUAL(FloatToHalf(1024 * minSubnormal), 0x0400);         // smallest normal
+    BOOST_CHECK_EQUAL(FloatToHalf(1023.5f * minSubnormal), 0x0400);      // rounds up into the normals
+    BOOST_CHECK_EQUAL(FloatToHalf(0.5f * minSubnormal), 0x0000);         // halfway to 0x0001, ties to even
+    BOOST_CHECK_EQUAL(FloatToHalf(0.75f * minSubnormal), 0x0001);
+    BOOST_CHECK_EQUAL(FloatToHalf(1.5f * minSubnormal), 0x0002);         // halfway, ties to even
+    BOOST_CHECK_EQUAL(FloatToHalf(2.5f * minSubnormal), 0x0002);
+    BOOST_CHECK_EQUAL(FloatToHalf(-3 * minSubnormal), 0x8003);
+    BOOST_CHECK_EQUAL(FloatToHalf(0.25f * minSubnormal), 0x0000);        // underflow
+    BOOST_CHECK_EQUAL(FloatToHalf(-0.25f * minSubnormal), 0x8000);
+    BOOST_CHECK_EQUAL(FloatToHalf(Bits(0x00000001)), 0x0000);            // float subnormals
+
+    // Inf and NaN
+    BOOST_CHECK_EQUAL(FloatToHalf(numeric_limits<float>::infinity()), 0x7c00);
+    BOOST_CHECK_EQUAL(FloatToHalf(-numeric_limits<float>::infinity()), 0xfc00);
+    uint16_t nan = FloatToHalf(numeric_limits<float>::quiet_NaN());
+    BOOST_CHECK_EQUAL(nan & 0x7c00, 0x7c00);
+    BOOST_CHECK_NE(nan & 0x03ff, 0);
+    BOOST_CHECK_NE(FloatToHalf(Bits(0x7f800001)) & 0x03ff, 0); // a NaN whose payload is lost does not become Inf
+}
+
+BOOST_AUTO_TEST_CASE(HalfToFloatRoundTrip)
+{
+    // every float16 value converts to float exactly and back to itself
+    for (uint32_t h = 0; h <= 0xffff; h++)
+    {
+        float value = HalfToFloat((uint16_t)h);
+        if ((h & 0x7c00) == 0x7c00 && (h & 0x03ff) != 0)
+        {
+            BOOST_CHECK(value != value); // NaN
+            continue;
+        }
+        if (FloatToHalf(value) != h)
+            BOOST_ERROR("float16 value " << h << " does not round-trip");
+    }
+    BOOST_CHECK_EQUAL(HalfToFloat(0x0001), ldexp(1.0f, -24));
+    BOOST_CHECK_EQUAL(HalfToFloat(0x03ff), 1023 * ldexp(1.0f, -24));
+    BOOST_CHECK_EQUAL(HalfToFloat(0x3555), 0.333251953125f);
+    BOOST_CHECK_EQUAL(HalfToFloat(0xfbff), -65504.0f);
+}
+
+BOOST_AUTO_TEST_CASE(WriteSequencesAndIndex)
+{
+    // two minibatches of sequences of dimension 3, with gaps; W has no dynamic axis and is written as one sample per minibatch
+    const size_t dim = 3;
+    auto net = CreateNetwork(dim);
+    auto x = net->GetNodeFromName(L"x");
+    auto w = net->GetNodeFromName(L"W");
+    vector<pair<size_t, vector<float>>> minibatch1 = { { 0, CreateSequence(1, 3, dim) }, { 1, CreateSequence(2, 1, dim) }, { 1, CreateSequence(3, 2, dim) } };
+    vector<pair<size_t, vector<float>>> minibatch2 = { { 1, CreateSequence(4, 1, dim) }, { 0, CreateSequence(5, 2, dim) } };
+
+    const wstring xPath = L"binaryoutput.x.tmp", wPath = L"binaryoutput.W.tmp";
+    for (auto precision : { BinaryOutputWriter<float>::Precision::Float, BinaryOutputWriter<float>::Precision::Half })
+    {
+        {
+            BinaryOutputWriter<float> writer({ x, w }, { xPath, wPath }, precision);
+            SetSequences(x, 2, 3, minibatch1);
+            writer.Write();
+            SetSequences(x, 2, 2, minibatch2);
+            writer.Write();
+            writer.Close();
+        }
+
+        bool half = precision == BinaryOutputWriter<float>::Precision::Half;
+        auto output = ReadBinaryOutput(xPath);
+        BOOST_CHECK_EQUAL(output.m_header.m_elementType, half ? 1 : 0);
+        BOOST_CHECK_EQUAL(output.m_header.m_sampleDim, dim);
+        BOOST_CHECK_EQUAL(output.m_header.m_numSequences, 5);
+        BOOST_CHECK_EQUAL(output.m_header.m_numSamples, 9);
+        BOOST_CHECK_EQUAL(output.m_header.m_indexOffset, sizeof(BinaryOutputHeader) + 9 * dim * (half ? 2 : 4));
+
+        // the sequences in the order of the MBLayout, each one contiguous
+        vector<float> expected;
+        vector<pair<uint64_t, uint64_t>> expectedIndex;
+        for (const auto& minibatch : { minibatch1, minibatch2 })
+        {
+            for (const auto& sequence : minibatch)
+            {
+                expectedIndex.push_back(make_pair(expected.size() / dim, sequence.second.size() / dim));
+                for (float value : sequence.second)
+                    expected.push_back(half ? HalfToFloat(FloatToHalf(value)) : value);
+            }
+        }
+        BOOST_CHECK_EQUAL_COLLECTIONS(output.m_values.begin(), output.m_values.end(), expected.begin(), expected.end());
+        BOOST_REQUIRE_EQUAL(output.m_index.size(), expectedIndex.size());
+        for (size_t i = 0; i < expectedIndex.size(); i++)
+        {
+            BOOST_CHECK_EQUAL(output.m_index[i].m_firstSample, expectedIndex[i].first);
+            BOOST_CHECK_EQUAL(output.m_index[i].m_numSamples, expectedIndex[i].second);
+        }
+
+        auto wOutput = ReadBinaryOutput(wPath);
+        BOOST_CHECK_EQUAL(wOutput.m_header.m_sampleDim, 3 * dim);
+        BOOST_REQUIRE_EQUAL(wOutput.m_index.size(), 2);
+        BOOST_CHECK_EQUAL(wOutput.m_index[1].m_firstSample, 1);
+        BOOST_CHECK_EQUAL(wOutput.m_index[1].m_numSamples, 1);
+        vector<float> wExpected;
+        for (size_t i = 0; i < 2; i++)
+            for (float value : CreateSequence(9, 3, dim))
+                wExpected.push_back(half ? HalfToFloat(FloatToHalf(value)) : value);
+        BOOST_CHECK_EQUAL_COLLECTIONS(wOutput.m_values.begin(), wOutput.m_values.end(), wExpected.begin(), wExpected.end());
+    }
+    _wunlink(xPath.c_str());
+    _wunlink(wPath.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(UnclosedFileIsIncomplete)
+{
+    // the header is only written by Close(), so a file that was not closed keeps its placeholder header
+    const wstring path = L"binaryoutput.x.tmp";
+    auto net = CreateNetwork(2);
+    auto x = net->GetNodeFromName(L"x");
+    {
+        BinaryOutputWriter<float> writer({ x }, { path }, BinaryOutputWriter<float>::Precision::Float);
+        SetSequences(x, 1, 3, { { 0, CreateSequence(1, 3, 2) } });
+        writer.Write();
+    }
+    auto header = ReadBinaryOutputHeader(path);
+    BOOST_CHECK_EQUAL(header.m_numSequences, 0);
+    BOOST_CHECK_EQUAL(header.m_indexOffset, 0);
+    BOOST_CHECK_EQUAL(filesize64(path.c_str()), sizeof(BinaryOutputHeader) + 3 * 2 * sizeof(float));
+    _wunlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(WriterErrorIsRethrown)
+{
+    const wstring path = L"binaryoutput.x.tmp";
+    auto net = CreateNetwork(2);
+    auto x = net->GetNodeFromName(L"x");
+    {
+        BinaryOutputWriter<float> writer({ x }, { path }, BinaryOutputWriter<float>::Precision::Float);
+        SetSequences(x, 2, 2, { { 0, CreateSequence(1, 2, 2) }, { 1, CreateSequence(2, 2, 2) } });
+        writer.Write();
+
+        // a value that does not match its MBLayout makes the writer thread fail
+        vector<float> values(2 * 5, 0);
+        x->As<ComputationNode<float>>()->Value().SetValue(2, 5, c_deviceId, values.data());
+        writer.Write();
+        BOOST_CHECK_THROW(writer.Close(), std::exception);
+    }
+    // the file stays incomplete
+    auto header = ReadBinaryOutputHeader(path);
+    BOOST_CHECK_EQUAL(header.m_numSequences, 0);
+    BOOST_CHECK_EQUAL(header.m_indexOffset, 0);
+    _wunlink(path.c_str());
+}
+
+// Delivers the given minibatches of sequences to the input 'x'.
+class SequenceReader : public IDataReader
+{
+public:
+    SequenceReader(size_t numParallelSequences, const vector<vector<pair<size_t, vector<float>>>>& minibatches)
+        : m_numParallelSequences(numParallelSequences), m_minibatches(minibatches), m_next(0)
+    {}
+
+    virtual void Init(const ConfigParameters&) override {}
+    virtual void Init(const ScriptableObjects::IConfigRecord&) override {}
+    virtual void Destroy() override {}
+    virtual void StartMinibatchLoop(size_t, size_t, size_t) override { m_next = 0; }
+    virtual size_t GetNumParallelSequencesForFixingBPTTMode() override { return m_numParallelSequences; }
+    virtual bool DataEnd() override { return m_next == m_minibatches.size(); }
+
+    virtual bool GetMinibatch(StreamMinibatchInputs& matrices) override
+    {
+        if (m_next == m_minibatches.size())
+            return false;
+        const auto& sequences = m_minibatches[m_next++];
+        const auto& input = matrices.GetInput(L"x");
+        let dim = input.sampleLayout.GetNumElements();
+        vector<size_t> lengths(m_numParallelSequences, 0);
+        for (const auto& sequence : sequences)
+            lengths[sequence.first] += sequence.second.size() / dim;
+        let numTimeSteps = *max_element(lengths.begin(), lengths.end());
+
+        auto pMBLayout = input.pMBLayout;
+        pMBLayout->Init(m_numParallelSequences, numTimeSteps);
+        vector<float> values(dim * m_numParallelSequences * numTimeSteps, 0);
+        vector<size_t> t0(m_numParallelSequences, 0);
+        for (const auto& sequence : sequences)
+        {
+            let s = sequence.first;
+            let length = sequence.second.size() / dim;
+            pMBLayout->AddSequence(m_nextSequenceId++, s, t0[s], t0[s] + length);
+            for (size_t t = 0; t < length; t++)
+                copy_n(sequence.second.begin() + t * dim, dim, values.begin() + ((t0[s] + t) * m_numParallelSequences + s) * dim);
+            t0[s] += length;
+        }
+        for (size_t s = 0; s < m_numParallelSequences; s++)
+        {
+            if (t0[s] < numTimeSteps)
+                pMBLayout->AddGap(s, t0[s], numTimeSteps);
+        }
+        input.GetMatrix<float>().SetValue(dim, values.size() / dim, c_deviceId, values.data());
+        return true;
+    }
+
+private:
+    size_t m_numParallelSequences;
+    vector<vector<pair<size_t, vector<float>>>> m_minibatches;
+    size_t m_next;
+    size_t m_nextSequenceId = 0;
+};
+
+BOOST_AUTO_TEST_CASE(WriteBinaryOutputOfNetwork)
+{
+    // the write action's binary output of z = x + x over three minibatches of several sequences
+    const size_t dim = 4;
+    vector<vector<pair<size_t, vector<float>>>> minibatches = {
+        { { 0, CreateSequence(1, 2, dim) }, { 1, CreateSequence(2, 4, dim) }, { 2, CreateSequence(3, 1, dim) }, { 0, CreateSequence(4, 1, dim) } },
+        { { 2, CreateSequence(5, 3, dim) } },
+        { { 1, CreateSequence(6, 1, dim) }, { 0, CreateSequence(7, 2, dim) } },
+    };
+    SequenceReader reader(3, minibatches);
+    SimpleOutputWriter<float> writer(CreateNetwork(dim));
+    writer.WriteBinaryOutput(reader, 0, L"binaryoutput.tmp", { L"z" }, /*halfPrecision=*/false);
+
+    auto output = ReadBinaryOutput(L"binaryoutput.tmp.z");
+    _wunlink(L"binaryoutput.tmp.z");
+
+    vector<float> expected;
+    vector<size_t> expectedLengths;
+    for (const auto& minibatch : minibatches)
+    {
+        for (const auto& sequence : minibatch)
+        {
+            expectedLengths.push_back(sequence.second.size() / dim);
+            for (float value : sequence.second)
+                expected.push_back(2 * value);
+        }
+    }
+    BOOST_CHECK_EQUAL(output.m_header.m_sampleDim, dim);
+    BOOST_CHECK_EQUAL_COLLECTIONS(output.m_values.begin(), output.m_values.end(), expected.begin(), expected.end());
+    BOOST_REQUIRE_EQUAL(output.m_index.size(), expectedLengths.size());
+    size_t firstSample = 0;
+    for (size_t i = 0; i < expectedLengths.size(); i++)
+    {
+        BOOST_CHECK_EQUAL(output.m_index[i].m_firstSample, firstSample);
+        BOOST_CHECK_EQUAL(output.m_index[i].m_numSamples, expectedLengths[i]);
+        firstSample += expectedLengths[i];
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
@@ -0,0 +1,271 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Tests of the gradient aggregators. With one MPI process the allreduce is an identity, so the
+// aggregated gradients must equal the local ones; this exercises the packing, scheduling and unpacking paths.
+// The hierarchical allreduce tests compare against a flat MPI allreduce and are meant to run with at least
+// 4 MPI processes (see Tests/EndToEndTests/UnitTests/NetworkTestsMPI), so that both of its levels are used.
+//
+#include "stdafx.h"
+#include "Matrix.h"
+#include "MPIWrapper.h"
+#include "DistGradHeader.h"
+#include "SimpleDistGradAggregator.h"
+#include "BucketedDistGradAggregator.h"
+#include "HierarchicalAllReducer.h"
+#include "CNTKLibrary.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// MPIWrapper is a singleton that can only be created once per process
+static MPIWrapperPtr GetMpi()
+{
+    auto mpi = MPIWrapper::GetInstance();
+    if (!mpi)
+        mpi = MPIWrapper::GetInstance(/*create=*/true);
+    return mpi;
+}
+
+static std::vector<std::shared_ptr<Matrix<float>>> CreateGradients(const std::vector<size_t>& numColumns, size_t numRows, unsigned long seed)
+{
+    std::vector<std::shared_ptr<Matrix<float>>> gradients;
+    for (size_t i = 0; i < numColumns.size(); i++)
+        gradients.push_back(std::make_shared<Matrix<float>>(Matrix<float>::RandomUniform(numRows, numColumns[i], CPUDEVICE, -1.0f, 1.0f, seed + (unsigned long)i)));
+    return gradients;
+}
+
+static std::vector<Matrix<float>*> GetPointers(const std::vector<std::shared_ptr<Matrix<float>>>& gradients)
+{
+    std::vector<Matrix<float>*> pointers;
+    for (const auto& gradient : gradients)
+        pointers.push_back(gradient.get());
+    return pointers;
+}
+
+static std::shared_ptr<DistGradHeader> CreateHeader(size_t numSamples, double criterion, double evalError)
+{
+    std::shared_ptr<DistGradHeader> header(DistGradHeader::Create(1), [](DistGradHeader* p) { DistGradHeader::Destroy(p); });
+    header->Clear();
+    header->numSamples = numSamples;
+    header->numSamplesWithLabel = numSamples;
+    header->criterion = criterion;
+    header->evalErrors[0] = std::make_pair(evalError, numSamples);
+    return header;
+}
+
+BOOST_AUTO_TEST_SUITE(DistGradAggregatorTests)
+
+BOOST_AUTO_TEST_CASE(BucketedAggregatorBucketAssignment)
+{
+    // buckets of up to 100 elements are filled greedily in the given order; a larger gradient gets a bucket of its own
+    auto gradients = CreateGradients({ 3, 5, 4, 20, 1, 1 }, 10, 1);
+    BucketedDistGradAggregator<float> aggregator(GetMpi(), 100 * sizeof(float), CPUDEVICE, 0);
+    auto header = CreateHeader(8, 1.5, 0.5);
+    BOOST_REQUIRE(aggregator.AggregateGradients(GetPointers(gradients), header.get(), /*resetState=*/true));
+
+    std::vector<size_t> expectedBuckets = { 0, 0, 1, 2, 3, 3 };
+    BOOST_REQUIRE_EQUAL(aggregator.NumBuckets(), 4);
+    for (size_t i = 0; i < gradients.size(); i++)
+        BOOST_CHECK_EQUAL(aggregator.BucketOf(gradients[i].get()), expectedBuckets[i]);
+
+    Matrix<float> other(CPUDEVICE);
+    BOOST_CHECK_THROW(aggregator.BucketOf(&other), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE(BucketedAggregatorMatchesSimpleAggregator)
+{
+    const std::vector<size_t> numColumns = { 7, 1, 12, 3, 1, 30, 2 };
+    const size_t numRows = 16;
+    auto bucketedGradients = CreateGradients(numColumns, numRows, 100);
+    auto simpleGradients = CreateGradients(numColumns, numRows, 100);
+
+    BucketedDistGradAggregator<float> bucketed(GetMpi(), 64 * sizeof(float), CPUDEVICE, 0);
+    SimpleDistGradAggregator<float> simple(GetMpi(), /*useAsyncAggregation=*/false, CPUDEVICE, 0);
+
+    // minibatch 2 has no samples, in which case the gradients are zeroed
+    const std::vector<size_t> numSamples = { 8, 5, 0, 11 };
+    for (size_t mb = 0; mb < numSamples.size(); mb++)
+    {
+        for (size_t i = 0; i < numColumns.size(); i++)
+        {
+            auto values = Matrix<float>::RandomUniform(numRows, numColumns[i], CPUDEVICE, -1.0f, 1.0f, (unsigned long)(1000 * mb + i));
+            bucketedGradients[i]->SetValue(values);
+            simpleGradients[i]->SetValue(values);
+        }
+
+        // after the first minibatch, report the gradients as backprop would, so that buckets are started early
+        if (mb > 0 && numSamples[mb] > 0)
+        {
+            for (const auto& gradient : bucketedGradients)
+                bucketed.GradientComputed(gradient.get());
+        }
+
+        double criterion = numSamples[mb] > 0 ? 0.25 * (mb + 1) : 0;
+        double evalError = numSamples[mb] > 0 ? 0.5 * mb : 0;
+        auto bucketedHeader = CreateHeader(numSamples[mb], criterion, evalError);
+        auto simpleHeader = CreateHeader(numSamples[mb], criterion, evalError);
+        bool bucketedResult = bucketed.AggregateGradients(GetPointers(bucketedGradients), bucketedHeader.get(), mb == 0);
+        bool simpleResult = simple.AggregateGradients(GetPointers(simpleGradients), simpleHeader.get(), mb == 0);
+
+        BOOST_CHECK_EQUAL(bucketedResult, simpleResult);
+        BOOST_CHECK_EQUAL(bucketedResult, numSamples[mb] > 0);
+        BOOST_CHECK_EQUAL(bucketedHeader->numSamples, simpleHeader->numSamples);
+        BOOST_CHECK_EQUAL(bucketedHeader->numSamplesWithLabel, simpleHeader->numSamplesWithLabel);
+        BOOST_CHECK_EQUAL(bucketedHeader->criterion, simpleHeader->criterion);
+        BOOST_CHECK_EQUAL(bucketedHeader->evalErrors[0].first, simpleHeader->evalErrors[0].first);
+        BOOST_CHECK_EQUAL(bucketedHeader->evalErrors[0].second, simpleHeader->evalErrors[0].second);
+        for (size_t i = 0; i < numColumns.size(); i++)
+            BOOST_CHECK(bucketedGradients[i]->IsEqualTo(*simpleGradients[i], 0.0f));
+    }
+    BOOST_CHECK_EQUAL(bucketed.NumBuckets(), 6); // columns { 7 }, { 1 }, { 12 }, { 3, 1 }, { 30 }, { 2 }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+// Values that are small integers, so that sums are exact in any order and a hierarchical sum must equal the flat one
+template <class ElemType>
+static std::vector<ElemType> CreateIntegerValues(size_t numElements, size_t rank, size_t seed)
+{
+    std::vector<ElemType> values(numElements);
+    for (size_t j = 0; j < numElements; j++)
+        values[j] = (ElemType)((int)((7 * j + 13 * rank + 5 * seed) % 29) - 14);
+    return values;
+}
+
+// Pseudo-hosts of 2 ranks, so that with 4 or more processes there are several hosts with several ranks each
+static const size_t s_ranksPerHost = 2;
+
+static void CheckHierarchicalTopology(const MPIWrapperPtr& mpi, const HierarchicalAllReducer& reducer)
+{
+    BOOST_CHECK_LE(reducer.NumLocalRanks(), s_ranksPerHost);
+    BOOST_CHECK_GE(reducer.NumHosts(), (mpi->NumNodesInUse() + s_ranksPerHost - 1) / s_ranksPerHost);
+    if (mpi->NumNodesInUse() < 2 * s_ranksPerHost)
+        BOOST_TEST_MESSAGE("Running with " << mpi->NumNodesInUse() << " MPI processes; at least " << 2 * s_ranksPerHost << " are needed to use both levels of the hierarchical allreduce.");
+}
+
+// Reduces buffers of the given sizes with the hierarchical and with a flat allreduce and compares the results.
+template <class ElemType>
+static void CheckHierarchicalAllReduce(const MPIWrapperPtr& mpi, HierarchicalAllReducer& reducer, const std::vector<size_t>& sizes, size_t seed)
+{
+    std::vector<std::vector<ElemType>> values, expected;
+    std::vector<std::pair<ElemType*, size_t>> buffers;
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        values.push_back(CreateIntegerValues<ElemType>(sizes[i], mpi->CurrentNodeRank(), seed + i));
+        expected.push_back(values.back());
+        mpi->AllReduce(expected.back());
+    }
+    for (auto& value : values)
+        buffers.push_back(std::make_pair(value.data(), value.size()));
+
+    reducer.AllReduce(buffers);
+    for (size_t i = 0; i < sizes.size(); i++)
+        BOOST_CHECK_EQUAL_COLLECTIONS(values[i].begin(), values[i].end(), expected[i].begin(), expected[i].end());
+}
+
+BOOST_AUTO_TEST_SUITE(HierarchicalAllReducerTests)
+
+BOOST_AUTO_TEST_CASE(HierarchicalAllReducerMatchesFlatAllReduce)
+{
+    auto mpi = GetMpi();
+
+    // A segment of 800 bytes holds chunks of 100 floats or 50 doubles per rank of a host of 2 ranks.
+    HierarchicalAllReducer reducer(mpi, s_ranksPerHost, 800);
+    CheckHierarchicalTopology(mpi, reducer);
+
+    // a single small chunk first, then several chunks that start and end inside the buffers (which reallocates the segment)
+    CheckHierarchicalAllReduce<float>(mpi, reducer, { 5, 3 }, 1);
+    CheckHierarchicalAllReduce<float>(mpi, reducer, { 37, 0, 1, 250, 13 }, 2);
+    CheckHierarchicalAllReduce<double>(mpi, reducer, { 120, 7, 64 }, 3);
+    CheckHierarchicalAllReduce<float>(mpi, reducer, { 0, 0 }, 4);
+
+    // grouping by physical host and one rank per pseudo-host
+    for (size_t ranksPerHost : { 0, 1 })
+    {
+        HierarchicalAllReducer otherReducer(mpi, ranksPerHost, 800);
+        CheckHierarchicalAllReduce<float>(mpi, otherReducer, { 37, 0, 1, 250, 13 }, 5);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(HierarchicalMPICommunicatorMatchesMPICommunicator)
+{
+    auto mpi = GetMpi();
+    auto flat = ::CNTK::MPICommunicator();
+    auto hierarchical = ::CNTK::HierarchicalMPICommunicator(s_ranksPerHost, 64 * sizeof(double));
+
+    // float and double values in one call, each aggregated in several chunks
+    const std::vector<size_t> floatSizes = { 37, 1, 250, 13 };
+    const std::vector<size_t> doubleSizes = { 3, 120 };
+    std::vector<std::vector<float>> flatFloats, hierarchicalFloats;
+    std::vector<std::vector<double>> flatDoubles, hierarchicalDoubles;
+    for (size_t i = 0; i < floatSizes.size(); i++)
+        flatFloats.push_back(CreateIntegerValues<float>(floatSizes[i], mpi->CurrentNodeRank(), i));
+    for (size_t i = 0; i < doubleSizes.size(); i++)
+        flatDoubles.push_back(CreateIntegerValues<double>(doubleSizes[i], mpi->CurrentNodeRank(), 10 + i));
+    hierarchicalFloats = flatFloats;
+    hierarchicalDoubles = flatDoubles;
+
+    auto createViews = [](std::vector<std::vector<float>>& floats, std::vector<std::vector<double>>& doubles)
+    {
+        std::vector<::CNTK::NDArrayViewPtr> views;
+        for (auto& v : floats)
+            views.push_back(std::make_shared<::CNTK::NDArrayView>(::CNTK::NDShape({ v.size() }), v.data(), v.size(), ::CNTK::DeviceDescriptor::CPUDevice()));
+        for (auto& v : doubles)
+            views.push_back(std::make_shared<::CNTK::NDArrayView>(::CNTK::NDShape({ v.size() }), v.data(), v.size(), ::CNTK::DeviceDescriptor::CPUDevice()));
+        return views;
+    };
+
+    flat->AggregateInPlace(createViews(flatFloats, flatDoubles), flat->Workers());
+    hierarchical->AggregateInPlace(createViews(hierarchicalFloats, hierarchicalDoubles), hierarchical->Workers());
+
+    for (size_t i = 0; i < floatSizes.size(); i++)
+        BOOST_CHECK_EQUAL_COLLECTIONS(hierarchicalFloats[i].begin(), hierarchicalFloats[i].end(), flatFloats[i].begin(), flatFloats[i].end());
+    for (size_t i = 0; i < doubleSizes.size(); i++)
+        BOOST_CHECK_EQUAL_COLLECTIONS(hierarchicalDoubles[i].begin(), hierarchicalDoubles[i].end(), flatDoubles[i].begin(), flatDoubles[i].end());
+}
+
+BOOST_AUTO_TEST_CASE(HierarchicalAggregatorMatchesSimpleAggregator)
+{
+    auto mpi = GetMpi();
+    const std::vector<size_t> numColumns = { 7, 1, 12, 3, 1, 30, 2 };
+    const size_t numRows = 16;
+
+    // chunks of 32 floats per rank of a host of 2 ranks, so that most gradients are split
+    SimpleDistGradAggregator<float> hierarchical(GetMpi(), /*useAsyncAggregation=*/false, CPUDEVICE, 0, /*useHierarchicalAggregation=*/true, s_ranksPerHost, 64 * sizeof(float));
+    SimpleDistGradAggregator<float> simple(GetMpi(), /*useAsyncAggregation=*/false, CPUDEVICE, 0);
+
+    for (size_t mb = 0; mb < 2; mb++)
+    {
+        std::vector<std::shared_ptr<Matrix<float>>> hierarchicalGradients, simpleGradients;
+        for (size_t i = 0; i < numColumns.size(); i++)
+        {
+            auto values = CreateIntegerValues<float>(numRows * numColumns[i], mpi->CurrentNodeRank(), 100 * mb + i);
+            hierarchicalGradients.push_back(std::make_shared<Matrix<float>>(numRows, numColumns[i], values.data(), CPUDEVICE));
+            simpleGradients.push_back(std::make_shared<Matrix<float>>(numRows, numColumns[i], values.data(), CPUDEVICE));
+        }
+
+        size_t numSamples = 3 + mpi->CurrentNodeRank();
+        auto hierarchicalHeader = CreateHeader(numSamples, 0.25 * numSamples, 0.5 * mb);
+        auto simpleHeader = CreateHeader(numSamples, 0.25 * numSamples, 0.5 * mb);
+        BOOST_REQUIRE(hierarchical.AggregateGradients(GetPointers(hierarchicalGradients), hierarchicalHeader.get(), mb == 0));
+        BOOST_REQUIRE(simple.AggregateGradients(GetPointers(simpleGradients), simpleHeader.get(), mb == 0));
+
+        BOOST_CHECK_EQUAL(hierarchicalHeader->numSamples, simpleHeader->numSamples);
+        BOOST_CHECK_EQUAL(hierarchicalHeader->criterion, simpleHeader->criterion);
+        BOOST_CHECK_EQUAL(hierarchicalHeader->evalErrors[0].first, simpleHeader->evalErrors[0].first);
+        for (size_t i = 0; i < numColumns.size(); i++)
+        {
+            std::unique_ptr<float[]> hierarchicalValues(hierarchicalGradients[i]->CopyToArray());
+            std::unique_ptr<float[]> simpleValues(simpleGradients[i]->CopyToArray());
+            size_t numElements = hierarchicalGradients[i]->GetNumElements();
+            BOOST_CHECK_EQUAL_COLLECTIONS(hierarchicalValues.get(), hierarchicalValues.get() + numElements, simpleValues.get(), simpleValues.get() + numElements);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} } } }
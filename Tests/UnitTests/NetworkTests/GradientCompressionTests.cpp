@@ -0,0 +1,148 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "Matrix.h"
+#include "GradientCompression.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+static GradientCompressionOptions CompressionOptions(GradientCompressionType type)
+{
+    GradientCompressionOptions options;
+    options.m_type = type;
+    options.m_topKFraction = 0.1;
+    return options;
+}
+
+BOOST_AUTO_TEST_SUITE(GradientCompressionTests)
+
+BOOST_AUTO_TEST_CASE(TopKSelectsLargestMagnitudes)
+{
+    // values whose magnitudes are a permutation of 1..100, with alternating signs
+    const size_t numRows = 20, numCols = 5, n = numRows * numCols;
+    std::vector<float> data(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        size_t magnitude = (i * 37) % n + 1;
+        data[i] = (i % 2 ? -1.0f : 1.0f) * magnitude;
+    }
+    Matrix<float> values(numRows, numCols, data.data(), CPUDEVICE);
+    Matrix<float> residual = Matrix<float>::Zeros(numRows, numCols, CPUDEVICE);
+
+    TopKGradientCompressor<float> compressor(0.1);
+    std::vector<char> message(compressor.MessageSize(numRows, numCols));
+    BOOST_REQUIRE_EQUAL(message.size(), 10 * (sizeof(float) + sizeof(uint32_t)));
+    compressor.Compress(values, residual, message.data());
+
+    Matrix<float> decoded(numRows, numCols, CPUDEVICE);
+    decoded.SetValue(7); // must be overwritten since add=false
+    compressor.Decompress(message.data(), decoded, /*add=*/false);
+
+    // exactly the 10 values of magnitude 91..100 are sent, all others stay in the residual
+    for (size_t i = 0; i < n; i++)
+    {
+        bool selected = fabs(data[i]) > 90;
+        BOOST_CHECK_EQUAL(decoded.Data()[i], selected ? data[i] : 0.0f);
+        BOOST_CHECK_EQUAL(residual.Data()[i], selected ? 0.0f : data[i]);
+    }
+
+    // with add=true, the message is added to the existing values
+    compressor.Decompress(message.data(), decoded, /*add=*/true);
+    for (size_t i = 0; i < n; i++)
+        BOOST_CHECK_EQUAL(decoded.Data()[i], fabs(data[i]) > 90 ? 2 * data[i] : 0.0f);
+
+    BOOST_CHECK_THROW(TopKGradientCompressor<float>(0.0), std::exception);
+    BOOST_CHECK_THROW(TopKGradientCompressor<float>(1.5), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE(StochasticRoundingErrorBound)
+{
+    const size_t numRows = 300, numCols = 7;
+    Matrix<float> values = Matrix<float>::RandomUniform(numRows, numCols, CPUDEVICE, -2.0f, 3.0f, 1);
+    // a constant column has a step of zero
+    for (size_t i = 0; i < numRows; i++)
+        values.Data()[3 * numRows + i] = 0.5f;
+    Matrix<float> residual = Matrix<float>::Zeros(numRows, numCols, CPUDEVICE);
+
+    StochasticRoundingGradientCompressor<float> compressor(1);
+    std::vector<char> message(compressor.MessageSize(numRows, numCols));
+    compressor.Compress(values, residual, message.data());
+    Matrix<float> decoded(numRows, numCols, CPUDEVICE);
+    compressor.Decompress(message.data(), decoded, /*add=*/false);
+
+    for (size_t j = 0; j < numCols; j++)
+    {
+        const float* in = values.Data() + j * numRows;
+        float lower = *std::min_element(in, in + numRows);
+        float upper = *std::max_element(in, in + numRows);
+        float step = (upper - lower) / 255;
+        for (size_t i = 0; i < numRows; i++)
+        {
+            size_t k = j * numRows + i;
+            // each value is rounded to one of the two neighbouring levels within the column's range...
+            BOOST_CHECK_LE(fabs(decoded.Data()[k] - in[i]), step * 1.001f + 1e-6f);
+            BOOST_CHECK_GE(decoded.Data()[k], lower - 1e-5f);
+            BOOST_CHECK_LE(decoded.Data()[k], upper + 1e-5f);
+            // ...and the residual is exactly what was lost
+            BOOST_CHECK_CLOSE_FRACTION(decoded.Data()[k] + residual.Data()[k] + 10.0f, in[i] + 10.0f, 1e-6f);
+        }
+    }
+    for (size_t i = 0; i < numRows; i++)
+        BOOST_CHECK_EQUAL(decoded.Data()[3 * numRows + i], 0.5f);
+}
+
+BOOST_AUTO_TEST_CASE(StochasticRoundingIsUnbiased)
+{
+    // a value a quarter of the way between two levels is rounded up about a quarter of the time, so its mean is exact
+    const size_t numRows = 3, numSteps = 20000;
+    std::vector<float> data = { 0.0f, 100.25f, 255.0f };
+    Matrix<float> values(numRows, 1, data.data(), CPUDEVICE);
+    StochasticRoundingGradientCompressor<float> compressor(2);
+    std::vector<char> message(compressor.MessageSize(numRows, 1));
+    Matrix<float> decoded(numRows, 1, CPUDEVICE);
+    double sum = 0;
+    for (size_t step = 0; step < numSteps; step++)
+    {
+        Matrix<float> residual = Matrix<float>::Zeros(numRows, 1, CPUDEVICE);
+        compressor.Compress(values, residual, message.data());
+        compressor.Decompress(message.data(), decoded, /*add=*/false);
+        sum += decoded.Data()[1];
+    }
+    BOOST_CHECK_CLOSE(sum / numSteps, 100.25, 0.1); // (rounding to the nearest level would give 100)
+}
+
+// With error feedback, nothing is lost: the sum of the decoded messages over all steps plus the final residual
+// equals the sum of the gradients.
+BOOST_AUTO_TEST_CASE(ErrorFeedbackPreservesGradientSum)
+{
+    const size_t numRows = 64, numCols = 10, numSteps = 25;
+    for (auto type : { GradientCompressionType::Quantization, GradientCompressionType::TopK, GradientCompressionType::StochasticRounding })
+    {
+        auto compressor = GradientCompressor<float>::Create(CompressionOptions(type), 5);
+        std::vector<char> message(compressor->MessageSize(numRows, numCols));
+        Matrix<float> residual = Matrix<float>::Zeros(numRows, numCols, CPUDEVICE);
+        Matrix<float> gradientSum = Matrix<float>::Zeros(numRows, numCols, CPUDEVICE);
+        Matrix<float> decodedSum = Matrix<float>::Zeros(numRows, numCols, CPUDEVICE);
+        for (size_t step = 0; step < numSteps; step++)
+        {
+            Matrix<float> gradient = Matrix<float>::RandomUniform(numRows, numCols, CPUDEVICE, -1.0f, 1.0f, (unsigned long)(100 + step));
+            gradientSum += gradient;
+            compressor->Compress(gradient, residual, message.data());
+            compressor->Decompress(message.data(), decodedSum, /*add=*/true);
+        }
+        decodedSum += residual;
+        for (size_t i = 0; i < numRows * numCols; i++)
+            BOOST_CHECK_SMALL(decodedSum.Data()[i] - gradientSum.Data()[i], 1e-3f);
+
+        // the residual stays bounded, i.e. the error is delayed, not accumulated
+        BOOST_CHECK_LT(residual.MatrixNormInf(), type == GradientCompressionType::TopK ? 20.0f : 5.0f);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} } } }
@@ -0,0 +1,448 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Tests of the lattice forward-backward used for sequence training, on small synthetic lattices.
+//
+#include "stdafx.h"
+#include <omp.h>
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <random>
+#include "fileutil.h"
+#include "Sequences.h"
+#include "latticearchive.h"
+#include "latticesource.h"
+#include "gammacalculation.h"
+
+using namespace std;
+using namespace msra::lattices;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// The HMM set: units with three states of their own each and the same left-to-right topology.
+static const char* const c_unitNames[] = { "sil", "a", "b", "c" };
+static const size_t c_numUnits = _countof(c_unitNames);
+static const size_t c_numStatesPerUnit = 3;
+static const size_t c_numSenones = c_numUnits * c_numStatesPerUnit;
+
+static void WriteLines(const wstring& path, const vector<string>& lines)
+{
+    FILE* f = fopenOrDie(path, L"wb");
+    for (const auto& line : lines)
+        fprintf(f, "%s\n", line.c_str());
+    fcloseOrDie(f);
+}
+
+static void LoadHmmSet(msra::asr::simplesenonehmm& hset)
+{
+    const wstring stateList = L"lattice.states.tmp";
+    const wstring transP = L"lattice.transp.tmp";
+    const wstring tying = L"lattice.tying.tmp";
+    vector<string> states, units;
+    for (size_t u = 0; u < c_numUnits; u++)
+    {
+        string unit = string(c_unitNames[u]) + " T";
+        for (size_t s = 0; s < c_numStatesPerUnit; s++)
+        {
+            states.push_back(string(c_unitNames[u]) + "_s" + to_string(s + 2));
+            unit += " " + states.back();
+        }
+        units.push_back(unit);
+    }
+    WriteLines(stateList, states);
+    // rows are the transitions from the entry state (-1) and states 0..2, columns those to states 0..2 and the exit state
+    WriteLines(transP, { "T 3  1 0 0 0  0.6 0.4 0 0  0 0.6 0.4 0  0 0 0.6 0.4" });
+    WriteLines(tying, units);
+    hset.loadfromfile(tying, stateList, transP);
+    _wunlink(tying.c_str());
+    _wunlink(transP.c_str());
+    _wunlink(stateList.c_str());
+}
+
+// A lattice to be serialized in one of the archive formats.
+struct TestLattice
+{
+    struct Edge
+    {
+        size_t S;
+        size_t E;
+        float a;
+        float l;
+        vector<pair<size_t, size_t>> units; // (unit id, number of frames)
+    };
+    vector<size_t> nodeTimes;
+    vector<Edge> edges;
+    vector<pair<size_t, size_t>> referenceUnits; // units of one path through the lattice
+};
+
+// Creates a "sausage" lattice: a sequence of segments with 'numAlternatives' words each, where every word is connected to every
+// word of the previous segment, followed by silence and a !NULL edge. Words consist of one or two units of at least 3 frames.
+static TestLattice CreateLattice(size_t numSegments, size_t numAlternatives, mt19937& rng)
+{
+    TestLattice lattice;
+    lattice.nodeTimes.push_back(0);
+    vector<size_t> previousNodes = { 0 };
+    auto addSegment = [&](size_t numWords, bool silence)
+    {
+        size_t startTime = lattice.nodeTimes.back();
+        size_t duration = silence ? 5 : 6 + rng() % 5;
+        vector<size_t> nodes;
+        for (size_t m = 0; m < numWords; m++)
+        {
+            vector<pair<size_t, size_t>> units;
+            if (silence)
+                units.push_back(make_pair(0, duration));
+            else if (rng() % 2)
+                units.push_back(make_pair(1 + rng() % 3, duration));
+            else
+            {
+                units.push_back(make_pair(1 + rng() % 3, 3));
+                units.push_back(make_pair(1 + rng() % 3, duration - 3));
+            }
+            if (m == 0)
+                lattice.referenceUnits.insert(lattice.referenceUnits.end(), units.begin(), units.end());
+
+            nodes.push_back(lattice.nodeTimes.size());
+            lattice.nodeTimes.push_back(startTime + duration);
+            for (size_t S : previousNodes)
+                lattice.edges.push_back(TestLattice::Edge{ S, nodes.back(), -(float) (rng() % 1000) / 10, -(float) (rng() % 100) / 10, units });
+        }
+        previousNodes = nodes;
+    };
+    for (size_t k = 0; k < numSegments; k++)
+        addSegment(numAlternatives, /*silence=*/false);
+    addSegment(1, /*silence=*/true);
+
+    // !NULL edge to the end node
+    lattice.nodeTimes.push_back(lattice.nodeTimes.back());
+    lattice.edges.push_back(TestLattice::Edge{ previousNodes[0], lattice.nodeTimes.size() - 1, 0, 0, {} });
+    return lattice;
+}
+
+// layout of the header of an archived lattice (lattice::header_v1_v2)
+struct LatticeHeader
+{
+    size_t numnodes : 32;
+    size_t numedges : 32;
+    float lmf;
+    float wp;
+    double frameduration;
+    size_t numframes : 32;
+    size_t impliedspunitid : 31;
+    size_t hasacscores : 1;
+};
+
+template <class T>
+static void Append(vector<char>& buffer, const T& value)
+{
+    const char* p = (const char*) &value;
+    buffer.insert(buffer.end(), p, p + sizeof(value));
+}
+
+template <class T>
+static void AppendVector(vector<char>& buffer, const char* tag, const vector<T>& v)
+{
+    buffer.insert(buffer.end(), tag, tag + 4);
+    Append(buffer, (int) v.size());
+    for (const auto& e : v)
+        Append(buffer, e);
+}
+
+static LatticeHeader CreateHeader(const TestLattice& lattice)
+{
+    LatticeHeader header;
+    header.numnodes = lattice.nodeTimes.size();
+    header.numedges = lattice.edges.size();
+    header.lmf = 14;
+    header.wp = 0;
+    header.frameduration = 0.01;
+    header.numframes = lattice.nodeTimes.back();
+    header.impliedspunitid = INT_MAX;
+    header.hasacscores = 1;
+    return header;
+}
+
+static vector<nodeinfo> GetNodes(const TestLattice& lattice)
+{
+    vector<nodeinfo> nodes;
+    for (size_t t : lattice.nodeTimes)
+        nodes.push_back(nodeinfo(t));
+    return nodes;
+}
+
+// serializes a lattice in the V1 archive format (edges with scores, and their alignments)
+static vector<char> SerializeV1(const TestLattice& lattice)
+{
+    vector<edgeinfowithscores> edges;
+    vector<aligninfo> align;
+    for (const auto& e : lattice.edges)
+    {
+        edges.push_back(edgeinfowithscores(e.S, e.E, e.a, e.l, align.size()));
+        for (const auto& unit : e.units)
+            align.push_back(aligninfo(unit.first, unit.second));
+    }
+
+    vector<char> buffer;
+    buffer.insert(buffer.end(), "LAT ", "LAT " + 4);
+    Append(buffer, (int) 1);
+    Append(buffer, CreateHeader(lattice));
+    AppendVector(buffer, "NODE", GetNodes(lattice));
+    AppendVector(buffer, "EDGE", edges);
+    AppendVector(buffer, "ALIG", align);
+    buffer.insert(buffer.end(), "END ", "END " + 4);
+    return buffer;
+}
+
+// serializes a lattice in the V2 archive format: edges point to uniqued alignments, each preceded by the ac and LM score of its edges,
+// and the last unit of an alignment of several units is not stored if it is 'spunit', but implied by the duration of the edge
+static vector<char> SerializeV2(const TestLattice& lattice, size_t spunit)
+{
+    auto scoreToken = [](float score)
+    {
+        aligninfo token;
+        memcpy(&token, &score, sizeof(token));
+        return token;
+    };
+    vector<edgeinfo> edges;
+    vector<aligninfo> tokens;
+    map<tuple<float, float, vector<pair<size_t, size_t>>>, pair<size_t, bool>> uniqueAlignments; // -> (firstalign, implysp)
+    for (const auto& e : lattice.edges)
+    {
+        auto key = make_tuple(e.a, e.l, e.units);
+        auto iter = uniqueAlignments.find(key);
+        if (iter == uniqueAlignments.end())
+        {
+            tokens.push_back(scoreToken(e.a));
+            tokens.push_back(scoreToken(e.l));
+            auto units = e.units;
+            bool implysp = units.size() > 1 && units.back().first == spunit;
+            if (implysp)
+                units.pop_back();
+            iter = uniqueAlignments.insert(make_pair(key, make_pair(tokens.size(), implysp))).first;
+            for (size_t k = 0; k < units.size(); k++)
+            {
+                tokens.push_back(aligninfo(units[k].first, units[k].second));
+                tokens.back().last = k + 1 == units.size();
+            }
+        }
+        edges.push_back(edgeinfo(e.S, e.E, iter->second.first));
+        edges.back().implysp = iter->second.second;
+    }
+
+    LatticeHeader header = CreateHeader(lattice);
+    header.impliedspunitid = spunit;
+    vector<char> buffer;
+    buffer.insert(buffer.end(), "LAT ", "LAT " + 4);
+    Append(buffer, (int) 2);
+    Append(buffer, header);
+    AppendVector(buffer, "NODS", GetNodes(lattice));
+    AppendVector(buffer, "EDGS", edges);
+    AppendVector(buffer, "ALNS", tokens);
+    buffer.insert(buffer.end(), "END ", "END " + 4);
+    return buffer;
+}
+
+// reads a lattice through lattice::fread() from a file with the content of 'buffer'
+static void FreadLattice(lattice& L, const vector<char>& buffer, const vector<size_t>& idmap, size_t spunit)
+{
+    const wstring path = L"lattice.tmp";
+    FILE* f = fopenOrDie(path, L"wb");
+    fwriteOrDie(buffer.data(), 1, buffer.size(), f);
+    fcloseOrDie(f);
+    f = fopenOrDie(path, L"rb");
+    L.fread(f, idmap, spunit);
+    fcloseOrDie(f);
+    _wunlink(path.c_str());
+}
+
+// the nodes, edges and alignments of a lattice as written by lattice::dump(), with unit names through the inverse of 'idmap'
+static string DumpLattice(const lattice& L, const vector<size_t>& idmap)
+{
+    vector<const char*> names(c_numUnits);
+    for (size_t u = 0; u < c_numUnits; u++)
+        names[idmap[u]] = c_unitNames[u];
+    const wstring path = L"lattice.dump.tmp";
+    FILE* f = fopenOrDie(path, L"wb");
+    L.dump(f, [&](size_t unit) { return names[unit]; });
+    fcloseOrDie(f);
+    f = fopenOrDie(path, L"rb");
+    string text(filesize(f), '\0');
+    freadOrDie(&text[0], 1, text.size(), f);
+    fcloseOrDie(f);
+    _wunlink(path.c_str());
+    return text;
+}
+
+static shared_ptr<const msra::dbn::latticepair> ReadLattice(const vector<char>& buffer)
+{
+    vector<size_t> idmap;
+    for (size_t u = 0; u < c_numUnits; u++)
+        idmap.push_back(u);
+    auto pair = make_shared<msra::dbn::latticepair>();
+    pair->second.read(buffer.data(), buffer.size(), idmap, SIZE_MAX);
+    return pair;
+}
+
+struct GammaResult
+{
+    float objective;
+    vector<float> gammas;
+    vector<float> labels;
+    vector<size_t> uids;
+};
+
+// Runs GammaCalculation::calgammaformb() on the CPU for a minibatch of utterances with the given number of OpenMP threads.
+static GammaResult CalculateGammas(const msra::asr::simplesenonehmm& hset, vector<shared_ptr<const msra::dbn::latticepair>> lattices,
+                                   const Matrix<float>& logLLs, vector<size_t> uids, vector<size_t> boundaries,
+                                   bool sMBR, bool referenceAlign, int numThreads)
+{
+    const size_t numFrames = logLLs.GetNumCols();
+    int maxThreads = omp_get_max_threads();
+    omp_set_num_threads(numThreads);
+
+    GammaCalculation<float> calculator;
+    calculator.init(hset, CPUDEVICE);
+    SeqGammarCalParam params;
+    params.sMBRmode = sMBR;
+    calculator.SetGammarCalculationParams(params);
+
+    Matrix<float> objective(1, 1, CPUDEVICE);
+    Matrix<float> labels(c_numSenones, numFrames, CPUDEVICE);
+    Matrix<float> gammas(c_numSenones, numFrames, CPUDEVICE);
+    vector<size_t> extraUttMap;
+    calculator.calgammaformb(objective, lattices, logLLs, labels, gammas, uids, boundaries, 1, nullptr, extraUttMap, referenceAlign);
+    omp_set_num_threads(maxThreads);
+
+    GammaResult result;
+    result.objective = objective.Get00Element();
+    result.gammas.assign(gammas.Data(), gammas.Data() + gammas.GetNumElements());
+    result.labels.assign(labels.Data(), labels.Data() + labels.GetNumElements());
+    result.uids = uids;
+    return result;
+}
+
+BOOST_AUTO_TEST_SUITE(LatticeTests)
+
+// The utterances of a minibatch (and the edges of a single utterance's lattice) are processed in parallel on the CPU.
+// The gammas, objective and reference alignment must not depend on the number of threads.
+BOOST_AUTO_TEST_CASE(LatticeGammasDoNotDependOnNumberOfThreads)
+{
+    msra::asr::simplesenonehmm hset;
+    LoadHmmSet(hset);
+
+    mt19937 rng(7);
+    normal_distribution<float> nd;
+    for (size_t numUtterances : { 1, 5 })
+    {
+        vector<shared_ptr<const msra::dbn::latticepair>> lattices;
+        vector<size_t> uids, boundaries;
+        for (size_t i = 0; i < numUtterances; i++)
+        {
+            auto lattice = CreateLattice(numUtterances == 1 ? 12 : 3 + i, 4, rng);
+            lattices.push_back(ReadLattice(SerializeV1(lattice)));
+            // the reference: a path through the lattice, with phone boundaries and random states
+            for (const auto& unit : lattice.referenceUnits)
+            {
+                for (size_t t = 0; t < unit.second; t++)
+                {
+                    uids.push_back(unit.first * c_numStatesPerUnit + rng() % c_numStatesPerUnit);
+                    boundaries.push_back(t == 0 ? unit.first + 1 : 0);
+                }
+            }
+            BOOST_REQUIRE_EQUAL(uids.size(), accumulate(lattices.begin(), lattices.end(), (size_t) 0, [](size_t n, const shared_ptr<const msra::dbn::latticepair>& l) { return n + l->getnumframes(); }));
+        }
+
+        const size_t numFrames = uids.size();
+        vector<float> data(c_numSenones * numFrames);
+        for (auto& v : data)
+            v = 2 * nd(rng) - 5;
+        Matrix<float> logLLs(c_numSenones, numFrames, data.data(), CPUDEVICE);
+
+        for (bool sMBR : { false, true })
+        {
+            for (bool referenceAlign : { false, true })
+            {
+                BOOST_TEST_MESSAGE("utterances: " << numUtterances << ", sMBR: " << sMBR << ", reference align: " << referenceAlign);
+                auto sequential = CalculateGammas(hset, lattices, logLLs, uids, boundaries, sMBR, referenceAlign, 1);
+                auto parallel = CalculateGammas(hset, lattices, logLLs, uids, boundaries, sMBR, referenceAlign, 4);
+                BOOST_CHECK_EQUAL(sequential.objective, parallel.objective);
+                BOOST_CHECK(sequential.gammas == parallel.gammas);
+                BOOST_CHECK(sequential.uids == parallel.uids);
+                if (referenceAlign)
+                    BOOST_CHECK(sequential.labels == parallel.labels);
+
+                if (!sMBR)
+                {
+                    // the denominator gammas are state posteriors
+                    for (size_t t = 0; t < numFrames; t++)
+                        BOOST_CHECK_CLOSE(accumulate(&sequential.gammas[t * c_numSenones], &sequential.gammas[(t + 1) * c_numSenones], 0.0), 1.0, 1e-3);
+                }
+                if (referenceAlign)
+                {
+                    // the realigned states belong to the reference units
+                    for (size_t t = 0; t < numFrames; t++)
+                        BOOST_CHECK_EQUAL(sequential.uids[t] / c_numStatesPerUnit, uids[t] / c_numStatesPerUnit);
+                }
+            }
+        }
+    }
+}
+
+// V1 and V2 lattices must give the same lattice through fread() from a file and read() from memory, with and without unit mapping,
+// and with an /sp/ unit that does or does not match the one of the lattice (which takes the workaround path for broken V2 lattices).
+BOOST_AUTO_TEST_CASE(LatticeReadMatchesFread)
+{
+    mt19937 rng(3);
+    auto testLattice = CreateLattice(5, 3, rng);
+    // edges into the same node get the same scores, so that they share their alignment records in V2
+    for (size_t j = 1; j < testLattice.edges.size(); j++)
+    {
+        if (testLattice.edges[j].E == testLattice.edges[j - 1].E)
+        {
+            testLattice.edges[j].a = testLattice.edges[j - 1].a;
+            testLattice.edges[j].l = testLattice.edges[j - 1].l;
+        }
+    }
+    // 'c' is the implied /sp/ unit of V2: edges that end in 'c' after another unit store it implicitly
+    const size_t spunit = 3;
+    BOOST_REQUIRE(any_of(testLattice.edges.begin(), testLattice.edges.end(), [&](const TestLattice::Edge& e) { return e.units.size() > 1 && e.units.back().first == spunit; }));
+    const vector<char> v1 = SerializeV1(testLattice);
+    const vector<char> v2 = SerializeV2(testLattice, spunit);
+    BOOST_REQUIRE_LT(v2.size(), v1.size());
+
+    const vector<size_t> identity = { 0, 1, 2, 3 };
+    const vector<size_t> permutation = { 2, 0, 3, 1 };
+    lattice reference;
+    reference.read(v1.data(), v1.size(), identity, spunit);
+    const string expected = DumpLattice(reference, identity);
+    BOOST_REQUIRE_EQUAL(count(expected.begin(), expected.end(), '\n'), testLattice.edges.size() + 1);
+    BOOST_REQUIRE(expected.find(",0.00:") == string::npos); // no unit has 0 frames
+
+    for (const auto* buffer : { &v1, &v2 })
+    {
+        for (const auto* idmap : { &identity, &permutation })
+        {
+            for (bool consistentspunit : { true, false })
+            {
+                BOOST_TEST_MESSAGE("V" << (buffer == &v1 ? 1 : 2) << ", mapped: " << (idmap == &permutation) << ", consistent /sp/: " << consistentspunit);
+                const size_t mappedspunit = consistentspunit ? (*idmap)[spunit] : SIZE_MAX;
+                lattice fromFile, fromMemory;
+                FreadLattice(fromFile, *buffer, *idmap, mappedspunit);
+                fromMemory.read(buffer->data(), buffer->size(), *idmap, mappedspunit);
+                for (const auto* L : { &fromFile, &fromMemory })
+                {
+                    BOOST_CHECK_EQUAL(L->getnumnodes(), testLattice.nodeTimes.size());
+                    BOOST_CHECK_EQUAL(L->getnumedges(), testLattice.edges.size());
+                    BOOST_CHECK_EQUAL(L->getnumframes(), testLattice.nodeTimes.back());
+                    BOOST_CHECK_EQUAL(DumpLattice(*L, *idmap), expected);
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} } } }
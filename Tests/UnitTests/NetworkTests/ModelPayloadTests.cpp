@@ -0,0 +1,87 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+
+#include "../../../Source/ComputationNetworkLib/ComputationNetwork.h"
+#include "../../../Source/ComputationNetworkLib/ComputationNetworkBuilder.h"
+#include "../../../Source/ComputationNetworkLib/ParameterPayload.h"
+#include <cstdio>
+#include <memory>
+
+using namespace Microsoft::MSR::CNTK;
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// We perform test on CPU.
+const DEVICEID_TYPE c_deviceId = CPUDEVICE;
+
+static vector<float> GetValues(const ComputationNetworkPtr& net, const wstring& nodeName)
+{
+    auto node = dynamic_pointer_cast<ComputationNode<float>>(net->GetNodeFromName(nodeName));
+    auto& value = node->Value();
+    return vector<float>(value.Data(), value.Data() + value.GetNumElements());
+}
+
+static void SetValues(const ComputationNetworkPtr& net, const wstring& nodeName, float offset)
+{
+    auto node = dynamic_pointer_cast<ComputationNode<float>>(net->GetNodeFromName(nodeName));
+    auto& value = node->Value();
+    vector<float> values(value.GetNumElements());
+    for (size_t i = 0; i < values.size(); i++)
+        values[i] = offset + (float)i;
+    value.SetValue(value.GetNumRows(), value.GetNumCols(), c_deviceId, values.data());
+}
+
+BOOST_AUTO_TEST_SUITE(ModelPayloadSuite)
+
+BOOST_AUTO_TEST_CASE(ParameterPayloadRoundTrip)
+{
+    // W is large enough to go into the payload region, b is serialized inline.
+    auto net = make_shared<ComputationNetwork>(c_deviceId);
+    ComputationNetworkBuilder<float> builder(*net);
+    auto w = builder.CreateLearnableParameter(L"W", 256, 128);
+    auto b = builder.CreateLearnableParameter(L"b", 256, 1);
+    auto x = builder.CreateInputNode(L"x", 128);
+    auto z = builder.Plus(builder.Times(w, x), b, L"z");
+    net->AddToNodeGroup(L"output", z);
+    net->CompileNetwork();
+    SetValues(net, L"W", 1);
+    SetValues(net, L"b", -100);
+    BOOST_REQUIRE(256 * 128 * sizeof(float) >= ParameterPayload::MinBytes);
+
+    const wstring modelPath = L"ModelPayloadTest.dnn";
+    net->Save(modelPath);
+
+    // on the CPU, the loaded network uses W in place from the page-aligned mapping
+    auto loaded = ComputationNetwork::CreateFromFile<float>(c_deviceId, modelPath);
+    auto loadedW = dynamic_pointer_cast<ComputationNode<float>>(loaded->GetNodeFromName(L"W"));
+    BOOST_CHECK_EQUAL((uintptr_t)loadedW->Value().Data() % ParameterPayload::Alignment, 0);
+    BOOST_CHECK(GetValues(loaded, L"W") == GetValues(net, L"W"));
+    BOOST_CHECK(GetValues(loaded, L"b") == GetValues(net, L"b"));
+
+    // reloading copies the values into the existing parameters
+    SetValues(net, L"W", 1000);
+    const wstring updatedModelPath = L"ModelPayloadTest.updated.dnn";
+    net->Save(updatedModelPath);
+    loaded->RereadPersistableParameters<float>(updatedModelPath);
+    BOOST_CHECK(GetValues(loaded, L"W") == GetValues(net, L"W"));
+
+    // the values may be modified without affecting the model file (the mapping is copy-on-write)
+    SetValues(loaded, L"W", 5);
+    auto reloaded = ComputationNetwork::CreateFromFile<float>(c_deviceId, modelPath);
+    SetValues(net, L"W", 1);
+    BOOST_CHECK(GetValues(reloaded, L"W") == GetValues(net, L"W"));
+
+    loaded.reset();
+    reloaded.reset();
+    remove(ws2s(modelPath).c_str());
+    remove(ws2s(updatedModelPath).c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
@@ -0,0 +1,215 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+
+#include "../../../Source/ComputationNetworkLib/ComputationNetwork.h"
+#include "../../../Source/ComputationNetworkLib/ComputationNetworkBuilder.h"
+#include "../../../Source/ComputationNetworkLib/InputAndParamNodes.h"
+#include "../../../Source/ComputationNetworkLib/LinearAlgebraNodes.h"
+#include "../../../Source/ComputationNetworkLib/TrainingNodes.h"
+#include <functional>
+#include <memory>
+#include <random>
+
+using namespace Microsoft::MSR::CNTK;
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// We perform test on CPU.
+static const DEVICEID_TYPE c_deviceId = CPUDEVICE;
+
+static void SetRandomValues(const ComputationNetworkPtr& net, const wstring& nodeName, float low, float high, unsigned int seed)
+{
+    auto node = dynamic_pointer_cast<ComputationNode<float>>(net->GetNodeFromName(nodeName));
+    auto& value = node->Value();
+    mt19937 rng(seed);
+    uniform_real_distribution<float> distribution(low, high);
+    vector<float> values(value.GetNumElements());
+    for (auto& v : values)
+        v = distribution(rng);
+    value.SetValue(value.GetNumRows(), value.GetNumCols(), c_deviceId, values.data());
+}
+
+// adds BN(input) with parameters of the given shape, whose running statistics are not trained
+static ComputationNodeBasePtr AddBatchNormalization(ComputationNetworkBuilder<float>& builder, const ComputationNodeBasePtr& input,
+                                                    const TensorShape& parameterShape, bool spatial)
+{
+    auto scale = builder.CreateLearnableParameter(L"scale", parameterShape);
+    auto bias = builder.CreateLearnableParameter(L"bias", parameterShape);
+    auto mean = builder.CreateLearnableParameter(L"mean", parameterShape);
+    auto variance = builder.CreateLearnableParameter(L"variance", parameterShape);
+    auto count = builder.CreateLearnableParameter(L"count", TensorShape(1));
+    for (const auto& statistic : vector<ComputationNodeBasePtr>{ mean, variance, count })
+        statistic->SetLearningRateMultiplier(0);
+    return builder.BatchNormalization(dynamic_pointer_cast<ComputationNode<float>>(input), scale, bias, mean, variance, count,
+                                      spatial, /*normalizationTimeConstant=*/0, /*blendTimeConstant=*/0, /*epsilon=*/1e-3, /*useCntkEngine=*/true,
+                                      ImageLayoutKind::CHW, L"bn");
+}
+
+static void SetBatchNormalizationValues(const ComputationNetworkPtr& net)
+{
+    SetRandomValues(net, L"scale", 0.5f, 2, 11);
+    SetRandomValues(net, L"bias", -1, 1, 12);
+    SetRandomValues(net, L"mean", -1, 1, 13);
+    SetRandomValues(net, L"variance", 0.25f, 4, 14);
+    SetRandomValues(net, L"count", 100, 100, 15);
+}
+
+// z = (Reshape(BN(W * x + b)) + C1 * C2) + (L1 + L2)
+// with a no-op Reshape, a subgraph of constants C1 * C2, and a subgraph of trainable parameters L1 + L2
+static ComputationNetworkPtr CreateDenseNetwork()
+{
+    auto net = make_shared<ComputationNetwork>(c_deviceId);
+    ComputationNetworkBuilder<float> builder(*net);
+    auto x = builder.CreateInputNode(L"x", 4);
+    auto w = builder.CreateLearnableParameter(L"W", 3, 4);
+    auto b = builder.CreateLearnableParameter(L"b", TensorShape(3));
+    auto bn = AddBatchNormalization(builder, builder.Plus(builder.Times(w, x, 1, L"t"), b, L"p"), TensorShape(3), /*spatial=*/false);
+    auto r = builder.Reshape(dynamic_pointer_cast<ComputationNode<float>>(bn), TensorShape(3), L"r");
+    auto c1 = builder.CreateLearnableParameter(L"C1", 3, 2);
+    auto c2 = builder.CreateLearnableParameter(L"C2", 2, 1);
+    c1->SetLearningRateMultiplier(0);
+    c2->SetLearningRateMultiplier(0);
+    auto l1 = builder.CreateLearnableParameter(L"L1", 3, 1);
+    auto l2 = builder.CreateLearnableParameter(L"L2", 3, 1);
+    auto s = builder.Plus(r, builder.Times(c1, c2, 1, L"cc"), L"s");
+    auto z = builder.Plus(s, builder.Plus(l1, l2, L"lp"), L"z");
+    net->AddToNodeGroup(L"output", z);
+    net->CompileNetwork();
+
+    SetRandomValues(net, L"W", -1, 1, 1);
+    SetRandomValues(net, L"b", -1, 1, 2);
+    SetRandomValues(net, L"C1", -1, 1, 3);
+    SetRandomValues(net, L"C2", -1, 1, 4);
+    SetRandomValues(net, L"L1", -1, 1, 5);
+    SetRandomValues(net, L"L2", -1, 1, 6);
+    SetBatchNormalizationValues(net);
+    return net;
+}
+
+// z = BN(Convolution(W, x) + b), spatial BN over the 4 output maps of a 3x3 convolution of a 5x5x2 image
+static ComputationNetworkPtr CreateConvolutionNetwork()
+{
+    auto net = make_shared<ComputationNetwork>(c_deviceId);
+    ComputationNetworkBuilder<float> builder(*net);
+    auto x = builder.CreateInputNode(L"x", TensorShape(5, 5, 2));
+    auto w = builder.CreateLearnableParameter(L"W", 4, 3 * 3 * 2);
+    auto b = builder.CreateLearnableParameter(L"b", TensorShape(1, 1, 4));
+    auto conv = builder.Convolution(w, x, 3, 3, 4, 1, 1, ImageLayoutKind::CHW, /*zeroPadding=*/false, 0, L"conv");
+    auto bn = AddBatchNormalization(builder, builder.Plus(conv, b, L"p"), TensorShape(4), /*spatial=*/true);
+    net->AddToNodeGroup(L"output", bn);
+    net->CompileNetwork();
+
+    SetRandomValues(net, L"W", -1, 1, 1);
+    SetRandomValues(net, L"b", -1, 1, 2);
+    SetBatchNormalizationValues(net);
+    return net;
+}
+
+// evaluates the output of the network for 'numSamples' random input vectors
+static vector<float> Evaluate(const ComputationNetworkPtr& net, size_t numSamples)
+{
+    ScopedNetworkOperationMode modeGuard(net, NetworkOperationMode::inferring);
+    auto output = net->OutputNodes()[0];
+    auto input = dynamic_pointer_cast<ComputationNode<float>>(net->GetNodeFromName(L"x"));
+    net->AllocateAllMatrices({}, { output }, nullptr);
+    net->StartEvaluateMinibatchLoop(output);
+
+    size_t inputDim = input->GetSampleLayout().GetNumElements();
+    vector<float> data(inputDim * numSamples);
+    mt19937 rng(42);
+    uniform_real_distribution<float> distribution(-1, 1);
+    for (auto& v : data)
+        v = distribution(rng);
+    input->GetMBLayout()->InitAsFrameMode(numSamples);
+    input->Value().SetValue(inputDim, numSamples, c_deviceId, data.data());
+    ComputationNetwork::BumpEvalTimeStamp({ input });
+    net->ForwardProp(output);
+
+    auto& value = dynamic_pointer_cast<ComputationNode<float>>(output)->Value();
+    return vector<float>(value.Data(), value.Data() + value.GetNumElements());
+}
+
+static void CheckClose(const vector<float>& actual, const vector<float>& expected)
+{
+    BOOST_REQUIRE_EQUAL(actual.size(), expected.size());
+    for (size_t i = 0; i < actual.size(); i++)
+        BOOST_CHECK_SMALL(actual[i] - expected[i], 1e-4f * (1 + fabs(expected[i])));
+}
+
+static bool IsLearnableParameter(const ComputationNetworkPtr& net, const wstring& nodeName)
+{
+    return net->GetNodeFromName(nodeName)->OperationName() == OperationNameOf(LearnableParameter);
+}
+
+BOOST_AUTO_TEST_SUITE(OptimizeForInferenceSuite)
+
+BOOST_AUTO_TEST_CASE(OptimizeDenseNetworkForInference)
+{
+    auto expected = Evaluate(CreateDenseNetwork(), 7);
+
+    auto net = CreateDenseNetwork();
+    BOOST_REQUIRE_EQUAL(net->GetTotalNumberOfNodes(), 20);
+    BOOST_CHECK_EQUAL(net->OptimizeForInference<float>(), 9);
+    BOOST_CHECK_EQUAL(net->GetTotalNumberOfNodes(), 11);
+
+    // the no-op Reshape is gone
+    BOOST_CHECK(!net->NodeNameExists(L"r"));
+    // C1 * C2 is folded into a constant of the same name
+    BOOST_CHECK(IsLearnableParameter(net, L"cc"));
+    BOOST_CHECK(!net->GetNodeFromName(L"cc")->IsParameterUpdateRequired());
+    BOOST_CHECK(!net->NodeNameExists(L"C1") && !net->NodeNameExists(L"C2"));
+    // L1 + L2 is left alone, since L1 and L2 are still trainable
+    BOOST_CHECK(net->GetNodeFromName(L"lp")->OperationName() == OperationNameOf(PlusNode));
+    BOOST_CHECK(net->NodeNameExists(L"L1") && net->NodeNameExists(L"L2"));
+    // BN(W * x + b) is now W' * x + b'
+    BOOST_CHECK(net->GetNodeFromName(L"bn")->OperationName() == OperationNameOf(PlusNode));
+    BOOST_CHECK(net->GetNodeFromName(L"bn")->Input(0) == net->GetNodeFromName(L"t"));
+    BOOST_CHECK(IsLearnableParameter(net, L"bn_foldedBias"));
+    for (const auto& name : { L"p", L"b", L"scale", L"bias", L"mean", L"variance", L"count" })
+        BOOST_CHECK(!net->NodeNameExists(name));
+
+    CheckClose(Evaluate(net, 7), expected);
+}
+
+BOOST_AUTO_TEST_CASE(OptimizeConvolutionNetworkForInference)
+{
+    auto expected = Evaluate(CreateConvolutionNetwork(), 3);
+
+    auto net = CreateConvolutionNetwork();
+    BOOST_REQUIRE_EQUAL(net->GetTotalNumberOfNodes(), 11);
+    BOOST_CHECK_EQUAL(net->OptimizeForInference<float>(), 6);
+    BOOST_CHECK_EQUAL(net->GetTotalNumberOfNodes(), 5);
+
+    BOOST_CHECK(net->GetNodeFromName(L"bn")->OperationName() == OperationNameOf(PlusNode));
+    BOOST_CHECK(net->GetNodeFromName(L"bn")->Input(0) == net->GetNodeFromName(L"conv"));
+    BOOST_CHECK(net->GetNodeFromName(L"bn_foldedBias")->GetSampleLayout() == TensorShape(1, 1, 4));
+
+    CheckClose(Evaluate(net, 3), expected);
+}
+
+BOOST_AUTO_TEST_CASE(BatchNormalizationWithSharedWeightsIsNotFolded)
+{
+    // W is also used by a second Times, so it cannot be scaled in place
+    auto net = make_shared<ComputationNetwork>(c_deviceId);
+    ComputationNetworkBuilder<float> builder(*net);
+    auto x = builder.CreateInputNode(L"x", 4);
+    auto w = builder.CreateLearnableParameter(L"W", 3, 4);
+    auto bn = AddBatchNormalization(builder, builder.Times(w, x, 1, L"t"), TensorShape(3), /*spatial=*/false);
+    auto z = builder.Plus(dynamic_pointer_cast<ComputationNode<float>>(bn), builder.Times(w, x, 1, L"t2"), L"z");
+    net->AddToNodeGroup(L"output", z);
+    net->CompileNetwork();
+    SetRandomValues(net, L"W", -1, 1, 1);
+    SetBatchNormalizationValues(net);
+
+    BOOST_CHECK_EQUAL(net->OptimizeForInference<float>(), 0);
+    BOOST_CHECK(net->GetNodeFromName(L"bn")->OperationName() == OperationNameOf(BatchNormalizationNode));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
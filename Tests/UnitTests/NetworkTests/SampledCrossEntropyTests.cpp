@@ -0,0 +1,364 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+
+#include "../../../Source/ComputationNetworkLib/ComputationNetwork.h"
+#include "../../../Source/ComputationNetworkLib/ComputationNetworkBuilder.h"
+#include "../../../Source/ComputationNetworkLib/InputAndParamNodes.h"
+#include "../../../Source/ComputationNetworkLib/TrainingNodes.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+
+using namespace Microsoft::MSR::CNTK;
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// We perform test on CPU, in double precision for the finite differences.
+static const DEVICEID_TYPE c_deviceId = CPUDEVICE;
+
+static const size_t c_inputDim = 4;
+static const size_t c_hiddenDim = 3;
+static const size_t c_numClasses = 6;
+static const uint64_t c_samplingSeed = 5;
+
+// 3 parallel sequences of 4, 2 and 3 frames, so the minibatch has gaps
+static const size_t c_numTimeSteps = 4;
+static const vector<size_t> c_sequenceLengths = { 4, 2, 3 };
+
+static size_t NumColumns()
+{
+    return c_numTimeSteps * c_sequenceLengths.size();
+}
+
+static bool IsGap(size_t j)
+{
+    return j / c_sequenceLengths.size() >= c_sequenceLengths[j % c_sequenceLengths.size()];
+}
+
+// classes 0..4, the last class is never a label
+static size_t LabelOf(size_t j)
+{
+    return (3 * j + 1) % (c_numClasses - 1);
+}
+
+static shared_ptr<ComputationNode<double>> GetNode(const ComputationNetworkPtr& net, const wstring& nodeName)
+{
+    return dynamic_pointer_cast<ComputationNode<double>>(net->GetNodeFromName(nodeName));
+}
+
+static vector<double> GetValues(const ComputationNetworkPtr& net, const wstring& nodeName)
+{
+    auto& value = GetNode(net, nodeName)->Value();
+    return vector<double>(value.Data(), value.Data() + value.GetNumElements());
+}
+
+static void SetValues(const ComputationNetworkPtr& net, const wstring& nodeName, const vector<double>& values)
+{
+    auto& value = GetNode(net, nodeName)->Value();
+    value.SetValue(value.GetNumRows(), value.GetNumCols(), c_deviceId, const_cast<double*>(values.data()));
+}
+
+static void SetRandomValues(const ComputationNetworkPtr& net, const wstring& nodeName, double low, double high, unsigned int seed)
+{
+    mt19937 rng(seed);
+    uniform_real_distribution<double> distribution(low, high);
+    vector<double> values(GetNode(net, nodeName)->Value().GetNumElements());
+    for (auto& v : values)
+        v = distribution(rng);
+    SetValues(net, nodeName, values);
+}
+
+// the gradient of a parameter as a dense [rows x cols] array; the gradient of the weights of the sampled criterion is sparse
+static vector<double> GetGradient(const ComputationNetworkPtr& net, const wstring& nodeName)
+{
+    auto& gradient = GetNode(net, nodeName)->Gradient();
+    Matrix<double> dense(gradient.GetNumRows(), gradient.GetNumCols(), c_deviceId);
+    dense.SetValue(0);
+    Matrix<double>::ScaleAndAdd(1, gradient, dense);
+    return vector<double>(dense.Data(), dense.Data() + dense.GetNumElements());
+}
+
+// label, x, and h = V * x; W, b are the output weights and bias, whose last class has a bias so low that it does not count
+static shared_ptr<ComputationNode<double>> CreateHiddenLayer(ComputationNetworkBuilder<double>& builder)
+{
+    builder.CreateInputNode(L"label", c_numClasses);
+    auto x = builder.CreateInputNode(L"x", c_inputDim);
+    auto v = builder.CreateLearnableParameter(L"V", c_hiddenDim, c_inputDim);
+    builder.CreateLearnableParameter(L"W", c_hiddenDim, c_numClasses);
+    builder.CreateLearnableParameter(L"b", TensorShape(c_numClasses));
+    return builder.Times(v, x, 1, L"h");
+}
+
+static void SetParameterValues(const ComputationNetworkPtr& net)
+{
+    SetRandomValues(net, L"V", -1, 1, 1);
+    SetRandomValues(net, L"W", -1, 1, 2);
+    SetRandomValues(net, L"b", -1, 1, 3);
+    auto bias = GetValues(net, L"b");
+    bias.back() = -100;
+    SetValues(net, L"b", bias);
+}
+
+// criterion = SampledCrossEntropyWithSoftmax(label, h, W, b, RandomSample(samplingWeights), inclusionFrequency),
+// where the inclusion frequency is either RandomSampleInclusionFrequency(samplingWeights) or 1 for every class
+static ComputationNetworkPtr CreateSampledNetwork(const vector<double>& samplingWeights, size_t numSamples, bool allowDuplicates, bool useInclusionFrequencyNode)
+{
+    auto net = make_shared<ComputationNetwork>(c_deviceId);
+    ComputationNetworkBuilder<double> builder(*net);
+    auto h = CreateHiddenLayer(builder);
+    auto weights = builder.CreateLearnableParameter(L"samplingWeights", c_numClasses, 1);
+    weights->SetLearningRateMultiplier(0);
+
+    auto samples = New<RandomSampleNode<double>>(c_deviceId, L"samples", numSamples, allowDuplicates);
+    net->AddNodeToNetAndAttachInputs(samples, { weights });
+    shared_ptr<ComputationNode<double>> inclusionFrequency;
+    if (useInclusionFrequencyNode)
+    {
+        inclusionFrequency = New<RandomSampleInclusionFrequencyNode<double>>(c_deviceId, L"inclusionFrequency", numSamples, allowDuplicates);
+        net->AddNodeToNetAndAttachInputs(inclusionFrequency, { weights });
+    }
+    else
+    {
+        inclusionFrequency = builder.CreateLearnableParameter(L"inclusionFrequency", TensorShape(c_numClasses));
+        inclusionFrequency->SetLearningRateMultiplier(0);
+    }
+
+    auto criterion = builder.SampledCrossEntropyWithSoftmax(GetNode(net, L"label"), h, GetNode(net, L"W"), GetNode(net, L"b"), samples, inclusionFrequency, L"criterion");
+    net->AddToNodeGroup(L"criterion", criterion);
+    net->CompileNetwork();
+
+    SetParameterValues(net);
+    SetValues(net, L"samplingWeights", samplingWeights);
+    if (!useInclusionFrequencyNode)
+        SetValues(net, L"inclusionFrequency", vector<double>(c_numClasses, 1));
+    return net;
+}
+
+// criterion = CrossEntropyWithSoftmax(label, TransposeTimes(W, h) + b)
+static ComputationNetworkPtr CreateFullNetwork()
+{
+    auto net = make_shared<ComputationNetwork>(c_deviceId);
+    ComputationNetworkBuilder<double> builder(*net);
+    auto h = CreateHiddenLayer(builder);
+    auto z = builder.Plus(builder.TransposeTimes(GetNode(net, L"W"), h, L"Wh"), GetNode(net, L"b"), L"z");
+    auto criterion = builder.CrossEntropyWithSoftmax(GetNode(net, L"label"), z, L"criterion");
+    net->AddToNodeGroup(L"criterion", criterion);
+    net->CompileNetwork();
+
+    SetParameterValues(net);
+    return net;
+}
+
+// Allocates the matrices for training and sets a minibatch of random inputs with one-hot labels, and garbage in the gaps.
+static void StartMinibatch(const ComputationNetworkPtr& net)
+{
+    auto criterion = net->GetNodeFromName(L"criterion");
+    net->AllocateAllMatrices({}, {}, criterion);
+    net->StartEvaluateMinibatchLoop(criterion);
+
+    auto x = GetNode(net, L"x");
+    auto label = GetNode(net, L"label");
+    auto pMBLayout = x->GetMBLayout();
+    pMBLayout->Init(c_sequenceLengths.size(), c_numTimeSteps);
+    for (size_t s = 0; s < c_sequenceLengths.size(); s++)
+    {
+        pMBLayout->AddSequence(s, s, 0, c_sequenceLengths[s]);
+        if (c_sequenceLengths[s] < c_numTimeSteps)
+            pMBLayout->AddGap(s, c_sequenceLengths[s], c_numTimeSteps);
+    }
+
+    mt19937 rng(42);
+    uniform_real_distribution<double> distribution(-1, 1);
+    vector<double> inputs(c_inputDim * NumColumns());
+    vector<double> labels(c_numClasses * NumColumns(), 0);
+    for (size_t j = 0; j < NumColumns(); j++)
+    {
+        for (size_t i = 0; i < c_inputDim; i++)
+            inputs[j * c_inputDim + i] = IsGap(j) ? 100 : distribution(rng);
+        if (!IsGap(j))
+            labels[j * c_numClasses + LabelOf(j)] = 1;
+    }
+    x->Value().SetValue(c_inputDim, NumColumns(), c_deviceId, inputs.data());
+    label->Value().SetValue(c_numClasses, NumColumns(), c_deviceId, labels.data());
+    ComputationNetwork::BumpEvalTimeStamp({ x, label });
+}
+
+// Evaluates the criterion. The sampler is reset first, so that every evaluation draws the same samples.
+static double Evaluate(const ComputationNetworkPtr& net)
+{
+    if (net->NodeNameExists(L"samples"))
+        net->GetNodeFromName(L"samples")->As<RandomSampleNode<double>>()->SetRngState(c_samplingSeed);
+    auto criterion = net->GetNodeFromName(L"criterion");
+    net->ForwardProp(criterion);
+    return GetNode(net, L"criterion")->Value().Get00Element();
+}
+
+static const vector<size_t>& GetSamples(const ComputationNetworkPtr& net)
+{
+    return net->GetNodeFromName(L"samples")->As<RandomSampleNode<double>>()->GetSamples();
+}
+
+// -log of the softmax of the label over the label and the samples that are not the label, with the logits W[:, c]' h + b[c] - log(q[c]),
+// summed over all frames except the gaps
+static double ReferenceCriterion(const ComputationNetworkPtr& net)
+{
+    auto v = GetValues(net, L"V");
+    auto x = GetValues(net, L"x");
+    auto w = GetValues(net, L"W");
+    auto b = GetValues(net, L"b");
+    auto q = GetValues(net, L"inclusionFrequency");
+    const auto& samples = GetSamples(net);
+
+    double result = 0;
+    for (size_t j = 0; j < NumColumns(); j++)
+    {
+        if (IsGap(j))
+            continue;
+        vector<double> h(c_hiddenDim, 0);
+        for (size_t i = 0; i < c_hiddenDim; i++)
+            for (size_t k = 0; k < c_inputDim; k++)
+                h[i] += v[k * c_hiddenDim + i] * x[j * c_inputDim + k];
+        auto logit = [&](size_t c)
+        {
+            double z = b[c] - log(q[c]);
+            for (size_t i = 0; i < c_hiddenDim; i++)
+                z += w[c * c_hiddenDim + i] * h[i];
+            return z;
+        };
+
+        auto label = LabelOf(j);
+        vector<double> logits = { logit(label) };
+        for (auto sample : samples)
+        {
+            if (sample != label)
+                logits.push_back(logit(sample));
+        }
+        auto maxLogit = *max_element(logits.begin(), logits.end());
+        double sum = 0;
+        for (auto z : logits)
+            sum += exp(z - maxLogit);
+        result -= logits[0] - maxLogit - log(sum);
+    }
+    return result;
+}
+
+static void CheckClose(const vector<double>& actual, const vector<double>& expected, double tolerance)
+{
+    BOOST_REQUIRE_EQUAL(actual.size(), expected.size());
+    for (size_t i = 0; i < actual.size(); i++)
+        BOOST_CHECK_SMALL(actual[i] - expected[i], tolerance * (1 + fabs(expected[i])));
+}
+
+// 4 samples with duplicates from all 6 classes, with the estimated inclusion frequencies
+static ComputationNetworkPtr CreateSampledNetworkWithDuplicates()
+{
+    return CreateSampledNetwork({ 1, 2, 0.5, 1.5, 1, 2 }, 4, /*allowDuplicates=*/true, /*useInclusionFrequencyNode=*/true);
+}
+
+BOOST_AUTO_TEST_SUITE(SampledCrossEntropyWithSoftmaxSuite)
+
+BOOST_AUTO_TEST_CASE(SampledCriterionMatchesReference)
+{
+    auto net = CreateSampledNetworkWithDuplicates();
+    ScopedNetworkOperationMode modeGuard(net, NetworkOperationMode::training);
+    StartMinibatch(net);
+    auto value = Evaluate(net);
+
+    // the test is only meaningful if a sample is the label of some frame, and the frames of that label are not all gaps
+    const auto& samples = GetSamples(net);
+    BOOST_REQUIRE_EQUAL(samples.size(), 4);
+    size_t numAccidentalHits = 0;
+    for (size_t j = 0; j < NumColumns(); j++)
+        numAccidentalHits += IsGap(j) ? 0 : count(samples.begin(), samples.end(), LabelOf(j));
+    BOOST_REQUIRE(numAccidentalHits > 0);
+
+    BOOST_CHECK_SMALL(value - ReferenceCriterion(net), 1e-10 * fabs(value));
+
+    // the same samples are drawn again after resetting the sampler, so the value does not change
+    BOOST_CHECK_EQUAL(Evaluate(net), value);
+}
+
+BOOST_AUTO_TEST_CASE(SampledCriterionGradientsMatchFiniteDifferences)
+{
+    auto net = CreateSampledNetworkWithDuplicates();
+    ScopedNetworkOperationMode modeGuard(net, NetworkOperationMode::training);
+    StartMinibatch(net);
+    Evaluate(net);
+    net->Backprop(net->GetNodeFromName(L"criterion"));
+
+    // V gets its gradient through h, so this also checks the gradient of the hidden activations
+    const double epsilon = 1e-5;
+    for (const auto& nodeName : { L"V", L"W", L"b" })
+    {
+        auto gradient = GetGradient(net, nodeName);
+        auto values = GetValues(net, nodeName);
+        vector<double> expected(values.size());
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            auto original = values[i];
+            values[i] = original + epsilon;
+            SetValues(net, nodeName, values);
+            ComputationNetwork::BumpEvalTimeStamp({ net->GetNodeFromName(nodeName) });
+            auto plus = Evaluate(net);
+            values[i] = original - epsilon;
+            SetValues(net, nodeName, values);
+            ComputationNetwork::BumpEvalTimeStamp({ net->GetNodeFromName(nodeName) });
+            auto minus = Evaluate(net);
+            values[i] = original;
+            expected[i] = (plus - minus) / (2 * epsilon);
+        }
+        SetValues(net, nodeName, values);
+        ComputationNetwork::BumpEvalTimeStamp({ net->GetNodeFromName(nodeName) });
+        CheckClose(gradient, expected, 1e-6);
+    }
+
+    // only the columns of W of the samples and the labels have a gradient
+    const auto& samples = GetSamples(net);
+    auto gradient = GetGradient(net, L"W");
+    for (size_t c = 0; c < c_numClasses; c++)
+    {
+        bool isUsed = find(samples.begin(), samples.end(), c) != samples.end();
+        for (size_t j = 0; j < NumColumns(); j++)
+            isUsed |= !IsGap(j) && LabelOf(j) == c;
+        if (!isUsed)
+        {
+            for (size_t i = 0; i < c_hiddenDim; i++)
+                BOOST_CHECK_EQUAL(gradient[c * c_hiddenDim + i], 0);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(SampledCriterionOverAllClassesMatchesFullSoftmax)
+{
+    // 5 samples without duplicates from the 5 classes that have a sampling weight, so every label is also a sample (an accidental hit).
+    // With an inclusion frequency of 1 for every class, the sampled softmax is the full softmax over these 5 classes,
+    // and the 6th class, which has a bias of -100, does not count in the full softmax either.
+    auto sampledNet = CreateSampledNetwork({ 1, 2, 0.5, 1.5, 1, 0 }, 5, /*allowDuplicates=*/false, /*useInclusionFrequencyNode=*/false);
+    auto fullNet = CreateFullNetwork();
+    for (const auto& net : { sampledNet, fullNet })
+    {
+        ScopedNetworkOperationMode modeGuard(net, NetworkOperationMode::training);
+        StartMinibatch(net);
+        Evaluate(net);
+        net->Backprop(net->GetNodeFromName(L"criterion"));
+    }
+
+    auto samples = GetSamples(sampledNet);
+    sort(samples.begin(), samples.end());
+    BOOST_CHECK(samples == vector<size_t>({ 0, 1, 2, 3, 4 }));
+
+    auto value = GetNode(fullNet, L"criterion")->Value().Get00Element();
+    BOOST_CHECK_SMALL(GetNode(sampledNet, L"criterion")->Value().Get00Element() - value, 1e-10 * value);
+    for (const auto& nodeName : { L"V", L"W", L"b" })
+        CheckClose(GetGradient(sampledNet, nodeName), GetGradient(fullNet, nodeName), 1e-10);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
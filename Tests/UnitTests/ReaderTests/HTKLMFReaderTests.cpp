@@ -4,8 +4,18 @@
 //
 #include "stdafx.h"
 #include "Common/ReaderTestHelper.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <memory>
+#include <random>
+#include <thread>
+#include "../../../Source/Readers/HTKDeserializers/MLFLabelLoader.h"
 
 using namespace Microsoft::MSR::CNTK;
+using namespace std;
 
 namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
 
@@ -702,6 +712,136 @@ BOOST_AUTO_TEST_CASE(HTKDeserializersSimpleDataLoop12)
         1);
 };
 
+// Reads the features of the DataLoop2 data (33 dims with 5 frames of context on each side) with all chunk compressions,
+// in frame and in sequence mode, and compares the results against the uncompressed data.
+BOOST_AUTO_TEST_CASE(HTKDeserializersChunkCompression)
+{
+    const size_t featureDim = 33;
+    const size_t contextFrames = 11;
+    const size_t dim = featureDim * contextFrames;
+
+    // Returns the augmented feature vectors of all sequences read in one epoch, in the order the reader returned them.
+    auto read = [this, dim](bool frameMode, const wstring& compression, size_t epochSize)
+    {
+        auto reader = GetDataReader(
+            testDataPath() + "/Config/HTKDeserializersSimpleDataLoop2_Config.cntk",
+            "Simple_Test",
+            "reader",
+            { wstring(L"Simple_Test=[reader=[frameMode=") + (frameMode ? L"true" : L"false") + L"]]",
+              L"Simple_Test=[reader=[features=[chunkCompression=" + compression + L"]]]" });
+        auto inputs = CreateStreamMinibatchInputs<float>(1, 1);
+
+        vector<vector<float>> sequences;
+        reader->StartMinibatchLoop(frameMode ? 256 : 2048, 0, inputs->GetStreamDescriptions(), epochSize);
+        while (reader->GetMinibatch(*inputs))
+        {
+            auto& matrix = inputs->GetInputMatrix<float>(L"features");
+            const auto& layout = *inputs->GetInput(L"features").pMBLayout;
+            BOOST_REQUIRE_EQUAL(matrix.GetNumRows(), dim);
+            unique_ptr<float[]> data{ matrix.CopyToArray() };
+
+            auto minibatchSequences = layout.GetAllSequences();
+            minibatchSequences.erase(remove_if(minibatchSequences.begin(), minibatchSequences.end(),
+                                               [](const MBLayout::SequenceInfo& s) { return s.seqId == GAP_SEQUENCE_ID; }),
+                                     minibatchSequences.end());
+            sort(minibatchSequences.begin(), minibatchSequences.end(),
+                 [](const MBLayout::SequenceInfo& a, const MBLayout::SequenceInfo& b) { return a.seqId < b.seqId; });
+
+            for (const auto& s : minibatchSequences)
+            {
+                BOOST_REQUIRE(s.tBegin >= 0 && s.tEnd <= layout.GetNumTimeSteps());
+                vector<float> sequence;
+                for (size_t t = s.tBegin; t < s.tEnd; t++)
+                {
+                    const float* column = data.get() + (t * layout.GetNumParallelSequences() + s.s) * dim;
+                    sequence.insert(sequence.end(), column, column + dim);
+                }
+                sequences.push_back(move(sequence));
+            }
+        }
+        return sequences;
+    };
+
+    auto flatten = [](const vector<vector<float>>& sequences)
+    {
+        vector<float> result;
+        for (const auto& s : sequences)
+            result.insert(result.end(), s.begin(), s.end());
+        return result;
+    };
+
+    const size_t epochSize = 3000;
+    map<wstring, vector<vector<float>>> results;
+    for (const wstring compression : { L"none", L"float16", L"int8" })
+    {
+        auto sequences = read(false, compression, epochSize);
+        auto expected = flatten(sequences);
+        BOOST_REQUIRE_GT(sequences.size(), 1);
+        BOOST_REQUIRE_GE(expected.size(), epochSize * dim);
+
+        // Frame mode slices the context window of every frame out of the same chunk data.
+        auto frames = flatten(read(true, compression, expected.size() / dim));
+        BOOST_REQUIRE_EQUAL(frames.size(), expected.size());
+        BOOST_CHECK_MESSAGE(frames == expected, "Frame and sequence mode differ for chunkCompression=" << string(compression.begin(), compression.end()));
+
+        results[compression] = move(sequences);
+    }
+
+    const auto& none = results[L"none"];
+    const auto& half = results[L"float16"];
+    const auto& int8 = results[L"int8"];
+    BOOST_REQUIRE_EQUAL(half.size(), none.size());
+    BOOST_REQUIRE_EQUAL(int8.size(), none.size());
+
+    size_t halfErrors = 0, int8Errors = 0;
+    for (size_t i = 0; i < none.size(); i++)
+    {
+        BOOST_REQUIRE_EQUAL(half[i].size(), none[i].size());
+        BOOST_REQUIRE_EQUAL(int8[i].size(), none[i].size());
+        size_t numFrames = none[i].size() / dim;
+
+        // float16 keeps 11 significant bits.
+        for (size_t j = 0; j < none[i].size(); j++)
+        {
+            if (fabs(half[i][j] - none[i][j]) > fabs(none[i][j]) * ldexp(1.0, -11) + ldexp(1.0, -24))
+                halfErrors++;
+        }
+
+        // int8 quantizes each dimension of an utterance to 256 steps between its minimum and maximum,
+        // so the error is at most half a step. The context blocks of a frame are frames of the same utterance.
+        for (size_t d = 0; d < featureDim; d++)
+        {
+            float minValue = numeric_limits<float>::max();
+            float maxValue = -numeric_limits<float>::max();
+            for (size_t t = 0; t < numFrames; t++)
+            {
+                for (size_t b = 0; b < contextFrames; b++)
+                {
+                    float value = none[i][t * dim + b * featureDim + d];
+                    minValue = min(minValue, value);
+                    maxValue = max(maxValue, value);
+                }
+            }
+
+            double bound = (maxValue - minValue) / 510.0 * (1 + 1e-3);
+            for (size_t t = 0; t < numFrames; t++)
+            {
+                for (size_t b = 0; b < contextFrames; b++)
+                {
+                    size_t j = t * dim + b * featureDim + d;
+                    if (fabs(int8[i][j] - none[i][j]) > bound + 1e-5 * fabs(none[i][j]))
+                        int8Errors++;
+                }
+            }
+        }
+    }
+
+    BOOST_CHECK_EQUAL(halfErrors, 0);
+    BOOST_CHECK_EQUAL(int8Errors, 0);
+    BOOST_CHECK(flatten(half) != flatten(none));
+    BOOST_CHECK(flatten(int8) != flatten(none));
+};
+
 BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_FIXTURE_TEST_SUITE(ReaderIVectorTestSuite, iVectorFixture)
@@ -815,6 +955,165 @@ BOOST_AUTO_TEST_CASE(HTKIVectorBptt)
 
 BOOST_AUTO_TEST_SUITE_END()
 
+BOOST_AUTO_TEST_SUITE(MLFLabelLoaderTests)
+
+// Writes a state list with the given number of states.
+static void WriteStateList(const wstring& path, size_t numberOfStates)
+{
+    FILE* f = fopenOrDie(path, L"wb");
+    for (size_t i = 0; i < numberOfStates; ++i)
+        fprintf(f, "s%d[%d]\n", (int)(i % 100), (int)i);
+    fcloseOrDie(f);
+}
+
+// Writes an MLF in the formats seen in practice (both line ends, "*/" prefixes, embedded headers of concatenated
+// files, time stamps in 100ns units) and returns the class id of every frame of every utterance.
+static void WriteMlf(const wstring& path, size_t numberOfUtterances, size_t numberOfStates,
+                     vector<string>& keys, vector<vector<unsigned short>>& classIds)
+{
+    std::mt19937 rng(17);
+    keys.clear();
+    classIds.clear();
+    FILE* f = fopenOrDie(path, L"wb");
+    fprintf(f, "#!MLF!#\n");
+    for (size_t u = 0; u < numberOfUtterances; ++u)
+    {
+        const char* newline = u % 3 == 0 ? "\r\n" : "\n";
+        if (u % 1000 == 500)
+            fprintf(f, "#!MLF!#%s", newline);
+
+        keys.push_back("speaker" + to_string(u % 10) + "/utt" + to_string(u));
+        fprintf(f, "\"%s%s.lab\"%s", u % 2 == 0 ? "*/" : "", keys.back().c_str(), newline);
+        classIds.push_back(vector<unsigned short>());
+        size_t frame = 0;
+        size_t numberOfSegments = 1 + rng() % 50;
+        for (size_t i = 0; i < numberOfSegments; ++i)
+        {
+            size_t length = 1 + rng() % 10;
+            size_t state = rng() % numberOfStates;
+            fprintf(f, "%d %d s%d[%d]%s", (int)(frame * 100000), (int)((frame + length) * 100000), (int)(state % 100), (int)state, newline);
+            classIds.back().insert(classIds.back().end(), length, (unsigned short)state);
+            frame += length;
+        }
+        fprintf(f, ".%s", newline);
+    }
+    fcloseOrDie(f);
+}
+
+static void CheckLabels(const MLFLabels& labels, const vector<string>& keys, const vector<vector<unsigned short>>& classIds)
+{
+    BOOST_REQUIRE_EQUAL(keys.size(), labels.NumberOfUtterances());
+    for (size_t u = 0; u < keys.size(); ++u)
+    {
+        BOOST_REQUIRE_EQUAL(keys[u], labels.GetKey(u));
+        BOOST_REQUIRE_EQUAL(classIds[u].size(), labels.GetNumberOfFrames(u));
+        BOOST_REQUIRE(equal(classIds[u].begin(), classIds[u].end(), labels.m_classIds.begin() + labels.m_frameOffsets[u]));
+        BOOST_REQUIRE_EQUAL(*max_element(classIds[u].begin(), classIds[u].end()), labels.m_maxClassIds[u]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MLFLabelLoaderParallelParseAndCache)
+{
+    const wstring stateList = L"states.tmp";
+    const wstring mlf = L"labels.mlf.tmp";
+    const wstring cache = L"labels.cache.tmp";
+    _wunlink(cache.c_str());
+
+    vector<string> keys;
+    vector<vector<unsigned short>> classIds;
+    WriteStateList(stateList, 3000);
+    WriteMlf(mlf, 20000, 3000, keys, classIds);
+
+    MLFLabels sequential;
+    MLFLabelLoader(stateList, 100000.0, 1).Parse(vector<wstring>{ mlf }, sequential);
+    CheckLabels(sequential, keys, classIds);
+
+    // The result does not depend on the number of threads.
+    MLFLabels parallel;
+    MLFLabelLoader(stateList, 100000.0, 8).Parse(vector<wstring>{ mlf, mlf }, parallel);
+    BOOST_CHECK_EQUAL(2 * keys.size(), parallel.NumberOfUtterances());
+    BOOST_CHECK(equal(sequential.m_classIds.begin(), sequential.m_classIds.end(), parallel.m_classIds.begin()));
+    BOOST_CHECK(equal(sequential.m_classIds.begin(), sequential.m_classIds.end(), parallel.m_classIds.begin() + sequential.m_classIds.size()));
+
+    // The first load writes the cache, the second one reads it.
+    MLFLabelLoader loader(stateList, 100000.0, 4);
+    MLFLabels parsed, cached;
+    loader.Load(vector<wstring>{ mlf }, cache, parsed);
+    BOOST_CHECK(fexists(cache));
+    loader.Load(vector<wstring>{ mlf }, cache, cached);
+    CheckLabels(cached, keys, classIds);
+
+    // A cache written with other options is ignored.
+    MLFLabels reparsed;
+    MLFLabelLoader(stateList, 50000.0, 4).Load(vector<wstring>{ mlf }, cache, reparsed);
+    BOOST_REQUIRE_EQUAL(keys.size(), reparsed.NumberOfUtterances());
+    // (twice the frames per HTK time unit, so the labels must come from the MLF and not from the cache)
+    BOOST_CHECK_EQUAL(2 * cached.m_classIds.size(), reparsed.m_classIds.size());
+    for (size_t u = 0; u <= keys.size(); ++u)
+        BOOST_REQUIRE_EQUAL(2 * cached.m_frameOffsets[u], reparsed.m_frameOffsets[u]);
+
+    _wunlink(cache.c_str());
+    _wunlink(mlf.c_str());
+    _wunlink(stateList.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(MLFLabelLoaderRejectsUnknownStates)
+{
+    const wstring stateList = L"states.tmp";
+    const wstring mlf = L"labels.mlf.tmp";
+    WriteStateList(stateList, 10);
+
+    FILE* f = fopenOrDie(mlf, L"wb");
+    fprintf(f, "#!MLF!#\n\"a.lab\"\n0 100000 s0[0]\n100000 200000 s0[10]\n.\n");
+    fcloseOrDie(f);
+    MLFLabels labels;
+    BOOST_CHECK_THROW(MLFLabelLoader(stateList, 100000.0, 2).Parse(vector<wstring>{ mlf }, labels), std::exception);
+
+    // an utterance without the terminating "."
+    f = fopenOrDie(mlf, L"wb");
+    fprintf(f, "#!MLF!#\n\"a.lab\"\n0 100000 s0[0]\n");
+    fcloseOrDie(f);
+    BOOST_CHECK_THROW(MLFLabelLoader(stateList, 100000.0, 2).Parse(vector<wstring>{ mlf }, labels), std::exception);
+
+    _wunlink(mlf.c_str());
+    _wunlink(stateList.c_str());
+}
+
+// Parse throughput with a single thread and with one thread per core.
+BOOST_AUTO_TEST_CASE(MLFLabelLoaderParseThroughput)
+{
+    const wstring stateList = L"states.tmp";
+    const wstring mlf = L"labels.mlf.tmp";
+    vector<string> keys;
+    vector<vector<unsigned short>> classIds;
+    WriteStateList(stateList, 9000);
+    WriteMlf(mlf, 60000, 9000, keys, classIds);
+    double megabytes = filesize64(mlf.c_str()) / 1e6;
+
+    MLFLabels reference;
+    size_t maxThreads = max(thread::hardware_concurrency(), 1u);
+    for (size_t threads : { (size_t)1, maxThreads })
+    {
+        MLFLabelLoader loader(stateList, 100000.0, threads);
+        MLFLabels labels;
+        auto start = chrono::steady_clock::now();
+        loader.Parse(vector<wstring>{ mlf }, labels);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        fprintf(stderr, "MLFLabelLoaderParseThroughput: %d thread(s): %.1f MB in %.3f s, %.1f MB/s\n", (int)threads, megabytes, seconds, megabytes / seconds);
+
+        if (threads == 1)
+            reference = labels;
+        else
+            BOOST_CHECK(reference.m_classIds == labels.m_classIds && reference.m_frameOffsets == labels.m_frameOffsets && reference.m_keys == labels.m_keys);
+    }
+    BOOST_CHECK_EQUAL(keys.size(), reference.NumberOfUtterances());
+
+    _wunlink(mlf.c_str());
+    _wunlink(stateList.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
 }
 
 }}}
@@ -10,8 +10,10 @@
 #include "DataDeserializer.h"
 #include "BlockRandomizer.h"
 #include "CorpusDescriptor.h"
+#include "Bundler.h"
 #include "FramePacker.h"
 #include "SequencePacker.h"
+#include "SidecarCache.h"
 #include "CudaMemoryProvider.h"
 #include "HeapMemoryProvider.h"
 
@@ -19,6 +21,7 @@
 // disable warning about possible mod 0 operation in uniform_int_distribution
 #pragma warning(disable:4724)
 #include <boost/random/uniform_int_distribution.hpp>
+#include <boost/filesystem.hpp>
 #pragma warning(pop)
 
 #include "SequentialDeserializer.h"
@@ -1030,6 +1033,305 @@ BOOST_AUTO_TEST_CASE(CorpusDescriptorFromFile)
     remove("test.tmp");
 }
 
+BOOST_AUTO_TEST_CASE(StringToIdMapInterning)
+{
+    StringToIdMap registry;
+    vector<string> keys;
+    for (size_t i = 0; i < 10000; ++i)
+        keys.push_back("utterance_" + to_string(i * 7919 % 10007));
+    keys.push_back("");
+
+    for (size_t i = 0; i < keys.size(); ++i)
+        BOOST_CHECK_EQUAL(i, registry[keys[i]]);
+    BOOST_CHECK_EQUAL(keys.size(), registry.Size());
+    BOOST_CHECK(registry.GetMemoryUsage() > 0);
+
+    // Adding existing values does not create new ids.
+    registry.AddValue(keys[42]);
+    BOOST_CHECK_EQUAL(42, registry[keys[42]]);
+    BOOST_CHECK_EQUAL(keys.size(), registry.Size());
+
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        size_t id = SIZE_MAX;
+        BOOST_CHECK(registry.TryGet(keys[i], id));
+        BOOST_CHECK_EQUAL(i, id);
+        BOOST_CHECK_EQUAL(keys[i], registry[id]);
+    }
+
+    size_t id = 0;
+    BOOST_CHECK(!registry.TryGet("utterance_", id));
+    BOOST_CHECK(!registry.Contains("utterance_10007"));
+    BOOST_CHECK_THROW(registry[keys.size()], std::exception);
+}
+
+BOOST_AUTO_TEST_CASE(StringToIdMapSaveAndLoad)
+{
+    const wstring path = L"keys.tmp";
+    {
+        StringToIdMap registry;
+        for (size_t i = 0; i < 5000; ++i)
+            registry["key" + to_string(i)];
+        registry.Save(path);
+    }
+
+    StringToIdMap mapped;
+    mapped.Load(path);
+    BOOST_CHECK_EQUAL(5000, mapped.Size());
+    for (size_t i = 0; i < 5000; ++i)
+    {
+        BOOST_CHECK_EQUAL(i, mapped["key" + to_string(i)]);
+        BOOST_CHECK_EQUAL("key" + to_string(i), mapped[i]);
+    }
+
+    // A mapped registry can still grow.
+    BOOST_CHECK_EQUAL(5000, mapped["new key"]);
+    BOOST_CHECK_EQUAL(17, mapped["key17"]);
+    BOOST_CHECK_EQUAL("new key", mapped[(size_t)5000]);
+
+    WStringToIdMap wideRegistry;
+    BOOST_CHECK_THROW(wideRegistry.Load(path), std::exception);
+
+    _wunlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(CorpusDescriptorKeyRegistry)
+{
+    const wstring path = L"corpuskeys.tmp";
+    _wunlink(path.c_str());
+    {
+        CorpusDescriptor corpus(false, path);
+        BOOST_CHECK_EQUAL(0, corpus.KeyToId("a"));
+        BOOST_CHECK_EQUAL(1, corpus.KeyToId("b"));
+        corpus.FinalizeKeyRegistry();
+    }
+    BOOST_CHECK(fexists(path));
+
+    CorpusDescriptor corpus(false, path);
+    BOOST_CHECK_EQUAL(1, corpus.KeyToId("b"));
+    BOOST_CHECK_EQUAL("a", corpus.IdToKey(0));
+    BOOST_CHECK_EQUAL(2, corpus.KeyToId("c"));
+
+    _wunlink(path.c_str());
+}
+
+// Cache files are optional: failing to write one is not an error and leaves no temporary file behind.
+BOOST_AUTO_TEST_CASE(SidecarCacheWriteFailures)
+{
+    // The directory of the key registry does not exist.
+    const wstring missingPath = L"missingdir.tmp/corpuskeys.tmp";
+    {
+        CorpusDescriptor corpus(false, missingPath);
+        BOOST_CHECK_EQUAL(0, corpus.KeyToId("a"));
+        BOOST_CHECK_NO_THROW(corpus.FinalizeKeyRegistry());
+    }
+    BOOST_CHECK(!fexists(missingPath));
+
+    // The cache file cannot be replaced, because a directory has its name.
+    const wstring blockedPath = L"blockedcache.tmp";
+    boost::filesystem::create_directory(blockedPath);
+    const wstring tempPath = blockedPath + L".tmp" + to_wstring((unsigned long long)GetCurrentProcessId());
+    bool written = TryWriteSidecarCache(blockedPath, "SidecarCacheWriteFailures", [&]()
+    {
+        SidecarCacheWriter writer(blockedPath);
+        writer.WriteValue(SidecarCacheHeader("TESTCACH", 1, 1, 0));
+        writer.Commit();
+    });
+    BOOST_CHECK(!written);
+    BOOST_CHECK(!fexists(tempPath));
+
+    boost::filesystem::remove(blockedPath);
+}
+
+// Driving deserializer that allows the bundler to check its chunks in parallel.
+class ConcurrentSequentialDeserializer : public SequentialDeserializer
+{
+public:
+    ConcurrentSequentialDeserializer(size_t seed, size_t chunkSizeInSamples, size_t sweepNumberOfSamples, uint32_t maxSequenceLength)
+        : SequentialDeserializer(seed, chunkSizeInSamples, sweepNumberOfSamples, maxSequenceLength)
+    {}
+
+    bool SupportsConcurrentSequenceDescriptions() const override
+    {
+        return true;
+    }
+};
+
+// Secondary deserializer that does not have every 7th sequence and has longer sequences for every 3rd.
+class MockSecondaryDeserializer : public IDataDeserializer
+{
+public:
+    MockSecondaryDeserializer() : m_numberOfLookups(0), m_numberOfSamples(0), m_sampleLayout(make_shared<TensorShape>(1))
+    {}
+
+    vector<StreamDescriptionPtr> GetStreamDescriptions() const override
+    {
+        return vector<StreamDescriptionPtr>
+        {
+            make_shared<StreamDescription>(StreamDescription{ L"secondary", 0, StorageType::dense, ElementType::tfloat, m_sampleLayout })
+        };
+    }
+
+    ChunkDescriptions GetChunkDescriptions() override
+    {
+        return ChunkDescriptions{ make_shared<ChunkDescription>(ChunkDescription{ 0, m_numberOfSamples, 0 }) };
+    }
+
+    void GetSequencesForChunk(ChunkIdType, vector<SequenceDescription>&) override
+    {
+        throw logic_error("Not implemented");
+    }
+
+    bool GetSequenceDescription(const SequenceDescription& primary, SequenceDescription& description) override
+    {
+        m_numberOfLookups++;
+        if (primary.m_key.m_sequence % 7 == 0)
+            return false;
+        description = primary;
+        description.m_numberOfSamples += primary.m_key.m_sequence % 3 == 0 ? 1 : 0;
+        return true;
+    }
+
+    ChunkPtr GetChunk(ChunkIdType) override
+    {
+        throw logic_error("Not implemented");
+    }
+
+    bool SupportsConcurrentSequenceDescriptions() const override
+    {
+        return true;
+    }
+
+    vector<wstring> GetInputFiles() const override
+    {
+        return m_inputFiles;
+    }
+
+    atomic<size_t> m_numberOfLookups;
+    size_t m_numberOfSamples;
+    vector<wstring> m_inputFiles;
+
+private:
+    TensorShapePtr m_sampleLayout;
+};
+
+BOOST_AUTO_TEST_CASE(BundlerParallelCleanseAndCache)
+{
+    auto driver = make_shared<ConcurrentSequentialDeserializer>(0, 100, 20000, 20);
+    auto secondary = make_shared<MockSecondaryDeserializer>();
+    vector<IDataDeserializerPtr> deserializers{ driver, secondary };
+
+    auto bundle = [&](const string& threads, const string& cache)
+    {
+        ConfigParameters config;
+        config.Insert("bundlerThreads", threads);
+        if (!cache.empty())
+            config.Insert("bundlerCache", cache);
+        Bundler bundler(config, driver, deserializers, true);
+
+        vector<pair<ChunkDescription, vector<SequenceDescription>>> result;
+        for (const auto& c : bundler.GetChunkDescriptions())
+        {
+            result.push_back(make_pair(*c, vector<SequenceDescription>()));
+            bundler.GetSequencesForChunk(c->m_id, result.back().second);
+        }
+        return result;
+    };
+
+    auto check = [](const vector<pair<ChunkDescription, vector<SequenceDescription>>>& expected,
+                    const vector<pair<ChunkDescription, vector<SequenceDescription>>>& actual)
+    {
+        BOOST_REQUIRE_EQUAL(expected.size(), actual.size());
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            BOOST_CHECK_EQUAL(i, actual[i].first.m_id);
+            BOOST_CHECK_EQUAL(expected[i].first.m_numberOfSamples, actual[i].first.m_numberOfSamples);
+            BOOST_CHECK_EQUAL(expected[i].first.m_numberOfSequences, actual[i].first.m_numberOfSequences);
+            BOOST_REQUIRE_EQUAL(expected[i].second.size(), actual[i].second.size());
+            for (size_t j = 0; j < expected[i].second.size(); ++j)
+            {
+                BOOST_CHECK_EQUAL(expected[i].second[j].m_id, actual[i].second[j].m_id);
+                BOOST_CHECK_EQUAL(expected[i].second[j].m_numberOfSamples, actual[i].second[j].m_numberOfSamples);
+                BOOST_CHECK_EQUAL(expected[i].second[j].m_key.m_sequence, actual[i].second[j].m_key.m_sequence);
+            }
+        }
+    };
+
+    auto serial = bundle("1", "");
+    size_t sequences = 0;
+    for (const auto& c : serial)
+    {
+        sequences += c.second.size();
+        for (const auto& s : c.second)
+            BOOST_CHECK(s.m_key.m_sequence % 7 != 0);
+    }
+    BOOST_CHECK(sequences > 0);
+
+    // Parallel check gives the same chunks in the same order.
+    check(serial, bundle("4", ""));
+
+    // The second bundler takes the result of the check from the cache.
+    const string path = "bundle.tmp";
+    _wunlink(msra::strfun::utf16(path).c_str());
+    size_t lookupsBefore = secondary->m_numberOfLookups;
+    check(serial, bundle("4", path));
+    BOOST_CHECK(fexists(path));
+    size_t lookupsWithoutCache = secondary->m_numberOfLookups - lookupsBefore;
+    lookupsBefore = secondary->m_numberOfLookups;
+    check(serial, bundle("4", path));
+    BOOST_CHECK(secondary->m_numberOfLookups - lookupsBefore < lookupsWithoutCache);
+
+    _wunlink(msra::strfun::utf16(path).c_str());
+}
+
+// The bundle cache is recomputed if an input file or the chunks of a secondary deserializer change.
+BOOST_AUTO_TEST_CASE(BundlerCacheDetectsChangedInputs)
+{
+    auto driver = make_shared<ConcurrentSequentialDeserializer>(0, 100, 2000, 20);
+    auto secondary = make_shared<MockSecondaryDeserializer>();
+    vector<IDataDeserializerPtr> deserializers{ driver, secondary };
+
+    const string input = "bundleinput.tmp";
+    const string cache = "bundleinput.cache.tmp";
+    _wunlink(msra::strfun::utf16(cache).c_str());
+    {
+        ofstream f(input);
+        f << "labels";
+    }
+    secondary->m_inputFiles.push_back(msra::strfun::utf16(input));
+
+    // Returns the number of lookups in the secondary deserializer.
+    auto bundle = [&]()
+    {
+        ConfigParameters config;
+        config.Insert("bundlerCache", cache);
+        size_t lookupsBefore = secondary->m_numberOfLookups;
+        Bundler bundler(config, driver, deserializers, true);
+        return secondary->m_numberOfLookups - lookupsBefore;
+    };
+
+    size_t lookupsWithoutCache = bundle();
+    BOOST_CHECK(lookupsWithoutCache > 0);
+    BOOST_CHECK(fexists(cache));
+    BOOST_CHECK_EQUAL(0, bundle());
+
+    // The input file reported by the secondary deserializer has changed.
+    {
+        ofstream f(input, ios::app);
+        f << " regenerated";
+    }
+    BOOST_CHECK_EQUAL(lookupsWithoutCache, bundle());
+    BOOST_CHECK_EQUAL(0, bundle());
+
+    // The chunks of the secondary deserializer have changed.
+    secondary->m_numberOfSamples = 1;
+    BOOST_CHECK_EQUAL(lookupsWithoutCache, bundle());
+    BOOST_CHECK_EQUAL(0, bundle());
+
+    _wunlink(msra::strfun::utf16(cache).c_str());
+    _wunlink(msra::strfun::utf16(input).c_str());
+}
+
 BOOST_AUTO_TEST_CASE(CheckEpochBoundarySingleWorker)
 {
     size_t chunkSizeInSamples = 1000;
@@ -1635,6 +1937,66 @@ BOOST_AUTO_TEST_CASE(SequencePackerSmallChunksWithSequences)
 }
 
 
+BOOST_AUTO_TEST_CASE(SequencePackerBigChunksWithLengthBucketsAndBestFitDecreasing1Sweep)
+{
+    size_t chunkSizeInSamples = 998;
+    size_t sweepNumberOfSamples = 21335;
+    uint32_t maxSequenceLength = 300;
+    size_t randomizationWindow = chunkSizeInSamples * 5;
+    size_t lengthBucketSizeInSamples = 128;
+
+    auto deserializer = make_shared<SequentialDeserializer>(0, chunkSizeInSamples, sweepNumberOfSamples, maxSequenceLength);
+
+    auto blockRandomizer = make_shared<BlockRandomizer>(0, randomizationWindow, deserializer, true, false, 0, true, lengthBucketSizeInSamples);
+    PackerPtr packer = std::make_shared<SequencePacker>(blockRandomizer, deserializer->GetStreamDescriptions(), 1, true, true);
+
+    CheckPackerOnSweep(packer, blockRandomizer, deserializer, 1, 64, false, true);
+    CheckPackerOnSweep(packer, blockRandomizer, deserializer, 5, 64, false, true);
+
+    CheckPackerOnSweep(packer, blockRandomizer, deserializer, 1, 33, false, true);
+    CheckPackerOnSweep(packer, blockRandomizer, deserializer, 5, 31, false, true);
+}
+
+BOOST_AUTO_TEST_CASE(MBLayoutBestFitDecreasingPacking)
+{
+    vector<MBLayout::SequenceInfo> sequences;
+    for (size_t length : { 1, 1, 5, 5, 6 })
+    {
+        MBLayout::SequenceInfo info;
+        info.seqId = sequences.size();
+        info.s = 0;
+        info.tBegin = 0;
+        info.tEnd = length;
+        sequences.push_back(info);
+    }
+
+    vector<pair<size_t, size_t>> placement;
+    vector<size_t> rowAllocations;
+
+    // First-fit in input order puts both short sequences into the first row, so each 5 needs a row of its own.
+    auto firstFit = make_shared<MBLayout>();
+    firstFit->InitAsPackedSequences(sequences, placement, rowAllocations);
+    BOOST_CHECK_EQUAL(firstFit->GetNumParallelSequences(), 4u);
+    BOOST_CHECK_EQUAL(firstFit->GetNumGapFrames(), 6u);
+    BOOST_CHECK_CLOSE(firstFit->GetPaddingEfficiency(), 0.75, 1e-6);
+
+    // Best-fit-decreasing fills up the rows of the two 5s with the short sequences.
+    auto bestFit = make_shared<MBLayout>();
+    bestFit->InitAsPackedSequences(sequences, placement, rowAllocations, true);
+    BOOST_CHECK_EQUAL(bestFit->GetNumParallelSequences(), 3u);
+    BOOST_CHECK_EQUAL(bestFit->GetNumGapFrames(), 0u);
+    BOOST_CHECK_CLOSE(bestFit->GetPaddingEfficiency(), 1.0, 1e-6);
+
+    // Sequences keep their order in the layout.
+    const auto& layoutSequences = bestFit->GetAllSequences();
+    for (size_t i = 0; i < sequences.size(); ++i)
+    {
+        BOOST_CHECK_EQUAL(layoutSequences[i].seqId, i);
+        BOOST_CHECK_EQUAL(layoutSequences[i].GetNumTimeSteps(), sequences[i].GetNumTimeSteps());
+    }
+}
+
+
 BOOST_AUTO_TEST_SUITE_END()
 
 } } } }
@@ -288,6 +288,148 @@ void TestThatEndOfSweepFlagIsSetCorrectly()
     }
 }
 
+// Writes 'numSamples' sequences of one sample each: 3 dense features, the last one constant, and a sparse one-hot label of dimension 4.
+// Returns the samples, each as the features followed by the dense label.
+std::vector<std::vector<float>> WriteStatisticsData(const std::wstring& path, size_t numSamples, unsigned int seed)
+{
+    std::mt19937 generator(seed);
+    std::vector<std::vector<float>> samples;
+    FILE* f = _wfopen(path.c_str(), L"w");
+    for (size_t i = 0; i < numSamples; ++i)
+    {
+        std::vector<float> sample = { ((int)(generator() % 2001) - 1000) / 64.0f, 1000 + (generator() % 100) / 8.0f, 0.5f, 0, 0, 0, 0 };
+        size_t label = generator() % 4;
+        sample[3 + label] = 1;
+        fprintf(f, "%d |features %.9g %.9g %.9g |labels %d:1\n", (int)i, sample[0], sample[1], sample[2], (int)label);
+        samples.push_back(sample);
+    }
+    fclose(f);
+    return samples;
+}
+
+// Mean and inverse standard deviation as computed by the Mean() and InvStdDev() nodes that were used before:
+// the population variance, floored at 1e-10.
+void ReferenceStatistics(const std::vector<std::vector<float>>& samples, size_t offset, size_t dim, std::vector<float>& mean, std::vector<float>& invStdDev)
+{
+    mean.assign(dim, 0);
+    invStdDev.assign(dim, 0);
+    for (size_t j = 0; j < dim; ++j)
+    {
+        double sum = 0;
+        for (const auto& sample : samples)
+            sum += sample[offset + j];
+        double m = sum / samples.size();
+        double squares = 0;
+        for (const auto& sample : samples)
+            squares += (sample[offset + j] - m) * (sample[offset + j] - m);
+        mean[j] = (float)m;
+        invStdDev[j] = (float)(1 / sqrt(std::max(squares / samples.size(), (double)1e-10f)));
+    }
+}
+
+typedef std::map<std::wstring, std::pair<std::vector<float>, std::vector<float>>> InputStatistics;
+
+// Computes the statistics of both streams of the data file. 'dataRead' tells whether the data was read,
+// i.e. whether the minibatch source is at the end of its sweep afterwards.
+InputStatistics ComputeStatistics(const std::wstring& dataPath, const std::wstring& cacheFile, bool& dataRead)
+{
+    std::vector<StreamConfiguration> streamConfig{ { L"features", 3 }, { L"labels", 4, /*isSparse=*/true } };
+    auto minibatchSource = TextFormatMinibatchSource(dataPath, streamConfig, MinibatchSource::FullDataSweep, /*randomize=*/false);
+
+    std::unordered_map<StreamInformation, std::pair<NDArrayViewPtr, NDArrayViewPtr>> computed;
+    for (const auto& config : streamConfig)
+        computed[minibatchSource->StreamInfo(config.m_streamName)] = { nullptr, nullptr };
+    ComputeInputPerDimMeansAndInvStdDevs(minibatchSource, computed, DeviceDescriptor::CPUDevice(), cacheFile);
+
+    InputStatistics result;
+    for (const auto& kv : computed)
+    {
+        auto toVector = [](const NDArrayViewPtr& view)
+        {
+            return std::vector<float>(view->DataBuffer<float>(), view->DataBuffer<float>() + view->Shape().TotalSize());
+        };
+        result[kv.first.m_name] = { toVector(kv.second.first), toVector(kv.second.second) };
+    }
+
+    dataRead = minibatchSource->GetNextMinibatch(1, DeviceDescriptor::CPUDevice()).empty();
+    return result;
+}
+
+void CheckStatistics(const InputStatistics& actual, const std::vector<std::vector<float>>& samples, const char* message)
+{
+    std::vector<float> mean, invStdDev;
+    ReferenceStatistics(samples, 0, 3, mean, invStdDev);
+    FloatingPointVectorCompare(actual.at(L"features").first, mean, message);
+    FloatingPointVectorCompare(actual.at(L"features").second, invStdDev, message);
+    ReferenceStatistics(samples, 3, 4, mean, invStdDev);
+    FloatingPointVectorCompare(actual.at(L"labels").first, mean, message);
+    FloatingPointVectorCompare(actual.at(L"labels").second, invStdDev, message);
+}
+
+void TestInputStatisticsMatchReference()
+{
+    // Several blocks of samples, so that the result is merged from partial accumulators.
+    const std::wstring dataPath = L"InputStatistics_cntk_text.tmp";
+    auto samples = WriteStatisticsData(dataPath, 5000, 1);
+
+    bool dataRead;
+    const size_t maxNumThreads = GetMaxNumCPUThreads();
+    SetMaxNumCPUThreads(1);
+    auto single = ComputeStatistics(dataPath, L"", dataRead);
+    SetMaxNumCPUThreads(4);
+    auto multiple = ComputeStatistics(dataPath, L"", dataRead);
+    SetMaxNumCPUThreads(maxNumThreads);
+
+    CheckStatistics(single, samples, "TestInputStatisticsMatchReference: statistics differ from the reference");
+    if (single != multiple)
+        ReportFailure("TestInputStatisticsMatchReference: statistics depend on the number of threads");
+
+    _wunlink(dataPath.c_str());
+}
+
+void TestInputStatisticsCache()
+{
+    const std::wstring dataPath = L"InputStatisticsCache_cntk_text.tmp";
+    const std::wstring cacheFile = L"InputStatisticsCache.statistics.tmp";
+    _wunlink(cacheFile.c_str());
+    auto samples = WriteStatisticsData(dataPath, 3000, 2);
+
+    // The first call computes the statistics and saves them, the second one only loads them.
+    bool dataRead;
+    auto computed = ComputeStatistics(dataPath, cacheFile, dataRead);
+    if (!dataRead)
+        ReportFailure("TestInputStatisticsCache: the data was not read on the first call");
+    auto cached = ComputeStatistics(dataPath, cacheFile, dataRead);
+    if (dataRead)
+        ReportFailure("TestInputStatisticsCache: the data was read although the statistics are cached");
+    if (cached != computed)
+        ReportFailure("TestInputStatisticsCache: cached statistics differ from the computed ones");
+    CheckStatistics(cached, samples, "TestInputStatisticsCache: cached statistics differ from the reference");
+
+    // Changing the data invalidates the cache.
+    samples = WriteStatisticsData(dataPath, 2000, 3);
+    auto changed = ComputeStatistics(dataPath, cacheFile, dataRead);
+    if (!dataRead)
+        ReportFailure("TestInputStatisticsCache: the data was not read after it changed");
+    CheckStatistics(changed, samples, "TestInputStatisticsCache: statistics of the changed data differ from the reference");
+
+    // A sidecar that is not a statistics file is ignored and replaced.
+    FILE* f = _wfopen(cacheFile.c_str(), L"wb");
+    fprintf(f, "this is not a statistics file\n");
+    fclose(f);
+    auto recomputed = ComputeStatistics(dataPath, cacheFile, dataRead);
+    if (!dataRead)
+        ReportFailure("TestInputStatisticsCache: a mismatched cache file was used");
+    if (recomputed != changed)
+        ReportFailure("TestInputStatisticsCache: statistics differ after a mismatched cache file");
+    ComputeStatistics(dataPath, cacheFile, dataRead);
+    if (dataRead)
+        ReportFailure("TestInputStatisticsCache: the mismatched cache file was not replaced");
+
+    _wunlink(cacheFile.c_str());
+    _wunlink(dataPath.c_str());
+}
+
 BOOST_AUTO_TEST_SUITE(MinibatchSourceSuite)
 
 BOOST_AUTO_TEST_CASE(EndOfSweepFlagIsSetCorrectly)
@@ -324,6 +466,16 @@ BOOST_AUTO_TEST_CASE(RandomizedMinibatchSourceWithNoData)
     TestMinibatchSourceWarmStart(64, 128, true, chunk32MB, expectNoData);
 }
 
+BOOST_AUTO_TEST_CASE(InputStatisticsMatchReference)
+{
+    TestInputStatisticsMatchReference();
+}
+
+BOOST_AUTO_TEST_CASE(InputStatisticsCache)
+{
+    TestInputStatisticsCache();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 }}
@@ -206,6 +206,7 @@
 
 %ignore_function CNTK::CreateDataParallelDistributedLearner;
 %ignore_function CNTK::CreateQuantizedDataParallelDistributedLearner;
+%ignore_function CNTK::CreateCompressedDataParallelDistributedLearner;
 %ignore_function CNTK::CreateBlockMomentumDistributedLearner;
 
 %ignore_class CNTK::Trainer;
@@ -225,6 +226,7 @@
 %ignore_class CNTK::DistributedCommunicator;
 %ignore_class CNTK::QuantizedDistributedCommunicator;
 %ignore_function CNTK::MPICommunicator;
+%ignore_function CNTK::HierarchicalMPICommunicator;
 %ignore_function CNTK::QuantizedMPICommunicator;
 
 %ignore_class CNTK::TrainingSession;
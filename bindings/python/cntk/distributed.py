@@ -113,7 +113,7 @@ class DistributedLearner(cntk_py.DistributedLearner):
         return super(DistributedLearner, self).get_communicator()
 
 @typemap
-def data_parallel_distributed_learner(learner, distributed_after=0, num_quantization_bits=32, use_async_buffered_parameter_update=False):
+def data_parallel_distributed_learner(learner, distributed_after=0, num_quantization_bits=32, use_async_buffered_parameter_update=False, use_hierarchical_aggregation=False, ranks_per_host=0):
     '''
     Creates a data parallel distributed learner
 
@@ -122,6 +122,10 @@ def data_parallel_distributed_learner(learner, distributed_after=0, num_quantiza
         distributed_after (int): number of samples after which distributed training starts
         num_quantization_bits (int): number of bits for quantization (1 to 32)
         use_async_buffered_parameter_update (bool): use async buffered parameter update
+        use_hierarchical_aggregation (bool): aggregate through shared memory among the
+         workers of a host first, then across hosts (only without quantization)
+        ranks_per_host (int): if greater than 0, group that many consecutive workers
+         into a pseudo-host instead of grouping them by physical host (for testing)
     Returns:
         a distributed learner instance
     '''
@@ -132,12 +136,43 @@ def data_parallel_distributed_learner(learner, distributed_after=0, num_quantiza
             distributed_after,
             use_async_buffered_parameter_update)
     else:
+        if use_hierarchical_aggregation:
+            communicator = cntk_py.hierarchical_mpicommunicator(ranks_per_host)
+        else:
+            communicator = cntk_py.mpicommunicator()
         return cntk_py.create_data_parallel_distributed_learner(
-            cntk_py.mpicommunicator(),
+            communicator,
             learner,
             distributed_after,
             use_async_buffered_parameter_update)
 
+@typemap
+def compressed_data_parallel_distributed_learner(learner, gradient_compression='1bit', num_quantization_bits=1, top_k_fraction=0.01, distributed_after=0):
+    '''
+    Creates a data parallel distributed learner that exchanges compressed gradients.
+    The part of a worker's gradients that is not transmitted is kept as a residual
+    and added to its next gradients (error feedback).
+
+    Args:
+        learner: a local learner (i.e. sgd)
+        gradient_compression (str): '1bit' (column-wise quantization to
+         ``num_quantization_bits`` bits), 'topK' (only the ``top_k_fraction``
+         values of largest magnitude are sent) or '8bit' (8-bit quantization
+         with stochastic rounding)
+        num_quantization_bits (int): number of bits for '1bit' compression
+        top_k_fraction (float): fraction of the values sent by 'topK' compression
+        distributed_after (int): number of samples after which distributed training starts
+    Returns:
+        a distributed learner instance
+    '''
+    return cntk_py.create_compressed_data_parallel_distributed_learner(
+        cntk_py.mpicommunicator(),
+        learner,
+        distributed_after,
+        gradient_compression,
+        num_quantization_bits,
+        top_k_fraction)
+
 @typemap
 def block_momentum_distributed_learner(learner, block_size, block_momentum_as_time_constant=None, use_nestrov_momentum=True, reset_sgd_momentum_after_aggregation=True, block_learning_rate=1.0, distributed_after=0):
     '''
@@ -186,6 +186,27 @@ def test_session_cross_validation_3_times(tmpdir, device_id):
 
     assert(t['trainer'].total_number_of_samples_seen == 61)
 
+def test_session_background_cross_validation_3_times(tmpdir, device_id):
+    device=cntk_device(device_id)
+    t = trainer(device)
+    mbs = mb_source(tmpdir, "training", epoch_size=INFINITELY_REPEAT)
+    mbs1 = mb_source(tmpdir, "cv")
+
+    input_map = {
+        t['input'] : mbs.streams.features,
+        t['label'] : mbs.streams.labels
+    }
+
+    printer = MockProgressPrinter(t['trainer'], expected_cv=[[92, 25], [92, 25], [92, 25]])
+    session = training_session(mbs, t['trainer'], minibatch_size_schedule(4), 
+        model_inputs_to_mb_source_mapping=input_map, 
+        max_training_samples=60, cv_source=mbs1, cv_frequency=20,
+        cv_mb_size_schedule=minibatch_size_schedule(2), progress_printer=printer,
+        cv_threads=2)
+    session.train(device)
+
+    assert(t['trainer'].total_number_of_samples_seen == 61)
+
 
 def test_session_cross_validation_3_times_checkpoints_2_save_all(tmpdir, device_id):
     from os import listdir
@@ -43,12 +43,15 @@ class TrainingSession(cntk_py.TrainingSession):
           If ``sys.maxsize``, a single cross validation is performed at the end of training.
         cv_mb_size_schedule (:class:`~cntk.cntk_py.minibatch_size_schedule`): minibatch schedule for cross validation
         max_training_samples (int): maximum number of samples used for training
+        cv_threads (int): if not 0, cross validation runs in the background on a snapshot of the parameters
+          using the given number of CPU threads while training continues (CPU training only)
     '''
 
     def __init__(self, training_minibatch_source, trainer, mb_size_schedule,
                  progress_printer, model_inputs_to_mb_source_mapping,
                  checkpoint_frequency, checkpoint_filename, save_all_checkpoints,
-                 restore, progress_frequency, cv_source, cv_frequency, cv_mb_size_schedule, max_training_samples):
+                 restore, progress_frequency, cv_source, cv_frequency, cv_mb_size_schedule, max_training_samples,
+                 cv_threads=0):
 
         self.progress_printer = progress_printer
         self.trainer = trainer
@@ -100,7 +103,8 @@ class TrainingSession(cntk_py.TrainingSession):
             restore,
             save_all_checkpoints,
             max_training_samples,
-            progress_frequency)
+            progress_frequency,
+            cv_threads)
 
     @typemap
     def train(self, device=None):
@@ -208,7 +212,8 @@ def training_session(training_minibatch_source,
                      cv_source=None,
                      cv_mb_size_schedule=None,
                      cv_frequency=None,
-                     max_training_samples=None):
+                     max_training_samples=None,
+                     cv_threads=0):
     '''
     A factory function to create a training session object.
 
@@ -229,6 +234,8 @@ def training_session(training_minibatch_source,
         cv_mb_size_schedule (:class:`~cntk.cntk_py.minibatch_size_schedule`): minibatch schedule for cross validation
           If ``sys.maxsize``, a single cross validation is performed at the end of training.
         max_training_samples (int): maximum number of samples used for training
+        cv_threads (int): if not 0, cross validation runs in the background on a snapshot of the parameters
+          using the given number of CPU threads while training continues (CPU training only)
 
     Returns:
         Instance of :class:`~TrainingSession`
@@ -244,4 +251,5 @@ def training_session(training_minibatch_source,
                            cv_source=cv_source,
                            cv_frequency=cv_frequency,
                            cv_mb_size_schedule=cv_mb_size_schedule,
-                           max_training_samples=max_training_samples)
+                           max_training_samples=max_training_samples,
+                           cv_threads=cv_threads)